@@ -23,6 +23,8 @@
  */
 
 #include "AnimationInfo.h"
+#include "image_alpha.h"
+#include "image_blend.h"
 #include <math.h>
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -30,9 +32,7 @@
 #if defined(USE_OMP_PARALLEL) || defined(USE_PARALLEL)
 #include "Parallel.h"
 #endif
-#ifdef USE_SIMD
-#include "simd/simd.h"
-#endif
+#include "blend_kernels.h"
 #include "builtin_layer.h"
 
 
@@ -42,6 +42,9 @@
 #define AMASK 0xff000000
 #define RBMASK (RMASK|BMASK)
 
+unsigned int AnimationInfo::surface_generation = 1;
+bool AnimationInfo::shared_blending = false;
+
 static bool is_inv_alpha_lut_initialized = false;
 static Uint32 inv_alpha_lut[256];
 
@@ -51,7 +54,10 @@ AnimationInfo::AnimationInfo()
     surface_name = NULL;
     mask_surface_name = NULL;
     image_surface = NULL;
+    image_version = 0;
+    alpha_version = image_version - 1;
     alpha_buf = NULL;
+    premultiplied = false;
     mutex = SDL_CreateMutex();
 
     duration_list = NULL;
@@ -120,6 +126,7 @@ AnimationInfo& AnimationInfo::operator =(const AnimationInfo &anim)
         }
         
         if (image_surface){
+            surface_generation++;
             image_surface = allocSurface( anim.image_surface->w, anim.image_surface->h, texture_format );
             memcpy(image_surface->pixels, anim.image_surface->pixels, anim.image_surface->pitch*anim.image_surface->h);
         }
@@ -174,13 +181,41 @@ void AnimationInfo::deleteSurface(bool delete_surface_name)
         mask_surface_name = NULL;
     }
     SDL_mutexP(mutex);
-    if ( image_surface ) SDL_FreeSurface( image_surface );
+    if ( image_surface ){
+        SDL_FreeSurface( image_surface );
+        surface_generation++;
+        image_version++;
+    }
     image_surface = NULL;
     SDL_mutexV(mutex);
     if (alpha_buf) delete[] alpha_buf;
     alpha_buf = NULL;
 }
 
+void AnimationInfo::detachSurface(bool copy_pixels)
+{
+    image_version++; // called ahead of every write to the pixels
+    if ( image_surface == NULL || image_surface->refcount == 1 ) return;
+
+    SDL_Surface *surface = SDL_CreateRGBSurface( SDL_SWSURFACE, image_surface->w, image_surface->h,
+                                                 image_surface->format->BitsPerPixel,
+                                                 image_surface->format->Rmask, image_surface->format->Gmask,
+                                                 image_surface->format->Bmask, image_surface->format->Amask );
+    SDL_BlendMode blend_mode;
+    SDL_GetSurfaceBlendMode( image_surface, &blend_mode );
+    SDL_SetSurfaceBlendMode( surface, blend_mode );
+    if (copy_pixels){
+        SDL_LockSurface( image_surface );
+        memcpy( surface->pixels, image_surface->pixels, image_surface->pitch*image_surface->h );
+        SDL_UnlockSurface( image_surface );
+    }
+
+    SDL_mutexP(mutex);
+    SDL_FreeSurface( image_surface ); // drops the shared reference only
+    image_surface = surface;
+    SDL_mutexV(mutex);
+}
+
 void AnimationInfo::remove()
 {
     deleteImageName();
@@ -288,6 +323,35 @@ void AnimationInfo::setCell(int cell)
     current_cell = cell;
 }
 
+int AnimationInfo::getBlendRect( int dst_x, int dst_y, SDL_Rect &clip, SDL_Rect &dst_rect, SDL_Rect &src_rect )
+{
+    dst_rect.x = dst_x;
+    dst_rect.y = dst_y;
+    dst_rect.w = pos.w;
+    dst_rect.h = pos.h;
+
+    // the add and sub blending of straight alpha write dst under
+    // transparent pixels too
+    bool margins = alpha_version == image_version &&
+        (premultiplied || blending_mode == BLEND_NORMAL);
+    if ( margins ){
+        if ( alpha_bounds.transparent ) return -1;
+        dst_rect.x += alpha_bounds.x;
+        dst_rect.y += alpha_bounds.y;
+        dst_rect.w = alpha_bounds.w;
+        dst_rect.h = alpha_bounds.h;
+        if ( dst_rect.w > pos.w - alpha_bounds.x ) dst_rect.w = pos.w - alpha_bounds.x;
+        if ( dst_rect.h > pos.h - alpha_bounds.y ) dst_rect.h = pos.h - alpha_bounds.y;
+    }
+    if ( doClipping( &dst_rect, &clip, &src_rect ) ) return -1;
+    if ( margins ){
+        src_rect.x += alpha_bounds.x;
+        src_rect.y += alpha_bounds.y;
+    }
+
+    return 0;
+}
+
 int AnimationInfo::doClipping( SDL_Rect *dst, SDL_Rect *clip, SDL_Rect *clipped )
 {
     if ( clipped ) clipped->x = clipped->y = 0;
@@ -322,99 +386,6 @@ int AnimationInfo::doClipping( SDL_Rect *dst, SDL_Rect *clip, SDL_Rect *clipped
     return 0;
 }
 
-#ifdef USE_SIMD
-static void blendPixel32(const Uint32 *src_buffer, Uint32 *__restrict dst_buffer, Uint8 alpha, Uint8 *alphap) {
-    using namespace simd;
-    uint8x4 src = load(src_buffer), dst = load(dst_buffer);
-    ivec128 zero = ivec128::zero();
-    uint16x4 r1 = widen(src, zero);
-    uint16x4 dstu = widen(dst, zero);
-    r1 -= dstu;
-    uint16x4 a((alpha * *alphap) >> 8);
-    r1 = (r1 * a) >> immint<8>();
-    uint8x4 r = narrow_hz(r1);
-    r += dst;
-    *dst_buffer = uint8x4::cvt2i32(r) | AMASK;
-}
-
-static void blend4Pixel32(const Uint32 *src_buffer, Uint32 *__restrict dst_buffer, simd::uint16x8 alpha, simd::uint8x16 alpha_mask, simd::ivec128 zero, simd::uint8x16 amask) {
-    using namespace simd;
-    uint8x16 src = load_u(src_buffer), dst = load_u(dst_buffer);
-    uint16x8 dstu = widen_lo(dst, zero);
-    uint16x8 r1 = widen_lo(src, zero);
-    r1 -= dstu;
-    dstu = widen_hi(dst, zero);
-    uint16x8 r2 = widen_hi(src, zero);
-    r2 -= dstu;
-#ifdef USE_SIMD_X86_SSSE3
-    uint8x16 an = shuffle(src, alpha_mask);
-    uint16x8 a = widen_lo(an, zero);
-#else
-	Uint8 *alphap = (Uint8*)src_buffer + 3;
-    uint16x8 a = uint16x8::set2(*alphap, *(alphap + 4));
-    alphap += 8;
-#endif
-    a = (a * alpha) >> immint<8>();
-    r1 = (r1 * a) >> immint<8>();
-#ifdef USE_SIMD_X86_SSSE3
-    a = widen_hi(an, zero);
-#else
-    a = uint16x8::set2(*alphap, *(alphap + 4));
-#endif
-    a = (a * alpha) >> immint<8>();
-    r2 = (r2 * a) >> immint<8>();
-    uint8x16 r = pack_hz(r1, r2);
-    r += dst;
-    r |= amask;
-    store_u(dst_buffer, r);
-}
-
-#ifdef USE_SIMD_X86_AVX2
-static void blend8Pixel32(const Uint32 *src_buffer, Uint32 *__restrict dst_buffer, simd::uint16x16 alpha, simd::uint8x32 alpha_mask, simd::ivec256 zero, simd::uint8x32 amask) {
-    using namespace simd;
-    uint8x32 src = load256_u(src_buffer), dst = load256_u(dst_buffer);
-    uint16x16 dstu = widen_lo(dst, zero);
-    uint16x16 r1 = widen_lo(src, zero);
-    r1 -= dstu;
-    dstu = widen_hi(dst, zero);
-    uint16x16 r2 = widen_hi(src, zero);
-    r2 -= dstu;
-	uint8x32 an = shuffle(src, alpha_mask);
-    uint16x16 a = widen_lo(an, zero);
-    a = (a * alpha) >> immint<8>();
-    r1 = (r1 * a) >> immint<8>();
-    a = widen_hi(an, zero);
-    a = (a * alpha) >> immint<8>();
-    r2 = (r2 * a) >> immint<8>();
-    uint8x32 r = pack_hz(r1, r2);
-    r += dst;
-    r |= amask;
-    store256_u(dst_buffer, r);
-}
-#endif
-
-#define BLEND_PIXEL() do{\
-  blendPixel32(src_buffer, dst_buffer, alpha, alphap);\
-  alphap += 4;\
-}while(0)
-#else
-#define BLEND_PIXEL() do{\
-    Uint32 mask2 = (*alphap * alpha) >> 8;\
-    Uint32 temp = *dst_buffer & 0xff00ff;\
-    Uint32 mask_rb = (((((*src_buffer & 0xff00ff) - temp ) * mask2 ) >> 8 ) + temp ) & 0xff00ff;\
-    temp = *dst_buffer & 0x00ff00;\
-    Uint32 mask_g  = (((((*src_buffer & 0x00ff00) - temp ) * mask2 ) >> 8 ) + temp ) & 0x00ff00;\
-    *dst_buffer = mask_rb | mask_g | 0xff000000;\
-    alphap += 4;\
-}while(0)
-#endif
-// Originally, the above looks like this.
-//      mask1 = mask2 ^ 0xff;
-//      Uint32 mask_rb = (((*dst_buffer & 0xff00ff) * mask1 +
-//                         (*src_buffer & 0xff00ff) * mask2) >> 8) & 0xff00ff;
-//      Uint32 mask_g  = (((*dst_buffer & 0x00ff00) * mask1 +
-//                         (*src_buffer & 0x00ff00) * mask2) >> 8) & 0x00ff00;
-
 #define ADDBLEND_PIXEL() do{\
     Uint32 mask2 = (*alphap * alpha) >> 8;\
     Uint32 mask_rb = (*dst_buffer & RBMASK) + ((((*src_buffer & RBMASK) * mask2) >> 8) & RBMASK);\
@@ -425,43 +396,6 @@ static void blend8Pixel32(const Uint32 *src_buffer, Uint32 *__restrict dst_buffe
     alphap += 4;\
 }while(0)
 
-inline void rainAddBlendPixel32(const Uint32 *src_buffer, Uint32 *__restrict dst_buffer) {
-#ifdef USE_SIMD
-    using namespace simd;
-    uint8x4 src = uint8x4::cvt2vec(*src_buffer);
-    uint8x4 dst = uint8x4::cvt2vec(*dst_buffer);
-    dst = adds(dst, src);
-    *dst_buffer = uint8x4::cvt2i32(dst);
-#else
-    const Uint8 *src = (const Uint8*)src_buffer;
-    Uint8 *dst = (Uint8*)dst_buffer;
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-    ++dst; ++src;
-#endif
-    for (int i = 0; i < 3; ++i, ++src, ++dst) {
-        int result = (*dst) + (*src);
-        (*dst) = (result < 255) ? result : 255;
-    }
-#endif
-}
-
-#ifdef USE_SIMD
-inline void rainAddBlend32(const Uint32 *src_buffer, Uint32 *__restrict dst_buffer, int remain) {
-    using namespace simd;
-    while (remain >= 4) {
-        uint8x16 srcvec = load_u(src_buffer),
-            dstvec = load_u(dst_buffer);
-        uint8x16 r = adds(srcvec, dstvec);
-        store_u(dst_buffer, r);
-        remain -= 4; src_buffer += 4; dst_buffer += 4;
-    }
-    while (remain > 0) {
-        rainAddBlendPixel32(src_buffer, dst_buffer);
-        --remain; ++src_buffer; ++dst_buffer;
-    }
-}
-#endif // USE_SIMD
-
 #define SUBBLEND_PIXEL(){\
     Uint32 mask2 = (*alphap * alpha) >> 8;\
     Uint32 mask_r = (*dst_buffer & RMASK) -\
@@ -483,18 +417,16 @@ void AnimationInfo::blendOnSurface( SDL_Surface *dst_surface, int dst_x, int dst
     if ( image_surface == NULL ) return;
     
     SDL_Rect dst_rect, src_rect;
-    dst_rect.x = dst_x;
-    dst_rect.y = dst_y;
-    dst_rect.w = pos.w;
-    dst_rect.h = pos.h;
-    if ( doClipping( &dst_rect, &clip, &src_rect ) ) return;
+    if ( getBlendRect( dst_x, dst_y, clip, dst_rect, src_rect ) ) return;
     if (alpha == 0) return;
 
     /* ---------------------------------------- */
     
-    SDL_mutexP(mutex);
+    if (!shared_blending){
+        SDL_mutexP(mutex);
+        SDL_LockSurface( image_surface );
+    }
     SDL_LockSurface( dst_surface );
-    SDL_LockSurface( image_surface );
     
     alpha &= 0xff;
     int pitch = image_surface->pitch / sizeof(ONSBuf);
@@ -502,95 +434,35 @@ void AnimationInfo::blendOnSurface( SDL_Surface *dst_surface, int dst_x, int dst
     struct Blender {
         ONSBuf *const stsrc_buffer, *const stdst_buffer;
         const int alpha, dst_rect_w, dst_rect_h, pitch, dst_surface_w, blendmode;
+        const bool premultiplied;
 
         void operator()(const int i) const {
             const ONSBuf *src_buffer = stsrc_buffer + (pitch)* i;
             ONSBuf *dst_buffer = stdst_buffer + (dst_surface_w)* i;
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-    unsigned char *alphap = (unsigned char *)src_buffer + 3;
-#else
-    unsigned char *alphap = (unsigned char *)src_buffer;
-#endif //SDL_BYTEORDER == SDL_LIL_ENDIAN
 #ifdef USE_BUILTIN_LAYER_EFFECTS
-            if (blendmode == AnimationInfo::BLEND_ADD) {
-#ifdef USE_SIMD
-                rainAddBlend32(src_buffer, dst_buffer, dst_rect_w);
-#else
-                for (int j = dst_rect_w; j != 0; j--, src_buffer++, dst_buffer++) {
-                    if (*src_buffer != AMASK) rainAddBlendPixel32(src_buffer, dst_buffer);
-                }
-#endif //USE_SIMD
-            }
+            if (blendmode == AnimationInfo::BLEND_ADD)
+                blend_kernels->addBlend(dst_buffer, src_buffer, dst_rect_w);
             else
 #endif
-#ifdef USE_SIMD
-            {
-                using namespace simd;
-#ifdef USE_SIMD_X86_AVX2
-                ivec256 zero = ivec256::zero();
-                uint8x32 mask = uint8x32::set8(3, 7, 11, 15, 19, 23, 27, 31);
-                uint8x32 amask =
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-                    uint8x32::set(0, 0, 0, 0xFF);
-#else
-                    uint8x32::set(0xFF, 0, 0, 0);
-#endif
-                ivec128 zerol = zero.lo();
-                uint8x16 maskl = mask.lo();
-                uint8x16 amaskl = amask.lo();
-#else
-                ivec128 zerol = ivec128::zero();
-                uint8x16 maskl = uint8x16::set4(3, 7, 11, 15);
-                uint8x16 amaskl =
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-                    uint8x16::set(0, 0, 0, 0xFF);
-#else
-                    uint8x16::set(0xFF, 0, 0, 0);
-#endif
-#endif
-                int remain = dst_rect_w;
-                while (remain > 0) {
-                    if (*alphap == 0) {
-                        --remain; ++src_buffer; ++dst_buffer; alphap += 4;
-                    }
-                    else if ((*alphap == 255) && (alpha == 255)) {
-                        *dst_buffer = *src_buffer;
-                        --remain; ++src_buffer; ++dst_buffer; alphap += 4;
-                    }
-#ifdef USE_SIMD_X86_AVX2
-                    else if (remain >= 8) {
-                        blend8Pixel32(src_buffer, dst_buffer, uint16x16(alpha), mask, zero, amask);
-                        remain -= 8; src_buffer += 8; dst_buffer += 8; alphap += 32;
-                    }
-#endif
-                    else if (remain >= 4) {
-                        blend4Pixel32(src_buffer, dst_buffer, uint16x8(alpha), maskl, zerol, amaskl);
-                        remain -= 4; src_buffer += 4; dst_buffer += 4; alphap += 16;
-                    }
-                    else {
-                        BLEND_PIXEL();
-                        --remain; ++src_buffer; ++dst_buffer;
-                    }
-                }
-            }
-#else
-                for (int j = dst_rect_w; j != 0; j--, src_buffer++, dst_buffer++) {
-                    BLEND_PIXEL();
-                }
-#endif
+            if (premultiplied)
+                blendPremultiplied(dst_buffer, src_buffer, dst_rect_w, alpha);
+            else
+                blend_kernels->blend(dst_buffer, src_buffer, dst_rect_w, alpha);
         }
     } blender = {(ONSBuf *)image_surface->pixels + pitch * src_rect.y + image_surface->w * current_cell / num_of_cells + src_rect.x,
         (ONSBuf *)dst_surface->pixels + dst_surface->w * dst_rect.y + dst_rect.x,
-        alpha, dst_rect.w, dst_rect.h, pitch, dst_surface->w, blending_mode};
+        alpha, dst_rect.w, dst_rect.h, pitch, dst_surface->w, blending_mode, premultiplied};
 #if defined(USE_PARALLEL) || defined(USE_OMP_PARALLEL)
     parallel::For(0, dst_rect.h, 1, blender, dst_rect.h * dst_rect.w);
 #else
     for (int i = 0; i < dst_rect.h; i++) blender(i);
 #endif
 
-    SDL_UnlockSurface( image_surface );
     SDL_UnlockSurface( dst_surface );
-    SDL_mutexV(mutex);
+    if (!shared_blending){
+        SDL_UnlockSurface( image_surface );
+        SDL_mutexV(mutex);
+    }
 }
 
 void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int dst_y,
@@ -617,9 +489,11 @@ void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int ds
     if (min_xy[1] <  0)               min_xy[1] = 0;
     if (max_xy[1] >= dst_surface->h)  max_xy[1] = dst_surface->h - 1;
 
-    SDL_mutexP(mutex);
+    if (!shared_blending){
+        SDL_mutexP(mutex);
+        SDL_LockSurface( image_surface );
+    }
     SDL_LockSurface( dst_surface );
-    SDL_LockSurface( image_surface );
     
     alpha &= 0xff;
     int pitch = image_surface->pitch / sizeof(ONSBuf);
@@ -635,12 +509,22 @@ void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int ds
     if (src_rect[0][1] < 0) src_rect[0][1] = 0;
     if (src_rect[1][0] >= pos.w) src_rect[1][0] = pos.w - 1;
     if (src_rect[1][1] >= pos.h) src_rect[1][1] = pos.h - 1;
+    if (alpha_version == image_version && (premultiplied || blending_mode == BLEND_NORMAL)){
+        // nothing is taken from the transparent margins; the straight add
+        // and sub blending write dst there too
+        const AlphaBounds &b = alpha_bounds;
+        if (src_rect[0][0] < b.x)       src_rect[0][0] = b.x;
+        if (src_rect[0][1] < b.y)       src_rect[0][1] = b.y;
+        if (src_rect[1][0] > b.x + b.w) src_rect[1][0] = b.x + b.w;
+        if (src_rect[1][1] > b.y + b.h) src_rect[1][1] = b.y + b.h;
+    }
     // set pixel by inverse-projection with raster scan
     struct Blender {
         const int(*corner_xy)[2], *min_xy, *max_xy;
         const int(*inv_mat)[2];
         ONSBuf *const pixels;
         const int cellw, blending_mode;
+        const bool premultiplied;
         SDL_Surface *dst_surface;
         const int alpha, pitch, dst_x, dst_y, cx2, cy2;
         const int(*src_rect)[2];
@@ -648,61 +532,18 @@ void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int ds
         void blendLine(Uint32* line_buffer, int size, ONSBuf** dst_buffer_p) const {
             ONSBuf*& src_buffer = line_buffer;
             ONSBuf* dst_buffer = *dst_buffer_p;
-            if (blending_mode == BLEND_NORMAL) {
-#ifdef USE_SIMD
-                if (size >= 4) {
-                    using namespace simd;
-#ifdef USE_SIMD_X86_AVX2
-                    ivec256 zero = ivec256::zero();
-                    uint8x32 mask = uint8x32::set8(3, 7, 11, 15, 19, 23, 27, 31);
-                    uint8x32 amask =
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-                        uint8x32::set(0, 0, 0, 0xFF);
-#else
-                        uint8x32::set(0xFF, 0, 0, 0);
-#endif
-                    ivec128 zerol = zero.lo();
-                    uint8x16 maskl = mask.lo();
-                    uint8x16 amaskl = amask.lo();
-                    while (size >= 8) {
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-                        unsigned char *alphap = (unsigned char *)line_buffer + 3;
-#else
-                        unsigned char *alphap = (unsigned char *)line_buffer;
-#endif
-                        blend8Pixel32(line_buffer, dst_buffer, uint16x16(alpha), mask, zero, amask);
-                        dst_buffer += 8; line_buffer += 8; size -= 8;
-                    }
-#else
-                    ivec128 zerol = ivec128::zero();
-                    uint8x16 maskl = uint8x16::set4(3, 7, 11, 15);
-                    uint8x16 amaskl =
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-                        uint8x16::set(0, 0, 0, 0xFF);
-#else
-                        uint8x16::set(0xFF, 0, 0, 0);
-#endif
-#endif
-                    while (size >= 4) {
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-                        unsigned char* alphap = (unsigned char *)line_buffer + 3;
-#else
-                        unsigned char *alphap = (unsigned char *)line_buffer;
-#endif
-                        blend4Pixel32(line_buffer, dst_buffer, uint16x8(alpha), maskl, zerol, amaskl);
-                        dst_buffer += 4; line_buffer += 4; size -= 4;
-                    }
-                }
-#endif
-                while (size > 0) {
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-                    unsigned char* alphap = (unsigned char *)line_buffer + 3;
-#else
-                    unsigned char *alphap = (unsigned char *)line_buffer;
-#endif
-                    BLEND_PIXEL();
-                    ++dst_buffer; ++line_buffer; --size;
-                }
+            if (premultiplied) {
+                if (blending_mode == BLEND_NORMAL)
+                    blendPremultiplied(dst_buffer, line_buffer, size, alpha);
+                else if (blending_mode == BLEND_ADD)
+                    addBlendPremultiplied(dst_buffer, line_buffer, size, alpha);
+                else
+                    subBlendPremultiplied(dst_buffer, line_buffer, size, alpha);
+                dst_buffer += size;
+            }
+            else if (blending_mode == BLEND_NORMAL) {
+                blend_kernels->blend(dst_buffer, line_buffer, size, alpha);
+                dst_buffer += size;
             }
             else {
                 if (blending_mode == BLEND_ADD) {
@@ -765,7 +606,7 @@ void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int ds
                 if (x2 < src_rect[0][0] || x2 >= src_rect[1][0] ||
                     y2 < src_rect[0][1] || y2 >= src_rect[1][1]) {
                     blendLine(line_buffer, line_pos, &dst_buffer_s);
-                    dst_buffer_s += line_pos;
+                    dst_buffer_s = dst_buffer + 1; // the next run starts past this pixel
                     line_pos = 0;
                     continue;
                 }
@@ -776,7 +617,7 @@ void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int ds
             blendLine(line_buffer, line_pos, &dst_buffer_s);
             delete[] line_buffer;
         }
-    } blender = {corner_xy, min_xy, max_xy, inv_mat, (ONSBuf*)image_surface->pixels, pos.w*current_cell, blending_mode, dst_surface, alpha, pitch, dst_x, dst_y, cx2, cy2, src_rect};
+    } blender = {corner_xy, min_xy, max_xy, inv_mat, (ONSBuf*)image_surface->pixels, pos.w*current_cell, blending_mode, premultiplied, dst_surface, alpha, pitch, dst_x, dst_y, cx2, cy2, src_rect};
 #if defined(USE_PARALLEL) || defined(USE_OMP_PARALLEL)
     parallel::For(min_xy[1], max_xy[1] + 1, 1, blender, (max_xy[1] - min_xy[1] + 1) * (max_xy[0] + 1 - min_xy[0]) * 4);
 #else
@@ -784,9 +625,11 @@ void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int ds
 #endif
     
     // unlock surface
-    SDL_UnlockSurface( image_surface );
     SDL_UnlockSurface( dst_surface );
-    SDL_mutexV(mutex);
+    if (!shared_blending){
+        SDL_UnlockSurface( image_surface );
+        SDL_mutexV(mutex);
+    }
 }
 
 #define BLEND_TEXT_ALPHA()\
@@ -820,6 +663,28 @@ void AnimationInfo::blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int ds
 //                           src_color2 * mask2) / alpha) & 0x00ff00;     
 //        *dst_buffer = mask_rb | mask_g | (alpha << 24);                 
 
+// x/255 rounded on the two channels of 0x00ff00ff, each below 65536
+#define DIV255_RB(x) (((x) + 0x00800080 + ((((x) + 0x00800080) >> 8) & 0x00ff00ff)) >> 8 & 0x00ff00ff)
+#define DIV255(x) (((x) + 128 + (((x) + 128) >> 8)) >> 8)
+
+// Color = Sa*Sc + (1-Sa)*Dc, on premultiplied surfaces
+#define BLEND_TEXT_ALPHA_PREMULTIPLIED()\
+{\
+    Uint32 mask2 = *src_buffer;                                         \
+    if (mask2 == 255){                                                  \
+        *dst_buffer = src_color;                                        \
+    }                                                                   \
+    else if (mask2 != 0){                                               \
+        Uint32 mask1 = 0xff ^ mask2;                                    \
+        Uint32 mask_rb = DIV255_RB((*dst_buffer & 0xff00ff) * mask1 +   \
+                                   src_color1 * mask2);                 \
+        Uint32 mask_g = DIV255(((*dst_buffer >> 8) & 0xff) * mask1 +    \
+                               (src_color2 >> 8) * mask2);              \
+        Uint32 alpha = DIV255((*dst_buffer >> 24) * mask1) + mask2;     \
+        *dst_buffer = mask_rb | (mask_g << 8) | (alpha << 24);          \
+    }                                                                   \
+}
+
 // used to draw characters on text_surface
 // Alpha = 1 - (1-Da)(1-Sa)
 // Color = (DaSaSc + Da(1-Sa)Dc + Sa(1-Da)Sc)/A
@@ -827,6 +692,7 @@ void AnimationInfo::blendText( SDL_Surface *surface, int dst_x, int dst_y, SDL_C
                                SDL_Rect *clip, bool rotate_flag )
 {
     if (image_surface == NULL || surface == NULL) return;
+    detachSurface();
     
     SDL_Rect dst_rect;
     dst_rect.x = dst_x;
@@ -881,7 +747,8 @@ void AnimationInfo::blendText( SDL_Surface *surface, int dst_x, int dst_y, SDL_C
             surface->pitch*src_rect.y + src_rect.x;
         for (int i=dst_rect.h ; i!=0 ; i--){
             for (int j=dst_rect.w ; j!=0 ; j--){
-                BLEND_TEXT_ALPHA();
+                if (premultiplied) BLEND_TEXT_ALPHA_PREMULTIPLIED()
+                else               BLEND_TEXT_ALPHA()
                 src_buffer++;
                 dst_buffer++;
             }
@@ -894,7 +761,8 @@ void AnimationInfo::blendText( SDL_Surface *surface, int dst_x, int dst_y, SDL_C
             unsigned char *src_buffer = (unsigned char*)surface->pixels + 
                 surface->pitch*(surface->h - src_rect.x - 1) + src_rect.y + i;
             for (int j=dst_rect.w ; j!=0 ; j--){
-                BLEND_TEXT_ALPHA();
+                if (premultiplied) BLEND_TEXT_ALPHA_PREMULTIPLIED()
+                else               BLEND_TEXT_ALPHA()
                 src_buffer -= surface->pitch;
                 dst_buffer++;
             }
@@ -986,6 +854,9 @@ void AnimationInfo::allocImage( int w, int h, Uint32 texture_format )
         this->texture_format = texture_format;
         SDL_mutexP(mutex);
         image_surface = allocSurface( w, h, texture_format );
+        surface_generation++;
+        image_version++;
+        premultiplied = false;
         SDL_mutexV(mutex);      
     }
 
@@ -1002,6 +873,7 @@ void AnimationInfo::allocImage( int w, int h, Uint32 texture_format )
 void AnimationInfo::copySurface( SDL_Surface *surface, SDL_Rect *src_rect, SDL_Rect *dst_rect )
 {
     if (!image_surface || !surface) return;
+    detachSurface();
     
     SDL_Rect _dst_rect = {0, 0};
     if (dst_rect) _dst_rect = *dst_rect;
@@ -1043,6 +915,7 @@ void AnimationInfo::copySurface( SDL_Surface *surface, SDL_Rect *src_rect, SDL_R
 void AnimationInfo::fill( Uint8 r, Uint8 g, Uint8 b, Uint8 a )
 {
     if (!image_surface) return;
+    detachSurface(false);
     
     SDL_mutexP(mutex);
     SDL_LockSurface( image_surface );
@@ -1064,7 +937,8 @@ void AnimationInfo::fill( Uint8 r, Uint8 g, Uint8 b, Uint8 a )
     SDL_mutexV(mutex);
 }
 
-SDL_Surface *AnimationInfo::setupImageAlpha( SDL_Surface *surface, SDL_Surface *surface_m, bool has_alpha )
+SDL_Surface *AnimationInfo::setupImageAlpha( SDL_Surface *surface, SDL_Surface *surface_m, bool has_alpha,
+                                             AlphaBounds *bounds )
 {
     if (surface == NULL) return NULL;
 
@@ -1078,12 +952,6 @@ SDL_Surface *AnimationInfo::setupImageAlpha( SDL_Surface *surface, SDL_Surface *
     orig_pos.w = w;
     orig_pos.h = h;
 
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-    unsigned char *alphap = (unsigned char *)buffer + 3;
-#else
-    unsigned char *alphap = (unsigned char *)buffer;
-#endif
-
     Uint32 ref_color = 0;
     if ( trans_mode == TRANS_TOPLEFT ){
         ref_color = *buffer;
@@ -1099,35 +967,14 @@ SDL_Surface *AnimationInfo::setupImageAlpha( SDL_Surface *surface, SDL_Surface *
     }
     ref_color &= 0xffffff;
 
-    int i, j, c;
     if ( trans_mode == TRANS_ALPHA && !has_alpha ){
-        const int w22 = w2/2;
-        const int w3 = w22 * num_of_cells;
+        const int w3 = w2/2 * num_of_cells;
         orig_pos.w = w3;
         SDL_PixelFormat *fmt = surface->format;
         SDL_Surface *surface2 = SDL_CreateRGBSurface( SDL_SWSURFACE, w3, h,
                                                       fmt->BitsPerPixel, fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask );
         SDL_LockSurface( surface2 );
-        Uint32 *buffer2 = (Uint32 *)surface2->pixels;
-
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-        alphap = (unsigned char *)buffer2 + 3;
-#else
-        alphap = (unsigned char *)buffer2;
-#endif
-
-        for (i=h ; i!=0 ; i--){
-            for (c=num_of_cells ; c!=0 ; c--){
-                for (j=w22 ; j!=0 ; j--, buffer++, alphap+=4){
-                    *buffer2++ = *buffer;
-                    *alphap = (*(buffer + w22) & 0xff) ^ 0xff;
-                }
-                buffer += (w2 - w22);
-            }
-            buffer  +=  surface->w  - w2 *num_of_cells;
-            buffer2 +=  surface2->w - w22*num_of_cells;
-            alphap  += (surface2->w - w22*num_of_cells)*4;
-        }
+        setupAlphaFromHalves( (Uint32 *)surface2->pixels, buffer, w, h, num_of_cells );
 
         SDL_UnlockSurface( surface );
         SDL_FreeSurface( surface );
@@ -1136,63 +983,54 @@ SDL_Surface *AnimationInfo::setupImageAlpha( SDL_Surface *surface, SDL_Surface *
     else if ( trans_mode == TRANS_MASK ){
         if (surface_m){
             SDL_LockSurface( surface_m );
-            const int mw  = surface_m->w;
-            const int mwh = surface_m->w * surface_m->h;
-
-            int i2 = 0;
-            for (i=h ; i!=0 ; i--){
-                Uint32 *buffer_m = (Uint32 *)surface_m->pixels + i2;
-                for (c=num_of_cells ; c!=0 ; c--){
-                    int j2 = 0;
-                    for (j=w2 ; j!=0 ; j--, buffer++, alphap+=4){
-                        *alphap = (*(buffer_m + j2) & 0xff) ^ 0xff;
-                        if (j2 >= mw) j2 = 0;
-                        else          j2++;
-                    }
-                }
-                if (i2 >= mwh) i2 = 0;
-                else           i2 += mw;
-            }
+            setupAlphaFromMask( buffer, w, h, num_of_cells,
+                                (Uint32 *)surface_m->pixels, surface_m->w, surface_m->h );
             SDL_UnlockSurface( surface_m );
         }
     }
     else if ( trans_mode == TRANS_TOPLEFT ||
               trans_mode == TRANS_TOPRIGHT ||
               trans_mode == TRANS_DIRECT ){
-        for (i=h ; i!=0 ; i--){
-            for (j=w ; j!=0 ; j--, buffer++, alphap+=4){
-                if ( (*buffer & 0xffffff) == ref_color )
-                    *alphap = 0x00;
-                else
-                    *alphap = 0xff;
-            }
-        }
+        setupAlphaFromColorKey( buffer, w*h, ref_color );
     }
     else if ( trans_mode == TRANS_STRING ){
-        for (i=h ; i!=0 ; i--){
-            for (j=w ; j!=0 ; j--, buffer++, alphap+=4)
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+        unsigned char *alphap = (unsigned char *)buffer + 3;
+#else
+        unsigned char *alphap = (unsigned char *)buffer;
+#endif
+        for (int i=h ; i!=0 ; i--){
+            for (int j=w ; j!=0 ; j--, buffer++, alphap+=4)
                 *alphap = *buffer >> 24;
         }
     }
     else if ( trans_mode != TRANS_ALPHA ){ // TRANS_COPY
-        for (i=h ; i!=0 ; i--){
-            for (j=w ; j!=0 ; j--, buffer++, alphap+=4)
-                *alphap = 0xff;
-        }
+        setupAlphaOpaque( buffer, w*h );
     }
+
+    if ( premultiplied )
+        premultiplyAlpha( (Uint32 *)surface->pixels, surface->w*surface->h );
+
+    scanAlpha( (Uint32 *)surface->pixels, surface->w, surface->h, surface->pitch / 4, num_of_cells, bounds );
     
     SDL_UnlockSurface( surface );
 
     return surface;
 }
 
-void AnimationInfo::setImage( SDL_Surface *surface, Uint32 texture_format )
+void AnimationInfo::setImage( SDL_Surface *surface, Uint32 texture_format, const AlphaBounds *bounds )
 {
     if (surface == NULL) return;
 
     this->texture_format = texture_format;
     image_surface = surface; // deleteSurface() should be called beforehand
+    surface_generation++;
+    image_version++;
     allocImage(surface->w, surface->h, texture_format);
+    if (bounds){
+        alpha_bounds = *bounds;
+        alpha_version = image_version;
+    }
 }
 
 unsigned char AnimationInfo::getAlpha(int x, int y)
@@ -1223,6 +1061,7 @@ unsigned char AnimationInfo::getAlpha(int x, int y)
 #ifdef USE_SMPEG
 void AnimationInfo::convertFromYUV(SDL_Overlay *src)
 {
+    detachSurface(false);
     SDL_mutexP(mutex);
     if (!image_surface){
         SDL_mutexV(mutex);
@@ -30,6 +30,7 @@
 #include <SDL2/SDL.h>
 #endif
 #include <string.h>
+#include "image_alpha.h"
 
 typedef unsigned char uchar3[3];
 
@@ -85,7 +86,11 @@ public:
     char *surface_name; // used to avoid reloading images
     char *mask_surface_name; // used to avoid reloading images
     SDL_Surface *image_surface;
+    unsigned int image_version; // moves whenever image_surface or its pixels may change
+    AlphaBounds alpha_bounds; // of image_surface as set up by setupImageAlpha()
+    unsigned int alpha_version; // alpha_bounds hold while image_version is this
     unsigned char *alpha_buf;
+    bool premultiplied; // the colors of image_surface are scaled by its alpha
     Uint32 texture_format;
     SDL_mutex *mutex;
         
@@ -116,6 +121,15 @@ public:
 
     AnimationInfo& operator =(const AnimationInfo &anim);
 
+    // Moves whenever an image_surface is set or dropped, for those keeping
+    // track of which objects have one.
+    static unsigned int surface_generation;
+    // Set while refreshSurface() composes in bands: the bands blend the
+    // same images at once, so blendOnSurface() and blendOnSurface2() leave
+    // the mutex and the image lock alone, the images being left unchanged
+    // meanwhile.
+    static bool shared_blending;
+
     void scalePosXY(int screen_ratio1, int screen_ratio2){
         pos.x = orig_pos.x * screen_ratio1 / screen_ratio2;
         pos.y = orig_pos.y * screen_ratio1 / screen_ratio2;
@@ -130,6 +144,9 @@ public:
     void deleteImageName();
     void setImageName( const char *name );
     void deleteSurface(bool delete_surface_name=true);
+    // Gives this object its own copy of an image_surface shared with
+    // SurfaceCache, to be called before writing to it.
+    void detachSurface(bool copy_pixels=true);
     void remove();
     void removeTag();
 
@@ -137,6 +154,12 @@ public:
 
     void setCell(int cell);
     static int doClipping( SDL_Rect *dst, SDL_Rect *clip, SDL_Rect *clipped=NULL );
+    // Whether every pixel of the image is known to have an alpha of 255.
+    bool isOpaque(){ return alpha_version == image_version && alpha_bounds.opaque; };
+    // Where blendOnSurface() at dst_x, dst_y changes the pixels within
+    // clip, left out the transparent margins when known, and the part of
+    // the current cell it takes them from; -1 if nowhere.
+    int getBlendRect( int dst_x, int dst_y, SDL_Rect &clip, SDL_Rect &dst_rect, SDL_Rect &src_rect );
     void blendOnSurface( SDL_Surface *dst_surface, int dst_x, int dst_y,
                          SDL_Rect &clip, int alpha=255 );
     void blendOnSurface2( SDL_Surface *dst_surface, int dst_x, int dst_y,
@@ -150,8 +173,11 @@ public:
     void allocImage( int w, int h, Uint32 texture_format );
     void copySurface( SDL_Surface *surface, SDL_Rect *src_rect, SDL_Rect *dst_rect = NULL );
     void fill( Uint8 r, Uint8 g, Uint8 b, Uint8 a );
-    SDL_Surface *setupImageAlpha( SDL_Surface *surface, SDL_Surface *surface_m, bool has_alpha );
-    void setImage( SDL_Surface *surface, Uint32 texture_format );
+    // bounds are set to those of the alpha of the returned surface.
+    SDL_Surface *setupImageAlpha( SDL_Surface *surface, SDL_Surface *surface_m, bool has_alpha,
+                                  AlphaBounds *bounds );
+    // bounds, when given, are those of the alpha of surface.
+    void setImage( SDL_Surface *surface, Uint32 texture_format, const AlphaBounds *bounds=NULL );
     unsigned char getAlpha(int x, int y);
 
 #ifdef USE_SMPEG
@@ -0,0 +1,263 @@
+/* -*- C++ -*-
+ *
+ *  AssetPrefetcher.cpp - Decoder of the images the script is about to load
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "AssetPrefetcher.h"
+
+AssetPrefetcher::AssetPrefetcher()
+{
+    decode = NULL;
+    decode_data = NULL;
+
+    mutex = SDL_CreateMutex();
+    cond = SDL_CreateCond();
+    num_threads = 0;
+    stop_flag = false;
+
+    stats.requested = stats.used = stats.wasted = stats.cancelled = 0;
+    stats.bytes = stats.pending = 0;
+}
+
+AssetPrefetcher::~AssetPrefetcher()
+{
+    stop();
+    if (cond) SDL_DestroyCond(cond);
+    if (mutex) SDL_DestroyMutex(mutex);
+}
+
+void AssetPrefetcher::setDecoder( DecodeFunc decode, void *data )
+{
+    this->decode = decode;
+    decode_data = data;
+}
+
+std::string AssetPrefetcher::capitalize( const char *name )
+{
+    std::string str = name;
+    for ( size_t i=0 ; i<str.size() ; i++ ){
+        if ( 'a' <= str[i] && str[i] <= 'z' ) str[i] += 'A' - 'a';
+        else if ( str[i] == '/' ) str[i] = '\\';
+    }
+
+    return str;
+}
+
+void AssetPrefetcher::filterRecent( std::vector<std::string> &names )
+{
+    size_t n = 0;
+    for ( size_t i=0 ; i<names.size() ; i++ ){
+        std::string name = capitalize( names[i].c_str() );
+        if ( recent_names.count( name ) ) continue;
+
+        recent_names.insert( name );
+        recent.push_back( name );
+        if ( recent.size() > NUM_RECENT_ASSETS ){
+            recent_names.erase( recent.front() );
+            recent.pop_front();
+        }
+        names[n++] = names[i];
+    }
+    names.resize( n );
+}
+
+void AssetPrefetcher::request( const std::vector<std::string> &names, bool pinned )
+{
+    if ( decode == NULL || names.empty() ) return;
+
+    SDL_mutexP(mutex);
+    for ( size_t i=0 ; i<names.size() ; i++ ){
+        Entry entry;
+        entry.file_name = names[i];
+        entry.name = capitalize( names[i].c_str() );
+        if ( excluded_names.count( entry.name ) ) continue;
+        entry.state = QUEUED;
+        entry.waited = false;
+        entry.pinned = pinned;
+        entry.surface = NULL;
+        entry.has_alpha = false;
+        entry.location = 0;
+        entries.push_back( entry );
+        stats.requested++;
+        stats.pending++;
+    }
+
+    if ( num_threads == 0 ){
+        int n = SDL_GetCPUCount();
+        if ( n > MAX_ASSET_PREFETCH_THREADS ) n = MAX_ASSET_PREFETCH_THREADS;
+        if ( n < 1 ) n = 1;
+        for ( int i=0 ; i<n ; i++ ){
+            threads[num_threads] = SDL_CreateThread( workerMain, "AssetPrefetcher", this );
+            if ( threads[num_threads] ) num_threads++;
+        }
+    }
+    SDL_CondBroadcast(cond);
+    SDL_mutexV(mutex);
+}
+
+SDL_Surface *AssetPrefetcher::take( const char *file_name, bool *has_alpha, int *location )
+{
+    std::string name = capitalize( file_name );
+    SDL_Surface *surface = NULL;
+
+    SDL_mutexP(mutex);
+    std::list<Entry>::iterator it = entries.begin();
+    while ( it != entries.end() && it->name != name ) it++;
+    if ( it != entries.end() ){
+        if ( it->state == QUEUED ){
+            // decoding it here is as fast as waiting for a worker
+            stats.cancelled++;
+            stats.pending--;
+        }
+        else{
+            it->waited = true;
+            while ( it->state == DECODING ) SDL_CondWait(cond, mutex);
+            surface = it->surface;
+            if ( surface ){
+                stats.used++;
+                stats.bytes -= (size_t)surface->pitch * surface->h;
+                if ( has_alpha ) *has_alpha = it->has_alpha;
+                if ( location ) *location = it->location;
+            }
+        }
+        entries.erase( it );
+        SDL_CondBroadcast(cond);
+    }
+    SDL_mutexV(mutex);
+
+    return surface;
+}
+
+void AssetPrefetcher::unpin()
+{
+    SDL_mutexP(mutex);
+    for ( std::list<Entry>::iterator it = entries.begin() ; it != entries.end() ; it++ )
+        it->pinned = false;
+    trim( ASSET_STAGING_SIZE );
+    SDL_CondBroadcast(cond);
+    SDL_mutexV(mutex);
+}
+
+void AssetPrefetcher::stop()
+{
+    SDL_mutexP(mutex);
+    stop_flag = true;
+    SDL_CondBroadcast(cond);
+    SDL_mutexV(mutex);
+
+    for ( int i=0 ; i<num_threads ; i++ )
+        SDL_WaitThread( threads[i], NULL );
+    num_threads = 0;
+
+    SDL_mutexP(mutex);
+    stop_flag = false;
+    for ( std::list<Entry>::iterator it = entries.begin() ; it != entries.end() ; it++ ){
+        if ( it->state == QUEUED ){
+            stats.cancelled++;
+            stats.pending--;
+        }
+        else if ( it->surface ){
+            stats.wasted++;
+            stats.bytes -= (size_t)it->surface->pitch * it->surface->h;
+            SDL_FreeSurface( it->surface );
+        }
+    }
+    entries.clear();
+    recent.clear();
+    recent_names.clear();
+    SDL_mutexV(mutex);
+}
+
+void AssetPrefetcher::exclude( const char *file_name )
+{
+    SDL_mutexP(mutex);
+    excluded_names.insert( capitalize( file_name ) );
+    SDL_mutexV(mutex);
+}
+
+AssetPrefetcher::Stats AssetPrefetcher::getStats()
+{
+    SDL_mutexP(mutex);
+    Stats s = stats;
+    SDL_mutexV(mutex);
+
+    return s;
+}
+
+int AssetPrefetcher::workerMain( void *data )
+{
+    ((AssetPrefetcher*)data)->work();
+
+    return 0;
+}
+
+void AssetPrefetcher::work()
+{
+    SDL_mutexP(mutex);
+    while ( !stop_flag ){
+        std::list<Entry>::iterator it = entries.begin();
+        while ( it != entries.end() && it->state != QUEUED ) it++;
+        if ( it == entries.end() ||
+             (it->pinned && stats.bytes >= ASSET_STAGING_SIZE) ){
+            SDL_CondWait(cond, mutex);
+            continue;
+        }
+
+        it->state = DECODING;
+        stats.pending--;
+        std::string file_name = it->file_name;
+        SDL_mutexV(mutex);
+
+        bool has_alpha = false;
+        int location = 0;
+        SDL_Surface *surface = decode( decode_data, file_name.c_str(), &has_alpha, &location );
+
+        SDL_mutexP(mutex);
+        it->state = DONE;
+        it->surface = surface;
+        it->has_alpha = has_alpha;
+        it->location = location;
+        if ( surface ){
+            stats.bytes += (size_t)surface->pitch * surface->h;
+            trim( ASSET_STAGING_SIZE );
+        }
+        else if ( !it->waited ){
+            entries.erase( it ); // let the main thread report the error
+        }
+        SDL_CondBroadcast(cond);
+    }
+    SDL_mutexV(mutex);
+}
+
+void AssetPrefetcher::trim( size_t size )
+{
+    std::list<Entry>::iterator it = entries.begin();
+    while ( stats.bytes > size && it != entries.end() ){
+        if ( it->state != DONE || it->waited || it->pinned ){
+            it++;
+            continue;
+        }
+        if ( it->surface ){
+            stats.wasted++;
+            stats.bytes -= (size_t)it->surface->pitch * it->surface->h;
+            SDL_FreeSurface( it->surface );
+        }
+        it = entries.erase( it );
+    }
+}
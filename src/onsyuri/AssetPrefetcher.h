@@ -0,0 +1,115 @@
+/* -*- C++ -*-
+ *
+ *  AssetPrefetcher.h - Decoder of the images the script is about to load
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __ASSET_PREFETCHER_H__
+#define __ASSET_PREFETCHER_H__
+
+#if defined(ANDROID)
+#include "SDL.h"
+#else
+#include <SDL2/SDL.h>
+#endif
+#include <deque>
+#include <list>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#define DEFAULT_LOOKAHEAD_LINES 64
+#define ASSET_STAGING_SIZE (32*1024*1024)
+#define MAX_ASSET_PREFETCH_THREADS 4
+#define NUM_RECENT_ASSETS 512
+
+// Images named by the script ahead of the current line are decoded on
+// worker threads and staged until createSurfaceFromFile() takes them.
+class AssetPrefetcher
+{
+public:
+    // called on the workers, must not touch the state of the main thread
+    typedef SDL_Surface *(*DecodeFunc)( void *data, const char *file_name, bool *has_alpha, int *location );
+
+    struct Stats{
+        size_t requested; // images queued for decoding
+        size_t used;      // decoded, then loaded by the script
+        size_t wasted;    // decoded, then dropped unused
+        size_t cancelled; // dropped or loaded before being decoded
+        size_t bytes;     // staged
+        size_t pending;   // queued
+    };
+
+    AssetPrefetcher();
+    ~AssetPrefetcher();
+
+    void setDecoder( DecodeFunc decode, void *data );
+
+    // Removes from names those passed here lately, which are either staged
+    // or already loaded, and remembers the others.
+    void filterRecent( std::vector<std::string> &names );
+    // Pinned images are never dropped, the workers wait for take() instead
+    // when the staging area is full.
+    void request( const std::vector<std::string> &names, bool pinned=false );
+    // The staged image of file_name, waited for if it is being decoded, or
+    // NULL if the caller has to decode it.
+    SDL_Surface *take( const char *file_name, bool *has_alpha, int *location );
+    // Lets the pinned images left untaken be dropped.
+    void unpin();
+    // Joins the workers and drops the staged images, request() restarts them.
+    void stop();
+    // Leaves file_name, which the engine writes itself, out of the requests
+    // from now on; what is staged of it has to be dropped by stop().
+    void exclude( const char *file_name );
+
+    Stats getStats();
+
+private:
+    enum { QUEUED, DECODING, DONE };
+    struct Entry{
+        std::string file_name; // as in the script
+        std::string name;      // capitalized, to match
+        int state;
+        bool waited; // by take(), not to be dropped
+        bool pinned;
+        SDL_Surface *surface;
+        bool has_alpha;
+        int location;
+    };
+    std::list<Entry> entries; // oldest request first
+    std::deque<std::string> recent;
+    std::unordered_set<std::string> recent_names;
+    std::unordered_set<std::string> excluded_names;
+
+    DecodeFunc decode;
+    void *decode_data;
+
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    SDL_Thread *threads[MAX_ASSET_PREFETCH_THREADS];
+    int num_threads;
+    bool stop_flag;
+    Stats stats;
+
+    static std::string capitalize( const char *name );
+    static int workerMain( void *data );
+    void work();
+    void trim( size_t size ); // with mutex held
+};
+
+#endif // __ASSET_PREFETCHER_H__
@@ -0,0 +1,156 @@
+/* -*- C++ -*-
+ *
+ *  BandCompositor.cpp - Composition of a clip in horizontal bands at once
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "BandCompositor.h"
+
+BandCompositor::BandCompositor()
+{
+    num_workers = 0;
+    num_threads = 1;
+
+    func = NULL;
+    data = NULL;
+    num_bands = 0;
+    pending = 0;
+    generation = 0;
+
+    mutex = SDL_CreateMutex();
+    cond = SDL_CreateCond();
+    done_cond = SDL_CreateCond();
+    stop_flag = false;
+}
+
+BandCompositor::~BandCompositor()
+{
+    stop();
+    if (done_cond) SDL_DestroyCond(done_cond);
+    if (cond) SDL_DestroyCond(cond);
+    if (mutex) SDL_DestroyMutex(mutex);
+}
+
+void BandCompositor::setThreads( int num )
+{
+    if ( num == 0 ) num = SDL_GetCPUCount();
+    if ( num > MAX_COMPOSITOR_THREADS ) num = MAX_COMPOSITOR_THREADS;
+    if ( num < 1 ) num = 1;
+
+    stop();
+    num_threads = num;
+}
+
+int BandCompositor::split( const SDL_Rect &clip, int num, SDL_Rect *bands )
+{
+    if ( num > clip.h / MIN_BAND_HEIGHT ) num = clip.h / MIN_BAND_HEIGHT;
+    if ( num > MAX_COMPOSITOR_THREADS ) num = MAX_COMPOSITOR_THREADS;
+    if ( num < 1 ) num = 1;
+
+    for ( int i=0 ; i<num ; i++ ){
+        bands[i] = clip;
+        bands[i].y = clip.y + clip.h * i / num;
+        bands[i].h = clip.y + clip.h * (i+1) / num - bands[i].y;
+    }
+
+    return num;
+}
+
+void BandCompositor::run( int num, ComposeFunc func, void *data )
+{
+    if ( num > num_threads ) num = num_threads;
+
+    int first_left = 1; // band left to the caller after band 0
+    if ( num > 1 ){
+        SDL_mutexP(mutex);
+        while ( num_workers < num-1 ){
+            Worker *worker = &workers[num_workers];
+            worker->owner = this;
+            worker->band = num_workers + 1;
+            worker->generation = generation;
+            worker->thread = SDL_CreateThread( workerMain, "BandCompositor", worker );
+            if ( worker->thread == NULL ) break;
+            num_workers++;
+        }
+        this->func = func;
+        this->data = data;
+        num_bands = num;
+        pending = num-1 < num_workers ? num-1 : num_workers;
+        first_left = pending + 1;
+        generation++;
+        SDL_CondBroadcast(cond);
+        SDL_mutexV(mutex);
+    }
+
+    func( data, 0 );
+    // the bands of the workers that could not be started
+    for ( int i=first_left ; i<num ; i++ ) func( data, i );
+
+    if ( num > 1 ){
+        SDL_mutexP(mutex);
+        while ( pending > 0 ) SDL_CondWait(done_cond, mutex);
+        SDL_mutexV(mutex);
+    }
+}
+
+void BandCompositor::stop()
+{
+    SDL_mutexP(mutex);
+    stop_flag = true;
+    SDL_CondBroadcast(cond);
+    SDL_mutexV(mutex);
+
+    for ( int i=0 ; i<num_workers ; i++ )
+        SDL_WaitThread( workers[i].thread, NULL );
+    num_workers = 0;
+
+    SDL_mutexP(mutex);
+    stop_flag = false;
+    SDL_mutexV(mutex);
+}
+
+int BandCompositor::workerMain( void *data )
+{
+    Worker *worker = (Worker*)data;
+    worker->owner->work( worker );
+
+    return 0;
+}
+
+void BandCompositor::work( Worker *worker )
+{
+    SDL_mutexP(mutex);
+    while ( !stop_flag ){
+        if ( worker->generation == generation ){
+            SDL_CondWait(cond, mutex);
+            continue;
+        }
+        worker->generation = generation;
+        if ( worker->band >= num_bands ) continue;
+
+        ComposeFunc func = this->func;
+        void *data = this->data;
+        SDL_mutexV(mutex);
+
+        func( data, worker->band );
+
+        SDL_mutexP(mutex);
+        if ( --pending == 0 ) SDL_CondBroadcast(done_cond);
+    }
+    SDL_mutexV(mutex);
+}
@@ -0,0 +1,85 @@
+/* -*- C++ -*-
+ *
+ *  BandCompositor.h - Composition of a clip in horizontal bands at once
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __BAND_COMPOSITOR_H__
+#define __BAND_COMPOSITOR_H__
+
+#if defined(ANDROID)
+#include "SDL.h"
+#else
+#include <SDL2/SDL.h>
+#endif
+
+#define MAX_COMPOSITOR_THREADS 8
+#define MIN_BAND_HEIGHT 32
+
+// Runs a whole layer stack on each horizontal band of a clip, one band per
+// thread with the caller taking the first, so that the threads meet once
+// per frame rather than once per sprite.  A band writes only its own rows,
+// which the kernels blend row by row, so the result is the one of the
+// whole clip composed at once.
+class BandCompositor
+{
+public:
+    typedef void (*ComposeFunc)( void *data, int band );
+
+    BandCompositor();
+    ~BandCompositor();
+
+    // 1 composes on the caller alone, 0 uses one thread per CPU.
+    void setThreads( int num );
+    int getThreads(){ return num_threads; }
+
+    // Cuts clip into at most num bands of MIN_BAND_HEIGHT rows or more,
+    // top to bottom, and returns how many.
+    static int split( const SDL_Rect &clip, int num, SDL_Rect *bands );
+    // Calls func on bands 0 to num-1 at once and returns when all are done.
+    void run( int num, ComposeFunc func, void *data );
+    // Joins the workers, run() restarts them.
+    void stop();
+
+private:
+    struct Worker{
+        BandCompositor *owner;
+        SDL_Thread *thread;
+        int band;
+        unsigned int generation; // of the last job seen
+    } workers[MAX_COMPOSITOR_THREADS-1];
+    int num_workers;
+    int num_threads;
+
+    // the job, renewed by run() with generation
+    ComposeFunc func;
+    void *data;
+    int num_bands;
+    int pending; // bands left to the workers
+    unsigned int generation;
+
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    SDL_cond *done_cond;
+    bool stop_flag;
+
+    static int workerMain( void *data );
+    void work( Worker *worker );
+};
+
+#endif // __BAND_COMPOSITOR_H__
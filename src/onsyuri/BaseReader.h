@@ -26,6 +26,9 @@
 #define __BASE_READER_H__
 
 #include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
 #if defined(ANDROID) && !defined(__LIBRETRO__)
 extern "C" int stat_ons(const char *path, struct stat *statbuf);
 extern "C" FILE *fopen_ons(const char *str, const char *mode);
@@ -43,6 +46,16 @@ extern "C" FILE *fopen_ons(const char *str, const char *mode);
 #define SEEK_END 2
 #endif
 
+// Archives are memory-mapped where mmap() is backed by a real pager;
+// elsewhere (Switch, PSP, Windows, web) entries are read through stdio.
+#if !defined(USE_MMAP_ARCHIVE) && (defined(__unix__) || defined(__APPLE__)) && \
+    !defined(__SWITCH__) && !defined(PSP) && !defined(__EMSCRIPTEN__)
+#define USE_MMAP_ARCHIVE
+#endif
+#if defined(USE_MMAP_ARCHIVE)
+#include <sys/mman.h>
+#endif
+
 #if defined(LINUX) || defined(MACOSX)
 #define DELIMITER '/'
 #elif defined(WIN32) || defined(_WIN32)
@@ -65,14 +78,17 @@ struct BaseReader
         NO_COMPRESSION   = 0,
         SPB_COMPRESSION  = 1,
         LZSS_COMPRESSION = 2,
-        NBZ_COMPRESSION  = 4
+        NBZ_COMPRESSION  = 4,
+        LZ4_COMPRESSION  = 8,      // only found in .nsx archives
+        SURFACE_COMPRESSION = 16   // .nsx pre-decoded image, see getSurfaceInfo()
     };
     
     enum {
         ARCHIVE_TYPE_NONE = 0,
         ARCHIVE_TYPE_SAR  = 1,
         ARCHIVE_TYPE_NSA  = 2,
-        ARCHIVE_TYPE_NS2  = 4   //new format since NScr2.91, uses ext ".ns2"
+        ARCHIVE_TYPE_NS2  = 4,  //new format since NScr2.91, uses ext ".ns2"
+        ARCHIVE_TYPE_NSX  = 8   //indexed, page-aligned archive written by tool/nsxconv
     };
 
     struct FileInfo{
@@ -91,6 +107,8 @@ struct BaseReader
         FileInfo *fi_list;
         unsigned int num_of_files;
         unsigned long base_offset;
+        unsigned char *mapped_buffer; // whole archive, NULL if not mapped
+        size_t mapped_length;
 
         ArchiveInfo(){
             next = NULL;
@@ -99,14 +117,58 @@ struct BaseReader
             file_name = NULL;
             fi_list = NULL;
             num_of_files = 0;
+            mapped_buffer = NULL;
+            mapped_length = 0;
         }
         ~ArchiveInfo(){
+#if defined(USE_MMAP_ARCHIVE)
+            if (mapped_buffer) munmap( mapped_buffer, mapped_length );
+#endif
             if (file_handle) fclose( file_handle );
             if (file_name)   delete[] file_name;
             if (fi_list)     delete[] fi_list;
         }
     };
 
+    struct DecodeCacheStats{
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t bytes;  // decoded bytes currently held
+        size_t budget; // upper bound on bytes, 0 disables the cache
+    };
+
+    struct PrefetchStats{
+        size_t requested;    // names passed to prefetch()
+        size_t hits;         // read-ahead entries that were then read
+        size_t advised;      // entries left to the OS to read ahead
+        size_t wasted_bytes; // read ahead but dropped unread
+        size_t queue_depth;  // names still waiting for the I/O thread
+        size_t bytes;        // held in the readahead buffer
+        size_t budget;       // upper bound on bytes, 0 disables prefetching
+    };
+
+    // A name looked up once, so that it can be read without searching
+    // again; valid until the reader is closed.
+    struct ResolvedFile{
+        int location;          // ARCHIVE_TYPE_NONE for a loose file
+        int compression_type;
+        size_t offset;         // of the entry within its archive
+        size_t length;         // decompressed length
+        ArchiveInfo *ai;       // NULL for a loose file
+        unsigned int no;
+        std::string path;      // loose file as spelled on disk
+    };
+
+    // Layout of a SURFACE_COMPRESSION entry: rows of width 32-bit pixels
+    // in the SDL_PixelFormatEnum format.
+    struct SurfaceInfo{
+        int width;
+        int height;
+        unsigned int format;
+        bool has_alpha;
+    };
+
     virtual ~BaseReader(){};
     
     virtual int open( const char *name=NULL ) = 0;
@@ -119,6 +181,36 @@ struct BaseReader
     //virtual FileInfo getFileByIndex( unsigned int index ) = 0;
     virtual size_t getFileLength( const char *file_name ) = 0;
     virtual size_t getFile( const char *file_name, unsigned char *buffer, int *location=NULL ) = 0;
+
+    // resolveFile() returns false if file_name is nowhere to be found;
+    // readFile() and viewFile() then behave like getFile() and getFileView().
+    virtual bool resolveFile( const char *file_name, ResolvedFile *rf ) = 0;
+    virtual size_t readFile( const ResolvedFile &rf, unsigned char *buffer ) = 0;
+    virtual const unsigned char *viewFile( const ResolvedFile &rf, size_t *length ){ return NULL; }
+
+    // Pixels of a SURFACE_COMPRESSION entry, so that the image need not be
+    // decoded; getFile() and readFile() return the same image as a BMP.
+    virtual bool getSurfaceInfo( const ResolvedFile &rf, SurfaceInfo *si ){ return false; }
+    virtual bool readSurface( const ResolvedFile &rf, unsigned char *pixels, int pitch ){ return false; }
+
+    // Read-only view of an uncompressed archived entry that stays valid
+    // until the reader is closed, or NULL if the caller must use getFile().
+    virtual const unsigned char *getFileView( const char *file_name, size_t *length, int *location=NULL ){ return NULL; }
+
+    // Forget cached directory listings after files were added or removed.
+    virtual void invalidateDirectoryIndex(){}
+    // Whether an fopen() mode may create or modify a file, "r+" included.
+    static bool isWriteMode( const char *mode ){ return strpbrk( mode, "wa+" ) != NULL; }
+
+    // Hint that the named files will be read soon; a background thread
+    // reads them ahead so that getFile() need not wait for the storage.
+    virtual void prefetch( const std::vector<std::string> &names ){}
+    virtual void setPrefetchSize( size_t bytes ){}
+    virtual PrefetchStats getPrefetchStats(){ PrefetchStats s = {0, 0, 0, 0, 0, 0, 0}; return s; }
+
+    // Byte budget of the LRU of decoded SPB/LZSS/NBZ entries.
+    virtual void setDecodeCacheSize( size_t bytes ){}
+    virtual DecodeCacheStats getDecodeCacheStats(){ DecodeCacheStats s = {0, 0, 0, 0, 0}; return s; }
 };
 
 #endif // __BASE_READER_H__
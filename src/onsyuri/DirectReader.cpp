@@ -33,8 +33,26 @@
 #endif
 
 #if !defined(WIN32) && !defined(_WIN32) && !defined(MACOS9) && !defined(PSP) && !defined(__OS2__)
+#define USE_DIRECTORY_INDEX
 #include <dirent.h>
 #endif
+#if defined(USE_MMAP_ARCHIVE)
+#include <sys/stat.h>
+#endif
+#include <vector>
+
+// pread() must not move a shared file position; libnx emulates it with
+// lseek+read, so the Switch takes the locked fseek+fread path instead.
+#if !defined(WIN32) && !defined(_WIN32) && !defined(MACOS9) && !defined(PSP) && !defined(__OS2__) && !defined(__SWITCH__)
+#define USE_PREAD
+#include <unistd.h>
+#endif
+
+// loose files are read ahead by the kernel where it takes the hint
+#if defined(__linux__) || defined(ANDROID)
+#define USE_FADVISE
+#include <fcntl.h>
+#endif
 
 #define IS_TWO_BYTE(x) \
         ( ((unsigned char)(x) > (unsigned char)0x80) && ((unsigned char)(x) !=(unsigned char) 0xff) )
@@ -56,13 +74,6 @@ extern Coding2UTF16 *coding2utf16;
 
 DirectReader::DirectReader( const char *path, const unsigned char *key_table )
 {
-    file_full_path = NULL;
-    file_sub_path = NULL;
-    file_path_len = 0;
-
-    capital_name = new char[MAX_FILE_NAME_LENGTH*2+1];
-    capital_name_tmp = new char[MAX_FILE_NAME_LENGTH*3+1];
-
     if ( path ){
         archive_path = new char[ strlen(path) + 1 ];
         memcpy( archive_path, path, strlen(path) + 1 );
@@ -82,27 +93,23 @@ DirectReader::DirectReader( const char *path, const unsigned char *key_table )
         for (i=0 ; i<256 ; i++) this->key_table[i] = i;
     }
 
-    read_buf = new unsigned char[READ_LENGTH];
-    decomp_buffer = new unsigned char[N*2];
-    decomp_buffer_len = N*2;
-
     last_registered_compression_type = &root_registered_compression_type;
     registerCompressionType( "NBZ", NBZ_COMPRESSION );
     registerCompressionType( "SPB", SPB_COMPRESSION );
     registerCompressionType( "JPG", NO_COMPRESSION );
     registerCompressionType( "GIF", NO_COMPRESSION );
+
+    num_prefetch_ranges = 0;
+    prefetch_stop = false;
+    memset( &prefetch_stats, 0, sizeof(prefetch_stats) );
+    prefetch_stats.budget = DEFAULT_PREFETCH_SIZE;
 }
 
 DirectReader::~DirectReader()
 {
-    if (file_full_path) delete[] file_full_path;
-    if (file_sub_path)  delete[] file_sub_path;
+    stopPrefetch();
+    delete[] archive_path;
 
-    delete[] capital_name;
-    delete[] capital_name_tmp;
-    delete[] read_buf;
-    delete[] decomp_buffer;
-    
     last_registered_compression_type = root_registered_compression_type.next;
     while ( last_registered_compression_type ){
         RegisteredCompressionType *cur = last_registered_compression_type;
@@ -111,67 +118,103 @@ DirectReader::~DirectReader()
     }
 }
 
-FILE *DirectReader::fopen(const char *path, const char *mode)
+static std::string foldFileName( const char *name )
 {
-    size_t len = strlen(archive_path) + strlen(path) + 1;
-    if (file_path_len < len){
-        file_path_len = len;
-        if (file_full_path) delete[] file_full_path;
-        file_full_path = new char[file_path_len];
-        if (file_sub_path) delete[] file_sub_path;
-        file_sub_path = new char[file_path_len];
-    }
-    sprintf( file_full_path, "%s%s", archive_path, path );
-
-    FILE *fp = ::fopen( file_full_path, mode );
-    if (fp) return fp;
+    std::string folded( name );
+    for ( size_t i=0 ; i<folded.size() ; i++ )
+        if ( 'A' <= folded[i] && folded[i] <= 'Z' ) folded[i] += 'a' - 'A';
+    return folded;
+}
 
-#if !defined(WIN32) && !defined(_WIN32) && !defined(MACOS9) && !defined(PSP) && !defined(__OS2__)
-    char *cur_p = NULL;
-    DIR *dp = NULL;
-    len = strlen(archive_path);
-    if (len > 0) dp = opendir(archive_path);
-    else         dp = opendir(".");
-    cur_p = file_full_path+len;
-
-    struct dirent *entp = NULL;
-
-    while(1){
-        if (dp == NULL) return NULL;
-
-        char *delim_p = NULL;
-        while(1){
-            delim_p = strchr( cur_p, (char)DELIMITER );
-            if (delim_p != cur_p) break;
-            cur_p++;
-        }
+DirectReader::DirectoryEntries &DirectReader::getDirectoryEntries( const std::string &dir )
+{
+    std::unordered_map<std::string, DirectoryEntries>::iterator it = directory_index.find( dir );
+    if ( it != directory_index.end() ) return it->second;
+
+    DirectoryEntries &entries = directory_index[dir];
+#if defined(USE_DIRECTORY_INDEX)
+    std::string dir_path = std::string( archive_path ) + dir;
+    DIR *dp = opendir( dir_path.empty() ? "." : dir_path.c_str() );
+    if ( dp == NULL ) return entries; // remembered as empty
+
+    struct dirent *entp;
+    while ( (entp = readdir(dp)) != NULL ){
+        entries.names.insert( entp->d_name );
+        // on a clash the first name readdir() returns wins, as before
+        entries.folded_names.insert( std::make_pair( foldFileName( entp->d_name ), std::string( entp->d_name ) ) );
+    }
+    closedir( dp );
+#endif
 
-        if (delim_p) len = delim_p - cur_p;
-        else         len = strlen(cur_p);
-        memcpy(file_sub_path, cur_p, len);
-        file_sub_path[len] = '\0';
+    return entries;
+}
 
-        entp = NULL;
-        while ( (entp = readdir(dp)) != NULL ){
-            if ( !strcasecmp( file_sub_path, entp->d_name ) ){
-                memcpy(cur_p, entp->d_name, len);
-                break;
+// Maps path onto the names actually on disk below archive_path; an exact
+// match of a component is preferred over a case-insensitive one.
+bool DirectReader::resolvePath( const char *path, std::string &resolved )
+{
+    std::lock_guard<std::mutex> lock( directory_index_mutex );
+
+    resolved.clear();
+    while ( *path ){
+        const char *delim_p = strchr( path, (char)DELIMITER );
+        size_t len = delim_p ? delim_p - path : strlen( path );
+
+        if ( len > 0 ){
+            std::string name( path, len );
+            DirectoryEntries &entries = getDirectoryEntries( resolved );
+            if ( entries.names.find( name ) == entries.names.end() ){
+                std::unordered_map<std::string, std::string>::iterator it =
+                    entries.folded_names.find( foldFileName( name.c_str() ) );
+                if ( it == entries.folded_names.end() ) return false;
+                name = it->second;
             }
+            if ( !resolved.empty() ) resolved += (char)DELIMITER;
+            resolved += name;
         }
-        closedir( dp );
-        dp = NULL;
 
-        if (entp == NULL) return NULL;
-        if (delim_p == NULL) break;
+        if ( delim_p == NULL ) break;
+        path = delim_p + 1;
+    }
+
+    return !resolved.empty();
+}
 
-        memcpy(file_sub_path, file_full_path, delim_p-file_full_path);
-        file_sub_path[delim_p-file_full_path]='\0';
-        dp = opendir(file_sub_path);
+void DirectReader::invalidateDirectoryIndex()
+{
+    std::lock_guard<std::mutex> lock( directory_index_mutex );
+    directory_index.clear();
+}
 
-        cur_p = delim_p+1;
+FILE *DirectReader::fopen(const char *path, const char *mode, std::string *full_path)
+{
+    std::string file_full_path( archive_path );
+#if defined(USE_DIRECTORY_INDEX)
+    // Reads go through the index so that a missing file costs a hash
+    // probe rather than a walk of every directory on the way.
+    if ( !isWriteMode( mode ) ){
+        std::string resolved;
+        if ( !resolvePath( path, resolved ) ) return NULL;
+        file_full_path += resolved;
     }
+    else{
+        // "r+" needs an existing file, which may differ in case
+        std::string resolved;
+        if ( mode[0] == 'r' && resolvePath( path, resolved ) )
+            file_full_path += resolved;
+        else
+            file_full_path += path;
+    }
+#else
+    file_full_path += path;
+#endif
 
-    fp = ::fopen( file_full_path, mode );
+    FILE *fp = ::fopen( file_full_path.c_str(), mode );
+    if ( fp && full_path ) *full_path = file_full_path;
+#if defined(USE_DIRECTORY_INDEX)
+    // dropped once the file exists, so that no listing read in between
+    // can miss it
+    if ( isWriteMode( mode ) ) invalidateDirectoryIndex();
 #endif
 
     return fp;
@@ -251,6 +294,7 @@ int DirectReader::open( const char *name )
 
 int DirectReader::close()
 {
+    stopPrefetch();
     return 0;
 }
 
@@ -276,10 +320,14 @@ int DirectReader::getRegisteredCompressionType( const char *file_name )
     while( *ext_buf != '.' && ext_buf != file_name ) ext_buf--;
     ext_buf++;
     
-    strcpy( capital_name, ext_buf );
-    for ( unsigned int i=0 ; i<strlen(ext_buf)+1 ; i++ )
+    char capital_name[MAX_FILE_NAME_LENGTH+1];
+    size_t len = strlen(ext_buf);
+    if ( len > MAX_FILE_NAME_LENGTH ) return NO_COMPRESSION;
+    for ( unsigned int i=0 ; i<len+1 ; i++ ){
+        capital_name[i] = ext_buf[i];
         if ( capital_name[i] >= 'a' && capital_name[i] <= 'z' )
             capital_name[i] += 'A' - 'a';
+    }
     
     RegisteredCompressionType *reg = root_registered_compression_type.next;
     while (reg){
@@ -299,10 +347,14 @@ struct DirectReader::FileInfo DirectReader::getFileByIndex( unsigned int index )
     return fi;
 }
 
-FILE *DirectReader::getFileHandle( const char *file_name, int &compression_type, size_t *length )
+FILE *DirectReader::getFileHandle( const char *file_name, int &compression_type, size_t *length, std::string *full_path )
 {
     FILE *fp;
     unsigned int i;
+    char capital_name[MAX_FILE_NAME_LENGTH*2+1];
+#if defined(UTF8_FILESYSTEM)
+    char capital_name_tmp[MAX_FILE_NAME_LENGTH*3+1];
+#endif
 
     compression_type = NO_COMPRESSION;
     size_t len = strlen( file_name );
@@ -324,7 +376,7 @@ FILE *DirectReader::getFileHandle( const char *file_name, int &compression_type,
 #endif    
 
     *length = 0;
-    if ( (fp = fopen( capital_name, "rb" )) != NULL && len >= 3 ){
+    if ( (fp = fopen( capital_name, "rb", full_path )) != NULL && len >= 3 ){
         compression_type = getRegisteredCompressionType( capital_name );
         if ( compression_type == NBZ_COMPRESSION || compression_type == SPB_COMPRESSION ){
             *length = getDecompressedFileLength( compression_type, fp, 0 );
@@ -348,16 +400,13 @@ size_t DirectReader::getFileLength( const char *file_name )
     return len;
 }
 
-size_t DirectReader::getFile( const char *file_name, unsigned char *buffer, int *location )
+size_t DirectReader::readLooseFile( FILE *fp, int compression_type, size_t len, unsigned char *buffer )
 {
-    int compression_type;
-    size_t len, c, total = 0;
-    FILE *fp = getFileHandle( file_name, compression_type, &len );
-    
-    if ( fp ){
-        if      ( compression_type & NBZ_COMPRESSION ) return decodeNBZ( fp, 0, buffer );
-        else if ( compression_type & SPB_COMPRESSION ) return decodeSPB( fp, 0, buffer );
+    size_t c, total = 0;
 
+    if      ( compression_type & NBZ_COMPRESSION ) total = decodeNBZ( fp, 0, buffer );
+    else if ( compression_type & SPB_COMPRESSION ) total = decodeSPB( fp, 0, buffer );
+    else{
         fseek( fp, 0, SEEK_SET );
         total = len;
         while( len > 0 ){
@@ -367,6 +416,19 @@ size_t DirectReader::getFile( const char *file_name, unsigned char *buffer, int
             fread( buffer, 1, c, fp );
             buffer += c;
         }
+    }
+
+    return total;
+}
+
+size_t DirectReader::getFile( const char *file_name, unsigned char *buffer, int *location )
+{
+    int compression_type;
+    size_t len, total = 0;
+    FILE *fp = getFileHandle( file_name, compression_type, &len );
+    
+    if ( fp ){
+        total = readLooseFile( fp, compression_type, len, buffer );
         fclose( fp );
         if ( location ) *location = ARCHIVE_TYPE_NONE;
     }
@@ -374,6 +436,35 @@ size_t DirectReader::getFile( const char *file_name, unsigned char *buffer, int
     return total;
 }
 
+bool DirectReader::resolveFile( const char *file_name, ResolvedFile *rf )
+{
+    rf->location = ARCHIVE_TYPE_NONE;
+    rf->compression_type = NO_COMPRESSION;
+    rf->offset = 0;
+    rf->length = 0;
+    rf->ai = NULL;
+    rf->no = 0;
+    rf->path.clear();
+
+    FILE *fp = getFileHandle( file_name, rf->compression_type, &rf->length, &rf->path );
+    if ( fp ) fclose( fp );
+
+    return rf->length > 0;
+}
+
+size_t DirectReader::readFile( const ResolvedFile &rf, unsigned char *buffer )
+{
+    if ( rf.ai || rf.path.empty() ) return 0;
+
+    FILE *fp = ::fopen( rf.path.c_str(), "rb" );
+    if ( fp == NULL ) return 0;
+
+    size_t total = readLooseFile( fp, rf.compression_type, rf.length, buffer );
+    fclose( fp );
+
+    return total;
+}
+
 void DirectReader::convertCodingToEUC( char *buf )
 {
     int i = 0;
@@ -446,35 +537,219 @@ void DirectReader::convertFromUTF8ToCoding(char *dst_buf, const char *src_buf)
     *dst_buf++ = 0;
 }
 
-size_t DirectReader::decodeNBZ( FILE *fp, size_t offset, unsigned char *buf )
+size_t DirectReader::readAt( FILE *fp, size_t offset, unsigned char *buf, size_t length )
 {
-    if (key_table_flag)
-        utils::printError("may not decode NBZ with key_table enabled.\n");
-    
-    unsigned int original_length, count;
-    BZFILE *bfp;
-    void *unused;
-    int err, len, nunused;
+    size_t total = 0;
+    if ( num_prefetch_ranges > 0 ){
+        total = readPrefetched( fp, offset, buf, length );
+        if ( total == length ) return total;
+    }
 
+    return total + readFromFile( fp, offset + total, buf + total, length - total );
+}
+
+size_t DirectReader::readFromFile( FILE *fp, size_t offset, unsigned char *buf, size_t length )
+{
+#if defined(USE_PREAD)
+    size_t total = 0;
+    while ( total < length ){
+        ssize_t ret = pread( fileno( fp ), buf + total, length - total, offset + total );
+        if ( ret <= 0 ) break;
+        total += ret;
+    }
+    return total;
+#else
+    std::lock_guard<std::mutex> lock( file_mutex );
     fseek( fp, offset, SEEK_SET );
-    original_length = count = readLong( fp );
+    return fread( buf, 1, length, fp );
+#endif
+}
 
-    bfp = BZ2_bzReadOpen( &err, fp, 0, 0, NULL, 0 );
-    if ( bfp == NULL || err != BZ_OK ) return 0;
+void DirectReader::prefetch( const std::vector<std::string> &names )
+{
+    std::lock_guard<std::mutex> lock( prefetch_mutex );
+    if ( prefetch_stats.budget == 0 ) return;
 
-    while( err == BZ_OK && count > 0 ){
-        if ( count >= READ_LENGTH )
-            len = BZ2_bzRead( &err, bfp, buf, READ_LENGTH );
-        else
-            len = BZ2_bzRead( &err, bfp, buf, count );
-        count -= len;
-        buf += len;
+    for ( size_t i=0 ; i<names.size() ; i++ )
+        prefetch_queue.push_back( names[i] );
+    prefetch_stats.requested += names.size();
+    prefetch_stats.queue_depth = prefetch_queue.size();
+
+    if ( !prefetch_thread.joinable() )
+        prefetch_thread = std::thread( &DirectReader::prefetchLoop, this );
+    prefetch_cond.notify_one();
+}
+
+void DirectReader::setPrefetchSize( size_t bytes )
+{
+    std::lock_guard<std::mutex> lock( prefetch_mutex );
+    prefetch_stats.budget = bytes;
+    trimPrefetch( bytes );
+}
+
+BaseReader::PrefetchStats DirectReader::getPrefetchStats()
+{
+    std::lock_guard<std::mutex> lock( prefetch_mutex );
+    return prefetch_stats;
+}
+
+void DirectReader::stopPrefetch()
+{
+    {
+        std::lock_guard<std::mutex> lock( prefetch_mutex );
+        prefetch_stop = true;
+    }
+    prefetch_cond.notify_one();
+    if ( prefetch_thread.joinable() ) prefetch_thread.join();
+
+    std::lock_guard<std::mutex> lock( prefetch_mutex );
+    prefetch_stop = false;
+    prefetch_queue.clear();
+    prefetch_stats.queue_depth = 0;
+    trimPrefetch( 0 );
+}
+
+void DirectReader::prefetchLoop()
+{
+    std::unique_lock<std::mutex> lock( prefetch_mutex );
+    while ( true ){
+        while ( !prefetch_stop && prefetch_queue.empty() ) prefetch_cond.wait( lock );
+        if ( prefetch_stop ) break;
+
+        std::string name = prefetch_queue.front();
+        prefetch_queue.pop_front();
+        prefetch_stats.queue_depth = prefetch_queue.size();
+
+        lock.unlock();
+        prefetchFile( name.c_str() );
+        lock.lock();
+    }
+}
+
+void DirectReader::prefetchFile( const char *file_name )
+{
+    ResolvedFile rf;
+    if ( !resolveFile( file_name, &rf ) ) return;
+
+    FILE *fp;
+    size_t offset, length;
+    bool mapped;
+    if ( !getPrefetchRange( rf, &fp, &offset, &length, &mapped ) ){
+#if defined(USE_FADVISE)
+        if ( rf.path.empty() ) return;
+        FILE *loose = ::fopen( rf.path.c_str(), "rb" );
+        if ( loose == NULL ) return;
+        posix_fadvise( fileno( loose ), 0, 0, POSIX_FADV_WILLNEED );
+        fclose( loose );
+        std::lock_guard<std::mutex> lock( prefetch_mutex );
+        prefetch_stats.advised++;
+#endif
+        return;
+    }
+    if ( length == 0 ) return;
+
+    if ( mapped ){
+#if defined(USE_MMAP_ARCHIVE)
+        size_t start = offset & ~(size_t)4095;
+        madvise( rf.ai->mapped_buffer + start, offset + length - start, MADV_WILLNEED );
+#endif
+        std::lock_guard<std::mutex> lock( prefetch_mutex );
+        prefetch_stats.advised++;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( prefetch_mutex );
+        if ( length > prefetch_stats.budget ) return;
+        for ( std::list<PrefetchRange>::iterator it = prefetch_ranges.begin() ; it != prefetch_ranges.end() ; ++it )
+            if ( it->fp == fp && it->offset == offset ) return;
+    }
+
+    PrefetchRange range;
+    range.fp = fp;
+    range.offset = offset;
+    range.data.resize( length );
+    range.used = false;
+    if ( readFromFile( fp, offset, &range.data[0], length ) != length ) return;
+
+    std::lock_guard<std::mutex> lock( prefetch_mutex );
+    if ( prefetch_stop || length > prefetch_stats.budget ) return;
+    trimPrefetch( prefetch_stats.budget - length );
+    prefetch_stats.bytes += length;
+    prefetch_ranges.push_back( std::move( range ) );
+    num_prefetch_ranges = prefetch_ranges.size();
+}
+
+size_t DirectReader::readPrefetched( FILE *fp, size_t offset, unsigned char *buf, size_t length )
+{
+    std::lock_guard<std::mutex> lock( prefetch_mutex );
+    for ( std::list<PrefetchRange>::iterator it = prefetch_ranges.begin() ; it != prefetch_ranges.end() ; ++it ){
+        size_t end = it->offset + it->data.size();
+        if ( it->fp != fp || offset < it->offset || offset >= end ) continue;
+
+        size_t len = end - offset;
+        if ( len > length ) len = length;
+        memcpy( buf, &it->data[offset - it->offset], len );
+        if ( !it->used ) prefetch_stats.hits++;
+        it->used = true;
+
+        if ( offset + len == end ){
+            prefetch_stats.bytes -= it->data.size();
+            prefetch_ranges.erase( it );
+            num_prefetch_ranges = prefetch_ranges.size();
+        }
+        return len;
+    }
+
+    return 0;
+}
+
+void DirectReader::trimPrefetch( size_t budget )
+{
+    while ( prefetch_stats.bytes > budget && !prefetch_ranges.empty() ){
+        PrefetchRange &range = prefetch_ranges.front();
+        if ( !range.used ) prefetch_stats.wasted_bytes += range.data.size();
+        prefetch_stats.bytes -= range.data.size();
+        prefetch_ranges.pop_front();
+    }
+    num_prefetch_ranges = prefetch_ranges.size();
+}
+
+size_t DirectReader::decodeNBZ( FILE *fp, size_t offset, unsigned char *buf )
+{
+    if (key_table_flag)
+        utils::printError("may not decode NBZ with key_table enabled.\n");
+    
+    unsigned char read_buf[READ_LENGTH];
+    if ( readAt( fp, offset, read_buf, 4 ) != 4 ) return 0;
+    unsigned int original_length = key_table[read_buf[0]];
+    original_length = original_length << 8 | key_table[read_buf[1]];
+    original_length = original_length << 8 | key_table[read_buf[2]];
+    original_length = original_length << 8 | key_table[read_buf[3]];
+    offset += 4;
+
+    bz_stream strm;
+    memset( &strm, 0, sizeof(strm) );
+    if ( BZ2_bzDecompressInit( &strm, 0, 0 ) != BZ_OK ) return 0;
+
+    strm.next_out = (char*)buf;
+    strm.avail_out = original_length;
+    int err = BZ_OK;
+    while( err == BZ_OK && strm.avail_out > 0 ){
+        if ( strm.avail_in == 0 ){
+            size_t len = readAt( fp, offset, read_buf, READ_LENGTH );
+            if ( len == 0 ) break;
+            offset += len;
+            strm.next_in = (char*)read_buf;
+            strm.avail_in = len;
+        }
+        err = BZ2_bzDecompress( &strm );
     }
 
-    BZ2_bzReadGetUnused(&err, bfp, &unused, &nunused );
-    BZ2_bzReadClose( &err, bfp );
+    size_t count = original_length - strm.avail_out;
+    BZ2_bzDecompressEnd( &strm );
 
-    return original_length - count;
+    return count;
 }
 
 size_t DirectReader::encodeNBZ( FILE *fp, size_t length, unsigned char *buf )
@@ -502,26 +777,78 @@ size_t DirectReader::encodeNBZ( FILE *fp, size_t length, unsigned char *buf )
     return bytes_out;
 }
 
-int DirectReader::getbit( FILE *fp, int n )
+// Same stream as encodeNBZ( FILE* ), appended to dst in memory.
+size_t DirectReader::encodeNBZ( std::vector<unsigned char> &dst, size_t length, const unsigned char *buf )
 {
-    int i, x = 0;
-    static int getbit_buf;
-    
-    for ( i=0 ; i<n ; i++ ){
-        if ( getbit_mask == 0 ){
-            if (getbit_len == getbit_count){
-                getbit_len = fread(read_buf, 1, READ_LENGTH, fp);
-                if (getbit_len == 0) return EOF;
-                getbit_count = 0;
+    bz_stream strm;
+    memset( &strm, 0, sizeof(strm) );
+    if ( BZ2_bzCompressInit( &strm, 9, 0, 30 ) != BZ_OK ) return 0;
+
+    size_t start = dst.size();
+    strm.next_in = (char*)buf;
+    strm.avail_in = length;
+
+    int ret;
+    do{
+        size_t pos = dst.size();
+        dst.resize( pos + WRITE_LENGTH*16 );
+        strm.next_out = (char*)&dst[pos];
+        strm.avail_out = WRITE_LENGTH*16;
+        ret = BZ2_bzCompress( &strm, BZ_FINISH );
+        dst.resize( dst.size() - strm.avail_out );
+    } while ( ret == BZ_FINISH_OK );
+    BZ2_bzCompressEnd( &strm );
+
+    if ( ret != BZ_STREAM_END ){
+        dst.resize( start );
+        return 0;
+    }
+
+    return dst.size() - start;
+}
+
+void DirectReader::initBitStream( BitStream *bs, FILE *fp, size_t offset )
+{
+    bs->fp = fp;
+    bs->offset = offset;
+    bs->bits = 0;
+    bs->num_bits = 0;
+    bs->eof = false;
+    bs->len = bs->count = 0;
+}
+
+void DirectReader::refillBitStream( BitStream *bs )
+{
+    while ( bs->num_bits <= 56 ){
+        if ( bs->count == bs->len ){
+            bs->len = readAt( bs->fp, bs->offset, bs->read_buf, READ_LENGTH );
+            bs->count = 0;
+            if ( bs->len == 0 ){
+                bs->eof = true;
+                return;
             }
+            bs->offset += bs->len;
+            if ( key_table_flag )
+                for ( size_t i=0 ; i<bs->len ; i++ ) bs->read_buf[i] = key_table[bs->read_buf[i]];
+        }
+        bs->bits |= (uint64_t)bs->read_buf[bs->count++] << (56 - bs->num_bits);
+        bs->num_bits += 8;
+    }
+}
 
-            getbit_buf = key_table[read_buf[getbit_count++]];
-            getbit_mask = 128;
+inline int DirectReader::getbit( BitStream *bs, int n )
+{
+    if ( bs->num_bits < n ){
+        if ( !bs->eof ) refillBitStream( bs );
+        if ( bs->num_bits < n ){
+            // the bits that are left are lost, as with the old bit-at-a-time reader
+            bs->num_bits = 0;
+            return EOF;
         }
-        x <<= 1;
-        if ( getbit_buf & getbit_mask ) x++;
-        getbit_mask >>= 1;
     }
+    int x = (int)(bs->bits >> (64 - n));
+    bs->bits <<= n;
+    bs->num_bits -= n;
     return x;
 }
 
@@ -532,12 +859,13 @@ size_t DirectReader::decodeSPB( FILE *fp, size_t offset, unsigned char *buf )
     size_t i, j, k;
     int c, n, m;
 
-    getbit_mask = 0;
-    getbit_len = getbit_count = 0;
-    
-    fseek( fp, offset, SEEK_SET );
-    size_t width  = readShort( fp );
-    size_t height = readShort( fp );
+    unsigned char header[4];
+    if ( readAt( fp, offset, header, 4 ) != 4 ) return 0;
+    size_t width  = key_table[header[0]] << 8 | key_table[header[1]];
+    size_t height = key_table[header[2]] << 8 | key_table[header[3]];
+
+    BitStream bs;
+    initBitStream( &bs, fp, offset + 4 );
 
     size_t width_pad  = (4 - width * 3 % 4) % 4;
 
@@ -563,17 +891,47 @@ size_t DirectReader::decodeSPB( FILE *fp, size_t offset, unsigned char *buf )
 
     buf += 54;
 
-    if (decomp_buffer_len < width*height+4){
-        if (decomp_buffer) delete[] decomp_buffer;
-        decomp_buffer_len = width*height+4;
-        decomp_buffer = new unsigned char[decomp_buffer_len];
-    }
+    unsigned char *decomp_buffer = new unsigned char[width*height+4];
     
     for ( i=0 ; i<3 ; i++ ){
         count = 0;
-        decomp_buffer[count++] = c = getbit( fp, 8 );
+        decomp_buffer[count++] = c = getbit( &bs, 8 );
         while ( count < (unsigned)(width * height) ){
-            n = getbit( fp, 3 );
+            if ( bs.num_bits < 35 && !bs.eof ) refillBitStream( &bs );
+            if ( bs.num_bits >= 35 ){
+                // the longest group (3+4*8 bits) is in the reservoir
+                uint64_t bits = bs.bits;
+                int used = 3;
+                n = (int)(bits >> 61);
+                if ( n == 0 ){
+                    decomp_buffer[count++] = c;
+                    decomp_buffer[count++] = c;
+                    decomp_buffer[count++] = c;
+                    decomp_buffer[count++] = c;
+                }
+                else{
+                    if ( n == 7 ){
+                        m = (int)(bits >> 60 & 1) + 1;
+                        used = 4;
+                    }
+                    else{
+                        m = n + 2;
+                    }
+                    for ( j=0 ; j<4 ; j++ ){
+                        k = (size_t)((bits << used) >> (64 - m));
+                        used += m;
+                        if ( m == 8 )    c = (int)k;
+                        else if ( k & 1 ) c += (k>>1) + 1;
+                        else             c -= (k>>1);
+                        decomp_buffer[count++] = c;
+                    }
+                }
+                bs.bits <<= used;
+                bs.num_bits -= used;
+                continue;
+            }
+
+            n = getbit( &bs, 3 );
             if ( n == 0 ){
                 decomp_buffer[count++] = c;
                 decomp_buffer[count++] = c;
@@ -582,7 +940,7 @@ size_t DirectReader::decodeSPB( FILE *fp, size_t offset, unsigned char *buf )
                 continue;
             }
             else if ( n == 7 ){
-                m = getbit( fp, 1 ) + 1;
+                m = getbit( &bs, 1 ) + 1;
             }
             else{
                 m = n + 2;
@@ -590,10 +948,10 @@ size_t DirectReader::decodeSPB( FILE *fp, size_t offset, unsigned char *buf )
 
             for ( j=0 ; j<4 ; j++ ){
                 if ( m == 8 ){
-                    c = getbit( fp, 8 );
+                    c = getbit( &bs, 8 );
                 }
                 else{
-                    k = getbit( fp, m );
+                    k = getbit( &bs, m );
                     if ( k & 1 ) c += (k>>1) + 1;
                     else         c -= (k>>1);
                 }
@@ -615,6 +973,7 @@ size_t DirectReader::decodeSPB( FILE *fp, size_t offset, unsigned char *buf )
             }
         }
     }
+    delete[] decomp_buffer;
     
     return total_size;
 }
@@ -622,24 +981,54 @@ size_t DirectReader::decodeSPB( FILE *fp, size_t offset, unsigned char *buf )
 size_t DirectReader::decodeLZSS( struct ArchiveInfo *ai, int no, unsigned char *buf )
 {
     unsigned int count = 0;
-    int i, j, k, r, c;
-
-    getbit_mask = 0;
-    getbit_len = getbit_count = 0;
+    int i, j, k, r, c, len;
+    unsigned char decomp_buffer[N];
 
-    fseek( ai->file_handle, ai->fi_list[no].offset, SEEK_SET );
-    memset( decomp_buffer, 0, N-F );
+    BitStream bs;
+    initBitStream( &bs, ai->file_handle, ai->fi_list[no].offset );
+    memset( decomp_buffer, 0, N );
     r = N - F;
 
-    while ( count < ai->fi_list[no].original_length ){
-        if ( getbit( ai->file_handle, 1 ) ) {
-            if ((c = getbit( ai->file_handle, 8 )) == EOF) break;
+    size_t original_length = ai->fi_list[no].original_length;
+    while ( count < original_length ){
+        if ( bs.num_bits < 1 + EI + EJ && !bs.eof ) refillBitStream( &bs );
+        if ( bs.num_bits >= 1 + EI + EJ ){
+            // a whole token is in the reservoir
+            uint64_t bits = bs.bits;
+            if ( bits >> 63 ){
+                c = (int)(bits >> (63 - 8)) & 0xff;
+                bs.bits <<= 9;
+                bs.num_bits -= 9;
+                buf[ count++ ] = c;
+                decomp_buffer[r++] = c;  r &= (N - 1);
+                continue;
+            }
+            i = (int)(bits >> (63 - EI)) & (N - 1);
+            j = (int)(bits >> (63 - EI - EJ)) & ((1 << EJ) - 1);
+            bs.bits <<= 1 + EI + EJ;
+            bs.num_bits -= 1 + EI + EJ;
+        }
+        else if ( getbit( &bs, 1 ) ) {
+            if ((c = getbit( &bs, 8 )) == EOF) break;
             buf[ count++ ] = c;
             decomp_buffer[r++] = c;  r &= (N - 1);
+            continue;
         } else {
-            if ((i = getbit( ai->file_handle, EI )) == EOF) break;
-            if ((j = getbit( ai->file_handle, EJ )) == EOF) break;
-            for (k = 0; k <= j + 1  ; k++) {
+            if ((i = getbit( &bs, EI )) == EOF) break;
+            if ((j = getbit( &bs, EJ )) == EOF) break;
+        }
+        len = j + 2;
+        if ( len > (int)(original_length - count) )
+            len = original_length - count;
+        if ( i + len <= N && r + len <= N && (i + len <= r || r + len <= i) ){
+            // neither run wraps nor overlaps the other
+            memcpy( buf + count, decomp_buffer + i, len );
+            memcpy( decomp_buffer + r, decomp_buffer + i, len );
+            count += len;
+            r = (r + len) & (N - 1);
+        }
+        else{
+            for (k = 0; k < len; k++) {
                 c = decomp_buffer[(i + k) & (N - 1)];
                 buf[ count++ ] = c;
                 decomp_buffer[r++] = c;  r &= (N - 1);
@@ -653,14 +1042,18 @@ size_t DirectReader::decodeLZSS( struct ArchiveInfo *ai, int no, unsigned char *
 size_t DirectReader::getDecompressedFileLength( int type, FILE *fp, size_t offset )
 {
     size_t length=0;
-    fseek( fp, offset, SEEK_SET );
+    unsigned char header[4];
+    if ( readAt( fp, offset, header, 4 ) != 4 ) return 0;
     
     if ( type == NBZ_COMPRESSION ){
-        length = readLong( fp );
+        length = key_table[header[0]];
+        length = length << 8 | key_table[header[1]];
+        length = length << 8 | key_table[header[2]];
+        length = length << 8 | key_table[header[3]];
     }
     else if ( type == SPB_COMPRESSION ){
-        size_t width  = readShort( fp );
-        size_t height = readShort( fp );
+        size_t width  = key_table[header[0]] << 8 | key_table[header[1]];
+        size_t height = key_table[header[2]] << 8 | key_table[header[3]];
         size_t width_pad  = (4 - width * 3 % 4) % 4;
             
         length = (width * 3 +width_pad) * height + 54;
@@ -668,3 +1061,18 @@ size_t DirectReader::getDecompressedFileLength( int type, FILE *fp, size_t offse
 
     return length;
 }
+
+void DirectReader::mapArchive( ArchiveInfo *ai )
+{
+#if defined(USE_MMAP_ARCHIVE)
+    struct stat st;
+    int fd = fileno( ai->file_handle );
+    if ( fstat( fd, &st ) != 0 || st.st_size <= 0 ) return;
+
+    void *p = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( p == MAP_FAILED ) return; // e.g. address space exhausted, keep using stdio
+
+    ai->mapped_buffer = (unsigned char*)p;
+    ai->mapped_length = st.st_size;
+#endif
+}
@@ -27,8 +27,20 @@
 
 #include "BaseReader.h"
 #include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
 #define MAX_FILE_NAME_LENGTH 256
+#define DEFAULT_PREFETCH_SIZE (16*1024*1024)
 
 class DirectReader : public BaseReader
 {
@@ -46,26 +58,63 @@ public:
     struct FileInfo getFileByIndex( unsigned int index );
     size_t getFileLength( const char *file_name );
     size_t getFile( const char *file_name, unsigned char *buffer, int *location=NULL );
+    bool resolveFile( const char *file_name, ResolvedFile *rf );
+    size_t readFile( const ResolvedFile &rf, unsigned char *buffer );
+    void invalidateDirectoryIndex();
+
+    void prefetch( const std::vector<std::string> &names );
+    void setPrefetchSize( size_t bytes );
+    PrefetchStats getPrefetchStats();
 
     static void convertCodingToEUC( char *buf );
     static void convertCodingToUTF8( char *dst_buf, const char *src_buf );
     static void convertFromUTF8ToCoding( char *dst_buf, const char *src_buf );
     
 protected:
-    char *file_full_path;
-    char *file_sub_path;
-    size_t file_path_len;
-    char *capital_name;
-    char *capital_name_tmp;
-
+    // All decoding state lives on the caller's stack, so one reader may
+    // serve getFile() from several threads at once.
     char *archive_path;
     unsigned char key_table[256];
     bool key_table_flag;
-    int  getbit_mask;
-    size_t getbit_len, getbit_count;
-    unsigned char *read_buf;
-    unsigned char *decomp_buffer;
-    size_t decomp_buffer_len;
+    std::mutex file_mutex; // guards fseek+fread where pread() is unavailable
+
+    // Listings of the directories below archive_path read so far, keyed by
+    // their relative path as spelled on disk; filled in lazily by fopen().
+    struct DirectoryEntries{
+        std::unordered_set<std::string> names;
+        std::unordered_map<std::string, std::string> folded_names; // lower case -> on disk
+    };
+    std::unordered_map<std::string, DirectoryEntries> directory_index;
+    std::mutex directory_index_mutex;
+
+    // Raw bytes of archived entries read by prefetch_thread, oldest first;
+    // readAt() serves from them and drops a range once read to its end.
+    // Entries read from a mapping are only madvise()d instead.
+    struct PrefetchRange{
+        FILE *fp;
+        size_t offset;
+        std::vector<unsigned char> data;
+        bool used;
+    };
+    std::list<PrefetchRange> prefetch_ranges;
+    std::atomic<size_t> num_prefetch_ranges;
+    std::deque<std::string> prefetch_queue;
+    PrefetchStats prefetch_stats;
+    std::mutex prefetch_mutex;
+    std::condition_variable prefetch_cond;
+    std::thread prefetch_thread;
+    bool prefetch_stop;
+
+    // MSB-first 64-bit bit reservoir refilled a READ_LENGTH block at a time
+    struct BitStream{
+        FILE *fp;
+        size_t offset;
+        uint64_t bits;
+        int num_bits;
+        bool eof;
+        size_t len, count;
+        unsigned char read_buf[4096];
+    };
     
     struct RegisteredCompressionType{
         RegisteredCompressionType *next;
@@ -90,7 +139,9 @@ protected:
         };
     } root_registered_compression_type, *last_registered_compression_type;
 
-    FILE *fopen(const char *path, const char *mode);
+    FILE *fopen(const char *path, const char *mode, std::string *full_path=NULL);
+    DirectoryEntries &getDirectoryEntries( const std::string &dir );
+    bool resolvePath( const char *path, std::string &resolved );
     unsigned char readChar( FILE *fp );
     unsigned short readShort( FILE *fp );
     unsigned long readLong( FILE *fp );
@@ -99,16 +150,34 @@ protected:
     void writeLong( FILE *fp, unsigned long ch );
     static unsigned short swapShort( unsigned short ch );
     static unsigned long swapLong( unsigned long ch );
+    size_t readAt( FILE *fp, size_t offset, unsigned char *buf, size_t length );
+    size_t readFromFile( FILE *fp, size_t offset, unsigned char *buf, size_t length );
     size_t decodeNBZ( FILE *fp, size_t offset, unsigned char *buf );
     size_t encodeNBZ( FILE *fp, size_t length, unsigned char *buf );
-    int getbit( FILE *fp, int n );
+    size_t encodeNBZ( std::vector<unsigned char> &dst, size_t length, const unsigned char *buf );
+    void initBitStream( BitStream *bs, FILE *fp, size_t offset );
+    void refillBitStream( BitStream *bs );
+    inline int getbit( BitStream *bs, int n );
     size_t decodeSPB( FILE *fp, size_t offset, unsigned char *buf );
     size_t decodeLZSS( struct ArchiveInfo *ai, int no, unsigned char *buf );
     int getRegisteredCompressionType( const char *file_name );
     size_t getDecompressedFileLength( int type, FILE *fp, size_t offset );
-    
+    void mapArchive( ArchiveInfo *ai );
+
+    // The thread calls resolveFile(), so the most derived reader has to
+    // stop it in its destructor and close() before tearing anything down.
+    void stopPrefetch();
+    // Where the stored bytes of an archived entry are; mapped is true if
+    // reading it copies from the mapping rather than calling readAt().
+    virtual bool getPrefetchRange( const ResolvedFile &rf, FILE **fp, size_t *offset, size_t *length, bool *mapped ){ return false; }
+
 private:
-    FILE *getFileHandle( const char *file_name, int &compression_type, size_t *length );
+    FILE *getFileHandle( const char *file_name, int &compression_type, size_t *length, std::string *full_path=NULL );
+    size_t readLooseFile( FILE *fp, int compression_type, size_t length, unsigned char *buffer );
+    void prefetchLoop();
+    void prefetchFile( const char *file_name );
+    size_t readPrefetched( FILE *fp, size_t offset, unsigned char *buf, size_t length );
+    void trimPrefetch( size_t budget );
 };
 
 #endif // __DIRECT_READER_H__
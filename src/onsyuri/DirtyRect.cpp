@@ -28,6 +28,7 @@ DirtyRect::DirtyRect()
 {
     screen_width = screen_height = 0;
     bounding_box.w = bounding_box.h = 0;
+    num_rects = 0;
 }
 
 DirtyRect::DirtyRect( const DirtyRect &d )
@@ -35,6 +36,8 @@ DirtyRect::DirtyRect( const DirtyRect &d )
     screen_width  = d.screen_width;
     screen_height = d.screen_height;
     bounding_box = d.bounding_box;
+    num_rects = d.num_rects;
+    for ( int i=0 ; i<num_rects ; i++ ) rects[i] = d.rects[i];
 }
 
 DirtyRect& DirtyRect::operator =( const DirtyRect &d )
@@ -42,6 +45,8 @@ DirtyRect& DirtyRect::operator =( const DirtyRect &d )
     screen_width  = d.screen_width;
     screen_height = d.screen_height;
     bounding_box = d.bounding_box;
+    num_rects = d.num_rects;
+    for ( int i=0 ; i<num_rects ; i++ ) rects[i] = d.rects[i];
 
     return *this;
 }
@@ -81,6 +86,37 @@ void DirtyRect::add( SDL_Rect src )
         src.h = screen_height-src.y;
 
     bounding_box = calcBoundingBox( bounding_box, src );
+    addRect( src );
+}
+
+void DirtyRect::addRect( SDL_Rect src )
+{
+    // merge the rects src overlaps or touches, and then those the merged
+    // rect does
+    for ( int i=0 ; i<num_rects ; ){
+        if ( src.x <= rects[i].x + rects[i].w && rects[i].x <= src.x + src.w &&
+             src.y <= rects[i].y + rects[i].h && rects[i].y <= src.y + src.h ){
+            src = calcBoundingBox( src, rects[i] );
+            rects[i] = rects[--num_rects];
+            i = 0;
+        }
+        else
+            i++;
+    }
+
+    if ( num_rects == MAX_DIRTY_RECTS ){
+        rects[0] = bounding_box;
+        num_rects = 1;
+        return;
+    }
+    rects[num_rects++] = src;
+
+    int area = 0;
+    for ( int i=0 ; i<num_rects ; i++ ) area += rects[i].w * rects[i].h;
+    if ( num_rects > 1 && area >= bounding_box.w * bounding_box.h / 4 * 3 ){
+        rects[0] = bounding_box;
+        num_rects = 1;
+    }
 }
 
 SDL_Rect DirtyRect::calcBoundingBox( SDL_Rect src1, SDL_Rect &src2 )
@@ -113,6 +149,7 @@ SDL_Rect DirtyRect::calcBoundingBox( SDL_Rect src1, SDL_Rect &src2 )
 void DirtyRect::clear()
 {
     bounding_box.w = bounding_box.h = 0;
+    num_rects = 0;
 }
 
 void DirtyRect::fill( int w, int h )
@@ -120,4 +157,6 @@ void DirtyRect::fill( int w, int h )
     bounding_box.x = bounding_box.y = 0;
     bounding_box.w = w;
     bounding_box.h = h;
+    rects[0] = bounding_box;
+    num_rects = 1;
 }
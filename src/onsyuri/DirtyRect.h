@@ -30,6 +30,10 @@
 #include <SDL2/SDL.h>
 #endif
 
+// Past this many disjoint rects, or when they cover most of their
+// bounding box, the region falls back to the bounding box.
+#define MAX_DIRTY_RECTS 8
+
 struct DirtyRect
 {
     DirtyRect();
@@ -46,6 +50,12 @@ struct DirtyRect
 
     int screen_width, screen_height;
     SDL_Rect bounding_box;
+    // disjoint, neither overlapping nor adjacent, within bounding_box
+    SDL_Rect rects[MAX_DIRTY_RECTS];
+    int num_rects;
+
+private:
+    void addRect( SDL_Rect src );
 };
 
 #endif // __DIRTY_RECT__
@@ -47,6 +47,7 @@ NsaReader::NsaReader( unsigned int nsa_offset, char *path, int archive_type, con
 
 NsaReader::~NsaReader()
 {
+    stopPrefetch();
 }
 
 int NsaReader::open( const char *nsa_path )
@@ -69,6 +70,8 @@ int NsaReader::open( const char *nsa_path )
             archive_info_ns2[i].file_name = new char[strlen(archive_name)+1];
             memcpy(archive_info_ns2[i].file_name, archive_name, strlen(archive_name)+1);
             readArchive( &archive_info_ns2[i], ARCHIVE_TYPE_NS2, nsa_offset );
+            addFileIndex( &archive_info_ns2[i] );
+            mapArchive( &archive_info_ns2[i] );
             num_of_ns2_archives = i+1;
         }
     }
@@ -93,6 +96,8 @@ int NsaReader::open( const char *nsa_path )
             ai->file_name = new char[strlen(archive_name)+1];
             memcpy(ai->file_name, archive_name, strlen(archive_name)+1);
             readArchive( ai, ARCHIVE_TYPE_NSA, nsa_offset );
+            addFileIndex( ai );
+            mapArchive( ai );
             num_of_nsa_archives = i+1;
         }
     }
@@ -111,6 +116,7 @@ int NsaReader::openForConvert( char *nsa_name, int archive_type, unsigned int ns
     }
 
     readArchive( &archive_info, archive_type, nsa_offset );
+    addFileIndex( &archive_info );
 
     return 0;
 }
@@ -127,6 +133,16 @@ size_t NsaReader::putFile( FILE *fp, int no, size_t offset, size_t length, size_
     return putFileSub( ai, fp, no, offset, length, original_length , compression_type, modified_flag, buffer );
 }
 
+void NsaReader::encodeFile( int no, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer, EncodedFile *ef )
+{
+    encodeFileSub( &archive_info, no, length, original_length, compression_type, modified_flag, buffer, ef );
+}
+
+size_t NsaReader::putEncodedFile( FILE *fp, int no, size_t offset, const EncodedFile &ef )
+{
+    return putEncodedFileSub( &archive_info, fp, no, offset, ef );
+}
+
 const char *NsaReader::getArchiveName() const
 {
     return "nsa";
@@ -141,75 +157,58 @@ int NsaReader::getNumFiles(){
     return total;
 }
 
-size_t NsaReader::getFileLengthSub( ArchiveInfo *ai, const char *file_name )
+int NsaReader::getLocation( ArchiveInfo *ai )
 {
-    unsigned int i = getIndexFromFile( ai, file_name );
-
-    if ( i == ai->num_of_files ) return 0;
-
-    if ( ai->fi_list[i].original_length != 0 )
-        return ai->fi_list[i].original_length;
-
-    int type = ai->fi_list[i].compression_type;
-    if ( type == NO_COMPRESSION )
-        type = getRegisteredCompressionType( file_name );
-    if ( type == NBZ_COMPRESSION || type == SPB_COMPRESSION ) {
-        ai->fi_list[i].original_length = getDecompressedFileLength( type, ai->file_handle, ai->fi_list[i].offset );
-    }
-    
-    return ai->fi_list[i].original_length;
+    if ( ai >= archive_info_ns2 && ai < archive_info_ns2 + MAX_NS2_ARCHIVE )
+        return ARCHIVE_TYPE_NS2;
+    return ARCHIVE_TYPE_NSA;
 }
 
-size_t NsaReader::getFileLength( const char *file_name )
+size_t NsaReader::getFile( const char *file_name, unsigned char *buffer, int *location )
 {
-    if ( sar_flag ) return SarReader::getFileLength( file_name );
-
     size_t ret;
-    int i;
-    
-    if ( ( ret = DirectReader::getFileLength( file_name ) ) ) return ret;
-    
-    for ( i=0 ; i<num_of_ns2_archives ; i++ ){
-        if ( (ret = getFileLengthSub( &archive_info_ns2[i], file_name )) ) return ret;
-    }
-    
-    if ( ( ret = getFileLengthSub( &archive_info, file_name )) ) return ret;
 
-    for ( i=0 ; i<num_of_nsa_archives ; i++ ){
-        if ( (ret = getFileLengthSub( &archive_info2[i], file_name )) ) return ret;
-    }
+    if ( sar_flag ) return SarReader::getFile( file_name, buffer, location );
 
-    return 0;
+    if ( ( ret = DirectReader::getFile( file_name, buffer, location ) ) ) return ret;
+
+    ArchiveInfo *ai;
+    unsigned int no;
+    if ( !findFileIndex( file_name, &ai, &no ) ) return 0;
+
+    if ( (ret = getFileSub( ai, no, buffer )) && location ) *location = getLocation( ai );
+
+    return ret;
 }
 
-size_t NsaReader::getFile( const char *file_name, unsigned char *buffer, int *location )
+const unsigned char *NsaReader::getFileView( const char *file_name, size_t *length, int *location )
 {
-    size_t ret;
+    if ( sar_flag ) return SarReader::getFileView( file_name, length, location );
 
-    if ( sar_flag ) return SarReader::getFile( file_name, buffer, location );
+    if ( DirectReader::getFileLength( file_name ) ) return NULL;
 
-    if ( ( ret = DirectReader::getFile( file_name, buffer, location ) ) ) return ret;
+    ArchiveInfo *ai;
+    unsigned int no;
+    if ( !findFileIndex( file_name, &ai, &no ) ) return NULL;
 
-    for ( int i=0 ; i<num_of_ns2_archives ; i++ ){
-        if ( (ret = getFileSub( &archive_info_ns2[i], file_name, buffer )) ){
-            if ( location ) *location = ARCHIVE_TYPE_NS2;
-            return ret;
-        }
-    }
+    const unsigned char *view = getFileViewSub( ai, no, length );
+    if ( view && location ) *location = getLocation( ai );
 
-    if ( (ret = getFileSub( &archive_info, file_name, buffer )) ){
-        if ( location ) *location = ARCHIVE_TYPE_NSA;
-        return ret;
-    }
+    return view;
+}
 
-    for ( int i=0 ; i<num_of_nsa_archives ; i++ ){
-        if ( (ret = getFileSub( &archive_info2[i], file_name, buffer )) ){
-            if ( location ) *location = ARCHIVE_TYPE_NSA;
-            return ret;
-        }
-    }
+bool NsaReader::resolveFile( const char *file_name, ResolvedFile *rf )
+{
+    if ( sar_flag ) return SarReader::resolveFile( file_name, rf );
 
-    return 0;
+    if ( DirectReader::resolveFile( file_name, rf ) ) return true;
+
+    ArchiveInfo *ai;
+    unsigned int no;
+    if ( !findFileIndex( file_name, &ai, &no ) ) return false;
+    resolveFileSub( ai, no, getLocation( ai ), rf );
+
+    return rf->length > 0;
 }
 
 NsaReader::FileInfo NsaReader::getFileByIndex( unsigned int index )
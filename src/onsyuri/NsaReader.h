@@ -38,13 +38,16 @@ public:
     const char *getArchiveName() const;
     int getNumFiles();
     
-    size_t getFileLength( const char *file_name );
     size_t getFile( const char *file_name, unsigned char *buf, int *location=NULL );
+    const unsigned char *getFileView( const char *file_name, size_t *length, int *location=NULL );
+    bool resolveFile( const char *file_name, ResolvedFile *rf );
     FileInfo getFileByIndex( unsigned int index );
 
     int openForConvert( char *nsa_name, int archive_type=ARCHIVE_TYPE_NSA, unsigned int nsa_offset=0 );
     int writeHeader( FILE *fp, int archive_type=ARCHIVE_TYPE_NSA, int nsa_offset=0 );
     size_t putFile( FILE *fp, int no, size_t offset, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer );
+    void encodeFile( int no, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer, EncodedFile *ef );
+    size_t putEncodedFile( FILE *fp, int no, size_t offset, const EncodedFile &ef );
     
 private:
     bool sar_flag;
@@ -57,7 +60,7 @@ private:
     ArchiveInfo archive_info2[MAX_EXTRA_ARCHIVE];
     ArchiveInfo archive_info_ns2[MAX_NS2_ARCHIVE];
 
-    size_t getFileLengthSub( ArchiveInfo *ai, const char *file_name );
+    int getLocation( ArchiveInfo *ai );
 };
 
 #endif // __NSA_READER_H__
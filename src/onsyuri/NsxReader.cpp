@@ -0,0 +1,583 @@
+/* -*- C++ -*-
+ *
+ *  NsxReader.cpp - Reader from a NSX archive
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "NsxReader.h"
+#include "lz4_codec.h"
+#include "Utils.h"
+#include <string.h>
+#define NSX_ARCHIVE_NAME "arc"
+#define NSX_ARCHIVE_NAME2 "arc%d"
+#define NSX_ARCHIVE_EXT "nsx"
+
+// BITMAPFILEHEADER + BITMAPV4HEADER, the smallest header with an alpha mask
+#define NSX_BMP_HEADER_SIZE (14+108)
+
+static inline unsigned int get16( const unsigned char *p )
+{
+    return p[0] | p[1] << 8;
+}
+
+static inline unsigned int get32( const unsigned char *p )
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+static inline size_t get64( const unsigned char *p )
+{
+    return (size_t)((unsigned long long)get32( p+4 ) << 32 | get32( p ));
+}
+
+static inline void put16( unsigned char *p, unsigned int v )
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static inline void put32( unsigned char *p, unsigned int v )
+{
+    put16( p, v & 0xffff );
+    put16( p+2, v >> 16 );
+}
+
+static inline void put64( unsigned char *p, unsigned long long v )
+{
+    put32( p, (unsigned int)(v & 0xffffffff) );
+    put32( p+4, (unsigned int)(v >> 32) );
+}
+
+// Top-down 32-bit BMP with bit fields, so that generic image loaders
+// read a surface entry like any other image.
+static bool putBMPHeader( unsigned char *buf, int width, int height, unsigned int format )
+{
+    unsigned int r_mask, b_mask;
+    if ( format == NSX_FORMAT_ARGB8888 ){
+        r_mask = 0x00ff0000;
+        b_mask = 0x000000ff;
+    }
+    else if ( format == NSX_FORMAT_ABGR8888 ){
+        r_mask = 0x000000ff;
+        b_mask = 0x00ff0000;
+    }
+    else return false;
+
+    size_t image_size = (size_t)width * height * 4;
+    memset( buf, 0, NSX_BMP_HEADER_SIZE );
+    buf[0] = 'B'; buf[1] = 'M';
+    put32( buf+2, (unsigned int)(NSX_BMP_HEADER_SIZE + image_size) );
+    put32( buf+10, NSX_BMP_HEADER_SIZE );
+    put32( buf+14, 108 );
+    put32( buf+18, width );
+    put32( buf+22, (unsigned int)-height ); // top-down
+    put16( buf+26, 1 );
+    put16( buf+28, 32 );
+    put32( buf+30, 3 ); // BI_BITFIELDS
+    put32( buf+34, (unsigned int)image_size );
+    put32( buf+38, 2835 ); // 72 dpi
+    put32( buf+42, 2835 );
+    put32( buf+54, r_mask );
+    put32( buf+58, 0x0000ff00 );
+    put32( buf+62, b_mask );
+    put32( buf+66, 0xff000000 );
+    put32( buf+70, 0x73524742 ); // LCS_sRGB
+
+    return true;
+}
+
+NsxReader::NsxReader( unsigned int nsa_offset, char *path, int archive_type, const unsigned char *key_table )
+        :NsaReader( nsa_offset, path, archive_type, key_table )
+{
+    num_of_nsx_archives = 0;
+}
+
+NsxReader::~NsxReader()
+{
+    stopPrefetch();
+}
+
+int NsxReader::open( const char *nsa_path )
+{
+    char archive_name[256], archive_name2[250];
+
+    for ( int i=0 ; i<MAX_NSX_ARCHIVE ; i++ ){
+        if ( i == 0 ){
+            sprintf( archive_name, "%s%s.%s", nsa_path?nsa_path:"", NSX_ARCHIVE_NAME, NSX_ARCHIVE_EXT );
+        }
+        else{
+            sprintf( archive_name2, NSX_ARCHIVE_NAME2, i );
+            sprintf( archive_name, "%s%s.%s", nsa_path?nsa_path:"", archive_name2, NSX_ARCHIVE_EXT );
+        }
+
+        NsxArchive *na = &nsx_archive[num_of_nsx_archives];
+        if ( ( na->ai.file_handle = fopen( archive_name, "rb" ) ) == NULL ) break;
+
+        na->ai.file_name = new char[strlen(archive_name)+1];
+        memcpy( na->ai.file_name, archive_name, strlen(archive_name)+1 );
+        if ( !readIndex( na ) ){
+            utils::printError( "NsxReader::open  %s is not a valid nsx archive, ignored.\n", archive_name );
+            closeArchive( na );
+            break;
+        }
+        num_of_nsx_archives++;
+    }
+
+    int ret = NsaReader::open( nsa_path );
+    if ( num_of_nsx_archives > 0 ) return 0;
+
+    return ret;
+}
+
+int NsxReader::close()
+{
+    stopPrefetch();
+    for ( int i=0 ; i<num_of_nsx_archives ; i++ )
+        closeArchive( &nsx_archive[i] );
+    num_of_nsx_archives = 0;
+
+    return NsaReader::close();
+}
+
+const char *NsxReader::getArchiveName() const
+{
+    return "nsx";
+}
+
+bool NsxReader::readIndex( NsxArchive *na )
+{
+    unsigned char header[NSX_HEADER_SIZE];
+    if ( readAt( na->ai.file_handle, 0, header, NSX_HEADER_SIZE ) != NSX_HEADER_SIZE ) return false;
+    if ( memcmp( header, NSX_MAGIC, 4 ) != 0 || get32( header+4 ) != NSX_VERSION ) return false;
+
+    na->num_entries = get32( header+12 );
+    na->num_buckets = get32( header+16 );
+    na->names_size  = get32( header+20 );
+    size_t index_offset = get64( header+24 );
+    if ( na->num_buckets == 0 || (na->num_buckets & (na->num_buckets-1)) ||
+         na->num_buckets <= na->num_entries ) return false;
+
+    size_t index_length = (size_t)na->num_buckets*4 + (size_t)na->num_entries*NSX_ENTRY_SIZE + na->names_size;
+    const unsigned char *index;
+
+    mapArchive( &na->ai );
+    if ( na->ai.mapped_buffer ){
+        if ( index_offset > na->ai.mapped_length ||
+             index_length > na->ai.mapped_length - index_offset ) return false;
+        index = na->ai.mapped_buffer + index_offset;
+    }
+    else{
+        na->index_buffer = new unsigned char[index_length];
+        if ( readAt( na->ai.file_handle, index_offset, na->index_buffer, index_length ) != index_length ) return false;
+        index = na->index_buffer;
+    }
+
+    na->buckets = index;
+    na->entries = na->buckets + (size_t)na->num_buckets*4;
+    na->names   = na->entries + (size_t)na->num_entries*NSX_ENTRY_SIZE;
+    na->ai.num_of_files = na->num_entries;
+
+    for ( unsigned int i=0 ; i<na->num_entries ; i++ ){
+        const unsigned char *e = na->entries + (size_t)i*NSX_ENTRY_SIZE;
+        if ( (size_t)get32( e+4 ) + get16( e+34 ) > na->names_size ) return false;
+    }
+
+    return true;
+}
+
+void NsxReader::closeArchive( NsxArchive *na )
+{
+#if defined(USE_MMAP_ARCHIVE)
+    if ( na->ai.mapped_buffer ) munmap( na->ai.mapped_buffer, na->ai.mapped_length );
+#endif
+    na->ai.mapped_buffer = NULL;
+    na->ai.mapped_length = 0;
+    if ( na->ai.file_handle ) fclose( na->ai.file_handle );
+    na->ai.file_handle = NULL;
+    if ( na->ai.file_name ) delete[] na->ai.file_name;
+    na->ai.file_name = NULL;
+    na->ai.num_of_files = 0;
+
+    if ( na->index_buffer ) delete[] na->index_buffer;
+    na->index_buffer = NULL;
+    na->buckets = na->entries = na->names = NULL;
+    na->num_buckets = na->num_entries = na->names_size = 0;
+}
+
+bool NsxReader::findEntry( const char *file_name, NsxArchive **na, unsigned int *no )
+{
+    if ( num_of_nsx_archives == 0 ) return false;
+
+    char name[MAX_FILE_NAME_LENGTH+1];
+    capitalizeFileName( name, file_name );
+    size_t len = strlen( name );
+    unsigned int hash = hashFileName( name );
+
+    for ( int i=0 ; i<num_of_nsx_archives ; i++ ){
+        NsxArchive *a = &nsx_archive[i];
+        unsigned int mask = a->num_buckets-1, pos = hash & mask;
+        for ( unsigned int n=0 ; n<a->num_buckets ; n++, pos = (pos+1) & mask ){
+            unsigned int b = get32( a->buckets + (size_t)pos*4 );
+            if ( b == 0 || b > a->num_entries ) break;
+
+            const unsigned char *e = a->entries + (size_t)(b-1)*NSX_ENTRY_SIZE;
+            if ( get32( e ) == hash && get16( e+34 ) == len &&
+                 memcmp( a->names + get32( e+4 ), name, len ) == 0 ){
+                *na = a;
+                *no = b-1;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void NsxReader::resolveEntry( NsxArchive *na, unsigned int no, ResolvedFile *rf )
+{
+    const unsigned char *e = na->entries + (size_t)no*NSX_ENTRY_SIZE;
+    unsigned int kind = get16( e+32 );
+
+    rf->location = ARCHIVE_TYPE_NSX;
+    if ( kind & NSX_KIND_SURFACE )
+        rf->compression_type = SURFACE_COMPRESSION;
+    else if ( kind & NSX_KIND_LZ4 )
+        rf->compression_type = LZ4_COMPRESSION;
+    else
+        rf->compression_type = NO_COMPRESSION;
+    rf->offset = get64( e+8 );
+    rf->length = get64( e+24 );
+    if ( kind & NSX_KIND_SURFACE ) rf->length += NSX_BMP_HEADER_SIZE;
+    rf->ai = &na->ai;
+    rf->no = no;
+    rf->path.clear();
+}
+
+const unsigned char *NsxReader::getEntry( const ResolvedFile &rf )
+{
+    for ( int i=0 ; i<num_of_nsx_archives ; i++ )
+        if ( rf.ai == &nsx_archive[i].ai && rf.no < nsx_archive[i].num_entries )
+            return nsx_archive[i].entries + (size_t)rf.no*NSX_ENTRY_SIZE;
+
+    return NULL;
+}
+
+size_t NsxReader::readPayload( const ResolvedFile &rf, unsigned char *buf, size_t capacity )
+{
+    const unsigned char *e = getEntry( rf );
+    if ( e == NULL ) return 0;
+
+    unsigned int kind = get16( e+32 );
+    size_t offset = get64( e+8 );
+    size_t stored_length = get64( e+16 );
+    size_t length = get64( e+24 );
+    if ( length > capacity || stored_length == 0 ) return 0;
+
+    const unsigned char *src;
+    std::vector<unsigned char> tmp;
+    if ( rf.ai->mapped_buffer ){
+        if ( offset > rf.ai->mapped_length || stored_length > rf.ai->mapped_length - offset ) return 0;
+        src = rf.ai->mapped_buffer + offset;
+    }
+    else if ( kind & NSX_KIND_LZ4 ){
+        tmp.resize( stored_length );
+        if ( readAt( rf.ai->file_handle, offset, &tmp[0], stored_length ) != stored_length ) return 0;
+        src = &tmp[0];
+    }
+    else{
+        if ( stored_length != length ) return 0;
+        return readAt( rf.ai->file_handle, offset, buf, length ) == length ? length : 0;
+    }
+
+    if ( kind & NSX_KIND_LZ4 )
+        return lz4Decompress( src, stored_length, buf, length ) == length ? length : 0;
+
+    if ( stored_length != length ) return 0;
+    memcpy( buf, src, length );
+
+    return length;
+}
+
+bool NsxReader::getPrefetchRange( const ResolvedFile &rf, FILE **fp, size_t *offset, size_t *length, bool *mapped )
+{
+    if ( rf.location != ARCHIVE_TYPE_NSX ) return NsaReader::getPrefetchRange( rf, fp, offset, length, mapped );
+
+    const unsigned char *e = getEntry( rf );
+    if ( e == NULL ) return false;
+
+    *fp = rf.ai->file_handle;
+    *offset = get64( e+8 );
+    *length = get64( e+16 );
+    *mapped = rf.ai->mapped_buffer != NULL; // readPayload() copies every kind from it
+
+    return true;
+}
+
+bool NsxReader::resolveFile( const char *file_name, ResolvedFile *rf )
+{
+    if ( DirectReader::resolveFile( file_name, rf ) ) return true;
+
+    NsxArchive *na;
+    unsigned int no;
+    if ( findEntry( file_name, &na, &no ) ){
+        resolveEntry( na, no, rf );
+        return rf->length > 0;
+    }
+
+    return NsaReader::resolveFile( file_name, rf );
+}
+
+size_t NsxReader::readFile( const ResolvedFile &rf, unsigned char *buffer )
+{
+    if ( rf.location != ARCHIVE_TYPE_NSX ) return NsaReader::readFile( rf, buffer );
+
+    if ( rf.compression_type == SURFACE_COMPRESSION ){
+        SurfaceInfo si;
+        if ( !getSurfaceInfo( rf, &si ) ||
+             !putBMPHeader( buffer, si.width, si.height, si.format ) ) return 0;
+        if ( readPayload( rf, buffer + NSX_BMP_HEADER_SIZE, rf.length - NSX_BMP_HEADER_SIZE ) == 0 ) return 0;
+        return rf.length;
+    }
+
+    return readPayload( rf, buffer, rf.length );
+}
+
+const unsigned char *NsxReader::viewFile( const ResolvedFile &rf, size_t *length )
+{
+    if ( rf.location != ARCHIVE_TYPE_NSX ) return NsaReader::viewFile( rf, length );
+
+    const unsigned char *e = getEntry( rf );
+    if ( e == NULL || rf.ai->mapped_buffer == NULL || get16( e+32 ) != 0 ) return NULL;
+
+    size_t offset = get64( e+8 ), stored_length = get64( e+16 );
+    if ( stored_length == 0 || offset > rf.ai->mapped_length ||
+         stored_length > rf.ai->mapped_length - offset ) return NULL;
+
+    *length = stored_length;
+    return rf.ai->mapped_buffer + offset;
+}
+
+bool NsxReader::getSurfaceInfo( const ResolvedFile &rf, SurfaceInfo *si )
+{
+    if ( rf.location != ARCHIVE_TYPE_NSX || rf.compression_type != SURFACE_COMPRESSION ) return false;
+
+    const unsigned char *e = getEntry( rf );
+    if ( e == NULL ) return false;
+
+    si->width  = get16( e+36 );
+    si->height = get16( e+38 );
+    si->format = get32( e+40 );
+    si->has_alpha = (get32( e+44 ) & 1) != 0;
+
+    return get64( e+24 ) == (size_t)si->width * si->height * 4;
+}
+
+bool NsxReader::readSurface( const ResolvedFile &rf, unsigned char *pixels, int pitch )
+{
+    SurfaceInfo si;
+    if ( !getSurfaceInfo( rf, &si ) ) return false;
+
+    size_t row = (size_t)si.width * 4, length = row * si.height;
+    if ( pitch == (int)row ) return readPayload( rf, pixels, length ) == length;
+
+    std::vector<unsigned char> tmp( length );
+    if ( length == 0 || readPayload( rf, &tmp[0], length ) != length ) return false;
+    for ( int i=0 ; i<si.height ; i++ )
+        memcpy( pixels + (size_t)pitch*i, &tmp[row*i], row );
+
+    return true;
+}
+
+size_t NsxReader::getFileLength( const char *file_name )
+{
+    ResolvedFile rf;
+    if ( !resolveFile( file_name, &rf ) ) return 0;
+
+    return rf.length;
+}
+
+size_t NsxReader::getFile( const char *file_name, unsigned char *buffer, int *location )
+{
+    ResolvedFile rf;
+    if ( !resolveFile( file_name, &rf ) ) return 0;
+
+    size_t ret = readFile( rf, buffer );
+    if ( ret && location ) *location = rf.location;
+
+    return ret;
+}
+
+const unsigned char *NsxReader::getFileView( const char *file_name, size_t *length, int *location )
+{
+    ResolvedFile rf;
+    if ( !resolveFile( file_name, &rf ) ) return NULL;
+
+    const unsigned char *view = viewFile( rf, length );
+    if ( view && location ) *location = rf.location;
+
+    return view;
+}
+
+NsxWriter::NsxWriter()
+{
+    fp = NULL;
+    offset = 0;
+}
+
+NsxWriter::~NsxWriter()
+{
+    if ( fp ) fclose( fp );
+}
+
+int NsxWriter::open( const char *file_name )
+{
+    if ( ( fp = ::fopen( file_name, "wb" ) ) == NULL ){
+        utils::printError( "can't open file %s\n", file_name );
+        return -1;
+    }
+    entries.clear();
+    names.clear();
+
+    // the header is filled in by close()
+    unsigned char pad[NSX_ALIGNMENT];
+    memset( pad, 0, NSX_ALIGNMENT );
+    if ( fwrite( pad, 1, NSX_ALIGNMENT, fp ) != NSX_ALIGNMENT ) return -1;
+    offset = NSX_ALIGNMENT;
+
+    return 0;
+}
+
+void NsxWriter::encodeEntry( const unsigned char *buf, size_t length, bool compress, EncodedEntry *ee )
+{
+    ee->kind = 0;
+    ee->length = length;
+    ee->width = ee->height = 0;
+    ee->format = 0;
+    ee->has_alpha = false;
+
+    if ( compress && length > 0 ){
+        ee->data.resize( lz4CompressBound( length ) );
+        size_t n = lz4Compress( buf, length, &ee->data[0], ee->data.size() );
+        if ( n > 0 && n < length - length/16 ){
+            ee->kind = NSX_KIND_LZ4;
+            ee->data.resize( n );
+            return;
+        }
+    }
+    ee->data.assign( buf, buf + length );
+}
+
+void NsxWriter::encodeSurface( const unsigned char *pixels, int width, int height, int pitch,
+                               unsigned int format, bool has_alpha, bool compress, EncodedEntry *ee )
+{
+    size_t row = (size_t)width * 4;
+    std::vector<unsigned char> packed( row * height );
+    for ( int i=0 ; i<height ; i++ )
+        memcpy( &packed[row*i], pixels + (size_t)pitch*i, row );
+
+    encodeEntry( packed.empty() ? NULL : &packed[0], packed.size(), compress, ee );
+    ee->kind |= NSX_KIND_SURFACE;
+    ee->width = width;
+    ee->height = height;
+    ee->format = format;
+    ee->has_alpha = has_alpha;
+}
+
+bool NsxWriter::putEntry( const char *file_name, const EncodedEntry &ee )
+{
+    if ( fp == NULL ) return false;
+    if ( (ee.kind & NSX_KIND_SURFACE) && (ee.width > 0xffff || ee.height > 0xffff) ) return false;
+
+    char name[MAX_FILE_NAME_LENGTH+1];
+    NsxReader::capitalizeFileName( name, file_name );
+    if ( !names.insert( name ).second ) return false;
+
+    Entry e;
+    e.hash = NsxReader::hashFileName( name );
+    e.name = name;
+    e.offset = offset;
+    e.stored_length = ee.data.size();
+    e.length = ee.length;
+    e.kind = ee.kind;
+    e.width = ee.width;
+    e.height = ee.height;
+    e.format = ee.format;
+    e.has_alpha = ee.has_alpha;
+    entries.push_back( e );
+
+    size_t pad = (NSX_ALIGNMENT - ee.data.size() % NSX_ALIGNMENT) % NSX_ALIGNMENT;
+    if ( !ee.data.empty() ) fwrite( &ee.data[0], 1, ee.data.size(), fp );
+    for ( size_t i=0 ; i<pad ; i++ ) fputc( 0, fp );
+    offset += ee.data.size() + pad;
+
+    return true;
+}
+
+int NsxWriter::close()
+{
+    if ( fp == NULL ) return -1;
+
+    unsigned int num_buckets = 2;
+    while ( num_buckets < entries.size()*2 ) num_buckets <<= 1;
+
+    std::string name_blob;
+    std::vector<unsigned char> buckets( (size_t)num_buckets*4, 0 );
+    std::vector<unsigned char> records( entries.size()*NSX_ENTRY_SIZE, 0 );
+    for ( size_t i=0 ; i<entries.size() ; i++ ){
+        const Entry &e = entries[i];
+        unsigned char *r = &records[i*NSX_ENTRY_SIZE];
+        put32( r, e.hash );
+        put32( r+4, (unsigned int)name_blob.size() );
+        put64( r+8, e.offset );
+        put64( r+16, e.stored_length );
+        put64( r+24, e.length );
+        put16( r+32, e.kind );
+        put16( r+34, (unsigned int)e.name.size() );
+        put16( r+36, e.width );
+        put16( r+38, e.height );
+        put32( r+40, e.format );
+        put32( r+44, e.has_alpha ? 1 : 0 );
+        name_blob += e.name;
+
+        unsigned int pos = e.hash & (num_buckets-1);
+        while ( get32( &buckets[(size_t)pos*4] ) ) pos = (pos+1) & (num_buckets-1);
+        put32( &buckets[(size_t)pos*4], (unsigned int)(i+1) );
+    }
+
+    fwrite( &buckets[0], 1, buckets.size(), fp );
+    if ( !records.empty() ) fwrite( &records[0], 1, records.size(), fp );
+    if ( !name_blob.empty() ) fwrite( name_blob.data(), 1, name_blob.size(), fp );
+
+    unsigned char header[NSX_HEADER_SIZE];
+    memset( header, 0, NSX_HEADER_SIZE );
+    memcpy( header, NSX_MAGIC, 4 );
+    put32( header+4, NSX_VERSION );
+    put32( header+8, NSX_ALIGNMENT );
+    put32( header+12, (unsigned int)entries.size() );
+    put32( header+16, num_buckets );
+    put32( header+20, (unsigned int)name_blob.size() );
+    put64( header+24, offset );
+    fseek( fp, 0, SEEK_SET );
+    fwrite( header, 1, NSX_HEADER_SIZE, fp );
+
+    int ret = ferror( fp ) ? -1 : 0;
+    if ( fclose( fp ) != 0 ) ret = -1;
+    fp = NULL;
+
+    return ret;
+}
@@ -0,0 +1,163 @@
+/* -*- C++ -*-
+ *
+ *  NsxReader.h - Reader from a NSX archive
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __NSX_READER_H__
+#define __NSX_READER_H__
+
+#include "NsaReader.h"
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+#define MAX_NSX_ARCHIVE 10 // arc.nsx, arc1.nsx ... arc9.nsx
+
+/* NSX layout, all integers little endian:
+ *
+ *   header   magic, version, alignment, number of entries, number of
+ *            buckets, size of names (u32 each), offset of the index (u64),
+ *            zero-padded to NSX_HEADER_SIZE
+ *   data     one payload per entry, each starting on an NSX_ALIGNMENT boundary
+ *   index    hash buckets (u32), entry records and names, read in one go
+ *
+ * An entry record holds hash, name offset (u32), payload offset, stored
+ * length, decompressed length (u64), kind, name length, width, height
+ * (u16), SDL pixel format and flags (u32, 1 = has alpha).  A bucket holds
+ * 1 + the number of an entry record, 0 if empty; names are hashed
+ * capitalized with '\\' delimiters (SarReader::hashFileName) and
+ * collisions are resolved by linear probing. */
+#define NSX_MAGIC "NSX\032"
+#define NSX_VERSION 1
+#define NSX_ALIGNMENT 4096
+#define NSX_HEADER_SIZE 64
+#define NSX_ENTRY_SIZE 48
+
+// entry kinds
+#define NSX_KIND_LZ4     1 // payload is an LZ4 block
+#define NSX_KIND_SURFACE 2 // payload is width*height 32-bit pixels
+
+// the surface formats that getFile() can present as a BMP
+#define NSX_FORMAT_ARGB8888 0x16362004 // SDL_PIXELFORMAT_ARGB8888
+#define NSX_FORMAT_ABGR8888 0x16762004 // SDL_PIXELFORMAT_ABGR8888
+
+class NsxReader : public NsaReader
+{
+public:
+    NsxReader( unsigned int nsa_offset=0, char *path=NULL, int archive_type=ARCHIVE_TYPE_NSA, const unsigned char *key_table=NULL );
+    ~NsxReader();
+
+    // Opens the .nsx archives and then whatever NsaReader finds; succeeds
+    // if either does.  A name is searched for as a loose file first, then
+    // in the .nsx archives and last in the NSA/NS2 archives.
+    int open( const char *nsa_path=NULL );
+    int close();
+    const char *getArchiveName() const;
+
+    size_t getFileLength( const char *file_name );
+    size_t getFile( const char *file_name, unsigned char *buf, int *location=NULL );
+    const unsigned char *getFileView( const char *file_name, size_t *length, int *location=NULL );
+    bool resolveFile( const char *file_name, ResolvedFile *rf );
+    size_t readFile( const ResolvedFile &rf, unsigned char *buffer );
+    const unsigned char *viewFile( const ResolvedFile &rf, size_t *length );
+    bool getSurfaceInfo( const ResolvedFile &rf, SurfaceInfo *si );
+    bool readSurface( const ResolvedFile &rf, unsigned char *pixels, int pitch );
+
+protected:
+    bool getPrefetchRange( const ResolvedFile &rf, FILE **fp, size_t *offset, size_t *length, bool *mapped );
+
+private:
+    struct NsxArchive{
+        ArchiveInfo ai;
+        unsigned char *index_buffer; // NULL if the index is read from the mapping
+        const unsigned char *buckets;
+        const unsigned char *entries;
+        const unsigned char *names;
+        unsigned int num_buckets; // power of two
+        unsigned int num_entries;
+        unsigned int names_size;
+
+        NsxArchive(){
+            index_buffer = NULL;
+            buckets = entries = names = NULL;
+            num_buckets = num_entries = names_size = 0;
+        }
+        ~NsxArchive(){
+            if (index_buffer) delete[] index_buffer;
+        }
+    } nsx_archive[MAX_NSX_ARCHIVE];
+    int num_of_nsx_archives;
+
+    friend class NsxWriter; // shares the name hashing
+
+    bool readIndex( NsxArchive *na );
+    void closeArchive( NsxArchive *na );
+    bool findEntry( const char *file_name, NsxArchive **na, unsigned int *no );
+    void resolveEntry( NsxArchive *na, unsigned int no, ResolvedFile *rf );
+    const unsigned char *getEntry( const ResolvedFile &rf );
+    size_t readPayload( const ResolvedFile &rf, unsigned char *buf, size_t capacity );
+};
+
+// Writes a NSX archive entry by entry; encodeEntry() and encodeSurface()
+// keep no state so that converters may run them on several threads.
+class NsxWriter
+{
+public:
+    struct EncodedEntry{
+        int kind;
+        size_t length;           // of the payload once decompressed
+        int width, height;       // NSX_KIND_SURFACE only
+        unsigned int format;
+        bool has_alpha;
+        std::vector<unsigned char> data;
+    };
+
+    NsxWriter();
+    ~NsxWriter();
+
+    int open( const char *file_name );
+    int close();
+
+    // Entries are LZ4 compressed when asked to and when that saves more
+    // than 1/16 of their size.
+    static void encodeEntry( const unsigned char *buf, size_t length, bool compress, EncodedEntry *ee );
+    static void encodeSurface( const unsigned char *pixels, int width, int height, int pitch,
+                               unsigned int format, bool has_alpha, bool compress, EncodedEntry *ee );
+
+    // The first of several entries of the same name is kept.
+    bool putEntry( const char *file_name, const EncodedEntry &ee );
+
+private:
+    struct Entry{
+        unsigned int hash;
+        std::string name;
+        size_t offset;
+        size_t stored_length;
+        size_t length;
+        int kind, width, height;
+        unsigned int format;
+        bool has_alpha;
+    };
+    FILE *fp;
+    size_t offset;
+    std::vector<Entry> entries;
+    std::unordered_set<std::string> names;
+};
+
+#endif // __NSX_READER_H__
@@ -525,6 +525,7 @@ ONScripter::ONScripter()
     getret_str = NULL;
     enable_wheeldown_advance_flag = false;
     disable_rescale_flag = false;
+    premultiplied_alpha_flag = false;
     edit_flag = false;
     key_exe_file = NULL;
     fullscreen_mode = false;
@@ -537,6 +538,17 @@ ONScripter::ONScripter()
     current_button_state.down_flag = false;
     vsync = true;
     video = true;
+    asset_prefetcher.setDecoder( decodePrefetched, this );
+    lookahead_lines = DEFAULT_LOOKAHEAD_LINES;
+    lookahead_label = NULL;
+    lookahead_line = 0;
+    composite_stats.frames = composite_stats.pixels = 0;
+    composite_stats.sprites_visited = composite_stats.sprites_drawn = 0;
+    composite_stats.layer_cache_hits = composite_stats.layer_cache_misses = 0;
+    composite_stats.pixels_skipped = 0;
+    layer_cache_surface = NULL;
+    layer_cache_rect.x = layer_cache_rect.y = layer_cache_rect.w = layer_cache_rect.h = 0;
+    live_sprites_generation = 0;
 
     int i;
     for (i=0 ; i<MAX_SPRITE2_NUM ; i++)
@@ -554,6 +566,8 @@ ONScripter::ONScripter()
 
 ONScripter::~ONScripter()
 {
+    asset_prefetcher.stop(); // the workers decode with image_surface
+
     delete[] wm_title_string;
     delete[] wm_icon_string;
     wm_title_string = nullptr;
@@ -644,6 +658,31 @@ void ONScripter::setVideoOff() {
     video = false;
 }
 
+void ONScripter::setDecodeCacheSize(int mb)
+{
+    decode_cache_size = mb > 0 ? (size_t)mb*1024*1024 : 0;
+}
+
+void ONScripter::setPrefetchSize(int mb)
+{
+    prefetch_size = mb > 0 ? (size_t)mb*1024*1024 : 0;
+}
+
+void ONScripter::setImageCacheSize(int mb)
+{
+    image_cache.setSize( mb > 0 ? (size_t)mb*1024*1024 : 0 );
+}
+
+void ONScripter::setLookahead(int lines)
+{
+    lookahead_lines = lines > 0 ? lines : 0;
+}
+
+void ONScripter::setCompositorThreads(int num)
+{
+    band_compositor.setThreads( num > 0 ? num : 0 );
+}
+
 void ONScripter::setFontCache()
 {
     cacheFont = true;
@@ -664,6 +703,11 @@ void ONScripter::disableRescale()
     disable_rescale_flag = true;
 }
 
+void ONScripter::enablePremultipliedAlpha()
+{
+    premultiplied_alpha_flag = true;
+}
+
 void ONScripter::renderFontOutline()
 {
     render_font_outline = true;
@@ -705,6 +749,7 @@ int ONScripter::init()
     image_surface        = AnimationInfo::alloc32bitSurface( 1, 1, texture_format );
     accumulation_surface = AnimationInfo::allocSurface( screen_width, screen_height, texture_format );
     backup_surface       = AnimationInfo::allocSurface( screen_width, screen_height, texture_format );
+    layer_cache_surface  = AnimationInfo::allocSurface( screen_width, screen_height, texture_format );
     effect_src_surface   = AnimationInfo::allocSurface( screen_width, screen_height, texture_format );
     effect_dst_surface   = AnimationInfo::allocSurface( screen_width, screen_height, texture_format );
     effect_tmp_surface = AnimationInfo::allocSurface(screen_width, screen_height, texture_format);
@@ -724,6 +769,7 @@ int ONScripter::init()
 
     text_info.num_of_cells = 1;
     text_info.allocImage( screen_width, screen_height, texture_format );
+    text_info.premultiplied = premultiplied_alpha_flag;
     text_info.fill(0, 0, 0, 0);
 
     // ----------------------------------------
@@ -1019,8 +1065,8 @@ void ONScripter::flush( int refresh_mode, SDL_Rect *rect, bool clear_dirty_flag,
     else{
         if ( rect ) dirty_rect.add( *rect );
 
-        if (dirty_rect.bounding_box.w * dirty_rect.bounding_box.h > 0)
-            flushDirect( dirty_rect.bounding_box, refresh_mode );
+        if (dirty_rect.num_rects > 0)
+            flushDirect( dirty_rect, refresh_mode );
     }
 
     if ( clear_dirty_flag ) dirty_rect.clear();
@@ -1028,13 +1074,28 @@ void ONScripter::flush( int refresh_mode, SDL_Rect *rect, bool clear_dirty_flag,
 
 void ONScripter::flushDirect( SDL_Rect &rect, int refresh_mode )
 {
-    // printf("## flushDirect mode%d, %d %d %d %d\n", refresh_mode, rect.x, rect.y, rect.w, rect.h );
+    if (updateTexture( rect, refresh_mode )) presentTexture();
+}
+
+// each rect of dirty recomposited and uploaded, then a single present
+void ONScripter::flushDirect( DirtyRect &dirty, int refresh_mode )
+{
+    bool updated = false;
+    for (int i = 0; i < dirty.num_rects; i++)
+        if (updateTexture( dirty.rects[i], refresh_mode )) updated = true;
+    if (updated) presentTexture();
+}
+
+bool ONScripter::updateTexture( SDL_Rect &rect, int refresh_mode )
+{
+    // printf("## updateTexture mode%d, %d %d %d %d\n", refresh_mode, rect.x, rect.y, rect.w, rect.h );
 
     SDL_Rect dst_rect = rect;
 
     --dst_rect.x; --dst_rect.y; dst_rect.w += 2; dst_rect.h += 2;
-    if (AnimationInfo::doClipping(&dst_rect, &screen_rect) || (dst_rect.w == 2 && dst_rect.h == 2)) return;
+    if (AnimationInfo::doClipping(&dst_rect, &screen_rect) || (dst_rect.w == 2 && dst_rect.h == 2)) return false;
     refreshSurface(accumulation_surface, &rect, refresh_mode);
+    composite_stats.pixels += (size_t)rect.w * rect.h;
     SDL_LockSurface(accumulation_surface);
     int offset = accumulation_surface->pitch * rect.y + rect.x * sizeof(ONSBuf);
     if (offset >= 0) // need to check for update texture
@@ -1045,14 +1106,16 @@ void ONScripter::flushDirect( SDL_Rect &rect, int refresh_mode )
     }
     SDL_UnlockSurface(accumulation_surface);
 
+    return true;
+}
+
+void ONScripter::presentTexture()
+{
     screen_dirty_flag = false;
+    composite_stats.frames++;
 #if defined(ANDROID) || defined(WEB) // See sdl2 DOCS/README-android.md for more information on this
     SDL_RenderClear(renderer);
-    SDL_Rect *rect_ptr = nullptr;
-#else
-    SDL_Rect *rect_ptr = &dst_rect;
 #endif
-    (void)rect_ptr;
 
 #if defined(USE_GLES)
     if (isnan(sharpness)) {
@@ -1261,6 +1324,7 @@ void ONScripter::executeLabel()
         }
 
         if ( kidokuskip_flag && skip_mode & SKIP_NORMAL && kidokumode_flag && !script_h.isKidoku() ) skip_mode &= ~SKIP_NORMAL;
+        if ( lookahead_lines > 0 && current_mode == NORMAL_MODE ) prefetchAhead();
 
         int ret = parseLine();
         if ( ret & (RET_SKIP_LINE | RET_EOL) ){
@@ -1284,6 +1348,24 @@ void ONScripter::executeLabel()
     endCommand();
 }
 
+// Rescans after a jump or a quarter of the window.
+void ONScripter::prefetchAhead()
+{
+    if ( current_label_info.start_address == lookahead_label &&
+         current_line >= lookahead_line &&
+         current_line < lookahead_line + (lookahead_lines+3)/4 ) return;
+    lookahead_label = current_label_info.start_address;
+    lookahead_line = current_line;
+
+    std::vector<std::string> images, sounds;
+    script_h.scanAssets( script_h.getCurrent(), lookahead_lines, images, sounds );
+
+    asset_prefetcher.filterRecent( images );
+    asset_prefetcher.request( images );
+    asset_prefetcher.filterRecent( sounds );
+    if ( !sounds.empty() ) script_h.cBR->prefetch( sounds );
+}
+
 void ONScripter::runScript()
 {
     readToken();
@@ -1705,6 +1787,38 @@ int ONScripter::refreshMode()
 void ONScripter::quit()
 {
     saveAll();
+    asset_prefetcher.stop();
+
+    if ( debug_level > 0 ){
+        SurfaceCache::Stats ics = image_cache.getStats();
+        utils::printInfo("image cache: %lu hits, %lu misses, %lu evictions, %lu entries in %lu bytes\n",
+                         (unsigned long)ics.hits, (unsigned long)ics.misses, (unsigned long)ics.evictions,
+                         (unsigned long)ics.entries, (unsigned long)ics.bytes);
+        AssetPrefetcher::Stats as = asset_prefetcher.getStats();
+        utils::printInfo("lookahead: %lu images requested, %lu used, %lu wasted, %lu cancelled\n",
+                         (unsigned long)as.requested, (unsigned long)as.used, (unsigned long)as.wasted,
+                         (unsigned long)as.cancelled);
+        if ( script_h.cBR ){
+            BaseReader::PrefetchStats ps = script_h.cBR->getPrefetchStats();
+            utils::printInfo("readahead: %lu requested, %lu hits, %lu advised, %lu bytes wasted\n",
+                             (unsigned long)ps.requested, (unsigned long)ps.hits, (unsigned long)ps.advised,
+                             (unsigned long)ps.wasted_bytes);
+        }
+        size_t frames = composite_stats.frames ? composite_stats.frames : 1;
+        utils::printInfo("compositor: %lu frames, %lu pixels composited, %lu per frame\n",
+                         (unsigned long)composite_stats.frames, (unsigned long)composite_stats.pixels,
+                         (unsigned long)(composite_stats.pixels / frames));
+        utils::printInfo("compositor: %lu sprites visited, %lu drawn, %lu and %lu per frame\n",
+                         (unsigned long)composite_stats.sprites_visited, (unsigned long)composite_stats.sprites_drawn,
+                         (unsigned long)(composite_stats.sprites_visited / frames),
+                         (unsigned long)(composite_stats.sprites_drawn / frames));
+        utils::printInfo("compositor: layers below the text window kept %lu times, recomposed %lu times\n",
+                         (unsigned long)composite_stats.layer_cache_hits,
+                         (unsigned long)composite_stats.layer_cache_misses);
+        utils::printInfo("compositor: %lu pixels of layers skipped, %lu per frame\n",
+                         (unsigned long)composite_stats.pixels_skipped,
+                         (unsigned long)(composite_stats.pixels_skipped / frames));
+    }
 
 #ifdef USE_CDROM
     if ( cdrom_info ){
@@ -1728,6 +1842,7 @@ void ONScripter::quit()
     SDL_FreeSurface(image_surface);
     SDL_FreeSurface(accumulation_surface);
     SDL_FreeSurface(backup_surface);
+    SDL_FreeSurface(layer_cache_surface);
     SDL_FreeSurface(effect_src_surface);
     SDL_FreeSurface(effect_dst_surface);
     SDL_FreeSurface(effect_tmp_surface);
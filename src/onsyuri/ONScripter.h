@@ -29,6 +29,9 @@
 #include "ScriptParser.h"
 #include "DirtyRect.h"
 #include "ButtonLink.h"
+#include "SurfaceCache.h"
+#include "AssetPrefetcher.h"
+#include "BandCompositor.h"
 
 #if defined(ANDROID)
 #include "SDL.h"
@@ -74,6 +77,8 @@
 
 class ONScripter : public ScriptParser
 {
+    friend class ONScripterHarness; // tests/onscripter_harness.h drives the compositor
+
 public:
     typedef AnimationInfo::ONSBuf ONSBuf;
 
@@ -106,9 +111,16 @@ public:
     void enableButtonShortCut();
     void enableWheelDownAdvance();
     void disableRescale();
+    void enablePremultipliedAlpha();
     void renderFontOutline();
     void enableEdit();
     void setKeyEXE(const char *path);
+    void setDecodeCacheSize(int mb);
+    void setPrefetchSize(int mb);
+    void setImageCacheSize(int mb);
+    void setLookahead(int lines);
+    void setCompositorThreads(int num);
+    SurfaceCache::Stats getImageCacheStats(){ return image_cache.getStats(); };
     const char* getArchivePath() { return archive_path; }
     void setWindowWidth(int width);
     void setWindowHeight(int height);
@@ -362,6 +374,7 @@ private:
     int  getret_int;
     bool enable_wheeldown_advance_flag;
     bool disable_rescale_flag;
+    bool premultiplied_alpha_flag;
     bool edit_flag;
     char *key_exe_file;
     bool vsync;
@@ -433,6 +446,17 @@ private:
     void resetSentenceFont();
     void flush( int refresh_mode, SDL_Rect *rect=NULL, bool clear_dirty_flag=true, bool direct_flag=false );
     void flushDirect( SDL_Rect &rect, int refresh_mode );
+    void flushDirect( DirtyRect &dirty, int refresh_mode );
+    bool updateTexture( SDL_Rect &rect, int refresh_mode );
+    void presentTexture();
+    struct CompositeStats{
+        size_t frames; // presented
+        size_t pixels; // recomposited into accumulation_surface by them
+        size_t sprites_visited; // by refreshSurface(), all of its calls
+        size_t sprites_drawn;   // of those, the ones within the clip
+        size_t layer_cache_hits, layer_cache_misses; // of refreshSurface() with the text window
+        size_t pixels_skipped; // of the layers, transparent or hidden under an opaque sprite
+    } composite_stats;
     #ifdef USE_SMPEG
     void flushDirectYUV(SDL_Overlay *overlay);
     #endif
@@ -490,9 +514,44 @@ private:
 
     int  calcDurationToNextAnimation();
     void proceedAnimation(int current_time);
+    // The animated tachi_info and sprite_info, earliest next_time first.
+    // An entry is pushed whenever next_time is set; those whose object has
+    // stopped or moved on since are dropped when they come up, and hidden
+    // ones set aside until shown again.
+    struct AnimationEntry{
+        int time;
+        AnimationInfo *anim;
+        bool operator<( const AnimationEntry &e ) const { return time > e.time; }
+    };
+    std::vector<AnimationEntry> animation_queue;
+    std::vector<AnimationInfo*> hidden_animations;
+    void scheduleAnimation(AnimationInfo *anim);
+    void settleAnimationQueue();
+    SurfaceCache image_cache; // images as set up by setupAnimationInfo()
     void setupAnimationInfo(AnimationInfo *anim, FontInfo *info=NULL);
+    std::string getImageCacheKey(AnimationInfo *anim);
+    void forgetWrittenFile(const char *filename);
+    bool usePremultipliedAlpha(AnimationInfo *anim);
     void parseTaggedString(AnimationInfo *anim );
-    void drawTaggedSurface(SDL_Surface *dst_surface, AnimationInfo *anim, SDL_Rect &clip);
+    void drawTaggedSurface(SDL_Surface *dst_surface, AnimationInfo *anim, SDL_Rect &clip, CompositeStats *stats=NULL);
+    // The slots of sprite_info and sprite2_info with an image, highest
+    // first, listed again when AnimationInfo::surface_generation moves.
+    // Some may have lost it since, so visible and image_surface are still
+    // checked when drawing.
+    std::vector<int> live_sprites, live_sprites2;
+    unsigned int live_sprites_generation;
+    void updateLiveSprites();
+    // Composing the layers of refreshSurface(), those drawn before cover
+    // are left out, cover being set to NULL once it is drawn.
+    void drawSprites(SDL_Surface *dst_surface, AnimationInfo *sprites, const std::vector<int> &live,
+                     int hi, int lo, SDL_Rect &clip, AnimationInfo *&cover, CompositeStats &stats);
+    void drawLayer(SDL_Surface *dst_surface, AnimationInfo *anim, SDL_Rect &clip,
+                   AnimationInfo *&cover, CompositeStats &stats);
+    SDL_Rect getLayerRect(AnimationInfo *anim);
+    bool hidesClip(AnimationInfo *anim, SDL_Rect &clip);
+    void findCover(AnimationInfo *&cover, AnimationInfo *sprites, const std::vector<int> &live,
+                   int hi, int lo, SDL_Rect &clip);
+    AnimationInfo *findCover(SDL_Rect &clip, int refresh_mode, int layers);
     void stopAnimation(int click);
     void loadCursor(int no, const char *str, int x, int y, bool abs_flag = false);
 #ifdef SWITCH
@@ -597,6 +656,8 @@ private:
     int  writeSaveFile( int no=0, const char *savestr=NULL );
 
     int  loadSaveFile2( int file_version );
+    void deferAnimationInfo( std::vector<AnimationInfo*> &anims, AnimationInfo *anim );
+    void requestSavedImages( std::vector<AnimationInfo*> &anims );
     void saveSaveFile2( bool output_flag );
 
     // ----------------------------------------
@@ -632,7 +693,7 @@ private:
     // format = SDL_PIXELFORMAT_RGB565 for any 16bit surface without SDL_Renderer (Android, Zaurus)
     Uint32 texture_format;
     SDL_Surface *accumulation_surface; // Final image, i.e. picture_surface (+ shadow + text_surface)
-    SDL_Surface *backup_surface; // Final image w/o (shadow + text_surface) used in leaveTextDisplayMode()
+    SDL_Surface *backup_surface; // text_info kept by executeSystemCall()
     SDL_Surface *screen_surface; // Text + Select_image + Tachi image + background
     SDL_Surface *effect_dst_surface; // Intermediate source buffer for effect
     SDL_Surface *effect_src_surface; // Intermediate destnation buffer for effect
@@ -655,9 +716,28 @@ private:
     unsigned char *resize_buffer;
     size_t resize_buffer_size;
 
-    SDL_Surface *loadImage(char *filename, bool *has_alpha=NULL, int *location=NULL, unsigned char *alpha=NULL);
+    // With reduce_unit > 0, a JPEG image may be decoded at 1/2, 1/4 or 1/8
+    // of its size, not below the screen ratio, if its width stays a multiple
+    // of reduce_unit; *scale_denom gets by how much.
+    SDL_Surface *loadImage(char *filename, bool *has_alpha=NULL, int *location=NULL, unsigned char *alpha=NULL,
+                           int reduce_unit=0, int *scale_denom=NULL);
+    SDL_Surface *convertToImageFormat(SDL_Surface *tmp);
     SDL_Surface *createRectangleSurface(char *filename, bool *has_alpha, unsigned char *alpha=NULL);
-    SDL_Surface *createSurfaceFromFile(char *filename,bool *has_alpha, int *location);
+    SDL_Surface *createSurfaceFromFile(char *filename,bool *has_alpha, int *location, int reduce_unit, int *scale_denom);
+    SDL_Surface *decodeSurface(const char *filename, const BaseReader::ResolvedFile &rf, const unsigned char *view,
+                               unsigned long length, unsigned char *buffer, bool *has_alpha,
+                               int reduce_unit=0, int *scale_denom=NULL);
+    SDL_Surface *decodeJPEGReduced(const unsigned char *data, unsigned long length, int reduce_unit, int *scale_denom);
+
+    // images and sounds named in the next lookahead_lines lines are read
+    // and decoded ahead
+    AssetPrefetcher asset_prefetcher;
+    int lookahead_lines;
+    char *lookahead_label; // where the last scan started
+    int lookahead_line;
+    void prefetchAhead();
+    static SDL_Surface *decodePrefetched(void *data, const char *filename, bool *has_alpha, int *location);
+    void releaseReader();
 
     int  resizeSurface( SDL_Surface *src, SDL_Surface *dst );
     void alphaBlend(SDL_Surface *mask_surface, int trans_mode, Uint32 mask_value = 255, SDL_Rect *clip = NULL,
@@ -667,6 +747,31 @@ private:
     void makeNegaSurface( SDL_Surface *surface, SDL_Rect &clip );
     void makeMonochromeSurface( SDL_Surface *surface, SDL_Rect &clip );
     void refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src, int refresh_mode = REFRESH_NORMAL_MODE );
+    // the layer stack of refreshSurface() over the background within clip,
+    // split where the text window goes
+    enum { LAYERS_BELOW_TEXT     = 1,
+           LAYERS_TEXT_AND_ABOVE = 2
+    };
+    void composeSurface( SDL_Surface *surface, SDL_Rect &clip, int refresh_mode, int layers, CompositeStats &stats );
+    void composeLayers( SDL_Surface *surface, SDL_Rect &clip, int refresh_mode, int layers );
+    BandCompositor band_compositor; // set up by --compositor-threads
+    struct BandJob{
+        ONScripter *ons;
+        SDL_Surface *surface[MAX_COMPOSITOR_THREADS];
+        SDL_Rect clip[MAX_COMPOSITOR_THREADS];
+        CompositeStats stats[MAX_COMPOSITOR_THREADS];
+        int refresh_mode;
+        int layers;
+    };
+    bool hasVisibleLayer();
+    bool canComposeInBands();
+    static void composeBand( void *data, int band );
+    // The layers below the text window composed within layer_cache_rect,
+    // for as long as makeLayerKey() gives layer_cache_key.
+    SDL_Surface *layer_cache_surface;
+    SDL_Rect layer_cache_rect;
+    std::vector<int> layer_cache_key, layer_key;
+    void makeLayerKey( std::vector<int> &key, int refresh_mode );
     void refreshSprite( int sprite_no, bool active_flag, int cell_no, SDL_Rect *check_src_rect, SDL_Rect *check_dst_rect );
     void createBackground();
 
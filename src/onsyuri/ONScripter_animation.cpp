@@ -24,6 +24,7 @@
 
 #include "ONScripter.h"
 #include "Utils.h"
+#include <algorithm>
 #ifdef USE_BUILTIN_LAYER_EFFECTS
 #include "builtin_layer.h"
 #endif
@@ -31,25 +32,62 @@
 #define DEFAULT_CURSOR_WAIT    ":l/3,160,2;cursor0.bmp"
 #define DEFAULT_CURSOR_NEWPAGE ":l/3,160,2;cursor1.bmp"
 
-int ONScripter::calcDurationToNextAnimation()
+void ONScripter::scheduleAnimation(AnimationInfo *anim)
 {
-    int min = 0; // minimum next time
+    if ((anim < sprite_info || anim >= sprite_info + MAX_SPRITE_NUM) &&
+        (anim < tachi_info || anim >= tachi_info + 3)) return;
+    if (!anim->is_animatable) return;
+
+    if (animation_queue.size() > (MAX_SPRITE_NUM + 3) * 2){
+        // too many stale entries, start over from those animated now
+        animation_queue.clear();
+        hidden_animations.clear();
+        for (int i=0 ; i<3 ; i++)
+            if (tachi_info[i].is_animatable && &tachi_info[i] != anim)
+                scheduleAnimation(&tachi_info[i]);
+        for (int i=0 ; i<MAX_SPRITE_NUM ; i++)
+            if (sprite_info[i].is_animatable && &sprite_info[i] != anim)
+                scheduleAnimation(&sprite_info[i]);
+    }
 
-    for (int i=0 ; i<3 ; i++){
-        AnimationInfo *anim = &tachi_info[i];
-        if (anim->visible && anim->is_animatable){
-            if (min == 0 || min > anim->next_time)
-                min = anim->next_time;
+    AnimationEntry e = {anim->next_time, anim};
+    animation_queue.push_back(e);
+    std::push_heap(animation_queue.begin(), animation_queue.end());
+}
+
+// Leaves a valid entry of a visible animation, or none, at the top.
+void ONScripter::settleAnimationQueue()
+{
+    for (size_t i=0 ; i<hidden_animations.size() ; ){
+        AnimationInfo *anim = hidden_animations[i];
+        if (anim->visible || !anim->is_animatable){
+            hidden_animations[i] = hidden_animations.back();
+            hidden_animations.pop_back();
+            scheduleAnimation(anim);
         }
+        else
+            i++;
     }
 
-    for (int i=MAX_SPRITE_NUM-1 ; i>=0 ; i--){
-        AnimationInfo *anim = &sprite_info[i];
-        if (anim->visible && anim->is_animatable){
-            if (min == 0 || min > anim->next_time)
-                min = anim->next_time;
+    while (!animation_queue.empty()){
+        AnimationEntry e = animation_queue.front();
+        if (e.anim->is_animatable && e.time == e.anim->next_time){
+            if (e.anim->visible) break;
+            if (std::find(hidden_animations.begin(), hidden_animations.end(), e.anim) == hidden_animations.end())
+                hidden_animations.push_back(e.anim);
         }
+        std::pop_heap(animation_queue.begin(), animation_queue.end());
+        animation_queue.pop_back();
     }
+}
+
+int ONScripter::calcDurationToNextAnimation()
+{
+    int min = 0; // minimum next time
+
+    settleAnimationQueue();
+    if (!animation_queue.empty())
+        min = animation_queue.front().time;
 
     if (!textgosub_label &&
          (clickstr_state == CLICK_WAIT || clickstr_state == CLICK_NEWPAGE)){
@@ -75,13 +113,26 @@ int ONScripter::calcDurationToNextAnimation()
 
 void ONScripter::proceedAnimation(int current_time)
 {
-    for (int i=0 ; i<3 ; i++)
-        if (tachi_info[i].proceedAnimation(current_time))
-            flushDirect(tachi_info[i].pos, refreshMode() | (draw_cursor_flag?REFRESH_CURSOR_MODE:0));
+    // taken out first, as those proceeded go back in, maybe due again
+    std::vector<AnimationEntry> due;
+    settleAnimationQueue();
+    while (!animation_queue.empty() && animation_queue.front().time <= current_time){
+        due.push_back(animation_queue.front());
+        std::pop_heap(animation_queue.begin(), animation_queue.end());
+        animation_queue.pop_back();
+        settleAnimationQueue();
+    }
 
-    for (int i=MAX_SPRITE_NUM-1 ; i>=0 ; i--)
-        if (sprite_info[i].proceedAnimation(current_time))
-            flushDirect(sprite_info[i].pos, refreshMode() | (draw_cursor_flag?REFRESH_CURSOR_MODE:0));
+    for (size_t i=0 ; i<due.size() ; i++){
+        AnimationInfo *anim = due[i].anim;
+        bool duplicate = due[i].time != anim->next_time;
+        for (size_t j=0 ; j<i && !duplicate ; j++)
+            duplicate = due[j].anim == anim;
+        if (duplicate) continue;
+        if (anim->proceedAnimation(current_time))
+            flushDirect(anim->pos, refreshMode() | (draw_cursor_flag?REFRESH_CURSOR_MODE:0));
+        scheduleAnimation(anim);
+    }
 
 #ifdef USE_LUA
     if (lua_handler.is_animatable && !script_h.isExternalScript()){
@@ -212,6 +263,7 @@ void ONScripter::setupAnimationInfo( AnimationInfo *anim, FontInfo *info )
         anim->orig_pos.h = pos.h;
         anim->scalePosWH( screen_ratio1, screen_ratio2 );
         anim->allocImage( anim->pos.w*anim->num_of_cells, anim->pos.h, texture_format );
+        anim->premultiplied = usePremultipliedAlpha( anim );
         anim->fill( 0, 0, 0, 0 );
 
         f_info.top_xy[0] = f_info.top_xy[1] = 0;
@@ -228,39 +280,127 @@ void ONScripter::setupAnimationInfo( AnimationInfo *anim, FontInfo *info )
     }
 #endif
     else{
+        anim->premultiplied = usePremultipliedAlpha( anim );
+
+        // the same image on several sprites, or set again, is set up once
+        std::string key;
+        if (anim->file_name && anim->file_name[0] != '>'){
+            key = getImageCacheKey( anim );
+            SurfaceCache::Info ci;
+            SDL_Surface *surface = image_cache.get( key, &ci );
+            if (surface){
+                anim->orig_pos.w = ci.orig_w;
+                anim->orig_pos.h = ci.orig_h;
+                anim->setImage( surface, texture_format, &ci.alpha );
+                return;
+            }
+        }
+
+        // a JPEG can be decoded smaller instead of being shrunk afterwards,
+        // as long as the cells, the halves of TRANS_ALPHA and the color keys
+        // stay exact
+        int reduce_unit = 0;
+        if (screen_ratio1 < screen_ratio2 && !disable_rescale_flag){
+            if (anim->trans_mode == AnimationInfo::TRANS_COPY)
+                reduce_unit = anim->num_of_cells;
+            else if (anim->trans_mode == AnimationInfo::TRANS_ALPHA)
+                reduce_unit = anim->num_of_cells * 2;
+        }
+
         bool has_alpha;
         int location;
-        SDL_Surface *surface = loadImage( anim->file_name, &has_alpha, &location, &anim->default_alpha );
+        int scale_denom;
+        SDL_Surface *surface = loadImage( anim->file_name, &has_alpha, &location, &anim->default_alpha,
+                                          reduce_unit, &scale_denom );
 
         SDL_Surface *surface_m = NULL;
         if (anim->trans_mode == AnimationInfo::TRANS_MASK)
             surface_m = loadImage( anim->mask_file_name );
 
-        surface = anim->setupImageAlpha(surface, surface_m, has_alpha);
+        AlphaBounds alpha;
+        surface = anim->setupImageAlpha(surface, surface_m, has_alpha, &alpha);
+        anim->orig_pos.w *= scale_denom;
+        anim->orig_pos.h *= scale_denom;
 
+        int w = 0, h = 0;
+        if (surface){
+            if ( (w = surface->w * scale_denom * screen_ratio1 / screen_ratio2) == 0 ) w = 1;
+            if ( (h = surface->h * scale_denom * screen_ratio1 / screen_ratio2) == 0 ) h = 1;
+        }
         if (surface &&
             screen_ratio2 != screen_ratio1 &&
-            (!disable_rescale_flag || location == BaseReader::ARCHIVE_TYPE_NONE))
+            (!disable_rescale_flag || location == BaseReader::ARCHIVE_TYPE_NONE) &&
+            (scale_denom == 1 || w != surface->w || h != surface->h))
         {
             SDL_Surface *src_s = surface;
 
-            int w, h;
-            if ( (w = src_s->w * screen_ratio1 / screen_ratio2) == 0 ) w = 1;
-            if ( (h = src_s->h * screen_ratio1 / screen_ratio2) == 0 ) h = 1;
             SDL_PixelFormat *fmt = image_surface->format;
             surface = SDL_CreateRGBSurface( SDL_SWSURFACE, w, h,
                                             fmt->BitsPerPixel, fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask );
 
             resizeSurface(src_s, surface);
             SDL_FreeSurface(src_s);
+
+            // the filter moves the edges of the alpha
+            SDL_LockSurface(surface);
+            scanAlpha((Uint32*)surface->pixels, surface->w, surface->h, surface->pitch / 4,
+                      anim->num_of_cells, &alpha);
+            SDL_UnlockSurface(surface);
         }
 
-        anim->setImage( surface, texture_format );
+        anim->setImage( surface, texture_format, &alpha );
+        if (surface && !key.empty()){
+            SurfaceCache::Info ci = {anim->orig_pos.w, anim->orig_pos.h, alpha};
+            image_cache.put( key, surface, ci );
+        }
 
         if ( surface_m ) SDL_FreeSurface(surface_m);
     }
 }
 
+// Called after the engine writes filename, e.g. by savescreenshot.  The
+// image cache is cleared as a whole, since the name may be spelled in
+// other cases or used as a mask, and writes are rare.  What the
+// prefetcher staged may be the file before, and it is not read ahead again.
+void ONScripter::forgetWrittenFile( const char *filename )
+{
+    image_cache.clear();
+    asset_prefetcher.stop();
+    asset_prefetcher.exclude( filename );
+    lookahead_label = NULL;
+}
+
+std::string ONScripter::getImageCacheKey( AnimationInfo *anim )
+{
+    char buf[64];
+    sprintf( buf, "|%d|%d|%d/%d", anim->trans_mode, anim->num_of_cells, screen_ratio1, screen_ratio2 );
+    std::string key = anim->file_name;
+    key += '|';
+    if (anim->trans_mode == AnimationInfo::TRANS_MASK && anim->mask_file_name)
+        key += anim->mask_file_name;
+    key += buf;
+    if (anim->trans_mode == AnimationInfo::TRANS_DIRECT){
+        sprintf( buf, "|%02x%02x%02x", anim->direct_color[0], anim->direct_color[1], anim->direct_color[2] );
+        key += buf;
+    }
+    if (usePremultipliedAlpha( anim ))
+        key += "|pm";
+
+    return key;
+}
+
+// btndef is also drawn as it is by blt and copied into buttons, and effect
+// masks are read by color, so these keep straight alpha.
+bool ONScripter::usePremultipliedAlpha( AnimationInfo *anim )
+{
+    if (!premultiplied_alpha_flag || anim == &btndef_info) return false;
+    if (anim == &window_effect.anim || anim == &tmp_effect.anim) return false;
+    for (EffectLink *link = root_effect_link.next ; link ; link = link->next)
+        if (anim == &link->anim) return false;
+
+    return true;
+}
+
 void ONScripter::parseTaggedString( AnimationInfo *anim )
 {
     if (anim->image_name == NULL) return;
@@ -368,6 +508,7 @@ void ONScripter::parseTaggedString( AnimationInfo *anim )
             anim->duration_list[0] = tmp->interval;
             anim->next_time = SDL_GetTicks() + tmp->interval;
             anim->is_animatable = true;
+            scheduleAnimation(anim);
             utils::printInfo("setup a sprite for layer %d\n", anim->layer_no);
         } else
             anim->layer_no = -1;
@@ -410,7 +551,10 @@ void ONScripter::parseTaggedString( AnimationInfo *anim )
                 anim->duration_list[i] = 0;
             anim->loop_mode = 3; // 3...no animation
         }
-        if ( anim->loop_mode != 3 ) anim->is_animatable = true;
+        if ( anim->loop_mode != 3 ){
+            anim->is_animatable = true;
+            scheduleAnimation(anim);
+        }
 
         while(buffer[0] != ';' && buffer[0] != '\0') buffer++;
     }
@@ -427,7 +571,8 @@ void ONScripter::parseTaggedString( AnimationInfo *anim )
     }
 }
 
-void ONScripter::drawTaggedSurface( SDL_Surface *dst_surface, AnimationInfo *anim, SDL_Rect &clip )
+void ONScripter::drawTaggedSurface( SDL_Surface *dst_surface, AnimationInfo *anim, SDL_Rect &clip,
+                                    CompositeStats *stats )
 {
 #ifdef USE_BUILTIN_LAYER_EFFECTS
   if (anim->trans_mode == AnimationInfo::TRANS_LAYER) {
@@ -444,6 +589,16 @@ void ONScripter::drawTaggedSurface( SDL_Surface *dst_surface, AnimationInfo *ani
         poly_rect.y += sentence_font.y() * screen_ratio1 / screen_ratio2;
     }
 
+    if (stats && anim->image_surface && !anim->affine_flag){
+        // what the transparent margins leave out
+        SDL_Rect rect = poly_rect, dst_rect, src_rect;
+        if ( AnimationInfo::doClipping( &rect, &clip ) == 0 ){
+            stats->pixels_skipped += (size_t)rect.w * rect.h;
+            if ( anim->getBlendRect( poly_rect.x, poly_rect.y, clip, dst_rect, src_rect ) == 0 )
+                stats->pixels_skipped -= (size_t)dst_rect.w * dst_rect.h;
+        }
+    }
+
     if (!anim->affine_flag)
         anim->blendOnSurface( dst_surface, poly_rect.x, poly_rect.y, clip, anim->trans );
     else
@@ -451,11 +451,20 @@ int ONScripter::sp_rgb_gradationCommand()
     AnimationInfo *ai;
     if (no == -1) ai = &sentence_font_info;
     else          ai = &sprite_info[no];
+    ai->detachSurface();
     SDL_Surface *surface = ai->image_surface;
     if (surface == NULL) return RET_CONTINUE;
 
     SDL_PixelFormat *fmt = surface->format;
 
+#if !defined(BPP16)
+    SDL_LockSurface(surface);
+    paintColorKeyGradation((Uint32 *)surface->pixels, surface->w, surface->h, surface->w,
+                           SDL_MapRGB(fmt, key_r, key_g, key_b),
+                           SDL_MapRGB(fmt, upper_r, upper_g, upper_b),
+                           SDL_MapRGB(fmt, lower_r, lower_g, lower_b),
+                           alpha, ai->premultiplied);
+#else
     ONSBuf key_mask = (((key_r >> fmt->Rloss) << fmt->Rshift) |
                        ((key_g >> fmt->Gloss) << fmt->Gshift) |
                        ((key_b >> fmt->Bloss) << fmt->Bshift));
@@ -485,15 +494,7 @@ int ONScripter::sp_rgb_gradationCommand()
     // replace pixels of the key-color with the specified color in gradation
     for (i=upper_bound ; i<=lower_bound ; i++){
         ONSBuf *buf = (ONSBuf *)surface->pixels + surface->w * i;
-#if defined(BPP16)
         unsigned char *alphap = ai->alpha_buf + surface->w * i;
-#else
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-        unsigned char *alphap = (unsigned char *)buf + 3;
-#else
-        unsigned char *alphap = (unsigned char *)buf;
-#endif
-#endif
         Uint32 color = alpha << surface->format->Ashift;
         if (upper_bound != lower_bound){
             color |= (((lower_r - upper_r) * (i-upper_bound) / (lower_bound - upper_bound) + upper_r) >> fmt->Rloss) << fmt->Rshift;
@@ -506,18 +507,14 @@ int ONScripter::sp_rgb_gradationCommand()
             color |= (upper_b >> fmt->Bloss) << fmt->Bshift;
         }
 
-        for (j=0 ; j<surface->w ; j++, buf++){
+        for (j=0 ; j<surface->w ; j++, buf++, alphap++){
             if ((*buf & rgb_mask) == key_mask){
                 *buf = color;
                 *alphap = alpha;
             }
-#if defined(BPP16)
-            alphap++;
-#else
-            alphap += 4;
-#endif
         }
     }
+#endif
 
     SDL_UnlockSurface(surface);
 
@@ -1009,6 +1006,8 @@ int ONScripter::savescreenshotCommand()
     if (rwops == nullptr || SDL_SaveBMP_RW(surface, rwops, 1) != 0)
         utils::printError("Save screenshot failed: %s\n", SDL_GetError());
     SDL_FreeSurface(surface);
+    script_h.cBR->invalidateDirectoryIndex();
+    forgetWrittenFile( imgpath.c_str() );
 
     return RET_CONTINUE;
 }
@@ -3115,6 +3114,8 @@ int ONScripter::defineresetCommand()
 {
     saveGlovalData();
 
+    asset_prefetcher.stop();
+    lookahead_label = NULL;
     script_h.reset();
     ScriptParser::reset();
     reset();
@@ -3723,6 +3724,7 @@ int ONScripter::bltCommand()
 
 #if defined(USE_GLES)
         if(!isnan(sharpness)){ // fix gles render blt problem
+            bg_info.detachSurface();
             SDL_BlitScaled(btndef_info.image_surface, &src_rect, bg_info.image_surface, &dst_rect);
             flushDirect(dst_rect, REFRESH_NORMAL_MODE);
             dirty_rect.clear();
@@ -3731,6 +3733,7 @@ int ONScripter::bltCommand()
 #endif
 
 #if defined(ANDROID) // dirty fix for android flash problem
+        bg_info.detachSurface();
         SDL_BlitScaled(btndef_info.image_surface, &src_rect, bg_info.image_surface, &dst_rect);
         flushDirect(dst_rect, REFRESH_NORMAL_MODE);
 #else
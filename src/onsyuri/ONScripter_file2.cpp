@@ -30,6 +30,12 @@ int ONScripter::loadSaveFile2( int file_version )
     deleteNestInfo();
     
     int i, j;
+
+    // The images are set up in order once the whole save is read, after
+    // queueing them to be decoded in parallel (see requestSavedImages()).
+    std::vector<AnimationInfo*> saved_images;
+    asset_prefetcher.stop();
+    lookahead_label = NULL;
     
     readInt(); // 1 ... < 2.96, 2 ... >= 2.96
     if ( readInt() == 1 ) sentence_font.is_bold = true;
@@ -83,7 +89,7 @@ int ONScripter::loadSaveFile2( int file_version )
     readStr( &ai->image_name );
     if ( !sentence_font.is_transparent && ai->image_name ){
         parseTaggedString( ai );
-        setupAnimationInfo( ai );
+        deferAnimationInfo( saved_images, ai );
     }
 
     if ( readInt() == 1 ) cursor_info[0].abs_flag = false;
@@ -100,14 +106,13 @@ int ONScripter::loadSaveFile2( int file_version )
     // load background surface
     bg_info.remove();
     readStr( &bg_info.file_name );
-    createBackground();
 
     for ( i=0 ; i<3 ; i++ ){
         tachi_info[i].remove();
         readStr( &tachi_info[i].image_name );
         if ( tachi_info[i].image_name ){
             parseTaggedString( &tachi_info[i] );
-            setupAnimationInfo( &tachi_info[i] );
+            deferAnimationInfo( saved_images, &tachi_info[i] );
         }
     }
 
@@ -138,7 +143,7 @@ int ONScripter::loadSaveFile2( int file_version )
         readStr( &ai->image_name );
         if ( ai->image_name ){
             parseTaggedString( ai );
-            setupAnimationInfo( ai );
+            deferAnimationInfo( saved_images, ai );
         }
         ai->orig_pos.x = readInt();
         ai->orig_pos.y = readInt();
@@ -328,9 +333,7 @@ int ONScripter::loadSaveFile2( int file_version )
     readStr( &btndef_info.image_name );
     if ( btndef_info.image_name && btndef_info.image_name[0] != '\0' ){
         parseTaggedString( &btndef_info );
-        setupAnimationInfo( &btndef_info );
-
-        SDL_SetSurfaceBlendMode(btndef_info.image_surface, SDL_BLENDMODE_NONE);
+        deferAnimationInfo( saved_images, &btndef_info );
     }
 
     if ( file_version >= 202 )
@@ -369,7 +372,7 @@ int ONScripter::loadSaveFile2( int file_version )
             readStr( &ai->image_name );
             if ( ai->image_name ){
                 parseTaggedString( ai );
-                setupAnimationInfo( ai );
+                deferAnimationInfo( saved_images, ai );
             }
             ai->orig_pos.x = readInt();
             ai->orig_pos.y = readInt();
@@ -381,11 +384,6 @@ int ONScripter::loadSaveFile2( int file_version )
             else                  ai->visible = false;
             ai->trans = readInt();
             ai->blending_mode = readInt();
-            ai->affine_pos.x = 0;
-            ai->affine_pos.y = 0;
-            ai->affine_pos.w = ai->pos.w;
-            ai->affine_pos.h = ai->pos.h;
-            ai->calcAffineMatrix();
         }
         
         readInt();
@@ -446,6 +444,26 @@ int ONScripter::loadSaveFile2( int file_version )
     }
     script_h.setCurrent( buf );
 
+    requestSavedImages( saved_images );
+    createBackground();
+    for ( i=0 ; i<(int)saved_images.size() ; i++ )
+        setupAnimationInfo( saved_images[i] );
+    asset_prefetcher.unpin();
+
+    if ( btndef_info.image_name && btndef_info.image_name[0] != '\0' )
+        SDL_SetSurfaceBlendMode(btndef_info.image_surface, SDL_BLENDMODE_NONE);
+
+    if (file_version >= 204){
+        for ( i=0 ; i<MAX_SPRITE2_NUM ; i++ ){
+            ai = &sprite2_info[i];
+            ai->affine_pos.x = 0;
+            ai->affine_pos.y = 0;
+            ai->affine_pos.w = ai->pos.w;
+            ai->affine_pos.h = ai->pos.h;
+            ai->calcAffineMatrix();
+        }
+    }
+
     display_mode = shelter_display_mode = DISPLAY_MODE_TEXT;
     clickstr_state = CLICK_NONE;
     draw_cursor_flag = false;
@@ -453,6 +471,51 @@ int ONScripter::loadSaveFile2( int file_version )
     return 0;
 }
 
+// Images are set up later, text and layers which do not read files now.
+void ONScripter::deferAnimationInfo( std::vector<AnimationInfo*> &anims, AnimationInfo *anim )
+{
+    if ( anim->trans_mode == AnimationInfo::TRANS_STRING
+#ifdef USE_BUILTIN_LAYER_EFFECTS
+         || anim->trans_mode == AnimationInfo::TRANS_LAYER
+#endif
+        )
+        setupAnimationInfo( anim );
+    else
+        anims.push_back( anim );
+}
+
+// Queues the images of the background and of anims for the workers, once
+// each, so that setting them up in order mostly takes decoded surfaces.
+void ONScripter::requestSavedImages( std::vector<AnimationInfo*> &anims )
+{
+    std::vector<std::string> names;
+
+    AnimationInfo bg;
+    if ( bg_info.file_name &&
+         strcmp( bg_info.file_name, "white" ) &&
+         strcmp( bg_info.file_name, "black" ) &&
+         strcmp( bg_info.file_name, "*bgcpy" ) &&
+         bg_info.file_name[0] != '#' ){
+        setStr( &bg.image_name, bg_info.file_name );
+        parseTaggedString( &bg );
+        bg.trans_mode = AnimationInfo::TRANS_COPY;
+    }
+
+    for ( int i=-1 ; i<(int)anims.size() ; i++ ){
+        AnimationInfo *anim = (i < 0) ? &bg : anims[i];
+        if ( anim->file_name == NULL || anim->file_name[0] == '>' ) continue;
+        if ( image_cache.contains( getImageCacheKey( anim ) ) ) continue;
+
+        names.push_back( anim->file_name );
+        if ( anim->trans_mode == AnimationInfo::TRANS_MASK && anim->mask_file_name &&
+             anim->mask_file_name[0] != '>' )
+            names.push_back( anim->mask_file_name );
+    }
+
+    asset_prefetcher.filterRecent( names );
+    asset_prefetcher.request( names, true );
+}
+
 void ONScripter::saveSaveFile2( bool output_flag )
 {
     int i, j;
@@ -26,16 +26,17 @@
 #include <new>
 #include <algorithm>
 #include "resize_image.h"
+#include "image_jpeg.h"
 #include "Utils.h"
 #if defined(USE_OMP_PARALLEL) || defined(USE_PARALLEL)
 #include "Parallel.h"
 #endif
-#ifdef USE_SIMD
-#include "simd/simd.h"
-#endif
+#include "blend_kernels.h"
 
-SDL_Surface *ONScripter::loadImage(char *filename, bool *has_alpha, int *location, unsigned char *alpha)
+SDL_Surface *ONScripter::loadImage(char *filename, bool *has_alpha, int *location, unsigned char *alpha,
+                                   int reduce_unit, int *scale_denom)
 {
+    if (scale_denom) *scale_denom = 1;
     if (!filename) return NULL;
 
     SDL_Surface *tmp = NULL;
@@ -44,9 +45,15 @@ SDL_Surface *ONScripter::loadImage(char *filename, bool *has_alpha, int *locatio
     if (filename[0] == '>')
         tmp = createRectangleSurface(filename, has_alpha, alpha);
     else
-        tmp = createSurfaceFromFile(filename, has_alpha, location);
+        tmp = createSurfaceFromFile(filename, has_alpha, location, reduce_unit, scale_denom);
     if (tmp == NULL) return NULL;
 
+    return convertToImageFormat(tmp);
+}
+
+// Safe on any thread, image_surface only serves as a format.
+SDL_Surface *ONScripter::convertToImageFormat(SDL_Surface *tmp)
+{
     SDL_Surface *ret;
     if((tmp->w * tmp->format->BytesPerPixel == tmp->pitch) &&
        (tmp->format->BitsPerPixel == image_surface->format->BitsPerPixel) &&
@@ -131,10 +138,25 @@ SDL_Surface *ONScripter::createRectangleSurface(char *filename, bool *has_alpha,
     return tmp;
 }
 
-SDL_Surface *ONScripter::createSurfaceFromFile(char *filename, bool *has_alpha, int *location)
+SDL_Surface *ONScripter::createSurfaceFromFile(char *filename, bool *has_alpha, int *location, int reduce_unit, int *scale_denom)
 {
     // printf("## createSurfaceFromFile %s\n", filename);
-    unsigned long length = script_h.cBR->getFileLength( filename );
+    SDL_Surface *prefetched = asset_prefetcher.take(filename, has_alpha, location);
+    if (prefetched){
+        if (filelog_flag)
+            script_h.findAndAddLog(script_h.log_info[ScriptHandler::FILE_LOG], filename, true);
+        return prefetched;
+    }
+
+    BaseReader::ResolvedFile rf;
+    size_t view_length = 0;
+    const unsigned char *view = NULL;
+    unsigned long length = 0;
+    if (script_h.cBR->resolveFile( filename, &rf )){
+        view = script_h.cBR->viewFile( rf, &view_length );
+        length = view ? view_length : rf.length;
+        if (location) *location = rf.location;
+    }
 
     if (length == 0){
         if(this->save_dir) { // dirty fix for load save image
@@ -165,32 +187,85 @@ SDL_Surface *ONScripter::createSurfaceFromFile(char *filename, bool *has_alpha,
         script_h.findAndAddLog(script_h.log_info[ScriptHandler::FILE_LOG], filename, true);
     //utils::printInfo(" ... loading %s length %ld\n", filename, length );
 
-    mean_size_of_loaded_images += length*6/5; // reserve 20% larger size
-    num_loaded_images++;
-    if (tmp_image_buf_length < mean_size_of_loaded_images/num_loaded_images){
-        tmp_image_buf_length = mean_size_of_loaded_images/num_loaded_images;
-        if (tmp_image_buf) delete[] tmp_image_buf;
-        tmp_image_buf = NULL;
+    unsigned char *buffer = NULL;
+    if (!view && rf.compression_type != BaseReader::SURFACE_COMPRESSION){
+        mean_size_of_loaded_images += length*6/5; // reserve 20% larger size
+        num_loaded_images++;
+        if (tmp_image_buf_length < mean_size_of_loaded_images/num_loaded_images){
+            tmp_image_buf_length = mean_size_of_loaded_images/num_loaded_images;
+            if (tmp_image_buf) delete[] tmp_image_buf;
+            tmp_image_buf = NULL;
+        }
+
+        if (length > tmp_image_buf_length){
+            buffer = new(std::nothrow) unsigned char[length];
+            if (buffer == NULL){
+                utils::printError("failed to load [%s] because file size [%lu] is too large.\n", filename, length);
+                return NULL;
+            }
+        }
+        else{
+            if (!tmp_image_buf) tmp_image_buf = new unsigned char[tmp_image_buf_length];
+            buffer = tmp_image_buf;
+        }
     }
 
-    unsigned char *buffer = NULL;
-    if (length > tmp_image_buf_length){
-        buffer = new(std::nothrow) unsigned char[length];
-        if (buffer == NULL){
-            utils::printError("failed to load [%s] because file size [%lu] is too large.\n", filename, length);
-            return NULL;
+    SDL_Surface *tmp = decodeSurface(filename, rf, view, length, buffer, has_alpha, reduce_unit, scale_denom);
+
+    if (buffer && buffer != tmp_image_buf) delete[] buffer;
+
+    return tmp;
+}
+
+// Decodes a resolved image from view if it is not NULL, or else from
+// buffer, which is allocated here if NULL.  Safe on any thread.
+SDL_Surface *ONScripter::decodeSurface(const char *filename, const BaseReader::ResolvedFile &rf, const unsigned char *view,
+                                       unsigned long length, unsigned char *buffer, bool *has_alpha,
+                                       int reduce_unit, int *scale_denom)
+{
+    BaseReader::SurfaceInfo si;
+    if (rf.compression_type == BaseReader::SURFACE_COMPRESSION &&
+        script_h.cBR->getSurfaceInfo(rf, &si)){
+        // pre-decoded by tool/nsxconv, copy the pixels as they are
+        SDL_Surface *tmp = SDL_CreateRGBSurfaceWithFormat(0, si.width, si.height, 32, si.format);
+        if (tmp && script_h.cBR->readSurface(rf, (unsigned char*)tmp->pixels, tmp->pitch)){
+            if (has_alpha) *has_alpha = si.has_alpha;
+            return tmp;
         }
+        if (tmp) SDL_FreeSurface(tmp);
+        // otherwise decode the BMP that readFile() makes of it
+    }
+
+    unsigned char *own_buffer = NULL;
+    SDL_RWops *src = NULL;
+    if (view){
+        // decode straight out of the mapped archive
+        src = SDL_RWFromConstMem(view, length);
     }
     else{
-        if (!tmp_image_buf) tmp_image_buf = new unsigned char[tmp_image_buf_length];
-        buffer = tmp_image_buf;
+        if (buffer == NULL){
+            buffer = own_buffer = new(std::nothrow) unsigned char[length];
+            if (buffer == NULL){
+                utils::printError("failed to load [%s] because file size [%lu] is too large.\n", filename, length);
+                return NULL;
+            }
+        }
+        script_h.cBR->readFile(rf, buffer);
+        src = SDL_RWFromMem(buffer, length);
     }
 
-    script_h.cBR->getFile(filename, buffer, location);
+    if (reduce_unit > 0){
+        SDL_Surface *tmp = decodeJPEGReduced(view ? view : buffer, length, reduce_unit, scale_denom);
+        if (tmp){
+            if (has_alpha) *has_alpha = false;
+            SDL_RWclose(src);
+            if (own_buffer) delete[] own_buffer;
+            return tmp;
+        }
+    }
 
-    char *ext = strrchr(filename, '.');
+    const char *ext = strrchr(filename, '.');
 
-    SDL_RWops *src = SDL_RWFromMem(buffer, length);
     int is_png = IMG_isPNG(src);
 
     SDL_Surface *tmp = IMG_Load_RW(src, 0);
@@ -208,7 +283,7 @@ SDL_Surface *ONScripter::createSurfaceFromFile(char *filename, bool *has_alpha,
 
     SDL_RWclose(src);
 
-    if (buffer != tmp_image_buf) delete[] buffer;
+    if (own_buffer) delete[] own_buffer;
 
     if (!tmp)
         utils::printError(" *** can't load file [%s] %s ***\n", filename, IMG_GetError());
@@ -216,6 +291,67 @@ SDL_Surface *ONScripter::createSurfaceFromFile(char *filename, bool *has_alpha,
     return tmp;
 }
 
+// NULL unless data is a JPEG image that shrinks by 2 or more towards the
+// screen ratio, which is then decoded at that size in image_surface format.
+SDL_Surface *ONScripter::decodeJPEGReduced(const unsigned char *data, unsigned long length, int reduce_unit, int *scale_denom)
+{
+    if (image_surface->format->BitsPerPixel != 32) return NULL;
+
+    int max_denom = 1;
+    while (max_denom < 8 && max_denom * 2 * screen_ratio1 <= screen_ratio2) max_denom *= 2;
+    if (max_denom == 1) return NULL;
+
+    int w, h;
+    int denom = getJPEGScaleDenom(data, length, max_denom, reduce_unit, &w, &h);
+    if (denom <= 1) return NULL;
+
+    SDL_PixelFormat *fmt = image_surface->format;
+    SDL_Surface *tmp = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h,
+                                            fmt->BitsPerPixel, fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask);
+    if (tmp == NULL) return NULL;
+
+    SDL_LockSurface(tmp);
+    bool ok = decodeJPEGScaled(data, length, denom, (uint32_t*)tmp->pixels, tmp->pitch,
+                               fmt->Rshift, fmt->Gshift, fmt->Bshift);
+    SDL_UnlockSurface(tmp);
+    if (!ok){
+        // left to SDL_image, which may know better
+        SDL_FreeSurface(tmp);
+        return NULL;
+    }
+
+    if (scale_denom) *scale_denom = denom;
+    return tmp;
+}
+
+SDL_Surface *ONScripter::decodePrefetched(void *data, const char *filename, bool *has_alpha, int *location)
+{
+    ONScripter *ons = (ONScripter*)data;
+
+    BaseReader::ResolvedFile rf;
+    if (!ons->script_h.cBR->resolveFile(filename, &rf)) return NULL;
+    *location = rf.location;
+
+    size_t view_length = 0;
+    const unsigned char *view = ons->script_h.cBR->viewFile(rf, &view_length);
+    unsigned long length = view ? view_length : rf.length;
+    if (length == 0) return NULL;
+
+    SDL_Surface *tmp = ons->decodeSurface(filename, rf, view, length, NULL, has_alpha);
+    if (tmp == NULL) return NULL;
+
+    return ons->convertToImageFormat(tmp);
+}
+
+// The workers decode through script_h.cBR, and what they or the image
+// cache hold may be of the archives before.
+void ONScripter::releaseReader()
+{
+    asset_prefetcher.stop();
+    lookahead_label = NULL;
+    image_cache.clear();
+}
+
 // resize 32bit surface to 32bit surface
 int ONScripter::resizeSurface( SDL_Surface *src, SDL_Surface *dst )
 {
@@ -248,195 +384,29 @@ int ONScripter::resizeSurface( SDL_Surface *src, SDL_Surface *dst )
     Uint32 mask_rb = (s1 + ((s2-s1) * mask2 >> 5)) & 0x07e0f81f; \
     *dst_buffer = mask_rb | mask_rb >> 16; \
 }
-#else
-#define BLEND_PIXEL_MASK(){\
-    Uint32 temp = *src1_buffer & 0xff00ff;\
-    Uint32 mask_rb = (((((*src2_buffer & 0xff00ff) - temp ) * mask2 ) >> 8 ) + temp ) & 0xff00ff;\
-    temp = *src1_buffer & 0x00ff00;\
-    Uint32 mask_g  = (((((*src2_buffer & 0x00ff00) - temp ) * mask2 ) >> 8 ) + temp ) & 0x00ff00;\
-    *dst_buffer = mask_rb | mask_g;\
-}
-// Originally, the above looks like this.
-//    mask1 = mask2 ^ 0xff;
-//    Uint32 mask_rb = (((*src1_buffer & 0xff00ff) * mask1 +
-//                       (*src2_buffer & 0xff00ff) * mask2) >> 8) & 0xff00ff;
-//    Uint32 mask_g  = (((*src1_buffer & 0x00ff00) * mask1 +
-//                       (*src2_buffer & 0x00ff00) * mask2) >> 8) & 0x00ff00;
-#ifdef USE_SIMD
-#ifdef USE_SIMD_X86_AVX2
-static void alphaBlend8Core32(Uint32 *src1_buffer, Uint32 *src2_buffer, Uint32 *dst_buffer,
-    simd::uint16x16 m_lo, simd::uint16x16 m_hi, simd::uint8x32 zero, simd::uint8x32 amask) {
-    using namespace simd;
-    uint8x32 src1 = load256_u(src1_buffer), src2 = load256_u(src2_buffer);
-    uint16x16 src1u = widen_lo(src1, zero);
-    uint16x16 r1 = widen_lo(src2, zero);
-    r1 -= src1u;
-    src1u = widen_hi(src1, zero);
-    uint16x16 r2 = widen_hi(src2, zero);
-    r2 -= src1u;
-    r1 = (r1 * m_lo) >> immint<8>();
-    r2 = (r2 * m_hi) >> immint<8>();
-    uint8x32 r = pack_hz(r1, r2);
-    r = (r + src1) | amask;
-    store256_u(dst_buffer, r);
-}
-#endif
-
-static void alphaBlendCore32(Uint32 *src1_buffer, Uint32 *src2_buffer, Uint32 *dst_buffer,
-    simd::uint16x8 m_lo, simd::uint16x8 m_hi, simd::uint8x16 zero, simd::uint8x16 amask) {
-    using namespace simd;
-    uint8x16 src1 = load_u(src1_buffer), src2 = load_u(src2_buffer);
-    uint16x8 src1u = widen_lo(src1, zero);
-    uint16x8 r1 = widen_lo(src2, zero);
-    r1 -= src1u;
-    src1u = widen_hi(src1, zero);
-    uint16x8 r2 = widen_hi(src2, zero);
-    r2 -= src1u;
-    r1 = (r1 * m_lo) >> immint<8>();
-    r2 = (r2 * m_hi) >> immint<8>();
-    uint8x16 r = pack_hz(r1, r2);
-    r = (r + src1) | amask;
-    store_u(dst_buffer, r);
-}
-
-static void alphaBlendPixelCore32(Uint32 *src1_buffer, Uint32 *src2_buffer, Uint32 *dst_buffer, Uint8 mask, simd::ivec128 zero) {
-    using namespace simd;
-    uint8x4 src1 = load(src1_buffer), src2 = load(src2_buffer);
-    uint16x4 r1 = widen(src2, zero);
-    uint16x4 dstu = widen(src1, zero);
-    r1 -= dstu;
-    uint16x4 m(mask);
-    r1 *= m;
-    r1 >>= immint<8>();
-    uint8x4 r = narrow_hz(r1);
-    r += src1;
-    *dst_buffer = uint8x4::cvt2i32(r) | 0xff000000;
-}
 #endif
 
 static void alphaBlend32(Uint32 *src1_buffer, Uint32 *src2_buffer, Uint32 *dst_buffer, const Uint32 *mask_buffer,
     Uint32 mask_value, Uint32 overflow_mask, Uint32 mask_surface_w, int rect_x, int rect_w) {
+    // the row is blended in chunks, whose masks fit on the stack
+    const int CHUNK = 256;
+    Uint32 mask2[CHUNK];
     int j2 = rect_x;
-#ifdef USE_SIMD
-    using namespace simd;
-#ifdef USE_SIMD_X86_AVX2
-    ivec256 zero = ivec256::zero();
-    uint8x32 amask =
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-    uint8x32::set(0, 0, 0, 0xFF);
-#else
-    uint8x32::set(0xFF, 0, 0, 0);
-#endif
-    ivec128 zerol = zero.lo();
-    uint8x16 amaskl = amask.lo();
-#else
-    ivec128 zerol = ivec128::zero();
-    uint8x16 amaskl =
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-        uint8x16::set(0, 0, 0, 0xFF);
-#else
-        uint8x16::set(0xFF, 0, 0, 0);
-#endif
-#endif
-    Uint32 *mask2 = new Uint32[rect_w];
-    for (int i = 0; i < rect_w; ++i) {
-        Uint32 mask2i = 0;
-        Uint32 mask = *(mask_buffer + j2) & 0xFF;
-        if (mask_value > mask) {
-            mask2i = mask_value - mask;
-            if (mask2i & overflow_mask) mask2i = 0xFF;
-        }
-        uint8x16 vec = uint8x16((Uint8)mask2i);
-        store_u_32(mask2 + i, vec);
-        j2 = j2 >= mask_surface_w ? 0 : j2 + 1;
-    }
-    Uint32* mask2p = mask2;
-#ifdef USE_SIMD_X86_AVX2
-    while (rect_w >= 8) {
-        uint8x32 maskv = load256_a(mask2p);
-        uint16x16 m_lo = widen_lo(maskv, zero);
-        uint16x16 m_hi = widen_hi(maskv, zero);
-        alphaBlend8Core32(src1_buffer, src2_buffer, dst_buffer, m_lo, m_hi, zero, amask);
-        rect_w -= 8; src1_buffer += 8; src2_buffer += 8; dst_buffer += 8; mask2p += 8;
-    }
-#endif
-    while (rect_w >= 4) {
-        uint8x16 maskv = load_a(mask2p);
-        uint16x8 m_lo = widen_lo(maskv, zerol);
-        uint16x8 m_hi = widen_hi(maskv, zerol);
-        alphaBlendCore32(src1_buffer, src2_buffer, dst_buffer, m_lo, m_hi, zerol, amaskl);
-        rect_w -= 4; src1_buffer += 4; src2_buffer += 4; dst_buffer += 4; mask2p +=4;
-    }
-    while (rect_w > 0) {
-        alphaBlendPixelCore32(src1_buffer, src2_buffer, dst_buffer, *((Uint8*)mask2p), zerol);
-        --rect_w; ++src1_buffer; ++src2_buffer; ++dst_buffer; ++mask2p;
-    }
-    delete[] mask2;
-#else
-    for (int j = 0; j < rect_w; j++) {
-        Uint32 mask2 = 0;
-        Uint32 mask = *(mask_buffer + j2) & 0xFF;
-        if (mask_value > mask) {
-            mask2 = mask_value - mask;
-            if (mask2 & overflow_mask) mask2 = 0xFF;
+    for (int x = 0; x < rect_w; x += CHUNK) {
+        int n = rect_w - x < CHUNK ? rect_w - x : CHUNK;
+        for (int i = 0; i < n; ++i) {
+            Uint32 mask2i = 0;
+            Uint32 mask = *(mask_buffer + j2) & 0xFF;
+            if (mask_value > mask) {
+                mask2i = mask_value - mask;
+                if (mask2i & overflow_mask) mask2i = 0xFF;
+            }
+            mask2[i] = mask2i * 0x01010101;
+            j2 = j2 >= (int)mask_surface_w ? 0 : j2 + 1;
         }
-        BLEND_PIXEL_MASK();
-        src1_buffer++; src2_buffer++; dst_buffer++;
-        j2 = j2 >= (int)mask_surface_w ? 0 : j2 + 1;
-    }
-#endif
-}
-
-inline static void alphaBlendConst32(Uint32 *src1_buffer, Uint32 *src2_buffer, Uint32 *dst_buffer, Uint32 mask2, int remain) {
-#ifdef USE_SIMD
-    using namespace simd;
-#ifdef USE_SIMD_X86_AVX2
-    ivec256 zero = ivec256::zero();
-    uint16x16 m(mask2);
-    uint8x32 amask =
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-        uint8x32::set(0, 0, 0, 0xFF);
-#else
-        uint8x32::set(0xFF, 0, 0, 0);
-#endif
-    ivec128 zerol = zero.lo();
-    uint16x8 ml = m.lo();
-    uint8x16 amaskl = amask.lo();
-#else
-    ivec128 zerol = ivec128::zero();
-    uint16x8 ml(mask2);
-    uint8x16 amaskl =
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-        uint8x16::set(0, 0, 0, 0xFF);
-#else
-        uint8x16::set(0xFF, 0, 0, 0);
-#endif
-#endif
-#ifdef USE_SIMD_X86_AVX2
-    while (remain >= 8) {
-        alphaBlend8Core32(src1_buffer, src2_buffer, dst_buffer, m, m, zero, amask);
-        remain -= 8; src1_buffer += 8; src2_buffer += 8; dst_buffer += 8;
+        blend_kernels->crossfade(dst_buffer + x, src1_buffer + x, src2_buffer + x, mask2, n);
     }
-#endif
-    while (remain >= 4) {
-        alphaBlendCore32(src1_buffer, src2_buffer, dst_buffer, ml, ml, zerol, amaskl);
-        remain -= 4; src1_buffer += 4; src2_buffer += 4; dst_buffer += 4;
-    }
-    while (remain > 0) {
-        alphaBlendPixelCore32(src1_buffer, src2_buffer, dst_buffer, mask2, zerol);
-        --remain; ++src1_buffer; ++src2_buffer; ++dst_buffer;
-    }
-#else
-    for (int i = 0; i < remain; ++i, ++src1_buffer, ++src2_buffer, ++dst_buffer) {
-        Uint32 temp = *src1_buffer & 0xff00ff;
-        Uint32 mask_rb = (((((*src2_buffer & 0xff00ff) - temp) * mask2) >> 8) + temp) & 0xff00ff;
-        temp = *src1_buffer & 0x00ff00;
-        Uint32 mask_g = (((((*src2_buffer & 0x00ff00) - temp) * mask2) >> 8) + temp) & 0x00ff00;
-        *dst_buffer = mask_rb | mask_g;
-    }
-#endif
 }
-#endif
 
 // alphaBlend
 // dst: accumulation_surface
@@ -521,7 +491,7 @@ void ONScripter::alphaBlend(SDL_Surface *mask_surface,
                 ONSBuf *src1_buffer = stsrc1_buffer + screen_width * i;
                 ONSBuf *src2_buffer = stsrc2_buffer + screen_width * i;
                 ONSBuf *dst_buffer = stdst_buffer + screen_width * i;
-                alphaBlendConst32(src1_buffer, src2_buffer, dst_buffer, mask2, rect_w);
+                blend_kernels->crossfadeConst(dst_buffer, src1_buffer, src2_buffer, mask2, rect_w);
             }
         } blender = {(ONSBuf *)src1->pixels + src1->w * rect.y + rect.x,
             (ONSBuf *)src2->pixels + src2->w * rect.y + rect.x,
@@ -644,13 +614,9 @@ void ONScripter::alphaBlendText( SDL_Surface *dst_surface, SDL_Rect dst_rect,
         if (!rotate_flag){
             unsigned char *src_buffer = (unsigned char*)src_surface->pixels + src_surface->pitch * y2 + x2;
             for ( int i=0 ; i<dst_rect.h ; i++ ){
-                for ( int j=dst_rect.w ; j!=0 ; j-- ){
-                    BLEND_PIXEL_TEXT();
-                    src_buffer++;
-                    dst_buffer++;
-                }
-                src_buffer += src_surface->pitch - dst_rect.w;
-                dst_buffer += dst_surface->w - dst_rect.w;
+                blend_kernels->blendText(dst_buffer, src_buffer, dst_rect.w, src_color3);
+                src_buffer += src_surface->pitch;
+                dst_buffer += dst_surface->w;
             }
         }
         else{
@@ -677,9 +643,8 @@ void ONScripter::makeNegaSurface( SDL_Surface *surface, SDL_Rect &clip )
 
     ONSBuf mask = surface->format->Rmask | surface->format->Gmask | surface->format->Bmask;
     for ( int i=clip.y ; i<clip.y + clip.h ; i++ ){
-        for ( int j=clip.x ; j<clip.x + clip.w ; j++ )
-            *buf++ ^= mask;
-        buf += surface->w - clip.w;
+        blend_kernels->nega( buf, clip.w, mask );
+        buf += surface->w;
     }
 
     SDL_UnlockSurface( surface );
@@ -688,24 +653,139 @@ void ONScripter::makeNegaSurface( SDL_Surface *surface, SDL_Rect &clip )
 void ONScripter::makeMonochromeSurface( SDL_Surface *surface, SDL_Rect &clip )
 {
     SDL_LockSurface( surface );
-    ONSBuf *buf = (ONSBuf *)surface->pixels + clip.y * surface->w + clip.x, c;
+    ONSBuf *buf = (ONSBuf *)surface->pixels + clip.y * surface->w + clip.x;
 
     SDL_PixelFormat *fmt = surface->format;
+    // opaque like the rest of the screen, or the layers drawn after would
+    // set the alpha of only the pixels they do not leave out
+    Uint32 lut[256];
+    for ( int i=0 ; i<256 ; i++ )
+        lut[i] = (monocro_color_lut[i][0] >> fmt->Rloss) << fmt->Rshift |
+                 (monocro_color_lut[i][1] >> fmt->Gloss) << fmt->Gshift |
+                 (monocro_color_lut[i][2] >> fmt->Bloss) << fmt->Bshift | fmt->Amask;
     for ( int i=clip.y ; i<clip.y + clip.h ; i++ ){
-        for ( int j=clip.x ; j<clip.x + clip.w ; j++ ){
-            c = ((((*buf & fmt->Rmask) >> fmt->Rshift) << fmt->Rloss) * 77 +
-                 (((*buf & fmt->Gmask) >> fmt->Gshift) << fmt->Gloss) * 151 +
-                 (((*buf & fmt->Bmask) >> fmt->Bshift) << fmt->Bloss) * 28 ) >> 8;
-            *buf++ = ((monocro_color_lut[c][0] >> fmt->Rloss) << surface->format->Rshift |
-                      (monocro_color_lut[c][1] >> fmt->Gloss) << surface->format->Gshift |
-                      (monocro_color_lut[c][2] >> fmt->Bloss) << surface->format->Bshift);
-        }
-        buf += surface->w - clip.w;
+        blend_kernels->monochrome( buf, clip.w, fmt->Rshift, lut );
+        buf += surface->w;
     }
 
     SDL_UnlockSurface( surface );
 }
 
+void ONScripter::updateLiveSprites()
+{
+    if (live_sprites_generation == AnimationInfo::surface_generation) return;
+    live_sprites_generation = AnimationInfo::surface_generation;
+
+    live_sprites.clear();
+    for ( int i=MAX_SPRITE_NUM-1 ; i>=0 ; i-- )
+        if ( sprite_info[i].image_surface ) live_sprites.push_back( i );
+    live_sprites2.clear();
+    for ( int i=MAX_SPRITE2_NUM-1 ; i>=0 ; i-- )
+        if ( sprite2_info[i].image_surface ) live_sprites2.push_back( i );
+}
+
+// the sprites numbered from hi down to lo which are on screen within clip
+void ONScripter::drawSprites( SDL_Surface *dst_surface, AnimationInfo *sprites, const std::vector<int> &live,
+                              int hi, int lo, SDL_Rect &clip, AnimationInfo *&cover, CompositeStats &stats )
+{
+    for ( size_t k=0 ; k<live.size() && live[k] >= lo ; k++ ){
+        if ( live[k] > hi ) continue;
+        AnimationInfo *anim = &sprites[live[k]];
+        if ( !anim->image_surface || !anim->visible ) continue;
+        stats.sprites_visited++;
+
+#ifdef USE_BUILTIN_LAYER_EFFECTS
+        if ( anim->trans_mode != AnimationInfo::TRANS_LAYER )
+#endif
+        {
+            SDL_Rect rect = getLayerRect( anim );
+            if ( AnimationInfo::doClipping( &rect, &clip ) ) continue;
+        }
+
+        stats.sprites_drawn++;
+        drawLayer( dst_surface, anim, clip, cover, stats );
+    }
+}
+
+void ONScripter::drawLayer( SDL_Surface *dst_surface, AnimationInfo *anim, SDL_Rect &clip,
+                            AnimationInfo *&cover, CompositeStats &stats )
+{
+    if ( cover && cover != anim ){
+        SDL_Rect rect = getLayerRect( anim );
+        if ( AnimationInfo::doClipping( &rect, &clip ) == 0 )
+            stats.pixels_skipped += (size_t)rect.w * rect.h;
+        return;
+    }
+    cover = NULL;
+    drawTaggedSurface( dst_surface, anim, clip, &stats );
+}
+
+// where anim is drawn on screen
+SDL_Rect ONScripter::getLayerRect( AnimationInfo *anim )
+{
+    if ( anim->affine_flag ) return anim->bounding_rect;
+
+    SDL_Rect rect = anim->pos;
+    if ( !anim->abs_flag ){
+        rect.x += sentence_font.x() * screen_ratio1 / screen_ratio2;
+        rect.y += sentence_font.y() * screen_ratio1 / screen_ratio2;
+    }
+    return rect;
+}
+
+// Whether anim hides all of clip: an opaque image, neither rotated nor
+// scaled, that blendOnSurface() copies as it is.
+bool ONScripter::hidesClip( AnimationInfo *anim, SDL_Rect &clip )
+{
+    if ( !anim->image_surface || anim->affine_flag || !anim->isOpaque() ) return false;
+    if ( anim->trans == 0 || (anim->trans & 0xff) != 255 ||
+         anim->blending_mode != AnimationInfo::BLEND_NORMAL ) return false;
+    if ( !anim->premultiplied && !blend_kernels->copies_opaque ) return false;
+
+    SDL_Rect rect = getLayerRect( anim );
+    return rect.x <= clip.x && rect.x + rect.w >= clip.x + clip.w &&
+           rect.y <= clip.y && rect.y + rect.h >= clip.y + clip.h;
+}
+
+// the last of the sprites drawSprites() would draw that hides clip
+void ONScripter::findCover( AnimationInfo *&cover, AnimationInfo *sprites, const std::vector<int> &live,
+                            int hi, int lo, SDL_Rect &clip )
+{
+    for ( size_t k=0 ; k<live.size() && live[k] >= lo ; k++ ){
+        if ( live[k] > hi ) continue;
+        if ( sprites[live[k]].visible && hidesClip( &sprites[live[k]], clip ) )
+            cover = &sprites[live[k]];
+    }
+}
+
+// The topmost layer composeSurface() draws that hides clip, in its order,
+// or NULL.
+AnimationInfo *ONScripter::findCover( SDL_Rect &clip, int refresh_mode, int layers )
+{
+    // the layer effects are refreshed whether they are seen or not
+    if ( hasVisibleLayer() ) return NULL;
+
+    bool below = layers & LAYERS_BELOW_TEXT, above = layers & LAYERS_TEXT_AND_ABOVE;
+    bool below_window = windowback_flag ? above : below;
+    AnimationInfo *cover = NULL;
+
+    if ( !all_sprite_hide_flag && below ){
+        int top = ( z_order < 10 && refresh_mode & REFRESH_SAYA_MODE ) ? 9 : z_order;
+        findCover( cover, sprite_info, live_sprites, MAX_SPRITE_NUM-1, top+1, clip );
+        for ( int i=0 ; i<3 ; i++ )
+            if ( human_order[2-i] >= 0 && hidesClip( &tachi_info[human_order[2-i]], clip ) )
+                cover = &tachi_info[human_order[2-i]];
+    }
+    if ( windowback_flag && below && !all_sprite2_hide_flag )
+        findCover( cover, sprite2_info, live_sprites2, MAX_SPRITE2_NUM-1, 0, clip );
+    if ( !all_sprite_hide_flag && below_window )
+        findCover( cover, sprite_info, live_sprites, z_order, ( refresh_mode & REFRESH_SAYA_MODE ) ? 10 : 0, clip );
+    if ( !windowback_flag && below && !all_sprite2_hide_flag )
+        findCover( cover, sprite2_info, live_sprites2, MAX_SPRITE2_NUM-1, 0, clip );
+
+    return cover;
+}
+
 void ONScripter::refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src, int refresh_mode )
 {
     if (refresh_mode == REFRESH_NONE_MODE) return;
@@ -716,62 +796,252 @@ void ONScripter::refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src, int r
     clip.h = surface->h;
     if (clip_src) if ( AnimationInfo::doClipping( &clip, clip_src ) ) return;
 
-    int i, top;
-    SDL_BlitSurface( bg_info.image_surface, &clip, surface, &clip );
+    updateLiveSprites();
+
+    // While the text window is shown, the layers below it are recomposed
+    // only when they change, not for every string and cursor frame.
+    if ( layer_cache_surface && refresh_mode & (REFRESH_SHADOW_MODE | REFRESH_TEXT_MODE) &&
+         !hasVisibleLayer() ){
+        makeLayerKey( layer_key, refresh_mode );
+        if ( layer_key != layer_cache_key ){
+            layer_cache_key.swap( layer_key );
+            layer_cache_rect.w = layer_cache_rect.h = 0;
+        }
+
+        SDL_Rect rect = clip;
+        if ( layer_cache_rect.w == 0 ||
+             AnimationInfo::doClipping( &rect, &layer_cache_rect ) ||
+             rect.w != clip.w || rect.h != clip.h ){
+            // what is kept grows to the bounding box of what was asked
+            if ( layer_cache_rect.w > 0 ){
+                int x2 = utils::max( clip.x + clip.w, layer_cache_rect.x + layer_cache_rect.w );
+                int y2 = utils::max( clip.y + clip.h, layer_cache_rect.y + layer_cache_rect.h );
+                rect.x = utils::min( clip.x, layer_cache_rect.x );
+                rect.y = utils::min( clip.y, layer_cache_rect.y );
+                rect.w = x2 - rect.x;
+                rect.h = y2 - rect.y;
+            }
+            else{
+                rect = clip;
+            }
+            if ( findCover( rect, refresh_mode, LAYERS_BELOW_TEXT ) )
+                composite_stats.pixels_skipped += (size_t)rect.w * rect.h;
+            else
+                SDL_BlitSurface( bg_info.image_surface, &rect, layer_cache_surface, &rect );
+            composeLayers( layer_cache_surface, rect, refresh_mode, LAYERS_BELOW_TEXT );
+            layer_cache_rect = rect;
+            composite_stats.layer_cache_misses++;
+        }
+        else{
+            composite_stats.layer_cache_hits++;
+        }
+
+        SDL_BlitSurface( layer_cache_surface, &clip, surface, &clip );
+        composeLayers( surface, clip, refresh_mode, LAYERS_TEXT_AND_ABOVE );
+        return;
+    }
+
+    if ( findCover( clip, refresh_mode, LAYERS_BELOW_TEXT | LAYERS_TEXT_AND_ABOVE ) )
+        composite_stats.pixels_skipped += (size_t)clip.w * clip.h;
+    else
+        SDL_BlitSurface( bg_info.image_surface, &clip, surface, &clip );
+    composeLayers( surface, clip, refresh_mode, LAYERS_BELOW_TEXT | LAYERS_TEXT_AND_ABOVE );
+}
+
+void ONScripter::composeLayers( SDL_Surface *surface, SDL_Rect &clip, int refresh_mode, int layers )
+{
+    // the background is blitted beforehand, the bands would share the
+    // blit map of bg_info
+    BandJob job;
+    int num_bands = 1;
+    if ( band_compositor.getThreads() > 1 && canComposeInBands() )
+        num_bands = BandCompositor::split( clip, band_compositor.getThreads(), job.clip );
+    for ( int i=1 ; i<num_bands ; i++ ){
+        // every band locks a surface of its own on the same pixels
+        SDL_PixelFormat *fmt = surface->format;
+        job.surface[i] = SDL_CreateRGBSurfaceWithFormatFrom( surface->pixels, surface->w, surface->h,
+                                                             fmt->BitsPerPixel, surface->pitch, fmt->format );
+        if ( job.surface[i] == NULL ){
+            while ( --i > 0 ) SDL_FreeSurface( job.surface[i] );
+            num_bands = 1;
+        }
+    }
+    if ( num_bands == 1 ){
+        composeSurface( surface, clip, refresh_mode, layers, composite_stats );
+        return;
+    }
+
+    job.ons = this;
+    job.surface[0] = surface;
+    job.refresh_mode = refresh_mode;
+    job.layers = layers;
+    for ( int i=0 ; i<num_bands ; i++ ){
+        job.stats[i].sprites_visited = job.stats[i].sprites_drawn = 0;
+        job.stats[i].pixels_skipped = 0;
+    }
+
+#if defined(USE_PARALLEL) || defined(USE_OMP_PARALLEL)
+    parallel::serial = true;
+#endif
+    AnimationInfo::shared_blending = true;
+    band_compositor.run( num_bands, composeBand, &job );
+    AnimationInfo::shared_blending = false;
+#if defined(USE_PARALLEL) || defined(USE_OMP_PARALLEL)
+    parallel::serial = false;
+#endif
+
+    for ( int i=0 ; i<num_bands ; i++ ){
+        composite_stats.sprites_visited += job.stats[i].sprites_visited;
+        composite_stats.sprites_drawn += job.stats[i].sprites_drawn;
+        composite_stats.pixels_skipped += job.stats[i].pixels_skipped;
+        if ( i > 0 ) SDL_FreeSurface( job.surface[i] );
+    }
+}
+
+void ONScripter::composeBand( void *data, int band )
+{
+    BandJob *job = (BandJob*)data;
+    job->ons->composeSurface( job->surface[band], job->clip[band], job->refresh_mode, job->layers, job->stats[band] );
+}
+
+bool ONScripter::hasVisibleLayer()
+{
+#ifdef USE_BUILTIN_LAYER_EFFECTS
+    for ( size_t k=0 ; k<live_sprites.size() ; k++ ){
+        AnimationInfo *anim = &sprite_info[live_sprites[k]];
+        if ( anim->image_surface && anim->visible &&
+             anim->trans_mode == AnimationInfo::TRANS_LAYER ) return true;
+    }
+#endif
+    return false;
+}
+
+bool ONScripter::canComposeInBands()
+{
+#ifdef USE_SMPEG
+    return false; // convertFromYUV() writes to the images from the decoder
+#endif
+    // the layers move their sprites and keep surfaces of their own
+    return !hasVisibleLayer();
+}
+
+// what the layers drawn by anim depend on
+static void addLayerKey( std::vector<int> &key, int no, AnimationInfo *anim, int offset_x, int offset_y )
+{
+    if ( !anim->image_surface ) return;
+
+    uintptr_t image = (uintptr_t)anim->image_surface;
+    int state[] = { no, (int)image, (int)(image >> 16 >> 16), (int)anim->image_version,
+                    anim->trans, anim->current_cell, anim->trans_mode, anim->blending_mode,
+                    anim->premultiplied, anim->pos.x, anim->pos.y, anim->pos.w, anim->pos.h,
+                    anim->abs_flag ? 0 : offset_x, anim->abs_flag ? 0 : offset_y, anim->affine_flag };
+    key.insert( key.end(), state, state + sizeof(state)/sizeof(state[0]) );
+    if ( anim->affine_flag ){
+        int affine[] = { anim->affine_pos.x, anim->affine_pos.y, anim->affine_pos.w, anim->affine_pos.h,
+                         anim->bounding_rect.x, anim->bounding_rect.y, anim->bounding_rect.w, anim->bounding_rect.h,
+                         anim->inv_mat[0][0], anim->inv_mat[0][1], anim->inv_mat[1][0], anim->inv_mat[1][1],
+                         anim->corner_xy[0][0], anim->corner_xy[0][1], anim->corner_xy[1][0], anim->corner_xy[1][1],
+                         anim->corner_xy[2][0], anim->corner_xy[2][1], anim->corner_xy[3][0], anim->corner_xy[3][1] };
+        key.insert( key.end(), affine, affine + sizeof(affine)/sizeof(affine[0]) );
+    }
+}
 
+// Everything the layers below the text window depend on, in the order of
+// composeSurface(), so that they are the same whenever the keys are.
+void ONScripter::makeLayerKey( std::vector<int> &key, int refresh_mode )
+{
+    int offset_x = sentence_font.x() * screen_ratio1 / screen_ratio2;
+    int offset_y = sentence_font.y() * screen_ratio1 / screen_ratio2;
+    int upper_top = ( z_order < 10 && refresh_mode & REFRESH_SAYA_MODE ) ? 9 : z_order;
+    int lower_top = ( refresh_mode & REFRESH_SAYA_MODE ) ? 10 : 0;
+
+    key.clear();
+    int state[] = { windowback_flag, refresh_mode & REFRESH_SAYA_MODE, all_sprite_hide_flag, all_sprite2_hide_flag,
+                    z_order, nega_mode, monocro_flag, monocro_color[0], monocro_color[1], monocro_color[2],
+                    human_order[0], human_order[1], human_order[2] };
+    key.insert( key.end(), state, state + sizeof(state)/sizeof(state[0]) );
+
+    addLayerKey( key, -1, &bg_info, offset_x, offset_y );
     if ( !all_sprite_hide_flag ){
+        for ( size_t k=0 ; k<live_sprites.size() ; k++ ){
+            int no = live_sprites[k];
+            if ( !sprite_info[no].visible ) continue;
+            if ( no > upper_top || (!windowback_flag && no >= lower_top && no <= z_order) )
+                addLayerKey( key, no, &sprite_info[no], offset_x, offset_y );
+        }
+        for ( int i=0 ; i<3 ; i++ )
+            if ( human_order[i] >= 0 )
+                addLayerKey( key, i, &tachi_info[human_order[i]], offset_x, offset_y );
+    }
+    if ( !all_sprite2_hide_flag ){
+        for ( size_t k=0 ; k<live_sprites2.size() ; k++ )
+            if ( sprite2_info[live_sprites2[k]].visible )
+                addLayerKey( key, live_sprites2[k], &sprite2_info[live_sprites2[k]], offset_x, offset_y );
+    }
+    if ( !windowback_flag && !(refresh_mode & REFRESH_SAYA_MODE) ){
+        for ( int i=0 ; i<MAX_PARAM_NUM ; i++ ){
+            if ( bar_info[i] )   addLayerKey( key, i, bar_info[i], offset_x, offset_y );
+            if ( prnum_info[i] ) addLayerKey( key, i, prnum_info[i], offset_x, offset_y );
+        }
+    }
+}
+
+void ONScripter::composeSurface( SDL_Surface *surface, SDL_Rect &clip, int refresh_mode, int layers,
+                                 CompositeStats &stats )
+{
+    int i, top;
+    bool below = layers & LAYERS_BELOW_TEXT, above = layers & LAYERS_TEXT_AND_ABOVE;
+    // with windowback, the text window goes under the sprites up to z_order
+    // and the bars instead of over them
+    bool below_window = windowback_flag ? above : below;
+    // the layers under it would not be seen
+    AnimationInfo *cover = findCover( clip, refresh_mode, layers );
+
+    if ( !all_sprite_hide_flag && below ){
         if ( z_order < 10 && refresh_mode & REFRESH_SAYA_MODE )
             top = 9;
         else
             top = z_order;
-        for ( i=MAX_SPRITE_NUM-1 ; i>top ; i-- ){
-            if ( sprite_info[i].image_surface && sprite_info[i].visible )
-                drawTaggedSurface( surface, &sprite_info[i], clip );
-        }
+        drawSprites( surface, sprite_info, live_sprites, MAX_SPRITE_NUM-1, top+1, clip, cover, stats );
     }
 
-    if ( !all_sprite_hide_flag ){
+    if ( !all_sprite_hide_flag && below ){
         for ( i=0 ; i<3 ; i++ ){
             if (human_order[2-i] >= 0 && tachi_info[human_order[2-i]].image_surface)
-                drawTaggedSurface( surface, &tachi_info[human_order[2-i]], clip );
+                drawLayer( surface, &tachi_info[human_order[2-i]], clip, cover, stats );
         }
     }
 
-    if ( windowback_flag ){
-        if ( nega_mode == 1 ) makeNegaSurface( surface, clip );
-        if ( monocro_flag )   makeMonochromeSurface( surface, clip );
-        if ( nega_mode == 2 ) makeNegaSurface( surface, clip );
+    if ( windowback_flag && below ){
+        if ( !cover ){
+            if ( nega_mode == 1 ) makeNegaSurface( surface, clip );
+            if ( monocro_flag )   makeMonochromeSurface( surface, clip );
+            if ( nega_mode == 2 ) makeNegaSurface( surface, clip );
+        }
 
         if (!all_sprite2_hide_flag){
-            for ( i=MAX_SPRITE2_NUM-1 ; i>=0 ; i-- ){
-                if ( sprite2_info[i].image_surface && sprite2_info[i].visible )
-                    drawTaggedSurface( surface, &sprite2_info[i], clip );
-            }
+            drawSprites( surface, sprite2_info, live_sprites2, MAX_SPRITE2_NUM-1, 0, clip, cover, stats );
         }
+    }
 
+    if ( windowback_flag && above && !cover ){
         if (refresh_mode & REFRESH_SHADOW_MODE)
             shadowTextDisplay( surface, clip );
         if (refresh_mode & REFRESH_TEXT_MODE)
             text_info.blendOnSurface( surface, 0, 0, clip );
     }
 
-    if ( !all_sprite_hide_flag ){
+    if ( !all_sprite_hide_flag && below_window ){
         if ( refresh_mode & REFRESH_SAYA_MODE )
             top = 10;
         else
             top = 0;
-        for ( i=z_order ; i>=top ; i-- ){
-            if ( sprite_info[i].image_surface && sprite_info[i].visible )
-                drawTaggedSurface( surface, &sprite_info[i], clip );
-        }
+        drawSprites( surface, sprite_info, live_sprites, z_order, top, clip, cover, stats );
     }
 
-    if ( !windowback_flag ){
+    if ( !windowback_flag && below ){
         if (!all_sprite2_hide_flag){
-            for ( i=MAX_SPRITE2_NUM-1 ; i>=0 ; i-- ){
-                if ( sprite2_info[i].image_surface && sprite2_info[i].visible )
-                    drawTaggedSurface( surface, &sprite2_info[i], clip );
-            }
+            drawSprites( surface, sprite2_info, live_sprites2, MAX_SPRITE2_NUM-1, 0, clip, cover, stats );
         }
 
         if ( nega_mode == 1 ) makeNegaSurface( surface, clip );
@@ -779,17 +1049,19 @@ void ONScripter::refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src, int r
         if ( nega_mode == 2 ) makeNegaSurface( surface, clip );
     }
 
-    if ( !( refresh_mode & REFRESH_SAYA_MODE ) ){
+    if ( !( refresh_mode & REFRESH_SAYA_MODE ) && below_window ){
         for ( i=0 ; i<MAX_PARAM_NUM ; i++ ){
             if ( bar_info[i] )
-                drawTaggedSurface( surface, bar_info[i], clip );
+                drawTaggedSurface( surface, bar_info[i], clip, &stats );
         }
         for ( i=0 ; i<MAX_PARAM_NUM ; i++ ){
             if ( prnum_info[i] )
-                drawTaggedSurface( surface, prnum_info[i], clip );
+                drawTaggedSurface( surface, prnum_info[i], clip, &stats );
         }
     }
 
+    if ( !above ) return;
+
     if ( !windowback_flag ){
         if (refresh_mode & REFRESH_SHADOW_MODE)
             shadowTextDisplay( surface, clip );
@@ -799,18 +1071,18 @@ void ONScripter::refreshSurface( SDL_Surface *surface, SDL_Rect *clip_src, int r
 
     if ( refresh_mode & REFRESH_CURSOR_MODE && !textgosub_label ){
         if ( clickstr_state == CLICK_WAIT )
-            drawTaggedSurface( surface, &cursor_info[0], clip );
+            drawTaggedSurface( surface, &cursor_info[0], clip, &stats );
         else if ( clickstr_state == CLICK_NEWPAGE )
-            drawTaggedSurface( surface, &cursor_info[1], clip );
+            drawTaggedSurface( surface, &cursor_info[1], clip, &stats );
     }
 
     if (show_dialog_flag)
-        drawTaggedSurface( surface, &dialog_info, clip );
+        drawTaggedSurface( surface, &dialog_info, clip, &stats );
 
     ButtonLink *bl = root_button_link.next;
     while( bl ){
         if (bl->show_flag > 0)
-            drawTaggedSurface( surface, bl->anim[bl->show_flag-1], clip );
+            drawTaggedSurface( surface, bl->anim[bl->show_flag-1], clip, &stats );
         bl = bl->next;
     }
 
@@ -73,17 +73,23 @@ int ONScripter::playSound(const char *filename, int format, bool loop_flag, int
 {
     if ( !audio_open_flag ) return SOUND_NONE;
 
-    long length = script_h.cBR->getFileLength( filename );
-    if (length == 0) return SOUND_NONE;
+    BaseReader::ResolvedFile rf;
+    if (!script_h.cBR->resolveFile( filename, &rf )) return SOUND_NONE;
+    size_t view_length = 0;
+    const unsigned char *view = script_h.cBR->viewFile( rf, &view_length );
+    long length = view ? (long)view_length : (long)rf.length;
     if (!mode_wave_demo_flag &&
         ((skip_mode & SKIP_NORMAL) || ctrl_pressed_status) && (format & SOUND_CHUNK) &&
         ((channel < ONS_MIX_CHANNELS) || (channel == MIX_WAVE_CHANNEL))) {
            return SOUND_NONE;
     }
 
-    unsigned char *buffer;
+    unsigned char *buffer = NULL;
 
-    if (format & SOUND_MUSIC &&
+    if (view){
+        // the mapped archive outlives both Mix_Music and Mix_Chunk
+    }
+    else if (format & SOUND_MUSIC &&
         length == music_buffer_length &&
         music_buffer ){
         buffer = music_buffer;
@@ -94,29 +100,36 @@ int ONScripter::playSound(const char *filename, int format, bool loop_flag, int
             utils::printError("failed to load [%s] because file size [%lu] is too large.\n", filename, length);
             return SOUND_NONE;
         }
-        script_h.cBR->getFile( filename, buffer );
+        script_h.cBR->readFile( rf, buffer );
     }
+    const unsigned char *data = view ? view : buffer;
 
     if (format & SOUND_MUSIC){
 #if SDL_MIXER_MAJOR_VERSION >= 2
-        music_info = Mix_LoadMUS_RW( SDL_RWFromMem( buffer, length ), 0);
+        music_info = Mix_LoadMUS_RW( SDL_RWFromConstMem( data, length ), 0);
 #else
-        music_info = Mix_LoadMUS_RW(SDL_RWFromMem(buffer, length));
+        music_info = Mix_LoadMUS_RW(SDL_RWFromConstMem(data, length));
 #endif
         if (music_info == NULL) {
             utils::printError("can't load music \"%s\": %s\n", filename, Mix_GetError());
         }
         Mix_VolumeMusic( music_volume );
         if ( music_info && Mix_PlayMusic( music_info, (music_play_loop_flag&&music_loopback_offset==0.0)?-1:0 ) == 0 ){
-            music_buffer = buffer;
-            music_buffer_length = length;
+            if (view && music_buffer){
+                delete[] music_buffer;
+                music_buffer = NULL;
+            }
+            if (buffer){
+                music_buffer = buffer;
+                music_buffer_length = length;
+            }
             return SOUND_MUSIC;
         }
         Mix_HookMusicFinished(musicFinishCallback);
     }
 
     if (format & SOUND_CHUNK){
-        Mix_Chunk *chunk = Mix_LoadWAV_RW(SDL_RWFromMem(buffer, length), 1);
+        Mix_Chunk *chunk = Mix_LoadWAV_RW(SDL_RWFromConstMem(data, length), 1);
         if (chunk == NULL) {
             utils::printError("can't load chunk \"%s\": %s\n", filename, Mix_GetError());
         }
@@ -127,8 +140,8 @@ int ONScripter::playSound(const char *filename, int format, bool loop_flag, int
     }
 
     /* check WMA */
-    if ( buffer[0] == 0x30 && buffer[1] == 0x26 &&
-         buffer[2] == 0xb2 && buffer[3] == 0x75 ){
+    if ( data[0] == 0x30 && data[1] == 0x26 &&
+         data[2] == 0xb2 && data[3] == 0x75 ){
         delete[] buffer;
         return SOUND_OTHER;
     }
@@ -139,7 +152,7 @@ int ONScripter::playSound(const char *filename, int format, bool loop_flag, int
             utils::printError("can't open temporaly MIDI file %s\n", TMP_MUSIC_FILE);
         }
         else{
-            fwrite(buffer, 1, length, fp);
+            fwrite(data, 1, length, fp);
             fclose( fp );
             ext_music_play_once_flag = !loop_flag;
             if (playMIDI(loop_flag) == 0){
@@ -260,17 +273,18 @@ int ONScripter::playMPEG(const char *filename, bool click_flag, bool loop_flag)
         return 0;
     }
 
-    unsigned long length = script_h.cBR->getFileLength( filename );
-    if (length == 0){
+    BaseReader::ResolvedFile rf;
+    if (!script_h.cBR->resolveFile( filename, &rf )){
         utils::printError(" *** can't find file [%s] ***\n", filename );
         return 0;
     }
+    unsigned long length = rf.length;
 
     int ret = 0;
 #if defined(USE_SMPEG)
     stopSMPEG();
     layer_smpeg_buffer = new unsigned char[length];
-    script_h.cBR->getFile( filename, layer_smpeg_buffer );
+    script_h.cBR->readFile( rf, layer_smpeg_buffer );
     SMPEG_Info info;
     layer_smpeg_sample = SMPEG_new_rwops( SDL_RWFromMem( layer_smpeg_buffer, length ), &info, 0 );
     if (SMPEG_error( layer_smpeg_sample )){
@@ -76,6 +76,10 @@ namespace parallel {
 
   extern ThreadPool threadPool;
 #endif
+  // Set while the bodies of another parallel job are running, which then
+  // call For themselves: it runs them in the caller.
+  inline bool serial = false;
+
   static int thread_clamp(int threadnum) {
     if (threadnum > thread_num) threadnum = thread_num;
     if (threadnum < 1) threadnum = 1;
@@ -85,7 +89,10 @@ namespace parallel {
   template<typename Body>
   void For(const int first, const int last, const int step, const Body &body, const int scale = -1) {
     assert(step > 0);
-    if (last > first) {
+    if (serial) {
+      for (int i = first; i < last; i += step) body(i);
+    }
+    else if (last > first) {
       static const int MINSCALE = 65536;
 #ifdef USE_OMP_PARALLEL
       scale > 0 ? omp_set_num_threads(thread_clamp(scale / MINSCALE)) : omp_set_num_threads(thread_num);
@@ -35,11 +35,20 @@ SarReader::SarReader( const char *path, const unsigned char *key_table )
 {
     root_archive_info = last_archive_info = &archive_info;
     num_of_sar_archives = 0;
+
+    file_index = NULL;
+    file_index_size = file_index_count = 0;
+
+    memset( &decode_cache_stats, 0, sizeof(decode_cache_stats) );
+    decode_cache_stats.budget = DEFAULT_DECODE_CACHE_SIZE;
 }
 
 SarReader::~SarReader()
 {
+    stopPrefetch();
     close();
+    if (file_index) delete[] file_index;
+    trimDecodeCache( 0 );
 }
 
 int SarReader::open( const char *name )
@@ -55,6 +64,8 @@ int SarReader::open( const char *name )
     memcpy(info->file_name, name, strlen(name)+1);
     
     readArchive( info );
+    addFileIndex( info );
+    mapArchive( info );
 
     last_archive_info->next = info;
     last_archive_info = last_archive_info->next;
@@ -199,33 +210,48 @@ int SarReader::writeHeader( FILE *fp )
     return writeHeaderSub( ai, fp );
 }
 
-size_t SarReader::putFileSub( ArchiveInfo *ai, FILE *fp, int no, size_t offset, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer )
+void SarReader::encodeFileSub( ArchiveInfo *ai, int no, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer, EncodedFile *ef )
 {
-    ai->fi_list[no].compression_type = compression_type;
-    ai->fi_list[no].length = length;
-    ai->fi_list[no].original_length = original_length;
+    ef->compression_type = compression_type;
+    ef->length = length;
+    ef->original_length = original_length;
+    ef->data.clear();
 
-    fseek( fp, offset, SEEK_SET );
     if ( modified_flag ){
-        if ( ai->fi_list[no].compression_type == NBZ_COMPRESSION ){
-            writeLong( fp, ai->fi_list[no].original_length );
-            fseek( ai->file_handle, ai->fi_list[no].offset+2, SEEK_SET );
-            if ( readChar( ai->file_handle ) != 'B' || readChar( ai->file_handle ) != 'Z' ){ // in case the original is not compressed in NBZ
-                ai->fi_list[no].length = encodeNBZ( fp, length, buffer ) + 4;
-                ai->fi_list[no].offset = offset;
-                return ai->fi_list[no].length;
+        if ( compression_type == NBZ_COMPRESSION ){
+            unsigned char bz[2];
+            ef->data.push_back( (original_length>>24) & 0xff );
+            ef->data.push_back( (original_length>>16) & 0xff );
+            ef->data.push_back( (original_length>>8)  & 0xff );
+            ef->data.push_back( original_length & 0xff );
+            readAt( ai->file_handle, ai->fi_list[no].offset+2, bz, 2 );
+            if ( key_table[bz[0]] != 'B' || key_table[bz[1]] != 'Z' ){ // in case the original is not compressed in NBZ
+                size_t len = encodeNBZ( ef->data, length, buffer );
+                ef->length = len + 4;
+                return;
             }
         }
         else{
-            ai->fi_list[no].compression_type = NO_COMPRESSION;
+            ef->compression_type = NO_COMPRESSION;
         }
+        ef->data.insert( ef->data.end(), buffer, buffer + length );
     }
     else{
-        fseek( ai->file_handle, ai->fi_list[no].offset, SEEK_SET );
-        fread( buffer, 1, ai->fi_list[no].length, ai->file_handle );
+        ef->data.resize( length );
+        if ( length > 0 )
+            ef->data.resize( readAt( ai->file_handle, ai->fi_list[no].offset, &ef->data[0], length ) );
     }
+}
+
+size_t SarReader::putEncodedFileSub( ArchiveInfo *ai, FILE *fp, int no, size_t offset, const EncodedFile &ef )
+{
+    ai->fi_list[no].compression_type = ef.compression_type;
+    ai->fi_list[no].length = ef.length;
+    ai->fi_list[no].original_length = ef.original_length;
 
-    size_t len = ai->fi_list[no].length, c;
+    fseek( fp, offset, SEEK_SET );
+    const unsigned char *buffer = ef.data.empty() ? NULL : &ef.data[0];
+    size_t len = ef.data.size(), c;
     while( len > 0 ){
         if ( len > WRITE_LENGTH ) c = WRITE_LENGTH;
         else                      c = len;
@@ -239,14 +265,33 @@ size_t SarReader::putFileSub( ArchiveInfo *ai, FILE *fp, int no, size_t offset,
     return ai->fi_list[no].length;
 }
 
+size_t SarReader::putFileSub( ArchiveInfo *ai, FILE *fp, int no, size_t offset, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer )
+{
+    EncodedFile ef;
+    encodeFileSub( ai, no, length, original_length, compression_type, modified_flag, buffer, &ef );
+
+    return putEncodedFileSub( ai, fp, no, offset, ef );
+}
+
 size_t SarReader::putFile( FILE *fp, int no, size_t offset, size_t length, size_t original_length, bool modified_flag, unsigned char *buffer )
 {
     ArchiveInfo *ai = archive_info.next;
     return putFileSub( ai, fp, no, offset, length, original_length, ai->fi_list[no].compression_type, modified_flag, buffer );
 }
 
+void SarReader::encodeFile( int no, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer, EncodedFile *ef )
+{
+    encodeFileSub( archive_info.next, no, length, original_length, compression_type, modified_flag, buffer, ef );
+}
+
+size_t SarReader::putEncodedFile( FILE *fp, int no, size_t offset, const EncodedFile &ef )
+{
+    return putEncodedFileSub( archive_info.next, fp, no, offset, ef );
+}
+
 int SarReader::close()
 {
+    stopPrefetch();
     ArchiveInfo *info = archive_info.next;
     
     for ( int i=0 ; i<num_of_sar_archives ; i++ ){
@@ -254,6 +299,9 @@ int SarReader::close()
         info = info->next;
         delete last_archive_info;
     }
+    clearFileIndex();
+    trimDecodeCache( 0 );
+
     return 0;
 }
 
@@ -274,58 +322,144 @@ int SarReader::getNumFiles(){
     return num;
 }
 
-int SarReader::getIndexFromFile( ArchiveInfo *ai, const char *file_name )
+void SarReader::capitalizeFileName( char *dst, const char *src )
 {
-    unsigned int i, len;
-
-    len = strlen( file_name );
+    size_t len = strlen( src );
     if ( len > MAX_FILE_NAME_LENGTH ) len = MAX_FILE_NAME_LENGTH;
-    memcpy( capital_name, file_name, len );
-    capital_name[ len ] = '\0';
 
-    for ( i=0 ; i<len ; i++ ){
-        if ( 'a' <= capital_name[i] && capital_name[i] <= 'z' ) capital_name[i] += 'A' - 'a';
-        else if ( capital_name[i] == '/' ) capital_name[i] = '\\';
+    for ( size_t i=0 ; i<len ; i++ ){
+        char ch = src[i];
+        if ( 'a' <= ch && ch <= 'z' ) ch += 'A' - 'a';
+        else if ( ch == '/' ) ch = '\\';
+        dst[i] = ch;
     }
-    for ( i=0 ; i<ai->num_of_files ; i++ ){
-        if ( !strcmp( capital_name, ai->fi_list[i].name ) ) break;
+    dst[len] = '\0';
+}
+
+unsigned int SarReader::hashFileName( const char *name )
+{
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    while ( *name ){
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
     }
+    return hash;
+}
 
-    return i;
+void SarReader::clearFileIndex()
+{
+    if ( file_index ) memset( file_index, 0, sizeof(FileIndexEntry)*file_index_size );
+    file_index_count = 0;
+    file_index_dups.clear();
 }
 
-size_t SarReader::getFileLength( const char *file_name )
+void SarReader::addFileIndex( ArchiveInfo *ai )
 {
-    size_t ret;
-    if ( ( ret = DirectReader::getFileLength( file_name ) ) ) return ret;
+    // keep the load factor at or below 1/2
+    unsigned int required = file_index_count + ai->num_of_files;
+    if ( required*2 > file_index_size ){
+        unsigned int new_size = 1024;
+        while ( new_size < required*2 ) new_size <<= 1;
+
+        FileIndexEntry *new_index = new FileIndexEntry[new_size];
+        memset( new_index, 0, sizeof(FileIndexEntry)*new_size );
+        for ( unsigned int i=0 ; i<file_index_size ; i++ ){
+            if ( file_index[i].ai == NULL ) continue;
+            unsigned int pos = file_index[i].hash & (new_size-1);
+            while ( new_index[pos].ai ) pos = (pos+1) & (new_size-1);
+            new_index[pos] = file_index[i];
+        }
+        if ( file_index ) delete[] file_index;
+        file_index = new_index;
+        file_index_size = new_size;
+    }
 
-    ArchiveInfo *info = archive_info.next;
-    unsigned int j = 0;
-    for ( int i=0 ; i<num_of_sar_archives ; i++ ){
-        j = getIndexFromFile( info, file_name );
-        if ( j != info->num_of_files ) break;
-        info = info->next;
+    unsigned int mask = file_index_size-1;
+    for ( unsigned int i=0 ; i<ai->num_of_files ; i++ ){
+        const char *name = ai->fi_list[i].name;
+        unsigned int hash = hashFileName( name );
+        unsigned int pos = hash & mask;
+        FileIndexEntry entry = { ai, i, hash, 0 };
+        unsigned int *next = NULL;
+        while ( file_index[pos].ai ){
+            FileIndexEntry &e = file_index[pos];
+            if ( e.hash == hash && !strcmp( e.ai->fi_list[e.no].name, name ) ){
+                // an earlier archive takes priority, this one comes after
+                next = &e.next;
+                while ( *next ) next = &file_index_dups[*next-1].next;
+                break;
+            }
+            pos = (pos+1) & mask;
+        }
+        if ( next ){
+            *next = file_index_dups.size() + 1;
+            file_index_dups.push_back( entry );
+            continue;
+        }
+
+        file_index[pos] = entry;
+        file_index_count++;
     }
-    if ( !info ) return 0;
-    
-    if ( info->fi_list[j].original_length != 0 )
-        return info->fi_list[j].original_length;
+}
 
-    int type = info->fi_list[j].compression_type;
-    if ( type == NO_COMPRESSION )
-        type = getRegisteredCompressionType( file_name );
-    if ( type == NBZ_COMPRESSION || type == SPB_COMPRESSION ) {
-        info->fi_list[j].original_length = getDecompressedFileLength( type, info->file_handle, info->fi_list[j].offset );
+bool SarReader::findFileIndex( const char *file_name, ArchiveInfo **ai, unsigned int *no )
+{
+    if ( file_index_count == 0 ) return false;
+
+    char name[MAX_FILE_NAME_LENGTH+1];
+    capitalizeFileName( name, file_name );
+
+    unsigned int hash = hashFileName( name );
+    unsigned int mask = file_index_size-1;
+    for ( unsigned int pos = hash & mask ; file_index[pos].ai ; pos = (pos+1) & mask ){
+        FileIndexEntry &e = file_index[pos];
+        if ( e.hash == hash && !strcmp( e.ai->fi_list[e.no].name, name ) ){
+            // an empty entry is looked up in the next archives, as the
+            // search through each archive in turn did
+            const FileIndexEntry *f = &e;
+            while ( f->next && getFileLengthSub( f->ai, f->no ) == 0 )
+                f = &file_index_dups[f->next-1];
+            *ai = f->ai;
+            *no = f->no;
+            return true;
+        }
     }
-    
-    return info->fi_list[j].original_length;
+
+    return false;
+}
+
+size_t SarReader::getFileLengthSub( ArchiveInfo *ai, unsigned int no )
+{
+    int type = ai->fi_list[no].compression_type;
+    if ( type == NO_COMPRESSION )
+        type = getRegisteredCompressionType( ai->fi_list[no].name );
+    if ( type != NBZ_COMPRESSION && type != SPB_COMPRESSION )
+        return ai->fi_list[no].original_length;
+
+    // the compression type may be registered after open(), so the length
+    // is read from the entry header on the first lookup
+    std::lock_guard<std::mutex> lock( file_length_mutex );
+    if ( ai->fi_list[no].original_length == 0 )
+        ai->fi_list[no].original_length = getDecompressedFileLength( type, ai->file_handle, ai->fi_list[no].offset );
+
+    return ai->fi_list[no].original_length;
 }
 
-size_t SarReader::getFileSub( ArchiveInfo *ai, const char *file_name, unsigned char *buf )
+size_t SarReader::getFileLength( const char *file_name )
 {
-    unsigned int i = getIndexFromFile( ai, file_name );
-    if ( i == ai->num_of_files ) return 0;
+    size_t ret;
+    if ( ( ret = DirectReader::getFileLength( file_name ) ) ) return ret;
+
+    ArchiveInfo *ai;
+    unsigned int no;
+    if ( !findFileIndex( file_name, &ai, &no ) ) return 0;
+
+    return getFileLengthSub( ai, no );
+}
 
+size_t SarReader::getFileSub( ArchiveInfo *ai, unsigned int no, unsigned char *buf )
+{
 #if defined(PSP)
     if (ai->power_resume_number != psp_power_resume_number){
         FILE *fp = fopen(ai->file_name, "rb");
@@ -334,21 +468,32 @@ size_t SarReader::getFileSub( ArchiveInfo *ai, const char *file_name, unsigned c
     }
 #endif
 
-    int type = ai->fi_list[i].compression_type;
-    if ( type == NO_COMPRESSION ) type = getRegisteredCompressionType( file_name );
+    int type = ai->fi_list[no].compression_type;
+    if ( type == NO_COMPRESSION ) type = getRegisteredCompressionType( ai->fi_list[no].name );
+
+    if ( type == NBZ_COMPRESSION || type == LZSS_COMPRESSION || type == SPB_COMPRESSION ){
+        size_t ret;
+        if ( findDecodeCache( ai, no, buf, &ret ) ) return ret;
 
-    if      ( type == NBZ_COMPRESSION ){
-        return decodeNBZ( ai->file_handle, ai->fi_list[i].offset, buf );
+        if      ( type == NBZ_COMPRESSION )
+            ret = decodeNBZ( ai->file_handle, ai->fi_list[no].offset, buf );
+        else if ( type == LZSS_COMPRESSION )
+            ret = decodeLZSS( ai, no, buf );
+        else
+            ret = decodeSPB( ai->file_handle, ai->fi_list[no].offset, buf );
+
+        addDecodeCache( ai, no, buf, ret );
+        return ret;
     }
-    else if ( type == LZSS_COMPRESSION ){
-        return decodeLZSS( ai, i, buf );
+
+    size_t ret;
+    if ( ai->mapped_buffer && ai->fi_list[no].offset + ai->fi_list[no].length <= ai->mapped_length ){
+        ret = ai->fi_list[no].length;
+        memcpy( buf, ai->mapped_buffer + ai->fi_list[no].offset, ret );
     }
-    else if ( type == SPB_COMPRESSION ){
-        return decodeSPB( ai->file_handle, ai->fi_list[i].offset, buf );
+    else{
+        ret = readAt( ai->file_handle, ai->fi_list[no].offset, buf, ai->fi_list[no].length );
     }
-
-    fseek( ai->file_handle, ai->fi_list[i].offset, SEEK_SET );
-    size_t ret = fread( buf, 1, ai->fi_list[i].length, ai->file_handle );
     if (key_table_flag)
         for (size_t j=0 ; j<ret ; j++) buf[j] = key_table[buf[j]];
     return ret;
@@ -359,15 +504,161 @@ size_t SarReader::getFile( const char *file_name, unsigned char *buf, int *locat
     size_t ret;
     if ( ( ret = DirectReader::getFile( file_name, buf, location ) ) ) return ret;
 
-    ArchiveInfo *info = archive_info.next;
-    size_t j = 0;
-    for ( int i=0 ; i<num_of_sar_archives ; i++ ){
-        if ( (j = getFileSub( info, file_name, buf )) > 0 ) break;
-        info = info->next;
-    }
+    ArchiveInfo *ai;
+    unsigned int no;
+    if ( !findFileIndex( file_name, &ai, &no ) ) return 0;
     if ( location ) *location = ARCHIVE_TYPE_SAR;
     
-    return j;
+    return getFileSub( ai, no, buf );
+}
+
+void SarReader::resolveFileSub( ArchiveInfo *ai, unsigned int no, int location, ResolvedFile *rf )
+{
+    rf->location = location;
+    rf->compression_type = ai->fi_list[no].compression_type;
+    if ( rf->compression_type == NO_COMPRESSION )
+        rf->compression_type = getRegisteredCompressionType( ai->fi_list[no].name );
+    rf->offset = ai->fi_list[no].offset;
+    rf->length = getFileLengthSub( ai, no );
+    rf->ai = ai;
+    rf->no = no;
+    rf->path.clear();
+}
+
+bool SarReader::getPrefetchRange( const ResolvedFile &rf, FILE **fp, size_t *offset, size_t *length, bool *mapped )
+{
+    if ( rf.ai == NULL ) return false;
+
+    FileInfo &fi = rf.ai->fi_list[rf.no];
+    *fp = rf.ai->file_handle;
+    *offset = fi.offset;
+    *length = fi.length;
+    // same choice as getFileSub()
+    *mapped = rf.ai->mapped_buffer && fi.offset + fi.length <= rf.ai->mapped_length &&
+        rf.compression_type != NBZ_COMPRESSION && rf.compression_type != LZSS_COMPRESSION &&
+        rf.compression_type != SPB_COMPRESSION;
+
+    return true;
+}
+
+bool SarReader::resolveFile( const char *file_name, ResolvedFile *rf )
+{
+    if ( DirectReader::resolveFile( file_name, rf ) ) return true;
+
+    ArchiveInfo *ai;
+    unsigned int no;
+    if ( !findFileIndex( file_name, &ai, &no ) ) return false;
+    resolveFileSub( ai, no, ARCHIVE_TYPE_SAR, rf );
+
+    return rf->length > 0;
+}
+
+size_t SarReader::readFile( const ResolvedFile &rf, unsigned char *buffer )
+{
+    if ( rf.ai == NULL ) return DirectReader::readFile( rf, buffer );
+
+    return getFileSub( rf.ai, rf.no, buffer );
+}
+
+const unsigned char *SarReader::viewFile( const ResolvedFile &rf, size_t *length )
+{
+    if ( rf.ai == NULL ) return NULL;
+
+    return getFileViewSub( rf.ai, rf.no, length );
+}
+
+void SarReader::setDecodeCacheSize( size_t bytes )
+{
+    std::lock_guard<std::mutex> lock( decode_cache_mutex );
+    decode_cache_stats.budget = bytes;
+    trimDecodeCache( bytes );
+}
+
+BaseReader::DecodeCacheStats SarReader::getDecodeCacheStats()
+{
+    std::lock_guard<std::mutex> lock( decode_cache_mutex );
+    return decode_cache_stats;
+}
+
+bool SarReader::findDecodeCache( ArchiveInfo *ai, unsigned int no, unsigned char *buf, size_t *length )
+{
+    std::lock_guard<std::mutex> lock( decode_cache_mutex );
+    if ( decode_cache_stats.budget == 0 ) return false;
+
+    std::map<std::pair<ArchiveInfo*, unsigned int>, DecodeCacheList::iterator>::iterator it =
+        decode_cache_map.find( std::make_pair( ai, no ) );
+    if ( it == decode_cache_map.end() ){
+        decode_cache_stats.misses++;
+        return false;
+    }
+
+    decode_cache.splice( decode_cache.begin(), decode_cache, it->second );
+    memcpy( buf, it->second->buf, it->second->length );
+    *length = it->second->length;
+    decode_cache_stats.hits++;
+
+    return true;
+}
+
+void SarReader::addDecodeCache( ArchiveInfo *ai, unsigned int no, const unsigned char *buf, size_t length )
+{
+    std::lock_guard<std::mutex> lock( decode_cache_mutex );
+    if ( length == 0 || length > decode_cache_stats.budget ) return;
+    // another thread may have decoded the same entry meanwhile
+    if ( decode_cache_map.count( std::make_pair( ai, no ) ) ) return;
+
+    trimDecodeCache( decode_cache_stats.budget - length );
+
+    DecodeCacheEntry e;
+    e.ai = ai;
+    e.no = no;
+    e.buf = new unsigned char[length];
+    e.length = length;
+    memcpy( e.buf, buf, length );
+    decode_cache.push_front( e );
+    decode_cache_map[std::make_pair( ai, no )] = decode_cache.begin();
+    decode_cache_stats.bytes += length;
+}
+
+// Drops least recently used entries until at most budget bytes remain.
+// Called with decode_cache_mutex held, or from close() and the destructor.
+void SarReader::trimDecodeCache( size_t budget )
+{
+    while ( decode_cache_stats.bytes > budget ){
+        DecodeCacheEntry &e = decode_cache.back();
+        decode_cache_map.erase( std::make_pair( e.ai, e.no ) );
+        decode_cache_stats.bytes -= e.length;
+        decode_cache_stats.evictions++;
+        delete[] e.buf;
+        decode_cache.pop_back();
+    }
+}
+
+const unsigned char *SarReader::getFileViewSub( ArchiveInfo *ai, unsigned int no, size_t *length )
+{
+    FileInfo &fi = ai->fi_list[no];
+    if ( ai->mapped_buffer == NULL || key_table_flag || fi.length == 0 ) return NULL;
+    if ( fi.compression_type != NO_COMPRESSION ||
+         getRegisteredCompressionType( fi.name ) != NO_COMPRESSION ) return NULL;
+    if ( fi.offset + fi.length > ai->mapped_length ) return NULL;
+
+    *length = fi.length;
+    return ai->mapped_buffer + fi.offset;
+}
+
+const unsigned char *SarReader::getFileView( const char *file_name, size_t *length, int *location )
+{
+    // a loose file overrides the archived one, and has no view
+    if ( DirectReader::getFileLength( file_name ) ) return NULL;
+
+    ArchiveInfo *ai;
+    unsigned int no;
+    if ( !findFileIndex( file_name, &ai, &no ) ) return NULL;
+
+    const unsigned char *view = getFileViewSub( ai, no, length );
+    if ( view && location ) *location = ARCHIVE_TYPE_SAR;
+
+    return view;
 }
 
 SarReader::FileInfo SarReader::getFileByIndex( unsigned int index )
@@ -25,6 +25,11 @@
 #define __SAR_READER_H__
 
 #include "DirectReader.h"
+#include <list>
+#include <map>
+#include <vector>
+
+#define DEFAULT_DECODE_CACHE_SIZE (8*1024*1024)
 
 class SarReader : public DirectReader
 {
@@ -39,10 +44,28 @@ public:
     
     size_t getFileLength( const char *file_name );
     size_t getFile( const char *file_name, unsigned char *buf, int *location=NULL );
+    const unsigned char *getFileView( const char *file_name, size_t *length, int *location=NULL );
+    bool resolveFile( const char *file_name, ResolvedFile *rf );
+    size_t readFile( const ResolvedFile &rf, unsigned char *buffer );
+    const unsigned char *viewFile( const ResolvedFile &rf, size_t *length );
     FileInfo getFileByIndex( unsigned int index );
 
+    void setDecodeCacheSize( size_t bytes );
+    DecodeCacheStats getDecodeCacheStats();
+
     int writeHeader( FILE *fp );
     size_t putFile( FILE *fp, int no, size_t offset, size_t length, size_t original_length, bool modified_flag, unsigned char *buffer );
+
+    // putFile() split in two for converters: encodeFile() may run on
+    // several threads at once, putEncodedFile() must be called in order.
+    struct EncodedFile{
+        int compression_type;
+        size_t length;
+        size_t original_length;
+        std::vector<unsigned char> data; // bytes written at the entry offset
+    };
+    virtual void encodeFile( int no, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer, EncodedFile *ef );
+    virtual size_t putEncodedFile( FILE *fp, int no, size_t offset, const EncodedFile &ef );
     
 protected:
     ArchiveInfo archive_info;
@@ -51,11 +74,56 @@ protected:
 
     void readArchive( ArchiveInfo *ai, int archive_type = ARCHIVE_TYPE_SAR, unsigned int offset=0 );
     int readArchiveSub( ArchiveInfo *ai, int archive_type = ARCHIVE_TYPE_SAR, bool check_size = true );
-    int getIndexFromFile( ArchiveInfo *ai, const char *file_name );
-    size_t getFileSub( ArchiveInfo *ai, const char *file_name, unsigned char *buf );
+    size_t getFileLengthSub( ArchiveInfo *ai, unsigned int no );
+    size_t getFileSub( ArchiveInfo *ai, unsigned int no, unsigned char *buf );
+    const unsigned char *getFileViewSub( ArchiveInfo *ai, unsigned int no, size_t *length );
+    void resolveFileSub( ArchiveInfo *ai, unsigned int no, int location, ResolvedFile *rf );
+    bool getPrefetchRange( const ResolvedFile &rf, FILE **fp, size_t *offset, size_t *length, bool *mapped );
+
+    // Case-folded open-addressing hash of every archived name, filled in
+    // priority order so that the first archive holding a name wins.  The
+    // later archives holding it are chained in file_index_dups, for the
+    // names that are empty in the first ones.
+    struct FileIndexEntry{
+        ArchiveInfo *ai;
+        unsigned int no;
+        unsigned int hash;
+        unsigned int next; // 1 + its index in file_index_dups, 0 if none
+    };
+    FileIndexEntry *file_index;
+    unsigned int file_index_size; // power of two
+    unsigned int file_index_count;
+    std::vector<FileIndexEntry> file_index_dups;
+
+    void clearFileIndex();
+    void addFileIndex( ArchiveInfo *ai );
+    bool findFileIndex( const char *file_name, ArchiveInfo **ai, unsigned int *no );
+    static void capitalizeFileName( char *dst, const char *src );
+    static unsigned int hashFileName( const char *name );
+
+    // Decoded SPB/LZSS/NBZ payloads keyed by (archive, entry index), most
+    // recently used first.
+    struct DecodeCacheEntry{
+        ArchiveInfo *ai;
+        unsigned int no;
+        unsigned char *buf;
+        size_t length;
+    };
+    typedef std::list<DecodeCacheEntry> DecodeCacheList;
+    DecodeCacheList decode_cache;
+    std::map<std::pair<ArchiveInfo*, unsigned int>, DecodeCacheList::iterator> decode_cache_map;
+    DecodeCacheStats decode_cache_stats;
+    std::mutex decode_cache_mutex;
+    std::mutex file_length_mutex; // guards the lengths read from NBZ/SPB headers on demand
+
+    bool findDecodeCache( ArchiveInfo *ai, unsigned int no, unsigned char *buf, size_t *length );
+    void addDecodeCache( ArchiveInfo *ai, unsigned int no, const unsigned char *buf, size_t length );
+    void trimDecodeCache( size_t budget );
 
     int writeHeaderSub( ArchiveInfo *ai, FILE *fp, int archive_type = ARCHIVE_TYPE_SAR, int nsa_offset=0 );
     size_t putFileSub( ArchiveInfo *ai, FILE *fp, int no, size_t offset, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer );
+    void encodeFileSub( ArchiveInfo *ai, int no, size_t length, size_t original_length, int compression_type, bool modified_flag, unsigned char *buffer, EncodedFile *ef );
+    size_t putEncodedFileSub( ArchiveInfo *ai, FILE *fp, int no, size_t offset, const EncodedFile &ef );
 };
 
 #endif // __SAR_READER_H__
@@ -41,6 +41,7 @@ extern Coding2UTF16 *coding2utf16;
 ScriptHandler::ScriptHandler()
 {
     save_dir = NULL;
+    cBR = NULL;
     num_of_labels = 0;
     script_buffer = NULL;
     kidoku_buffer = NULL;
@@ -162,7 +163,11 @@ FILE *ScriptHandler::fopen( const char *path, const char *mode, bool use_save_di
         if ( filename[i] == '/' || filename[i] == '\\' )
             filename[i] = DELIMITER;
 
-    return ::fopen( filename, mode );
+    FILE *fp = ::fopen( filename, mode );
+    // the archive reader caches directory listings of archive_path
+    if ( BaseReader::isWriteMode( mode ) && cBR ) cBR->invalidateDirectoryIndex();
+
+    return fp;
 }
 
 void ScriptHandler::setKeyTable( const unsigned char *key_table )
@@ -888,6 +893,129 @@ struct ScriptHandler::LabelInfo ScriptHandler::lookupLabelNext( const char *labe
     return label_info[num_of_labels];
 }
 
+static bool isListed( const char *word, const char **list )
+{
+    for ( ; *list ; list++ )
+        if ( !strcmp( word, *list ) ) return true;
+    return false;
+}
+
+void ScriptHandler::scanAssets( const char *pos, int max_lines,
+                                std::vector<std::string> &images, std::vector<std::string> &sounds )
+{
+    static const char *image_commands[] = {"lsp", "lsph", "lsp2", "lsph2", "bg", "ld", "btndef", NULL};
+    static const char *sound_commands[] = {"wave", "waveloop", "dwave", "dwaveloop", "dwaveload",
+                                           "bgm", "bgmonce", "mp3", "mp3loop", "mp3save", "loopbgm", NULL};
+    static const char *jump_commands[] = {"goto", "gosub", "return", "end", NULL};
+
+    const char *end = script_buffer + script_buffer_length;
+    if ( pos < script_buffer || pos >= end ) return; // in an internal script
+
+    const char *return_stack[16];
+    int num_returns = 0;
+    bool conditional = false; // the rest of the line runs only if
+    int lines = 0;
+
+    while ( pos < end && lines < max_lines ){
+        SKIP_SPACE( pos );
+        if ( *pos == ':' ){
+            pos++;
+            continue;
+        }
+        if ( *pos == 0x0a ){
+            pos++;
+            lines++;
+            conditional = false;
+            continue;
+        }
+
+        char word[16];
+        int len = 0;
+        const char *p = pos;
+        if ( *p == '_' ) p++;
+        while ( (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+                (*p >= '0' && *p <= '9') || *p == '_' ){
+            if ( len < 15 ) word[len++] = (*p >= 'A' && *p <= 'Z') ? *p + 'a' - 'A' : *p;
+            p++;
+        }
+        word[len] = '\0';
+
+        if ( len == 0 ){ // label, comment or text
+            while ( pos < end && *pos != 0x0a ) pos++;
+            continue;
+        }
+
+        if ( !strcmp( word, "if" ) || !strcmp( word, "notif" ) ){
+            // skip the condition up to the first command of interest
+            conditional = true;
+            bool in_quote = false;
+            for ( pos = p ; pos < end && *pos != 0x0a ; pos++ ){
+                if ( *pos == '"' ) in_quote = !in_quote;
+                if ( in_quote || (pos[-1] != ' ' && pos[-1] != '\t') ) continue;
+                const char *q = pos;
+                char w[16];
+                int l = 0;
+                while ( *q >= 'a' && *q <= 'z' && l < 15 ) w[l++] = *q++;
+                w[l] = '\0';
+                if ( isListed( w, image_commands ) || isListed( w, sound_commands ) ||
+                     isListed( w, jump_commands ) ) break;
+            }
+            continue;
+        }
+
+        if ( isListed( word, jump_commands ) ){
+            pos = p;
+            if ( conditional ) continue; // may not be taken, read on
+            lines++; // as the rest of the line is left
+
+            if ( !strcmp( word, "return" ) ){
+                if ( num_returns == 0 ) return;
+                pos = return_stack[--num_returns];
+                continue;
+            }
+            if ( !strcmp( word, "end" ) ) return;
+
+            SKIP_SPACE( pos );
+            if ( *pos != '*' ) return; // the label is in a variable
+            char label[256];
+            int l = 0;
+            for ( pos++ ; l < 255 && ((*pos >= 'a' && *pos <= 'z') || (*pos >= 'A' && *pos <= 'Z') ||
+                                       (*pos >= '0' && *pos <= '9') || *pos == '_') ; pos++ )
+                label[l++] = *pos;
+            label[l] = '\0';
+            int i = findLabel( label, false );
+            if ( i < 0 ) return;
+
+            if ( word[1] == 'o' && word[2] == 's' ){ // gosub
+                if ( num_returns == 16 ) return;
+                return_stack[num_returns++] = pos;
+            }
+            pos = label_info[i].start_address;
+            continue;
+        }
+
+        std::vector<std::string> *names = NULL;
+        if ( isListed( word, image_commands ) ) names = &images;
+        else if ( isListed( word, sound_commands ) ) names = &sounds;
+
+        // to the end of the statement, picking up string literals
+        for ( pos = p ; pos < end && *pos != 0x0a && *pos != ':' && *pos != ';' ; pos++ ){
+            if ( *pos != '"' ) continue;
+            const char *str = ++pos;
+            while ( pos < end && *pos != '"' && *pos != 0x0a ) pos++;
+            if ( pos >= end || *pos != '"' ) break;
+            if ( names == NULL ) continue;
+
+            if ( names == &images && *str == ':' ){ // tagged
+                if ( str[1] == 's' ) continue; // a string, not an image
+                while ( str < pos && *str != ';' ) str++;
+                if ( str < pos ) str++;
+            }
+            if ( str < pos && *str != '>' ) names->push_back( std::string( str, pos - str ) );
+        }
+    }
+}
+
 ScriptHandler::LogLink *ScriptHandler::findAndAddLog( LogInfo &info, const char *name, bool add_flag )
 {
     char capital_name[256];
@@ -1302,7 +1430,7 @@ int ScriptHandler::labelScript()
     return 0;
 }
 
-int ScriptHandler::findLabel( const char *label )
+int ScriptHandler::findLabel( const char *label, bool exit_flag )
 {
     int i;
     char capital_label[256];
@@ -1316,6 +1444,8 @@ int ScriptHandler::findLabel( const char *label )
             return i;
     }
 
+    if (!exit_flag) return -1;
+
     char *p = new char[ 256 ];
     snprintf(p, 256, "Label \"%.200s\" is not found.", label);
     errorAndExit( p );
@@ -30,6 +30,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "BaseReader.h"
+#include <string>
+#include <vector>
 
 #define IS_TWO_BYTE(x) \
         ( ((unsigned char)(x) > (unsigned char)0x80) && ((unsigned char)(x) !=(unsigned char) 0xff) )
@@ -183,6 +185,12 @@ public:
     LabelInfo lookupLabelNext( const char* label );
     void errorAndExit( const char *str );
 
+    // Collects the file names given as string literals to the image and
+    // sound commands within max_lines lines from pos, following goto and
+    // gosub to static labels as the script would.
+    void scanAssets( const char *pos, int max_lines,
+                     std::vector<std::string> &images, std::vector<std::string> &sounds );
+
     ArrayVariable *getRootArrayVariable();
     void loadArrayVariable( FILE *fp );
     
@@ -304,7 +312,7 @@ private:
     void readConfiguration();
     int  labelScript();
 
-    int findLabel( const char* label );
+    int findLabel( const char* label, bool exit_flag=true );
 
     char *checkComma( char *buf );
     void parseStr( char **buf );
@@ -58,6 +58,8 @@ ScriptParser::ScriptParser()
     nsa_path = NULL;
     nsa_offset = 0;
     key_table = NULL;
+    decode_cache_size = DEFAULT_DECODE_CACHE_SIZE;
+    prefetch_size = DEFAULT_PREFETCH_SIZE;
     force_button_shortcut_flag = false;
     
     save_menu_name = NULL;
@@ -260,12 +262,14 @@ void ScriptParser::reset()
 
 int ScriptParser::openScript()
 {
-    script_h.cBR = new NsaReader( 0, archive_path, BaseReader::ARCHIVE_TYPE_NS2, key_table );
+    script_h.cBR = new NsxReader( 0, archive_path, BaseReader::ARCHIVE_TYPE_NS2, key_table );
     if (script_h.cBR->open( nsa_path )){
         delete script_h.cBR;
         script_h.cBR = new DirectReader( archive_path, key_table );
         script_h.cBR->open();
     }
+    script_h.cBR->setDecodeCacheSize( decode_cache_size );
+    script_h.cBR->setPrefetchSize( prefetch_size );
     
     if ( script_h.openScript( archive_path ) ) return -1;
 
@@ -32,7 +32,7 @@
 #include <time.h>
 
 #include "ScriptHandler.h"
-#include "NsaReader.h"
+#include "NsxReader.h"
 #include "DirectReader.h"
 #include "AnimationInfo.h"
 #include "FontInfo.h"
@@ -174,6 +174,10 @@ public:
     int addCommand();
 
 protected:
+    // Called before script_h.cBR is replaced or opens other archives, for
+    // what still reads through it on other threads to let go of it.
+    virtual void releaseReader(){}
+
     struct UserFuncLUT{
         struct UserFuncLUT *next;
         char *command;
@@ -518,6 +522,8 @@ protected:
     ScriptHandler script_h;
 
     unsigned char *key_table;
+    size_t decode_cache_size; // applied to every archive reader created
+    size_t prefetch_size;     // likewise
 
     void createKeyTable( const char *key_exe );
 };
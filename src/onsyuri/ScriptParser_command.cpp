@@ -533,11 +533,14 @@ int ScriptParser::nsaCommand()
         nsa_offset = 2;
     }
 
+    releaseReader();
     delete script_h.cBR;
-    script_h.cBR = new NsaReader( nsa_offset, archive_path, BaseReader::ARCHIVE_TYPE_NSA|BaseReader::ARCHIVE_TYPE_NS2, key_table );
+    script_h.cBR = new NsxReader( nsa_offset, archive_path, BaseReader::ARCHIVE_TYPE_NSA|BaseReader::ARCHIVE_TYPE_NS2, key_table );
     if ( script_h.cBR->open( nsa_path ) ){
         utils::printError(" *** failed to open nsa or ns2 archive, ignored.  ***\n");
     }
+    script_h.cBR->setDecodeCacheSize( decode_cache_size );
+    script_h.cBR->setPrefetchSize( prefetch_size );
 
     return RET_CONTINUE;
 }
@@ -1454,13 +1457,17 @@ int ScriptParser::arcCommand()
     buf2[i] = '\0';
 
     if ( strcmp( script_h.cBR->getArchiveName(), "direct" ) == 0 ){
+        releaseReader();
         delete script_h.cBR;
         script_h.cBR = new SarReader( archive_path, key_table );
+        script_h.cBR->setDecodeCacheSize( decode_cache_size );
+        script_h.cBR->setPrefetchSize( prefetch_size );
         if ( script_h.cBR->open( buf2 ) ){
             utils::printError( " *** failed to open archive %s, ignored.  ***\n", buf2 );
         }
     }
     else if ( strcmp( script_h.cBR->getArchiveName(), "sar" ) == 0 ){
+        releaseReader();
         if ( script_h.cBR->open( buf2 ) ){
             utils::printError( " *** failed to open archive %s, ignored.  ***\n", buf2 );
         }
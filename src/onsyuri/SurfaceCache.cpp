@@ -0,0 +1,129 @@
+/* -*- C++ -*-
+ *
+ *  SurfaceCache.cpp - LRU cache of images ready to be set to AnimationInfo
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SurfaceCache.h"
+
+SurfaceCache::SurfaceCache()
+{
+    mutex = SDL_CreateMutex();
+
+    stats.hits = stats.misses = stats.evictions = 0;
+    stats.bytes = stats.entries = 0;
+    stats.budget = DEFAULT_IMAGE_CACHE_SIZE;
+}
+
+SurfaceCache::~SurfaceCache()
+{
+    clear();
+    if (mutex) SDL_DestroyMutex(mutex);
+}
+
+void SurfaceCache::setSize( size_t size )
+{
+    SDL_mutexP(mutex);
+    stats.budget = size;
+    trim( size );
+    SDL_mutexV(mutex);
+}
+
+SDL_Surface *SurfaceCache::get( const std::string &key, Info *info )
+{
+    SDL_Surface *surface = NULL;
+
+    SDL_mutexP(mutex);
+    std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it = index.find( key );
+    if (it != index.end()){
+        entries.splice( entries.begin(), entries, it->second );
+        surface = it->second->surface;
+        surface->refcount++;
+        *info = it->second->info;
+        stats.hits++;
+    }
+    else if (stats.budget > 0){
+        stats.misses++;
+    }
+    SDL_mutexV(mutex);
+
+    return surface;
+}
+
+bool SurfaceCache::contains( const std::string &key )
+{
+    SDL_mutexP(mutex);
+    bool ret = index.count( key ) > 0;
+    SDL_mutexV(mutex);
+
+    return ret;
+}
+
+void SurfaceCache::put( const std::string &key, SDL_Surface *surface, const Info &info )
+{
+    if (surface == NULL) return;
+    size_t bytes = (size_t)surface->pitch * surface->h;
+
+    SDL_mutexP(mutex);
+    if (bytes <= stats.budget && index.find( key ) == index.end()){
+        trim( stats.budget - bytes );
+
+        Entry entry;
+        entry.key = key;
+        entry.surface = surface;
+        entry.info = info;
+        entry.bytes = bytes;
+        surface->refcount++;
+        entries.push_front( entry );
+        index[key] = entries.begin();
+        stats.bytes += bytes;
+        stats.entries++;
+    }
+    SDL_mutexV(mutex);
+}
+
+void SurfaceCache::clear()
+{
+    SDL_mutexP(mutex);
+    size_t evictions = stats.evictions;
+    trim( 0 );
+    stats.evictions = evictions; // not an eviction
+    SDL_mutexV(mutex);
+}
+
+SurfaceCache::Stats SurfaceCache::getStats()
+{
+    SDL_mutexP(mutex);
+    Stats s = stats;
+    SDL_mutexV(mutex);
+
+    return s;
+}
+
+void SurfaceCache::trim( size_t size )
+{
+    while (stats.bytes > size){
+        Entry &entry = entries.back();
+        SDL_FreeSurface( entry.surface ); // the users keep theirs
+        stats.bytes -= entry.bytes;
+        stats.entries--;
+        stats.evictions++;
+        index.erase( entry.key );
+        entries.pop_back();
+    }
+}
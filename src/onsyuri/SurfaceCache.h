@@ -0,0 +1,89 @@
+/* -*- C++ -*-
+ *
+ *  SurfaceCache.h - LRU cache of images ready to be set to AnimationInfo
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __SURFACE_CACHE_H__
+#define __SURFACE_CACHE_H__
+
+#if defined(ANDROID)
+#include "SDL.h"
+#else
+#include <SDL2/SDL.h>
+#endif
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "image_alpha.h"
+
+#define DEFAULT_IMAGE_CACHE_SIZE (64*1024*1024)
+
+// Surfaces are shared through SDL_Surface::refcount: the cache holds one
+// reference and every AnimationInfo using the surface another, so that
+// eviction never frees a surface still on screen.  Users must not write
+// to a shared surface (see AnimationInfo::detachSurface()).
+class SurfaceCache
+{
+public:
+    // what setupAnimationInfo() computes besides the pixels
+    struct Info{
+        int orig_w, orig_h;
+        AlphaBounds alpha;
+    };
+    struct Stats{
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t bytes;  // held by the cache, shared or not
+        size_t budget;
+        size_t entries;
+    };
+
+    SurfaceCache();
+    ~SurfaceCache();
+
+    // 0 disables the cache and drops what it holds.
+    void setSize( size_t size );
+
+    // Returns a new reference to the surface cached under key, or NULL.
+    SDL_Surface *get( const std::string &key, Info *info );
+    // Whether get() would hit, without counting it.
+    bool contains( const std::string &key );
+    // Adds a reference to surface and keeps it under key.
+    void put( const std::string &key, SDL_Surface *surface, const Info &info );
+    void clear();
+
+    Stats getStats();
+
+private:
+    struct Entry{
+        std::string key;
+        SDL_Surface *surface;
+        Info info;
+        size_t bytes;
+    };
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    SDL_mutex *mutex;
+    Stats stats;
+
+    void trim( size_t size );
+};
+
+#endif // __SURFACE_CACHE_H__
@@ -127,6 +127,10 @@ namespace utils{
         return a < b ? a : b;
     }
 
+	template<class T> T max(T a, T b){
+        return a > b ? a : b;
+    }
+
 	template<class T> T clamp(T x, T min, T max){
         return x < min ? min : (x > max ? max : x);
     }
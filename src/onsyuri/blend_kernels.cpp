@@ -0,0 +1,93 @@
+/* -*- C++ -*-
+ * 
+ *  blend_kernels.cpp - pixel kernels of the compositor chosen at runtime
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "blend_kernels.h"
+#include <string.h>
+
+#define BLEND_KERNELS_NS blend_kernels_scalar_ns
+#define BLEND_KERNELS_TABLE blend_kernels_scalar
+#define BLEND_KERNELS_NAME "scalar"
+#include "blend_kernels.inl"
+
+#ifdef HAVE_BLEND_KERNELS_X86
+extern const BlendKernels blend_kernels_sse2, blend_kernels_ssse3, blend_kernels_avx2;
+#endif
+#ifdef HAVE_BLEND_KERNELS_NEON
+extern const BlendKernels blend_kernels_neon;
+#endif
+
+const BlendKernels *blend_kernels_table[NUM_BLEND_KERNELS] = {
+    &blend_kernels_scalar,
+#ifdef HAVE_BLEND_KERNELS_X86
+    &blend_kernels_sse2,
+    &blend_kernels_ssse3,
+    &blend_kernels_avx2,
+#else
+    NULL, NULL, NULL,
+#endif
+#ifdef HAVE_BLEND_KERNELS_NEON
+    &blend_kernels_neon,
+#else
+    NULL,
+#endif
+};
+
+bool isBlendKernelsSupported( int level )
+{
+    if (level < 0 || level >= NUM_BLEND_KERNELS || blend_kernels_table[level] == NULL) return false;
+
+#ifdef HAVE_BLEND_KERNELS_X86
+    __builtin_cpu_init();
+    if (level == BLEND_KERNELS_SSE2)  return __builtin_cpu_supports("sse2");
+    if (level == BLEND_KERNELS_SSSE3) return __builtin_cpu_supports("ssse3");
+    if (level == BLEND_KERNELS_AVX2)  return __builtin_cpu_supports("avx2");
+#endif
+
+    return true;
+}
+
+static const BlendKernels *bestBlendKernels()
+{
+    for (int i = NUM_BLEND_KERNELS - 1 ; i > 0 ; i--)
+        if (isBlendKernelsSupported( i )) return blend_kernels_table[i];
+
+    return &blend_kernels_scalar;
+}
+
+const BlendKernels *blend_kernels = bestBlendKernels();
+
+bool setBlendKernels( const char *name )
+{
+    if (!strcmp( name, "auto" )){
+        blend_kernels = bestBlendKernels();
+        return true;
+    }
+
+    for (int i = 0 ; i < NUM_BLEND_KERNELS ; i++){
+        if (blend_kernels_table[i] && !strcmp( name, blend_kernels_table[i]->name )){
+            if (!isBlendKernelsSupported( i )) return false;
+            blend_kernels = blend_kernels_table[i];
+            return true;
+        }
+    }
+
+    return false;
+}
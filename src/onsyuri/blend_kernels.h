@@ -0,0 +1,82 @@
+/* -*- C++ -*-
+ * 
+ *  blend_kernels.h - pixel kernels of the compositor chosen at runtime
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __BLEND_KERNELS_H__
+#define __BLEND_KERNELS_H__
+
+#include <stdint.h>
+
+// The kernels below are compiled once per SIMD level, whatever USE_SIMD
+// says (blend_kernels_*.cpp), and the best one the CPU runs is picked at
+// startup.  Each level gives the bytes the build with the flags of that
+// level used to give.  Pixels are 32bpp with the alpha in the top byte.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_BLEND_KERNELS_X86
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define HAVE_BLEND_KERNELS_NEON
+#endif
+
+enum{
+    BLEND_KERNELS_SCALAR,
+    BLEND_KERNELS_SSE2,
+    BLEND_KERNELS_SSSE3,
+    BLEND_KERNELS_AVX2,
+    BLEND_KERNELS_NEON,
+    NUM_BLEND_KERNELS
+};
+
+struct BlendKernels{
+    const char *name;
+    // whether blend() at an alpha of 255 copies the opaque pixels of src as
+    // they are, so that nothing under them shows through
+    bool copies_opaque;
+    // AnimationInfo::blendOnSurface(): dst = src over dst, the alpha of src
+    // scaled by alpha (0 to 255)
+    void (*blend)( uint32_t *dst, const uint32_t *src, int num, int alpha );
+    // BLEND_ADD of the builtin layer effects: dst = dst + src, saturated
+    void (*addBlend)( uint32_t *dst, const uint32_t *src, int num );
+    // ONScripter::alphaBlend(): dst = src1 + (src2 - src1)*mask/256, with
+    // the mask of each pixel repeated in the 4 bytes of mask, or constant
+    void (*crossfade)( uint32_t *dst, const uint32_t *src1, const uint32_t *src2, const uint32_t *mask, int num );
+    void (*crossfadeConst)( uint32_t *dst, const uint32_t *src1, const uint32_t *src2, uint32_t mask, int num );
+    // ONScripter::alphaBlendText(): the opaque color over dst by the 8bit
+    // coverage in src
+    void (*blendText)( uint32_t *dst, const uint8_t *src, int num, uint32_t color );
+    // ONScripter::makeNegaSurface(): buf ^= mask
+    void (*nega)( uint32_t *buf, int num, uint32_t mask );
+    // ONScripter::makeMonochromeSurface(): buf = lut[luma of buf], with the
+    // red and blue at rshift and 16 - rshift
+    void (*monochrome)( uint32_t *buf, int num, int rshift, const uint32_t *lut );
+};
+
+// Those the build has, NULL for the others.
+extern const BlendKernels *blend_kernels_table[NUM_BLEND_KERNELS];
+// The ones in use, the best for the CPU unless set otherwise.
+extern const BlendKernels *blend_kernels;
+
+// Sets the kernels by name ("auto" for the best), false if the CPU can't
+// run them or the build doesn't have them.
+bool setBlendKernels( const char *name );
+bool isBlendKernelsSupported( int level );
+
+#endif // __BLEND_KERNELS_H__
@@ -0,0 +1,440 @@
+/* -*- C++ -*-
+ * 
+ *  blend_kernels.inl - pixel kernels of the compositor, once per SIMD level
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Included by blend_kernels*.cpp, which name the level with one of
+// BLEND_KERNELS_SSE2, _SSSE3, _AVX2 or _NEON (none for scalar), the
+// namespace and the table, after setting the target of the compiler.
+
+#undef USE_SIMD
+#undef USE_SIMD_X86_SSE
+#undef USE_SIMD_X86_SSE2
+#undef USE_SIMD_X86_SSE3
+#undef USE_SIMD_X86_SSSE3
+#undef USE_SIMD_X86_AVX2
+#undef USE_SIMD_ARM_NEON
+#if defined(BLEND_KERNELS_AVX2)
+#define USE_SIMD 1
+#define USE_SIMD_X86_AVX2 1
+#elif defined(BLEND_KERNELS_SSSE3)
+#define USE_SIMD 1
+#define USE_SIMD_X86_SSSE3 1
+#elif defined(BLEND_KERNELS_SSE2)
+#define USE_SIMD 1
+#define USE_SIMD_X86_SSE2 1
+#elif defined(BLEND_KERNELS_NEON)
+#define USE_SIMD 1
+#define USE_SIMD_ARM_NEON 1
+#endif
+
+#ifdef USE_SIMD
+// each level has its own copy of the wrappers, or the linker could keep
+// the out of line AVX2 code of one for all
+#define simd BLEND_KERNELS_NS
+#include "simd/simd.h"
+#if defined(ANDROID)
+#include "SDL.h"
+#else
+#include <SDL2/SDL.h>
+#endif
+#endif
+
+#define RB_MASK    0x00ff00ff
+#define G_MASK     0x0000ff00
+#define ALPHA_MASK 0xff000000
+#ifdef USE_SIMD
+// ALPHA_MASK is of a pixel as an integer, the lanes are its bytes in memory
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+#define ALPHA_LANES 0, 0, 0, 0xff
+#else
+#define ALPHA_LANES 0xff, 0, 0, 0
+#endif
+#endif
+
+namespace BLEND_KERNELS_NS {
+
+#ifdef USE_SIMD
+static void blendPixel( const uint32_t *src, uint32_t *dst, int alpha )
+{
+    using namespace simd;
+    uint8x4 s = load(src), d = load(dst);
+    ivec128 zero = ivec128::zero();
+    uint16x4 r1 = widen(s, zero);
+    uint16x4 du = widen(d, zero);
+    r1 -= du;
+    uint16x4 a((alpha * (*src >> 24)) >> 8);
+    r1 = (r1 * a) >> immint<8>();
+    uint8x4 r = narrow_hz(r1);
+    r += d;
+    *dst = uint8x4::cvt2i32(r) | ALPHA_MASK;
+}
+
+static void blend4Pixel( const uint32_t *src, uint32_t *dst, simd::uint16x8 alpha, simd::uint8x16 alpha_mask,
+                         simd::ivec128 zero, simd::uint8x16 amask )
+{
+    using namespace simd;
+    uint8x16 s = load_u(src), d = load_u(dst);
+    uint16x8 du = widen_lo(d, zero);
+    uint16x8 r1 = widen_lo(s, zero);
+    r1 -= du;
+    du = widen_hi(d, zero);
+    uint16x8 r2 = widen_hi(s, zero);
+    r2 -= du;
+#ifdef USE_SIMD_X86_SSSE3
+    uint8x16 an = shuffle(s, alpha_mask);
+    uint16x8 a = widen_lo(an, zero);
+#else
+    uint16x8 a = uint16x8::set2(src[0] >> 24, src[1] >> 24);
+#endif
+    a = (a * alpha) >> immint<8>();
+    r1 = (r1 * a) >> immint<8>();
+#ifdef USE_SIMD_X86_SSSE3
+    a = widen_hi(an, zero);
+#else
+    a = uint16x8::set2(src[2] >> 24, src[3] >> 24);
+#endif
+    a = (a * alpha) >> immint<8>();
+    r2 = (r2 * a) >> immint<8>();
+    uint8x16 r = pack_hz(r1, r2);
+    r += d;
+    r |= amask;
+    store_u(dst, r);
+}
+
+#ifdef USE_SIMD_X86_AVX2
+static void blend8Pixel( const uint32_t *src, uint32_t *dst, simd::uint16x16 alpha, simd::uint8x32 alpha_mask,
+                         simd::ivec256 zero, simd::uint8x32 amask )
+{
+    using namespace simd;
+    uint8x32 s = load256_u(src), d = load256_u(dst);
+    uint16x16 du = widen_lo(d, zero);
+    uint16x16 r1 = widen_lo(s, zero);
+    r1 -= du;
+    du = widen_hi(d, zero);
+    uint16x16 r2 = widen_hi(s, zero);
+    r2 -= du;
+    uint8x32 an = shuffle(s, alpha_mask);
+    uint16x16 a = widen_lo(an, zero);
+    a = (a * alpha) >> immint<8>();
+    r1 = (r1 * a) >> immint<8>();
+    a = widen_hi(an, zero);
+    a = (a * alpha) >> immint<8>();
+    r2 = (r2 * a) >> immint<8>();
+    uint8x32 r = pack_hz(r1, r2);
+    r += d;
+    r |= amask;
+    store256_u(dst, r);
+}
+#endif
+
+// dst = src1 + (src2 - src1)*m/256
+static void crossfadePixel( const uint32_t *src1, const uint32_t *src2, uint32_t *dst, uint8_t m, simd::ivec128 zero )
+{
+    using namespace simd;
+    uint8x4 s1 = load(src1), s2 = load(src2);
+    uint16x4 r1 = widen(s2, zero);
+    uint16x4 s1u = widen(s1, zero);
+    r1 -= s1u;
+    uint16x4 mv(m);
+    r1 *= mv;
+    r1 >>= immint<8>();
+    uint8x4 r = narrow_hz(r1);
+    r += s1;
+    *dst = uint8x4::cvt2i32(r) | ALPHA_MASK;
+}
+
+static void crossfade4Pixel( const uint32_t *src1, const uint32_t *src2, uint32_t *dst,
+                             simd::uint16x8 m_lo, simd::uint16x8 m_hi, simd::uint8x16 zero, simd::uint8x16 amask )
+{
+    using namespace simd;
+    uint8x16 s1 = load_u(src1), s2 = load_u(src2);
+    uint16x8 s1u = widen_lo(s1, zero);
+    uint16x8 r1 = widen_lo(s2, zero);
+    r1 -= s1u;
+    s1u = widen_hi(s1, zero);
+    uint16x8 r2 = widen_hi(s2, zero);
+    r2 -= s1u;
+    r1 = (r1 * m_lo) >> immint<8>();
+    r2 = (r2 * m_hi) >> immint<8>();
+    uint8x16 r = pack_hz(r1, r2);
+    r = (r + s1) | amask;
+    store_u(dst, r);
+}
+
+#ifdef USE_SIMD_X86_AVX2
+static void crossfade8Pixel( const uint32_t *src1, const uint32_t *src2, uint32_t *dst,
+                             simd::uint16x16 m_lo, simd::uint16x16 m_hi, simd::uint8x32 zero, simd::uint8x32 amask )
+{
+    using namespace simd;
+    uint8x32 s1 = load256_u(src1), s2 = load256_u(src2);
+    uint16x16 s1u = widen_lo(s1, zero);
+    uint16x16 r1 = widen_lo(s2, zero);
+    r1 -= s1u;
+    s1u = widen_hi(s1, zero);
+    uint16x16 r2 = widen_hi(s2, zero);
+    r2 -= s1u;
+    r1 = (r1 * m_lo) >> immint<8>();
+    r2 = (r2 * m_hi) >> immint<8>();
+    uint8x32 r = pack_hz(r1, r2);
+    r = (r + s1) | amask;
+    store256_u(dst, r);
+}
+#endif
+#endif // USE_SIMD
+
+#ifdef USE_SIMD
+// The blocks round opaque pixels at 255 where a single one is copied; copy
+// them after, so that a row blends the same from whichever pixel it starts
+// (the layer cache composes other rects than the screen asks for).
+static void copyOpaque( const uint32_t *src, uint32_t *dst, int num, int alpha )
+{
+    if (alpha != 255) return;
+    for (int i = 0 ; i < num ; i++)
+        if (src[i] >= ALPHA_MASK) dst[i] = src[i];
+}
+#endif
+
+static void blend( uint32_t *dst, const uint32_t *src, int num, int alpha )
+{
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    ivec256 zero = ivec256::zero();
+    uint8x32 mask = uint8x32::set8(3, 7, 11, 15, 19, 23, 27, 31);
+    uint8x32 amask = uint8x32::set(ALPHA_LANES);
+    ivec128 zerol = zero.lo();
+    uint8x16 maskl = mask.lo();
+    uint8x16 amaskl = amask.lo();
+#else
+    ivec128 zerol = ivec128::zero();
+    uint8x16 maskl = uint8x16::set4(3, 7, 11, 15);
+    uint8x16 amaskl = uint8x16::set(ALPHA_LANES);
+#endif
+    while (num > 0){
+        uint32_t a = *src >> 24;
+        if (a == 0){
+            num--; src++; dst++;
+        }
+        else if (a == 255 && alpha == 255){
+            *dst = *src;
+            num--; src++; dst++;
+        }
+#ifdef USE_SIMD_X86_AVX2
+        else if (num >= 8){
+            blend8Pixel(src, dst, uint16x16(alpha), mask, zero, amask);
+            copyOpaque(src, dst, 8, alpha);
+            num -= 8; src += 8; dst += 8;
+        }
+#endif
+        else if (num >= 4){
+            blend4Pixel(src, dst, uint16x8(alpha), maskl, zerol, amaskl);
+            copyOpaque(src, dst, 4, alpha);
+            num -= 4; src += 4; dst += 4;
+        }
+        else{
+            blendPixel(src, dst, alpha);
+            num--; src++; dst++;
+        }
+    }
+#else
+    for ( ; num > 0 ; num--, src++, dst++ ){
+        uint32_t mask2 = ((*src >> 24) * alpha) >> 8;
+        uint32_t temp = *dst & RB_MASK;
+        uint32_t mask_rb = (((((*src & RB_MASK) - temp) * mask2) >> 8) + temp) & RB_MASK;
+        temp = *dst & G_MASK;
+        uint32_t mask_g  = (((((*src & G_MASK) - temp) * mask2) >> 8) + temp) & G_MASK;
+        *dst = mask_rb | mask_g | ALPHA_MASK;
+    }
+#endif
+}
+
+static void addBlend( uint32_t *dst, const uint32_t *src, int num )
+{
+#ifdef USE_SIMD
+    using namespace simd;
+    for ( ; num >= 4 ; num -= 4, src += 4, dst += 4 )
+        store_u(dst, adds(load_u(src), load_u(dst)));
+    for ( ; num > 0 ; num--, src++, dst++ )
+        *dst = uint8x4::cvt2i32(adds(uint8x4::cvt2vec(*dst), uint8x4::cvt2vec(*src)));
+#else
+    for ( ; num > 0 ; num--, src++, dst++ ){
+        if (*src == ALPHA_MASK) continue;
+        uint32_t r = *dst & ALPHA_MASK;
+        for (int shift = 0 ; shift < 24 ; shift += 8){
+            uint32_t c = ((*dst >> shift) & 0xff) + ((*src >> shift) & 0xff);
+            r |= (c < 255 ? c : 255) << shift;
+        }
+        *dst = r;
+    }
+#endif
+}
+
+static void crossfade( uint32_t *dst, const uint32_t *src1, const uint32_t *src2, const uint32_t *mask, int num )
+{
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    ivec256 zero = ivec256::zero();
+    uint8x32 amask = uint8x32::set(ALPHA_LANES);
+    for ( ; num >= 8 ; num -= 8, src1 += 8, src2 += 8, dst += 8, mask += 8 ){
+        uint8x32 m = load256_u(mask);
+        crossfade8Pixel(src1, src2, dst, widen_lo(m, zero), widen_hi(m, zero), zero, amask);
+    }
+    ivec128 zerol = zero.lo();
+    uint8x16 amaskl = amask.lo();
+#else
+    ivec128 zerol = ivec128::zero();
+    uint8x16 amaskl = uint8x16::set(ALPHA_LANES);
+#endif
+    for ( ; num >= 4 ; num -= 4, src1 += 4, src2 += 4, dst += 4, mask += 4 ){
+        uint8x16 m = load_u(mask);
+        crossfade4Pixel(src1, src2, dst, widen_lo(m, zerol), widen_hi(m, zerol), zerol, amaskl);
+    }
+    for ( ; num > 0 ; num--, src1++, src2++, dst++, mask++ )
+        crossfadePixel(src1, src2, dst, *mask & 0xff, zerol);
+#else
+    for ( ; num > 0 ; num--, src1++, src2++, dst++, mask++ ){
+        uint32_t mask2 = *mask & 0xff;
+        uint32_t temp = *src1 & RB_MASK;
+        uint32_t mask_rb = (((((*src2 & RB_MASK) - temp) * mask2) >> 8) + temp) & RB_MASK;
+        temp = *src1 & G_MASK;
+        uint32_t mask_g  = (((((*src2 & G_MASK) - temp) * mask2) >> 8) + temp) & G_MASK;
+        *dst = mask_rb | mask_g;
+    }
+#endif
+}
+
+static void crossfadeConst( uint32_t *dst, const uint32_t *src1, const uint32_t *src2, uint32_t mask2, int num )
+{
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    ivec256 zero = ivec256::zero();
+    uint16x16 m(mask2);
+    uint8x32 amask = uint8x32::set(ALPHA_LANES);
+    for ( ; num >= 8 ; num -= 8, src1 += 8, src2 += 8, dst += 8 )
+        crossfade8Pixel(src1, src2, dst, m, m, zero, amask);
+    ivec128 zerol = zero.lo();
+    uint16x8 ml = m.lo();
+    uint8x16 amaskl = amask.lo();
+#else
+    ivec128 zerol = ivec128::zero();
+    uint16x8 ml(mask2);
+    uint8x16 amaskl = uint8x16::set(ALPHA_LANES);
+#endif
+    for ( ; num >= 4 ; num -= 4, src1 += 4, src2 += 4, dst += 4 )
+        crossfade4Pixel(src1, src2, dst, ml, ml, zerol, amaskl);
+    for ( ; num > 0 ; num--, src1++, src2++, dst++ )
+        crossfadePixel(src1, src2, dst, mask2, zerol);
+#else
+    for ( ; num > 0 ; num--, src1++, src2++, dst++ ){
+        uint32_t temp = *src1 & RB_MASK;
+        uint32_t mask_rb = (((((*src2 & RB_MASK) - temp) * mask2) >> 8) + temp) & RB_MASK;
+        temp = *src1 & G_MASK;
+        uint32_t mask_g  = (((((*src2 & G_MASK) - temp) * mask2) >> 8) + temp) & G_MASK;
+        *dst = mask_rb | mask_g;
+    }
+#endif
+}
+
+static void blendText( uint32_t *dst, const uint8_t *src, int num, uint32_t color )
+{
+    const uint32_t color_rb = color & RB_MASK, color_g = color & G_MASK;
+#ifdef USE_SIMD
+    // 4 pixels at once, those fully in or out of the glyph fixed after
+    using namespace simd;
+    ivec128 zero = ivec128::zero();
+    uint16x8 c = widen_lo(uint8x16::set(color, color >> 8, color >> 16, color >> 24), zero);
+    uint16x8 full(255);
+    for ( ; num >= 4 ; num -= 4, src += 4, dst += 4 ){
+        if ((src[0] | src[1] | src[2] | src[3]) == 0) continue;
+        uint8x16 d = load_u(dst);
+        uint16x8 m1 = uint16x8::set2(src[0], src[1]), m2 = uint16x8::set2(src[2], src[3]);
+        uint16x8 r1 = (widen_lo(d, zero) * (full - m1) + c * m1) >> immint<8>();
+        uint16x8 r2 = (widen_hi(d, zero) * (full - m2) + c * m2) >> immint<8>();
+        uint32_t r[4];
+        store_u(r, pack_hz(r1, r2));
+        for (int i = 0 ; i < 4 ; i++){
+            if (src[i] == 255) dst[i] = color;
+            else if (src[i] != 0) dst[i] = r[i] | ALPHA_MASK;
+        }
+    }
+#endif
+    for ( ; num > 0 ; num--, src++, dst++ ){
+        uint32_t mask2 = *src;
+        if (mask2 == 255){
+            *dst = color;
+        }
+        else if (mask2 != 0){
+            uint32_t mask1 = mask2 ^ 0xff;
+            uint32_t mask_rb = (((*dst & RB_MASK) * mask1 + color_rb * mask2) >> 8) & RB_MASK;
+            uint32_t mask_g  = (((*dst & G_MASK) * mask1 + color_g * mask2) >> 8) & G_MASK;
+            *dst = ALPHA_MASK | mask_rb | mask_g;
+        }
+    }
+}
+
+static void nega( uint32_t *buf, int num, uint32_t mask )
+{
+#ifdef USE_SIMD
+    using namespace simd;
+    uint32x4 m(mask);
+    for ( ; num >= 4 ; num -= 4, buf += 4 )
+        store_u(buf, uint32x4::load_u(buf) ^ m);
+#endif
+    for ( ; num > 0 ; num--, buf++ )
+        *buf ^= mask;
+}
+
+// a table lookup per pixel, the same in all levels
+static void monochrome( uint32_t *buf, int num, int rshift, const uint32_t *lut )
+{
+    const int bshift = 16 - rshift;
+    for ( ; num > 0 ; num--, buf++ )
+        *buf = lut[(((*buf >> rshift) & 0xff) * 77 +
+                    ((*buf >> 8) & 0xff) * 151 +
+                    ((*buf >> bshift) & 0xff) * 28) >> 8];
+}
+
+} // namespace BLEND_KERNELS_NS
+
+extern const BlendKernels BLEND_KERNELS_TABLE = {
+    BLEND_KERNELS_NAME,
+#ifdef USE_SIMD
+    true,
+#else
+    false, // dst leaks through by 1/256
+#endif
+    BLEND_KERNELS_NS::blend,
+    BLEND_KERNELS_NS::addBlend,
+    BLEND_KERNELS_NS::crossfade,
+    BLEND_KERNELS_NS::crossfadeConst,
+    BLEND_KERNELS_NS::blendText,
+    BLEND_KERNELS_NS::nega,
+    BLEND_KERNELS_NS::monochrome,
+};
+
+#undef RB_MASK
+#undef G_MASK
+#undef ALPHA_MASK
+#ifdef USE_SIMD
+#undef ALPHA_LANES
+#undef simd
+#endif
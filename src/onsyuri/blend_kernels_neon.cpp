@@ -0,0 +1,31 @@
+/* -*- C++ -*-
+ * 
+ *  blend_kernels_neon.cpp - blend kernels for NEON
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "blend_kernels.h"
+
+// NEON is part of ARMv8, and on ARMv7 only built when the compiler has it
+#ifdef HAVE_BLEND_KERNELS_NEON
+#define BLEND_KERNELS_NEON
+#define BLEND_KERNELS_NS blend_kernels_neon_ns
+#define BLEND_KERNELS_TABLE blend_kernels_neon
+#define BLEND_KERNELS_NAME "neon"
+#include "blend_kernels.inl"
+#endif
@@ -0,0 +1,40 @@
+/* -*- C++ -*-
+ * 
+ *  blend_kernels_ssse3.cpp - blend kernels for SSSE3
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "blend_kernels.h"
+
+#ifdef HAVE_BLEND_KERNELS_X86
+#ifdef __clang__
+#pragma clang attribute push (__attribute__((target("ssse3"))), apply_to=function)
+#else
+#pragma GCC target("ssse3")
+#endif
+
+#define BLEND_KERNELS_SSSE3
+#define BLEND_KERNELS_NS blend_kernels_ssse3_ns
+#define BLEND_KERNELS_TABLE blend_kernels_ssse3
+#define BLEND_KERNELS_NAME "ssse3"
+#include "blend_kernels.inl"
+
+#ifdef __clang__
+#pragma clang attribute pop
+#endif
+#endif
@@ -0,0 +1,261 @@
+/* -*- C++ -*-
+ * 
+ *  image_alpha.cpp - build the alpha channel of loaded images
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "image_alpha.h"
+#ifdef USE_SIMD
+#include "simd/simd.h"
+#endif
+
+#define RGB_MASK   0x00ffffff
+#define ALPHA_MASK 0xff000000
+#define RB_MASK    0x00ff00ff
+#define G_MASK     0x0000ff00
+
+// dst = src with the inverted low byte of src_a as alpha, dst may be src
+static void alphaFromInverse( uint32_t *dst, const uint32_t *src, const uint32_t *src_a, int num )
+{
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    uint32x8 rgb8(RGB_MASK), amask8(ALPHA_MASK);
+    for ( ; num >= 8 ; num -= 8, dst += 8, src += 8, src_a += 8 ){
+        uint32x8 c = load256_u(src), a = load256_u(src_a);
+        store256_u(dst, (c & rgb8) | (shiftl<24>(a) ^ amask8));
+    }
+#endif
+    uint32x4 rgb(RGB_MASK), amask(ALPHA_MASK);
+    for ( ; num >= 4 ; num -= 4, dst += 4, src += 4, src_a += 4 ){
+        uint32x4 c = uint32x4::load_u(src), a = uint32x4::load_u(src_a);
+        store_u(dst, (c & rgb) | (shiftl<24>(a) ^ amask));
+    }
+#endif
+    for ( ; num > 0 ; num--, dst++, src++, src_a++ )
+        *dst = (*src & RGB_MASK) | ((*src_a & 0xff) ^ 0xff) << 24;
+}
+
+void setupAlphaFromHalves( uint32_t *dst, const uint32_t *src, int w, int h, int num_of_cells )
+{
+    const int w2  = w / num_of_cells;
+    const int w22 = w2 / 2;
+
+    for ( int i=0 ; i<h ; i++ ){
+        const uint32_t *src_c = src + w*i;
+        for ( int c=0 ; c<num_of_cells ; c++, src_c += w2, dst += w22 )
+            alphaFromInverse( dst, src_c, src_c + w22, w22 );
+    }
+}
+
+void setupAlphaFromMask( uint32_t *buffer, int w, int h, int num_of_cells,
+                         const uint32_t *mask, int mask_w, int mask_h )
+{
+    const int w2  = w / num_of_cells;
+    const int mwh = mask_w * mask_h;
+
+    // Rows take w2*num_of_cells pixels and the mask wraps after mask_w+1
+    // of them, as it always has.
+    int i2 = 0;
+    for ( int i=0 ; i<h ; i++ ){
+        const uint32_t *buffer_m = mask + i2;
+        for ( int c=0 ; c<num_of_cells ; c++ ){
+            for ( int j=w2 ; j>0 ; ){
+                int n = mask_w + 1;
+                if ( n > j ) n = j;
+                alphaFromInverse( buffer, buffer, buffer_m, n );
+                buffer += n;
+                j -= n;
+            }
+        }
+        if ( i2 >= mwh ) i2 = 0;
+        else             i2 += mask_w;
+    }
+}
+
+void setupAlphaFromColorKey( uint32_t *buffer, int num, uint32_t ref_color )
+{
+    ref_color &= RGB_MASK;
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    uint32x8 rgb8(RGB_MASK), amask8(ALPHA_MASK), ref8(ref_color);
+    for ( ; num >= 8 ; num -= 8, buffer += 8 ){
+        uint32x8 c = load256_u(buffer);
+        c = c & rgb8;
+        store256_u(buffer, c | andnot(cmpeq(c, ref8), amask8));
+    }
+#endif
+    uint32x4 rgb(RGB_MASK), amask(ALPHA_MASK), ref(ref_color);
+    for ( ; num >= 4 ; num -= 4, buffer += 4 ){
+        uint32x4 c = uint32x4::load_u(buffer) & rgb;
+        store_u(buffer, c | andnot(cmpeq(c, ref), amask));
+    }
+#endif
+    for ( ; num > 0 ; num--, buffer++ ){
+        if ( (*buffer & RGB_MASK) == ref_color )
+            *buffer &= RGB_MASK;
+        else
+            *buffer |= ALPHA_MASK;
+    }
+}
+
+void setupAlphaOpaque( uint32_t *buffer, int num )
+{
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    uint32x8 amask8(ALPHA_MASK);
+    for ( ; num >= 8 ; num -= 8, buffer += 8 ){
+        uint32x8 c = load256_u(buffer);
+        store256_u(buffer, c | amask8);
+    }
+#endif
+    uint32x4 amask(ALPHA_MASK);
+    for ( ; num >= 4 ; num -= 4, buffer += 4 )
+        store_u(buffer, uint32x4::load_u(buffer) | amask);
+#endif
+    for ( ; num > 0 ; num--, buffer++ )
+        *buffer |= ALPHA_MASK;
+}
+
+void premultiplyAlpha( uint32_t *buffer, int num )
+{
+#ifdef USE_SIMD
+    using namespace simd;
+    ivec128 zero = ivec128::zero();
+    uint8x16 amask = uint8x16::set(0, 0, 0, 0xff);
+    uint16x8 half(128);
+#ifdef USE_SIMD_X86_SSSE3
+    uint8x16 alpha_mask = uint8x16::set4(3, 7, 11, 15);
+#endif
+    for ( ; num >= 4 ; num -= 4, buffer += 4 ){
+        if ( (buffer[0] & buffer[1] & buffer[2] & buffer[3]) >= ALPHA_MASK ) continue;
+
+        uint8x16 c = load_u(buffer);
+        // alpha*color/255 for the colors and 255*alpha/255 for the alpha
+#ifdef USE_SIMD_X86_SSSE3
+        uint8x16 a = shuffle(c, alpha_mask) | amask;
+#else
+        const uint8_t *alphap = (const uint8_t *)buffer + 3;
+        uint8x16 a = uint8x16::set4(alphap[0], alphap[4], alphap[8], alphap[12]) | amask;
+#endif
+        uint16x8 c1 = widen_lo(c, zero) * widen_lo(a, zero) + half;
+        uint16x8 c2 = widen_hi(c, zero) * widen_hi(a, zero) + half;
+        c1 = (c1 + (c1 >> immint<8>())) >> immint<8>();
+        c2 = (c2 + (c2 >> immint<8>())) >> immint<8>();
+        store_u(buffer, pack_hz(c1, c2));
+    }
+#endif
+    for ( ; num > 0 ; num--, buffer++ ){
+        uint32_t a = *buffer >> 24;
+        if ( a == 0xff ) continue;
+
+        // x/255 rounded is (x + 128 + ((x + 128) >> 8)) >> 8 for x < 65536
+        uint32_t rb = (*buffer & RB_MASK) * a + 0x00800080;
+        uint32_t g  = (*buffer & G_MASK)  * a + 0x00008000;
+        rb = ((rb + ((rb >> 8) & RB_MASK)) >> 8) & RB_MASK;
+        g  = ((g  + ((g  >> 8) & 0x00ffff00)) >> 8) & G_MASK;
+        *buffer = (*buffer & ALPHA_MASK) | rb | g;
+    }
+}
+
+static bool isColorKey( uint32_t pixel, uint32_t key, bool premultiplied )
+{
+    if ( !premultiplied ) return ((pixel ^ key) & RGB_MASK) == 0;
+    if ( (pixel & ALPHA_MASK) == 0 ) return false;
+
+    key = (key & RGB_MASK) | (pixel & ALPHA_MASK);
+    premultiplyAlpha( &key, 1 );
+    return key == pixel;
+}
+
+void paintColorKeyGradation( uint32_t *buffer, int w, int h, int pitch, uint32_t key,
+                             uint32_t upper, uint32_t lower, uint8_t alpha, bool premultiplied )
+{
+    int upper_bound = -1, lower_bound = -1;
+    for ( int i=0 ; i<h ; i++ ){
+        const uint32_t *buf = buffer + pitch * i;
+        for ( int j=0 ; j<w ; j++ ){
+            if ( isColorKey( buf[j], key, premultiplied ) ){
+                if ( upper_bound < 0 ) upper_bound = i;
+                lower_bound = i;
+                break;
+            }
+        }
+    }
+    if ( upper_bound < 0 ) return;
+
+    for ( int i=upper_bound ; i<=lower_bound ; i++ ){
+        uint32_t color = (uint32_t)alpha << 24;
+        for ( int shift=0 ; shift<24 ; shift+=8 ){
+            int u = (upper >> shift) & 0xff, l = (lower >> shift) & 0xff;
+            if ( upper_bound != lower_bound )
+                u += (l - u) * (i - upper_bound) / (lower_bound - upper_bound);
+            color |= (uint32_t)u << shift;
+        }
+        if ( premultiplied ) premultiplyAlpha( &color, 1 );
+
+        uint32_t *buf = buffer + pitch * i;
+        for ( int j=0 ; j<w ; j++ )
+            if ( isColorKey( buf[j], key, premultiplied ) ) buf[j] = color;
+    }
+}
+
+void scanAlpha( const uint32_t *buffer, int w, int h, int pitch, int num_of_cells, AlphaBounds *bounds )
+{
+    int cell_w = w / num_of_cells;
+    int x1 = cell_w, x2 = 0, y1 = h, y2 = 0;
+    uint32_t all = ALPHA_MASK;
+
+    for ( int i=0 ; i<h ; i++, buffer += pitch ){
+        bool any = false;
+        for ( int c=0 ; c<num_of_cells ; c++ ){
+            const uint32_t *cell = buffer + cell_w * c;
+            int j = 0;
+            while ( j < cell_w && cell[j] < 0x01000000 ) j++;
+            if ( j == cell_w ){
+                all = 0;
+                continue;
+            }
+            any = true;
+            if ( x1 > j ) x1 = j;
+            int k = cell_w;
+            while ( cell[k-1] < 0x01000000 ) k--;
+            if ( x2 < k ) x2 = k;
+            if ( j > 0 || k < cell_w ) all = 0;
+            for ( ; j<k ; j++ ) all &= cell[j];
+        }
+        if ( any ){
+            if ( y1 > i ) y1 = i;
+            y2 = i + 1;
+        }
+    }
+
+    bounds->opaque = h > 0 && cell_w > 0 && all >= ALPHA_MASK;
+    bounds->transparent = y1 >= y2;
+    if ( bounds->transparent ){
+        bounds->x = bounds->y = bounds->w = bounds->h = 0;
+    }
+    else{
+        bounds->x = x1;
+        bounds->y = y1;
+        bounds->w = x2 - x1;
+        bounds->h = y2 - y1;
+    }
+}
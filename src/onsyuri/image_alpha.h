@@ -0,0 +1,66 @@
+/* -*- C++ -*-
+ * 
+ *  image_alpha.h - build the alpha channel of loaded images
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __IMAGE_ALPHA_H__
+#define __IMAGE_ALPHA_H__
+
+#include <stdint.h>
+
+// Kernels of AnimationInfo::setupImageAlpha() on 32bpp pixels, whose
+// alpha is the top byte in either byte order.  The SIMD versions give the
+// same bytes as the scalar ones.
+
+// TRANS_ALPHA: the left half of each cell, with the inverted right half as
+// its alpha, is copied to dst, which is (w/num_of_cells/2)*num_of_cells wide.
+void setupAlphaFromHalves( uint32_t *dst, const uint32_t *src, int w, int h, int num_of_cells );
+// TRANS_MASK: the inverted mask, tiled over each cell, becomes the alpha.
+void setupAlphaFromMask( uint32_t *buffer, int w, int h, int num_of_cells,
+                         const uint32_t *mask, int mask_w, int mask_h );
+// TRANS_TOPLEFT, TRANS_TOPRIGHT and TRANS_DIRECT: the pixels of ref_color
+// (without alpha) become transparent, the others opaque.
+void setupAlphaFromColorKey( uint32_t *buffer, int num, uint32_t ref_color );
+// TRANS_COPY
+void setupAlphaOpaque( uint32_t *buffer, int num );
+
+// Scales the colors by the alpha, rounded, for the kernels of image_blend.h.
+void premultiplyAlpha( uint32_t *buffer, int num );
+
+// sp_rgb_gradation: the pixels of the color key (without alpha) are painted
+// with a vertical gradation from upper to lower over the rows from the first
+// to the last holding the key, with the given alpha.  Each of the three
+// color bytes is interpolated on its own, so the colors may be in either
+// order.  On a premultiplied buffer the key is scaled by the alpha of each
+// pixel before it is compared, and the gradation is written scaled too;
+// transparent pixels there have lost their color and are left alone.
+void paintColorKeyGradation( uint32_t *buffer, int w, int h, int pitch, uint32_t key,
+                             uint32_t upper, uint32_t lower, uint8_t alpha, bool premultiplied );
+
+// What the alpha of an image leaves to draw, the same for all its cells.
+struct AlphaBounds{
+    bool opaque;      // every pixel has an alpha of 255
+    bool transparent; // every pixel has an alpha of 0
+    int x, y, w, h;   // the pixels with alpha within a cell, w and h 0 if none
+};
+// The bounds of w x h pixels, pitch apart, in num_of_cells cells side by
+// side.
+void scanAlpha( const uint32_t *buffer, int w, int h, int pitch, int num_of_cells, AlphaBounds *bounds );
+
+#endif // __IMAGE_ALPHA_H__
@@ -0,0 +1,187 @@
+/* -*- C++ -*-
+ * 
+ *  image_blend.cpp - blend premultiplied images
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "image_blend.h"
+#include <string.h>
+#ifdef USE_SIMD
+#include "simd/simd.h"
+#endif
+
+#define RB_MASK    0x00ff00ff
+#define G_MASK     0x0000ff00
+#define ALPHA_MASK 0xff000000
+
+// pixels checked at once for being all transparent or all opaque
+#ifdef USE_SIMD_X86_AVX2
+#define BLEND_SPAN 8
+#else
+#define BLEND_SPAN 4
+#endif
+
+// src*alpha1/256, alpha1 being alpha+1
+static inline uint32_t scalePixel( uint32_t src, uint32_t alpha1 )
+{
+    return ((((src & RB_MASK) * alpha1) >> 8) & RB_MASK) |
+           ((((src & G_MASK)  * alpha1) >> 8) & G_MASK);
+}
+
+static inline uint32_t blendPixel( uint32_t src, uint32_t dst, uint32_t alpha1 )
+{
+    uint32_t a = src >> 24;
+    if ( alpha1 != 256 ){
+        src = scalePixel( src, alpha1 );
+        a = (a * alpha1) >> 8;
+    }
+    uint32_t inv = 256 - a;
+    return ((src & RB_MASK) + ((((dst & RB_MASK) * inv) >> 8) & RB_MASK)) |
+           ((src & G_MASK)  + ((((dst & G_MASK)  * inv) >> 8) & G_MASK)) | ALPHA_MASK;
+}
+
+#if defined(USE_SIMD) && !defined(USE_SIMD_X86_AVX2)
+static void blend4Pixel( const uint32_t *src, uint32_t *dst, simd::uint16x8 alpha1, bool scale,
+                         simd::uint8x16 alpha_mask, simd::ivec128 zero, simd::uint8x16 amask )
+{
+    using namespace simd;
+    uint8x16 s = load_u(src), d = load_u(dst);
+#ifdef USE_SIMD_X86_SSSE3
+    uint8x16 an = shuffle(s, alpha_mask);
+#else
+    const uint8_t *alphap = (const uint8_t *)src + 3;
+    uint8x16 an = uint8x16::set4(alphap[0], alphap[4], alphap[8], alphap[12]);
+#endif
+    uint16x8 s1 = widen_lo(s, zero), s2 = widen_hi(s, zero);
+    uint16x8 a1 = widen_lo(an, zero), a2 = widen_hi(an, zero);
+    if ( scale ){
+        s1 = (s1 * alpha1) >> immint<8>();
+        s2 = (s2 * alpha1) >> immint<8>();
+        a1 = (a1 * alpha1) >> immint<8>();
+        a2 = (a2 * alpha1) >> immint<8>();
+    }
+    uint16x8 one(256);
+    uint16x8 d1 = (widen_lo(d, zero) * (one - a1)) >> immint<8>();
+    uint16x8 d2 = (widen_hi(d, zero) * (one - a2)) >> immint<8>();
+    uint8x16 r = pack_hz(s1, s2);
+    r += pack_hz(d1, d2);
+    r |= amask;
+    store_u(dst, r);
+}
+#endif
+
+#ifdef USE_SIMD_X86_AVX2
+static void blend8Pixel( const uint32_t *src, uint32_t *dst, simd::uint16x16 alpha1, bool scale,
+                         simd::uint8x32 alpha_mask, simd::ivec256 zero, simd::uint8x32 amask )
+{
+    using namespace simd;
+    uint8x32 s = load256_u(src), d = load256_u(dst);
+    uint8x32 an = shuffle(s, alpha_mask);
+    uint16x16 s1 = widen_lo(s, zero), s2 = widen_hi(s, zero);
+    uint16x16 a1 = widen_lo(an, zero), a2 = widen_hi(an, zero);
+    if ( scale ){
+        s1 = (s1 * alpha1) >> immint<8>();
+        s2 = (s2 * alpha1) >> immint<8>();
+        a1 = (a1 * alpha1) >> immint<8>();
+        a2 = (a2 * alpha1) >> immint<8>();
+    }
+    uint16x16 one(256);
+    uint16x16 d1 = (widen_lo(d, zero) * (one - a1)) >> immint<8>();
+    uint16x16 d2 = (widen_hi(d, zero) * (one - a2)) >> immint<8>();
+    uint8x32 r = pack_hz(s1, s2);
+    r += pack_hz(d1, d2);
+    r |= amask;
+    store256_u(dst, r);
+}
+#endif
+
+void blendPremultiplied( uint32_t *dst, const uint32_t *src, int num, int alpha )
+{
+    const uint32_t alpha1 = (alpha & 0xff) + 1;
+    const bool scale = alpha1 != 256;
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    ivec256 zero = ivec256::zero();
+    uint8x32 alpha_mask = uint8x32::set8(3, 7, 11, 15, 19, 23, 27, 31);
+    uint8x32 amask = uint8x32::set(0, 0, 0, 0xff);
+    uint16x16 alpha1v(alpha1);
+#else
+    ivec128 zero = ivec128::zero();
+    uint8x16 alpha_mask = uint8x16::set4(3, 7, 11, 15);
+    uint8x16 amask = uint8x16::set(0, 0, 0, 0xff);
+    uint16x8 alpha1v(alpha1);
+#endif
+#endif
+
+    // spans of transparent pixels are skipped, those of opaque ones copied
+    for ( ; num >= BLEND_SPAN ; num -= BLEND_SPAN, dst += BLEND_SPAN, src += BLEND_SPAN ){
+        uint32_t all = src[0], any = src[0];
+        for ( int i=1 ; i<BLEND_SPAN ; i++ ){
+            all &= src[i];
+            any |= src[i];
+        }
+        if ( any < 0x01000000 ) continue;
+        if ( !scale && all >= ALPHA_MASK ){
+            memcpy( dst, src, BLEND_SPAN * sizeof(uint32_t) );
+            continue;
+        }
+#if defined(USE_SIMD_X86_AVX2)
+        blend8Pixel( src, dst, alpha1v, scale, alpha_mask, zero, amask );
+#elif defined(USE_SIMD)
+        blend4Pixel( src, dst, alpha1v, scale, alpha_mask, zero, amask );
+#else
+        for ( int i=0 ; i<BLEND_SPAN ; i++ )
+            dst[i] = blendPixel( src[i], dst[i], alpha1 );
+#endif
+    }
+
+    for ( ; num > 0 ; num--, dst++, src++ ){
+        if ( *src < 0x01000000 ) continue;
+        if ( !scale && *src >= ALPHA_MASK ) *dst = *src;
+        else                                *dst = blendPixel( *src, *dst, alpha1 );
+    }
+}
+
+void addBlendPremultiplied( uint32_t *dst, const uint32_t *src, int num, int alpha )
+{
+    const uint32_t alpha1 = (alpha & 0xff) + 1;
+
+    for ( ; num > 0 ; num--, dst++, src++ ){
+        uint32_t s = scalePixel( *src, alpha1 ), r = ALPHA_MASK;
+        for ( int shift=0 ; shift<24 ; shift+=8 ){
+            uint32_t c = ((*dst >> shift) & 0xff) + ((s >> shift) & 0xff);
+            r |= (c < 0xff ? c : 0xff) << shift;
+        }
+        *dst = r;
+    }
+}
+
+void subBlendPremultiplied( uint32_t *dst, const uint32_t *src, int num, int alpha )
+{
+    const uint32_t alpha1 = (alpha & 0xff) + 1;
+
+    for ( ; num > 0 ; num--, dst++, src++ ){
+        uint32_t s = scalePixel( *src, alpha1 ), r = ALPHA_MASK;
+        for ( int shift=0 ; shift<24 ; shift+=8 ){
+            int c = (int)((*dst >> shift) & 0xff) - (int)((s >> shift) & 0xff);
+            r |= (uint32_t)(c > 0 ? c : 0) << shift;
+        }
+        *dst = r;
+    }
+}
@@ -0,0 +1,39 @@
+/* -*- C++ -*-
+ * 
+ *  image_blend.h - blend premultiplied images
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __IMAGE_BLEND_H__
+#define __IMAGE_BLEND_H__
+
+#include <stdint.h>
+
+// Kernels of AnimationInfo::blendOnSurface() and blendOnSurface2() for
+// images set up with premultiplied alpha (see premultiplyAlpha()).  src
+// and dst are 32bpp pixels whose alpha is the top byte, dst is left
+// opaque, alpha is the opacity of the whole image, 0 to 255.
+
+// dst = src*alpha + dst*(1 - src_alpha*alpha)
+void blendPremultiplied( uint32_t *dst, const uint32_t *src, int num, int alpha );
+// dst = dst + src*alpha, saturated
+void addBlendPremultiplied( uint32_t *dst, const uint32_t *src, int num, int alpha );
+// dst = dst - src*alpha, saturated
+void subBlendPremultiplied( uint32_t *dst, const uint32_t *src, int num, int alpha );
+
+#endif // __IMAGE_BLEND_H__
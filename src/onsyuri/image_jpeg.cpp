@@ -0,0 +1,117 @@
+/* -*- C++ -*-
+ * 
+ *  image_jpeg.cpp - JPEG decoding at reduced size
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "image_jpeg.h"
+#include <stdio.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+// without exceptions, libjpeg errors unwind through longjmp
+struct ErrorMgr{
+    struct jpeg_error_mgr pub;
+    jmp_buf jmp;
+};
+
+static void errorExit( j_common_ptr cinfo )
+{
+    longjmp( ((ErrorMgr*)cinfo->err)->jmp, 1 );
+}
+
+static void outputMessage( j_common_ptr cinfo )
+{
+}
+
+bool isJPEG( const unsigned char *data, size_t length )
+{
+    return length >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff;
+}
+
+int getJPEGScaleDenom( const unsigned char *data, size_t length, int max_denom, int width_unit,
+                       int *w, int *h )
+{
+    if (!isJPEG( data, length )) return 0;
+
+    struct jpeg_decompress_struct cinfo;
+    ErrorMgr err;
+    cinfo.err = jpeg_std_error( &err.pub );
+    err.pub.error_exit = errorExit;
+    err.pub.output_message = outputMessage;
+    if (setjmp( err.jmp )){
+        jpeg_destroy_decompress( &cinfo );
+        return 0;
+    }
+
+    jpeg_create_decompress( &cinfo );
+    jpeg_mem_src( &cinfo, (unsigned char*)data, length );
+    jpeg_read_header( &cinfo, TRUE );
+
+    int denom = 8;
+    while (denom > 1 &&
+           (denom > max_denom ||
+            cinfo.image_width % (denom * width_unit) != 0 ||
+            cinfo.image_height % denom != 0))
+        denom /= 2;
+    *w = cinfo.image_width / denom;
+    *h = cinfo.image_height / denom;
+
+    jpeg_destroy_decompress( &cinfo );
+
+    return denom;
+}
+
+bool decodeJPEGScaled( const unsigned char *data, size_t length, int scale_denom,
+                       uint32_t *pixels, int pitch, int rshift, int gshift, int bshift )
+{
+    struct jpeg_decompress_struct cinfo;
+    ErrorMgr err;
+    cinfo.err = jpeg_std_error( &err.pub );
+    err.pub.error_exit = errorExit;
+    err.pub.output_message = outputMessage;
+    if (setjmp( err.jmp )){
+        jpeg_destroy_decompress( &cinfo );
+        return false;
+    }
+
+    jpeg_create_decompress( &cinfo );
+    jpeg_mem_src( &cinfo, (unsigned char*)data, length );
+    jpeg_read_header( &cinfo, TRUE );
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale_denom;
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress( &cinfo );
+
+    // each row is decoded into the last 3/4 of its 32bpp row, then widened
+    // in place front to back
+    unsigned char *row = (unsigned char*)pixels;
+    while (cinfo.output_scanline < cinfo.output_height){
+        uint32_t *dst = (uint32_t*)row;
+        unsigned char *src = row + cinfo.output_width;
+        jpeg_read_scanlines( &cinfo, &src, 1 );
+        for (JDIMENSION i=0 ; i<cinfo.output_width ; i++, src+=3)
+            dst[i] = 0xff000000 | (uint32_t)src[0] << rshift | (uint32_t)src[1] << gshift | (uint32_t)src[2] << bshift;
+        row += pitch;
+    }
+
+    jpeg_finish_decompress( &cinfo );
+    jpeg_destroy_decompress( &cinfo );
+
+    return true;
+}
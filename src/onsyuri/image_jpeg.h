@@ -0,0 +1,42 @@
+/* -*- C++ -*-
+ * 
+ *  image_jpeg.h - JPEG decoding at reduced size
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __IMAGE_JPEG_H__
+#define __IMAGE_JPEG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// libjpeg can scale the DCT blocks down while decoding, which costs a
+// fraction of decoding the full image and shrinking it afterwards.
+
+bool isJPEG( const unsigned char *data, size_t length );
+// The largest of 8, 4 and 2, up to max_denom, by which the image in data
+// shrinks exactly, its width a multiple of denom*width_unit, or 1.  *w and
+// *h get the size at 1/denom.  0 if the header can't be read.
+int getJPEGScaleDenom( const unsigned char *data, size_t length, int max_denom, int width_unit,
+                       int *w, int *h );
+// Decodes the image in data at 1/scale_denom of its size into opaque 32bpp
+// pixels, the colors at the given shifts and the alpha in the top byte.
+bool decodeJPEGScaled( const unsigned char *data, size_t length, int scale_denom,
+                       uint32_t *pixels, int pitch, int rshift, int gshift, int bshift );
+
+#endif // __IMAGE_JPEG_H__
@@ -0,0 +1,176 @@
+/* -*- C++ -*-
+ *
+ *  lz4_codec.cpp - LZ4 block format encoder and decoder
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "lz4_codec.h"
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+
+#define LZ4_MIN_MATCH     4
+#define LZ4_LAST_LITERALS 5  // a block always ends with this many literals
+#define LZ4_MFLIMIT       12 // and its last match starts at least this far before the end
+#define LZ4_MAX_OFFSET    65535
+#define LZ4_HASH_LOG      14
+
+static inline uint32_t read32( const unsigned char *p )
+{
+    uint32_t v;
+    memcpy( &v, p, 4 );
+    return v;
+}
+
+static inline unsigned char *putLength( unsigned char *op, size_t length )
+{
+    while ( length >= 255 ){
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+size_t lz4CompressBound( size_t length )
+{
+    return length + length/255 + 16;
+}
+
+size_t lz4Compress( const unsigned char *src, size_t length, unsigned char *dst, size_t capacity )
+{
+    unsigned char *op = dst, *oend = dst + capacity;
+    size_t anchor = 0;
+
+    if ( length > LZ4_MFLIMIT ){
+        std::vector<uint32_t> table( 1 << LZ4_HASH_LOG, 0 );
+        size_t match_limit = length - LZ4_LAST_LITERALS;
+        size_t input_limit = length - LZ4_MFLIMIT;
+        size_t pos = 0;
+
+        while ( pos <= input_limit ){
+            uint32_t seq = read32( src + pos );
+            uint32_t h = (seq * 2654435761u) >> (32 - LZ4_HASH_LOG);
+            size_t ref = table[h];
+            table[h] = (uint32_t)pos;
+            if ( ref >= pos || pos - ref > LZ4_MAX_OFFSET || read32( src + ref ) != seq ){
+                pos += 1 + ((pos - anchor) >> 6); // skip faster through incompressible runs
+                continue;
+            }
+
+            size_t match_length = LZ4_MIN_MATCH;
+            while ( pos + match_length < match_limit && src[pos + match_length] == src[ref + match_length] )
+                match_length++;
+            while ( pos > anchor && ref > 0 && src[pos-1] == src[ref-1] ){
+                pos--;
+                ref--;
+                match_length++;
+            }
+
+            size_t literals = pos - anchor;
+            size_t ml = match_length - LZ4_MIN_MATCH;
+            if ( (size_t)(oend - op) < 1 + literals/255 + 1 + literals + 2 + ml/255 + 1 ) return 0;
+
+            unsigned char *token = op++;
+            *token = (unsigned char)((literals < 15 ? literals : 15) << 4 | (ml < 15 ? ml : 15));
+            if ( literals >= 15 ) op = putLength( op, literals - 15 );
+            memcpy( op, src + anchor, literals );
+            op += literals;
+            *op++ = (unsigned char)((pos - ref) & 0xff);
+            *op++ = (unsigned char)((pos - ref) >> 8);
+            if ( ml >= 15 ) op = putLength( op, ml - 15 );
+
+            pos += match_length;
+            anchor = pos;
+            if ( pos - 2 <= input_limit )
+                table[(read32( src + pos - 2 ) * 2654435761u) >> (32 - LZ4_HASH_LOG)] = (uint32_t)(pos - 2);
+        }
+    }
+
+    size_t literals = length - anchor;
+    if ( (size_t)(oend - op) < 1 + literals/255 + 1 + literals ) return 0;
+    *op++ = (unsigned char)((literals < 15 ? literals : 15) << 4);
+    if ( literals >= 15 ) op = putLength( op, literals - 15 );
+    if ( literals ) memcpy( op, src + anchor, literals );
+    op += literals;
+
+    return op - dst;
+}
+
+size_t lz4Decompress( const unsigned char *src, size_t length, unsigned char *dst, size_t capacity )
+{
+    const unsigned char *ip = src, *iend = src + length;
+    unsigned char *op = dst, *oend = dst + capacity;
+
+    while ( ip < iend ){
+        unsigned int token = *ip++;
+
+        size_t literals = token >> 4;
+        if ( literals == 15 ){
+            unsigned int b;
+            do{
+                if ( ip >= iend ) return (size_t)-1;
+                b = *ip++;
+                literals += b;
+            } while ( b == 255 );
+        }
+        if ( literals > (size_t)(iend - ip) || literals > (size_t)(oend - op) ) return (size_t)-1;
+        memcpy( op, ip, literals );
+        op += literals;
+        ip += literals;
+        if ( ip == iend ) break; // the last sequence has no match
+
+        if ( iend - ip < 2 ) return (size_t)-1;
+        size_t offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        if ( offset == 0 || offset > (size_t)(op - dst) ) return (size_t)-1;
+
+        size_t match_length = token & 15;
+        if ( match_length == 15 ){
+            unsigned int b;
+            do{
+                if ( ip >= iend ) return (size_t)-1;
+                b = *ip++;
+                match_length += b;
+            } while ( b == 255 );
+        }
+        match_length += LZ4_MIN_MATCH;
+        if ( match_length > (size_t)(oend - op) ) return (size_t)-1;
+
+        const unsigned char *match = op - offset;
+        if ( offset >= match_length ){
+            memcpy( op, match, match_length );
+            op += match_length;
+        }
+        else if ( offset >= 8 ){
+            // 8-byte steps never read bytes of the same step they write
+            unsigned char *end = op + match_length;
+            while ( end - op >= 8 ){
+                memcpy( op, match, 8 );
+                op += 8;
+                match += 8;
+            }
+            while ( op < end ) *op++ = *match++;
+        }
+        else{
+            for ( size_t i=0 ; i<match_length ; i++ ) *op++ = *match++;
+        }
+    }
+
+    return op - dst;
+}
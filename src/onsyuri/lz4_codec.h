@@ -0,0 +1,40 @@
+/* -*- C++ -*-
+ *
+ *  lz4_codec.h - LZ4 block format encoder and decoder
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __LZ4_CODEC_H__
+#define __LZ4_CODEC_H__
+
+#include <stddef.h>
+
+// Blocks are interchangeable with liblz4's LZ4_compress_default() and
+// LZ4_decompress_safe(); liblz4 itself is not available on every target.
+
+// Worst-case size of the compressed form of length bytes.
+size_t lz4CompressBound( size_t length );
+
+// Returns the compressed length, or 0 if it does not fit into capacity.
+size_t lz4Compress( const unsigned char *src, size_t length, unsigned char *dst, size_t capacity );
+
+// Returns the decompressed length, or (size_t)-1 if src is malformed or
+// its contents do not fit into capacity.
+size_t lz4Decompress( const unsigned char *src, size_t length, unsigned char *dst, size_t capacity );
+
+#endif // __LZ4_CODEC_H__
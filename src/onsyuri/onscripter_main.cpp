@@ -28,6 +28,7 @@
 #include "gbk2utf16.h"
 #include "sjis2utf16.h"
 #include "version.h"
+#include "blend_kernels.h"
 #include "stdlib.h"
 #include <sys/stat.h>
 
@@ -91,11 +92,18 @@ void optionHelp()
     printf( "      --dll file\tset a dll file\n");
     printf( "      --enable-wheeldown-advance\tadvance the text on mouse wheel down\n");
     printf( "      --disable-rescale\tdo not rescale the images in the archives\n");
+    printf( "      --premultiplied-alpha\tstore the images with premultiplied alpha for faster blending\n");
+    printf( "      --simd level\tforce the blending kernels to auto, scalar, sse2, ssse3, avx2 or neon (default auto)\n");
     printf( "      --force-button-shortcut\tignore useescspc and getenter command\n");
     printf( "      --render-font-outline\trender the outline of a text instead of casting a shadow\n");
     printf( "      --edit\t\tenable online modification of the volume and variables when 'z' is pressed\n");
     printf( "      --key-exe file\tset a file (*.EXE) that includes a key table\n");
     printf( "      --fontcache\tcache default font\n");
+    printf( "      --decode-cache MB\tbudget for decoded SPB/LZSS/NBZ archive entries (default 8, 0 disables)\n");
+    printf( "      --readahead MB\tbudget for archive entries read ahead in the background (default 16, 0 disables)\n");
+    printf( "      --image-cache MB\tbudget for decoded images shared between sprites (default 64, 0 disables)\n");
+    printf( "      --lookahead lines\tread and decode the images and sounds of the next lines ahead (default 64, 0 disables)\n");
+    printf( "      --compositor-threads num\tcompose the screen in horizontal bands on num threads (default 1, 0 for one per CPU)\n");
     exit(0);
 }
 
@@ -460,6 +468,15 @@ void parseOption(int argc, char *argv[]) {
             else if ( !strcmp( argv[0]+1, "-disable-rescale" ) ){
                 ons.disableRescale();
             }
+            else if ( !strcmp( argv[0]+1, "-premultiplied-alpha" ) ){
+                ons.enablePremultipliedAlpha();
+            }
+            else if ( !strcmp( argv[0]+1, "-simd" ) ){
+                argc--;
+                argv++;
+                if ( !setBlendKernels(argv[0]) )
+                    utils::printInfo(" SIMD level %s is not available, using %s\n", argv[0], blend_kernels->name);
+            }
             else if ( !strcmp( argv[0]+1, "-render-font-outline" ) ){
                 ons.renderFontOutline();
             }
@@ -474,6 +491,31 @@ void parseOption(int argc, char *argv[]) {
             else if (!strcmp(argv[0]+1, "-fontcache")){
                 ons.setFontCache();
             }
+            else if ( !strcmp( argv[0]+1, "-decode-cache" ) ){
+                argc--;
+                argv++;
+                ons.setDecodeCacheSize(atoi(argv[0]));
+            }
+            else if ( !strcmp( argv[0]+1, "-readahead" ) ){
+                argc--;
+                argv++;
+                ons.setPrefetchSize(atoi(argv[0]));
+            }
+            else if ( !strcmp( argv[0]+1, "-image-cache" ) ){
+                argc--;
+                argv++;
+                ons.setImageCacheSize(atoi(argv[0]));
+            }
+            else if ( !strcmp( argv[0]+1, "-lookahead" ) ){
+                argc--;
+                argv++;
+                ons.setLookahead(atoi(argv[0]));
+            }
+            else if ( !strcmp( argv[0]+1, "-compositor-threads" ) ){
+                argc--;
+                argv++;
+                ons.setCompositorThreads(atoi(argv[0]));
+            }
             else{
                 utils::printInfo(" unknown option %s\n", argv[0]);
             }
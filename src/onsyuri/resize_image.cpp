@@ -2,7 +2,7 @@
  * 
  *  resize_image.cpp - resize image using smoothing and resampling
  *
- *  Copyright (c) 2001-2012 Ogapee. All rights reserved.
+ *  Copyright (c) 2001-2014 Ogapee. All rights reserved.
  *
  *  ogapee@aqua.dti2.ne.jp
  *
@@ -21,84 +21,152 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
-#include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <vector>
+#include "Parallel.h"
+#ifdef USE_SIMD
+#include "simd/simd.h"
+#endif
 
-static unsigned long *pixel_accum=NULL;
-static unsigned long *pixel_accum_num=NULL;
-static int pixel_accum_size=0;
-static unsigned long tmp_acc[4];
-static unsigned long tmp_acc_num[4];
+// Rows are processed in blocks, each with its own running sums, so that
+// the blocks can go to parallel::For and several images can be resized at
+// once (the archive converters do).
+#define RESIZE_BLOCK_ROWS 16
 
-static void calcWeightedSumColumnInit(unsigned char **src,
-                                      int interpolation_height,
-                                      int image_width, int image_height, int image_pixel_width, int byte_per_pixel)
+// floor(sum/n) is (sum*reciprocal(n))>>32 while 255*n*n < 2^32
+static inline uint64_t reciprocal( uint32_t n )
 {
-    int y_end   = -interpolation_height/2+interpolation_height;
-
-    memset(pixel_accum, 0, image_width*byte_per_pixel*sizeof(unsigned long));
-    memset(pixel_accum_num, 0, image_width*byte_per_pixel*sizeof(unsigned long));
-    for (int s=0 ; s<byte_per_pixel ; s++){
-        for (int i=0 ; i<y_end-1 ; i++){
-            if (i >= image_height) break;
-            unsigned long *pa = pixel_accum + image_width*s;
-            unsigned long *pan = pixel_accum_num + image_width*s;
-            unsigned char *p = *src+image_pixel_width*i+s;
-            for (int j=image_width ; j!=0 ; j--, p+=byte_per_pixel){
-                *pa++ += *p;
-                (*pan++)++;
-            }
-        }
-    }
+    return ((1ull << 32) + n - 1) / n;
+}
+
+static inline int clampRange( int v, int max )
+{
+    if (v < 0)   return 0;
+    if (v > max) return max;
+    return v;
 }
 
-static void calcWeightedSumColumn(unsigned char **src, int y,
-                                  int interpolation_height,
-                                  int image_width, int image_height, int image_pixel_width, int byte_per_pixel)
+/* box filter of interpolation_width x interpolation_height around each pixel */
+static void smoothRows( unsigned char *tmp_buffer, int tmp_total_width,
+                        const unsigned char *src_buffer, int src_width, int src_height, int src_total_width,
+                        int byte_per_pixel, int interpolation_width, int interpolation_height,
+                        int y_start, int y_end )
 {
-    int y_start = y-interpolation_height/2;
-    int y_end   = y-interpolation_height/2+interpolation_height;
-
-    for (int s=0 ; s<byte_per_pixel ; s++){
-        if ((y_start-1)>=0 && (y_start-1)<image_height){
-            unsigned long *pa = pixel_accum + image_width*s;
-            unsigned long *pan = pixel_accum_num + image_width*s;
-            unsigned char *p = *src+image_pixel_width*(y_start-1)+s;
-            for (int j=image_width ; j!=0 ; j--, p+=byte_per_pixel){
-                *pa++ -= *p;
-                (*pan++)--;
+    const int bpp = byte_per_pixel;
+    const int row = src_width * bpp;
+    std::vector<uint32_t> column( row, 0 );
+
+    // rows [top, bottom) are summed up in column
+    int top = y_start - interpolation_height/2;
+    int bottom = top + interpolation_height;
+    for (int i=clampRange(top, src_height) ; i<clampRange(bottom, src_height) ; i++){
+        const unsigned char *p = src_buffer + src_total_width*i;
+        for (int k=0 ; k<row ; k++) column[k] += p[k];
+    }
+
+    for (int y=y_start ; y<y_end ; y++, top++, bottom++){
+        if (y > y_start){
+            if (top-1 >= 0 && top-1 < src_height){
+                const unsigned char *p = src_buffer + src_total_width*(top-1);
+                for (int k=0 ; k<row ; k++) column[k] -= p[k];
+            }
+            if (bottom-1 >= 0 && bottom-1 < src_height){
+                const unsigned char *p = src_buffer + src_total_width*(bottom-1);
+                for (int k=0 ; k<row ; k++) column[k] += p[k];
             }
         }
-        
-        if ((y_end-1)>=0 && (y_end-1)<image_height){
-            unsigned long *pa = pixel_accum + image_width*s;
-            unsigned long *pan = pixel_accum_num + image_width*s;
-            unsigned char *p = *src+image_pixel_width*(y_end-1)+s;
-            for (int j=image_width ; j!=0 ; j--, p+=byte_per_pixel){
-                *pa++ += *p;
-                (*pan++)++;
+        const uint32_t num_y = clampRange(bottom, src_height) - clampRange(top, src_height);
+
+        // columns [left, right) are summed up in acc
+        uint32_t acc[4] = {0, 0, 0, 0};
+        int left = -interpolation_width/2;
+        int right = left + interpolation_width;
+        for (int j=clampRange(left, src_width) ; j<clampRange(right, src_width) ; j++)
+            for (int s=0 ; s<bpp ; s++) acc[s] += column[j*bpp+s];
+
+        unsigned char *dst = tmp_buffer + tmp_total_width*y;
+        uint32_t num = 0;
+        uint64_t rcp = 0;
+        for (int x=0 ; x<src_width ; x++, left++, right++){
+            if (x > 0){
+                if (left-1 >= 0 && left-1 < src_width)
+                    for (int s=0 ; s<bpp ; s++) acc[s] -= column[(left-1)*bpp+s];
+                if (right-1 >= 0 && right-1 < src_width)
+                    for (int s=0 ; s<bpp ; s++) acc[s] += column[(right-1)*bpp+s];
+            }
+            uint32_t n = num_y * (clampRange(right, src_width) - clampRange(left, src_width));
+            if (n != num){
+                num = n;
+                rcp = reciprocal(n);
             }
+            for (int s=0 ; s<bpp ; s++)
+                *dst++ = (unsigned char)((acc[s] * rcp) >> 32);
         }
     }
 }
 
-static void calcWeightedSum(unsigned char **dst, unsigned char **src, int x,
-                            int interpolation_width,
-                            int image_width, int byte_per_pixel)
+/* bilinear resampling at 1/8 pixel, first down the columns then along the row */
+static void resampleRows( unsigned char *dst_buffer, int dst_width, int dst_total_width,
+                          const unsigned char *src_buffer, int src_width, int src_height, int src_total_width,
+                          int byte_per_pixel, bool palette_flag, const int *x_pos,
+                          int dh1, int y_start, int y_end )
 {
-    int x_start = x-interpolation_width/2;
-    int x_end   = x-interpolation_width/2+interpolation_width;
-    
-    for (int s=0 ; s<byte_per_pixel ; s++){
-        if ((x_start-1)>=0 && (x_start-1)<image_width){
-            tmp_acc[s] -= pixel_accum[image_width*s+x_start-1];
-            tmp_acc_num[s] -= pixel_accum_num[image_width*s+x_start-1];
+    const int bpp = byte_per_pixel;
+    const int row = src_width * bpp;
+    // one more pixel, weighted 0, for the right edge
+    std::vector<uint16_t> column( row + bpp, 0 );
+
+    for (int i=y_start ; i<y_end ; i++){
+        int y = (i<<3) * (src_height-1) / dh1;
+        const int dy = y & 0x7;
+        y >>= 3;
+        const unsigned char *src0 = src_buffer + src_total_width*y;
+        const unsigned char *src1 = dy ? src0 + src_total_width : src0;
+        unsigned char *dst = dst_buffer + dst_total_width*i;
+
+        if (palette_flag){ //assuming byte_per_pixel=1
+            for (int j=0 ; j<dst_width ; j++)
+                *dst++ = src0[(x_pos[j]>>3)*bpp];
         }
-        if ((x_end-1)>=0 && (x_end-1)<image_width){
-            tmp_acc[s] += pixel_accum[image_width*s+x_end-1];
-            tmp_acc_num[s] += pixel_accum_num[image_width*s+x_end-1];
+        else{
+            uint16_t *col = &column[0];
+            int k = 0;
+#ifdef USE_SIMD
+            {
+                using namespace simd;
+                uint8x16 zero = ivec128::zero();
+                uint16x8 w0(8-dy), w1(dy);
+                for ( ; k+16<=row ; k+=16){
+                    uint8x16 a = load_u(src0+k), b = load_u(src1+k);
+                    store_u(col+k,   widen_lo(a, zero)*w0 + widen_lo(b, zero)*w1);
+                    store_u(col+k+8, widen_hi(a, zero)*w0 + widen_hi(b, zero)*w1);
+                }
+            }
+#endif
+            for ( ; k<row ; k++)
+                col[k] = (8-dy)*src0[k] + dy*src1[k];
+
+            int j = 0;
+#ifdef USE_SIMD
+            if (bpp == 4){
+                using namespace simd;
+                for ( ; j<dst_width ; j++, dst+=4){
+                    const int x = x_pos[j]>>3, dx = x_pos[j] & 0x7;
+                    uint16x4 a = uint16x4::load_u(col + x*4), b = uint16x4::load_u(col + x*4 + 4);
+                    uint32_t p = uint8x4::cvt2i32(narrow_hz(shiftr<6>(a*uint16x4(8-dx) + b*uint16x4(dx))));
+                    memcpy(dst, &p, 4);
+                }
+            }
+#endif
+            for ( ; j<dst_width ; j++){
+                const int x = x_pos[j]>>3, dx = x_pos[j] & 0x7;
+                const uint16_t *c = col + x*bpp;
+                for (int s=0 ; s<bpp ; s++, c++)
+                    *dst++ = (unsigned char)(((8-dx)*c[0] + dx*c[bpp]) >> 6);
+            }
         }
-        *(*dst)++ = (unsigned char)(tmp_acc[s]/tmp_acc_num[s]);
+        memset(dst, 0, dst_total_width - dst_width*bpp);
     }
 }
 
@@ -107,95 +175,71 @@ void resizeImage( unsigned char *dst_buffer, int dst_width, int dst_height, int
                   int byte_per_pixel, unsigned char *tmp_buffer, int tmp_total_width, bool palette_flag )
 {
     if (dst_width == 0 || dst_height == 0) return;
-    
-    unsigned char *tmp_buf = tmp_buffer;
-    unsigned char *src_buf = src_buffer;
-
-    int i, j, s;
-    int tmp_offset = tmp_total_width - src_width * byte_per_pixel;
-
-    unsigned int mx, my;
-
-    if ( src_width  > 1 ) mx = 1;
-    else                  mx = 0;
-    if ( src_height > 1 ) my = 1;
-    else                  my = 0;
 
     int interpolation_width = src_width / dst_width;
     if ( interpolation_width == 0 ) interpolation_width = 1;
     int interpolation_height = src_height / dst_height;
     if ( interpolation_height == 0 ) interpolation_height = 1;
 
-    if (pixel_accum_size < src_width*byte_per_pixel){
-        pixel_accum_size = src_width*byte_per_pixel;
-        if (pixel_accum) delete[] pixel_accum;
-        pixel_accum = new unsigned long[pixel_accum_size];
-        if (pixel_accum_num) delete[] pixel_accum_num;
-        pixel_accum_num = new unsigned long[pixel_accum_size];
-    }
-    /* smoothing */
-    if ( byte_per_pixel >= 3 ){
-        calcWeightedSumColumnInit(&src_buf, interpolation_height,
-                                  src_width, src_height, src_total_width, byte_per_pixel );
-        for ( i=0 ; i<src_height ; i++ ){
-            calcWeightedSumColumn(&src_buf, i, interpolation_height,
-                                  src_width, src_height, src_total_width, byte_per_pixel );
-            for (s=0 ; s<byte_per_pixel ; s++){
-                tmp_acc[s]=0;
-                tmp_acc_num[s]=0;
-                for (j=0 ; j<-interpolation_width/2+interpolation_width-1 ; j++){
-                    if (j >= src_width) break;
-                    tmp_acc[s] += pixel_accum[src_width*s+j];
-                    tmp_acc_num[s] += pixel_accum_num[src_width*s+j];
-                }
+    const int num_src_blocks = (src_height + RESIZE_BLOCK_ROWS - 1) / RESIZE_BLOCK_ROWS;
+    const int num_dst_blocks = (dst_height + RESIZE_BLOCK_ROWS - 1) / RESIZE_BLOCK_ROWS;
+
+    /* smoothing, nothing to do when not shrinking by 2 or more */
+    const unsigned char *smoothed = src_buffer;
+    int smoothed_total_width = src_total_width;
+    if ( byte_per_pixel >= 3 && (interpolation_width > 1 || interpolation_height > 1) ){
+        struct Smoother {
+            unsigned char *tmp_buffer; int tmp_total_width;
+            const unsigned char *src_buffer; int src_width, src_height, src_total_width;
+            int byte_per_pixel, interpolation_width, interpolation_height;
+
+            void operator()(const int block) const {
+                int y_end = (block+1) * RESIZE_BLOCK_ROWS;
+                if (y_end > src_height) y_end = src_height;
+                smoothRows(tmp_buffer, tmp_total_width, src_buffer, src_width, src_height, src_total_width,
+                           byte_per_pixel, interpolation_width, interpolation_height,
+                           block * RESIZE_BLOCK_ROWS, y_end);
             }
-            
-            for ( j=0 ; j<src_width ; j++ )
-                calcWeightedSum(&tmp_buf, &src_buf, j,
-                                interpolation_width,
-                                src_width, byte_per_pixel );
-            tmp_buf += tmp_offset;
-        }
+        } smoother = {tmp_buffer, tmp_total_width, src_buffer, src_width, src_height, src_total_width,
+                      byte_per_pixel, interpolation_width, interpolation_height};
+#if defined(USE_PARALLEL) || defined(USE_OMP_PARALLEL)
+        parallel::For(0, num_src_blocks, 1, smoother, src_width * src_height);
+#else
+        for (int i = 0; i < num_src_blocks; i++) smoother(i);
+#endif
+        smoothed = tmp_buffer;
+        smoothed_total_width = tmp_total_width;
     }
-    else{
-        tmp_buffer = src_buffer;
-    }
-    
+
     /* resampling */
-    unsigned char *dst_buf = dst_buffer;
     int dh1 = dst_height-1; if (dh1==0) dh1 = 1;
     int dw1 = dst_width-1;  if (dw1==0) dw1 = 1;
-    for ( i=0 ; i<dst_height ; i++ ){
-        int y = (i<<3) * (src_height-1) / dh1;
-        int dy = y & 0x7;
-        y >>= 3;
-        for ( j=0 ; j<dst_width ; j++ ){
-            int x = (j<<3) * (src_width-1) / dw1;
-            int dx = x & 0x7;
-            x >>= 3;
-
-            int k = tmp_total_width * y + x * byte_per_pixel;
-            
-            if (palette_flag){ //assuming byte_per_pixel=1
-                *dst_buf++ = tmp_buffer[k];
-            }
-            else{
-                for ( s=0 ; s<byte_per_pixel ; s++, k++ ){
-                    unsigned int p;
-                    p =  (8-dx)*(8-dy)*tmp_buffer[ k ];
-                    p +=    dx *(8-dy)*tmp_buffer[ k+mx*byte_per_pixel ];
-                    p += (8-dx)*   dy *tmp_buffer[ k+my*tmp_total_width ];
-                    p +=    dx *   dy *tmp_buffer[ k+mx*byte_per_pixel+my*tmp_total_width ];
-                    *dst_buf++ = (unsigned char)(p>>6);
-                }
-            }
+    std::vector<int> x_pos( dst_width );
+    for (int j=0 ; j<dst_width ; j++)
+        x_pos[j] = (j<<3) * (src_width-1) / dw1;
+
+    struct Resampler {
+        unsigned char *dst_buffer; int dst_width, dst_height, dst_total_width;
+        const unsigned char *src_buffer; int src_width, src_height, src_total_width;
+        int byte_per_pixel; bool palette_flag; const int *x_pos; int dh1;
+
+        void operator()(const int block) const {
+            int y_end = (block+1) * RESIZE_BLOCK_ROWS;
+            if (y_end > dst_height) y_end = dst_height;
+            resampleRows(dst_buffer, dst_width, dst_total_width, src_buffer, src_width, src_height, src_total_width,
+                         byte_per_pixel, palette_flag, x_pos, dh1, block * RESIZE_BLOCK_ROWS, y_end);
         }
-        for ( j=0 ; j<dst_total_width - dst_width*byte_per_pixel ; j++ )
-            *dst_buf++ = 0;
-    }
+    } resampler = {dst_buffer, dst_width, dst_height, dst_total_width,
+                   smoothed, src_width, src_height, smoothed_total_width,
+                   byte_per_pixel, palette_flag, &x_pos[0], dh1};
+#if defined(USE_PARALLEL) || defined(USE_OMP_PARALLEL)
+    parallel::For(0, num_dst_blocks, 1, resampler, dst_width * dst_height);
+#else
+    for (int i = 0; i < num_dst_blocks; i++) resampler(i);
+#endif
 
     /* pixels at the corners are preserved */
-    for ( i=0 ; i<byte_per_pixel ; i++ ){
+    for ( int i=0 ; i<byte_per_pixel ; i++ ){
         dst_buffer[i] = src_buffer[i];
         dst_buffer[(dst_width-1)*byte_per_pixel+i] = src_buffer[(src_width-1)*byte_per_pixel+i];
         dst_buffer[(dst_height-1)*dst_total_width+i] = src_buffer[(src_height-1)*src_total_width+i];
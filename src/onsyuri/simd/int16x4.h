@@ -39,10 +39,12 @@ namespace simd {
     uint16x4(__m128i v) : v_(v) {};
     operator __m128i() const { return v_; }
     uint16x4(uint16_t rm) { v_ = _mm_shufflelo_epi16(_mm_cvtsi32_si128(rm), 0);  /*MOVD r32, xmm, PSHUFLW xmm1, xmm2, imm*/ }
+    static uint16x4 load_u(const void *m) { return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(m));  /*MOVQ xmm, m64*/ }
 #elif USE_SIMD_ARM_NEON
     uint16x4(uint16x4_t v) : v_(v) {};
     operator uint16x4_t() const { return v_; }
     uint16x4(uint16_t rm) { v_ = vdup_n_u16(rm); }
+    static uint16x4 load_u(const void *m) { return vld1_u16(reinterpret_cast<const uint16_t*>(m)); }
 #endif
   };
 
@@ -66,6 +66,10 @@ namespace simd {
   };
 
   //Arithmetic
+  static uint16x8 operator+(uint16x8 a, uint16x8 b);
+
+  static uint16x8 operator+=(uint16x8 &a, uint16x8 b);
+
   static uint16x8 operator-(uint16x8 a, uint16x8 b);
 
   static uint16x8 operator-=(uint16x8 &a, uint16x8 b);
@@ -84,4 +88,7 @@ namespace simd {
   static uint16x8 operator>>(uint16x8 a, immint<8> imm8);
 
   static uint16x8 operator>>=(uint16x8 &a, immint<8> imm8);
-}
+
+  //Store
+  static void store_u(void* m, uint16x8 a);
+}
\ No newline at end of file
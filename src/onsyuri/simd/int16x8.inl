@@ -24,6 +24,18 @@
 
 namespace simd {
   //Arithmetic
+  inline uint16x8 operator+(uint16x8 a, uint16x8 b) {
+#ifdef USE_SIMD_X86_SSE2
+    return _mm_add_epi16(a, b); //PADDW xmm1, xmm2
+#elif USE_SIMD_ARM_NEON
+    return vaddq_u16(a, b);
+#endif
+  }
+
+  inline uint16x8 operator+=(uint16x8 &a, uint16x8 b) {
+    return a = a + b;
+  }
+
   inline uint16x8 operator-(uint16x8 a, uint16x8 b) {
 #ifdef USE_SIMD_X86_SSE2
     return _mm_sub_epi16(a, b); //PSUBW xmm1, xmm2
@@ -82,4 +94,13 @@ namespace simd {
   
   inline uint16x8 operator>>(uint16x8 a, immint<8> imm8) { return shiftr<8>(a); }
   inline uint16x8 operator>>=(uint16x8 &a, immint<8> imm8) { return a = a >> imm8; }
+
+  //Store
+  inline void store_u(void* m, uint16x8 a) {
+#ifdef USE_SIMD_X86_SSE2
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(m), a);
+#elif USE_SIMD_ARM_NEON
+    vst1q_u16(reinterpret_cast<uint16_t*>(m), a);
+#endif
+  }
 }
\ No newline at end of file
@@ -42,6 +42,7 @@ namespace simd {
     uint32x4(uint32_t rm) : v_(_mm_set1_epi32(rm)) {}
     static uint32x4 cvt2vec(uint32_t rm) { return _mm_cvtsi32_si128(rm);  /* MOVD xmm, r32 */ }
     static uint32_t cvt2i32(uint32x4 a) { return _mm_cvtsi128_si32(a);  /* MOVD r32, xmm */ }
+    static uint32x4 load_u(const void *m) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(m)); }
 #elif USE_SIMD_ARM_NEON
     uint32x4(uint32x4_t v) : v_(v) {};
     operator uint32x4_t() const { return v_; }
@@ -52,11 +53,24 @@ namespace simd {
       return r;
     }
     static uint32_t cvt2i32(uint32x4 a) { return vgetq_lane_u32(a, 0); }
+    static uint32x4 load_u(const void *m) { return vld1q_u32(reinterpret_cast<const uint32_t*>(m)); }
 #endif
   };
 
+  //Compare
+  static uint32x4 cmpeq(uint32x4 a, uint32x4 b);
+
   //Logical
+  static uint32x4 operator&(uint32x4 a, uint32x4 b);
+
   static uint32x4 operator|(uint32x4 a, uint32x4 b);
 
   static uint32x4 operator|=(uint32x4 &a, uint32x4 b);
+
+  static uint32x4 operator^(uint32x4 a, uint32x4 b);
+
+  static uint32x4 andnot(uint32x4 a, uint32x4 b);
+
+  //Store
+  static void store_u(void* m, uint32x4 a);
 }
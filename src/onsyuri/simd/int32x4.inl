@@ -23,7 +23,24 @@
 #endif
 
 namespace simd {
+  //Compare
+  inline uint32x4 cmpeq(uint32x4 a, uint32x4 b) {
+#ifdef USE_SIMD_X86_SSE2
+    return _mm_cmpeq_epi32(a, b);  //PCMPEQD xmm1, xmm2
+#elif USE_SIMD_ARM_NEON
+    return vceqq_u32(a, b);
+#endif
+  }
+
   //Logical
+  inline uint32x4 operator&(uint32x4 a, uint32x4 b) {
+#ifdef USE_SIMD_X86_SSE2
+    return _mm_and_si128(a, b);  //PAND xmm1, xmm2
+#elif USE_SIMD_ARM_NEON
+    return vandq_u32(a, b);
+#endif
+  }
+
   inline uint32x4 operator|(uint32x4 a, uint32x4 b) {
 #ifdef USE_SIMD_X86_SSE2
     return _mm_or_si128(a, b);  //POR xmm1, xmm2
@@ -35,4 +52,40 @@ namespace simd {
   inline uint32x4 operator|=(uint32x4 &a, uint32x4 b) {
     return a = a | b;
   }
+
+  inline uint32x4 operator^(uint32x4 a, uint32x4 b) {
+#ifdef USE_SIMD_X86_SSE2
+    return _mm_xor_si128(a, b);  //PXOR xmm1, xmm2
+#elif USE_SIMD_ARM_NEON
+    return veorq_u32(a, b);
+#endif
+  }
+
+  // ~a & b
+  inline uint32x4 andnot(uint32x4 a, uint32x4 b) {
+#ifdef USE_SIMD_X86_SSE2
+    return _mm_andnot_si128(a, b);  //PANDN xmm1, xmm2
+#elif USE_SIMD_ARM_NEON
+    return vbicq_u32(b, a);
+#endif
+  }
+
+  //Shift
+  template<unsigned imm8>
+  inline uint32x4 shiftl(uint32x4 a) {
+#ifdef USE_SIMD_X86_SSE2
+    return _mm_slli_epi32(a, imm8); //PSLLD xmm1, imm
+#elif USE_SIMD_ARM_NEON
+    return vshlq_n_u32(a, imm8);
+#endif
+  }
+
+  //Store
+  inline void store_u(void* m, uint32x4 a) {
+#ifdef USE_SIMD_X86_SSE2
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(m), a);
+#elif USE_SIMD_ARM_NEON
+    vst1q_u32(reinterpret_cast<uint32_t*>(m), a);
+#endif
+  }
 }
\ No newline at end of file
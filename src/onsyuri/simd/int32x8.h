@@ -0,0 +1,55 @@
+/* -*- C++ -*-
+*
+*  int32x8.h
+*
+*  Copyright (c) 2026 ONScripter-jh-Switch contributors
+*
+*  This program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2 of the License, or
+*  (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software
+*  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+#pragma once
+
+#ifndef __SIMD_H__
+#error "This file must be included through simd.h"
+#endif
+#include <stdint.h>
+
+namespace simd {
+  class uint32x8 {
+#ifdef USE_SIMD_X86_AVX2
+    __m256i v_;
+#endif
+  public:
+    uint32x8() = default;
+    uint32x8(const uint32x8&) = default;
+    uint32x8 &operator=(const uint32x8&) = default;
+#ifdef USE_SIMD_X86_AVX2
+    uint32x8(__m256i v) : v_(v) {}
+    operator __m256i() const { return v_; }
+    uint32x8(uint32_t rm) : v_(_mm256_set1_epi32(rm)) {}
+#endif
+  };
+
+  //Compare
+  static uint32x8 cmpeq(uint32x8 a, uint32x8 b);
+
+  //Logical
+  static uint32x8 operator&(uint32x8 a, uint32x8 b);
+
+  static uint32x8 operator|(uint32x8 a, uint32x8 b);
+
+  static uint32x8 operator^(uint32x8 a, uint32x8 b);
+
+  static uint32x8 andnot(uint32x8 a, uint32x8 b);
+}
@@ -0,0 +1,66 @@
+/* -*- C++ -*-
+*
+*  int32x8.inl
+*
+*  Copyright (c) 2026 ONScripter-jh-Switch contributors
+*
+*  This program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2 of the License, or
+*  (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software
+*  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+#ifndef __SIMD_H__
+#error "This file must be included through simd.h"
+#endif
+
+namespace simd {
+  //Compare
+  inline uint32x8 cmpeq(uint32x8 a, uint32x8 b) {
+#ifdef USE_SIMD_X86_AVX2
+    return _mm256_cmpeq_epi32(a, b);  //VPCMPEQD ymm1, ymm2, ymm3
+#endif
+  }
+
+  //Logical
+  inline uint32x8 operator&(uint32x8 a, uint32x8 b) {
+#ifdef USE_SIMD_X86_AVX2
+    return _mm256_and_si256(a, b);  //VPAND ymm1, ymm2, ymm3
+#endif
+  }
+
+  inline uint32x8 operator|(uint32x8 a, uint32x8 b) {
+#ifdef USE_SIMD_X86_AVX2
+    return _mm256_or_si256(a, b);  //VPOR ymm1, ymm2, ymm3
+#endif
+  }
+
+  inline uint32x8 operator^(uint32x8 a, uint32x8 b) {
+#ifdef USE_SIMD_X86_AVX2
+    return _mm256_xor_si256(a, b);  //VPXOR ymm1, ymm2, ymm3
+#endif
+  }
+
+  // ~a & b
+  inline uint32x8 andnot(uint32x8 a, uint32x8 b) {
+#ifdef USE_SIMD_X86_AVX2
+    return _mm256_andnot_si256(a, b);  //VPANDN ymm1, ymm2, ymm3
+#endif
+  }
+
+  //Shift
+  template<unsigned imm8>
+  inline uint32x8 shiftl(uint32x8 a) {
+#ifdef USE_SIMD_X86_AVX2
+    return _mm256_slli_epi32(a, imm8);  //VPSLLD ymm1, ymm2, imm8
+#endif
+  }
+}
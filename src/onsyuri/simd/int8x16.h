@@ -146,7 +146,9 @@ namespace simd {
 	static void store_u_32(void* m, uint8x16 a);
 
 	//Shuffle
+#ifdef USE_SIMD_X86_SSSE3
 	static uint8x16 shuffle(uint8x16 a, uint8x16 mask);
+#endif
 
 	//Swizzle
 	class uint16x8;
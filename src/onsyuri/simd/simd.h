@@ -94,6 +94,8 @@ namespace simd {
 #include "int8x32.inl"
 #include "int16x16.h"
 #include "int16x16.inl"
+#include "int32x8.h"
+#include "int32x8.inl"
 #include "vec256.h"
 #include "vec256.inl"
 #endif
@@ -27,6 +27,7 @@
 namespace simd {
   class uint8x32;
   class uint16x16;
+  class uint32x8;
   class ivec256 {
 #ifdef USE_SIMD_X86_AVX2
     __m256i v_;
@@ -40,6 +41,7 @@ namespace simd {
     operator __m256i() const { return v_; }
     operator uint8x32() const { return v_; }
     operator uint16x16() const { return v_; }
+    operator uint32x8() const { return v_; }
     ivec128 lo() { return _mm256_castsi256_si128(v_); }
     static ivec256 zero() { return _mm256_setzero_si256(); }
 #endif
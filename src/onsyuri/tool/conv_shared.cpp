@@ -29,7 +29,12 @@ extern "C"{
 };
 
 #include <bzlib.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
 #include "resize_image.h"
+#include "conv_shared.h"
 
 #if defined(WIN32) || defined(_WIN32)
 #include <windows.h>
@@ -38,13 +43,33 @@ extern "C"{
 int scale_ratio_upper;
 int scale_ratio_lower;
 
-unsigned char *rescaled_tmp2_buffer = NULL;
-size_t rescaled_tmp2_length = 0;
-unsigned char *rescaled_tmp_buffer = NULL;
-size_t rescaled_tmp_length = 0;
+ConvContext::ConvContext()
+{
+    rescaled_tmp_buffer = rescaled_tmp2_buffer = restored_buffer = NULL;
+    rescaled_tmp_length = rescaled_tmp2_length = restored_length = 0;
+    rescaled_buffer = NULL;
+    buffer = NULL;
+    buffer_length = 0;
+}
 
-static unsigned char *restored_buffer = NULL;
-static size_t restored_length = 0;
+ConvContext::~ConvContext()
+{
+    if ( rescaled_tmp_buffer )  delete[] rescaled_tmp_buffer;
+    if ( rescaled_tmp2_buffer ) delete[] rescaled_tmp2_buffer;
+    if ( restored_buffer )      delete[] restored_buffer;
+    if ( rescaled_buffer )      delete[] rescaled_buffer;
+    if ( buffer )               delete[] buffer;
+}
+
+unsigned char *ConvContext::getBuffer( size_t length )
+{
+    if ( length > buffer_length ){
+        if ( buffer ) delete[] buffer;
+        buffer = new unsigned char[length];
+        buffer_length = length;
+    }
+    return buffer;
+}
 
 #define INPUT_BUFFER_SIZE       4096
 typedef struct {
@@ -62,37 +87,40 @@ typedef struct {
 } my_destination_mgr;
 
 
-void rescaleImage( unsigned char *original_buffer, int width, int height, int byte_per_pixel,
-                   bool src_pad_flag, bool dst_pad_flag, bool palette_flag )
+static size_t scaleLength( size_t length )
+{
+    size_t scaled = (int)(length * scale_ratio_upper / scale_ratio_lower);
+    return scaled == 0 ? 1 : scaled;
+}
+
+// Resizes width x height pixels to w x h in ctx->rescaled_tmp_buffer.
+void rescaleImage( ConvContext *ctx, unsigned char *original_buffer, int width, int height, size_t w, size_t h,
+                   int byte_per_pixel, bool src_pad_flag, bool dst_pad_flag, bool palette_flag )
 {
     size_t width_pad = 0;
     if ( src_pad_flag ) width_pad = (4 - width * byte_per_pixel % 4) % 4;
     
-    size_t w = (int)(width  * scale_ratio_upper / scale_ratio_lower);
-    size_t h = (int)(height * scale_ratio_upper / scale_ratio_lower);
-    if ( w==0 ) w=1;
-    if ( h==0 ) h=1;
     size_t w_pad = 0;
     if ( dst_pad_flag ) w_pad = (4 - w * byte_per_pixel % 4) % 4;
 
-    if  ( (w * byte_per_pixel + w_pad) * h > rescaled_tmp_length ){
+    if  ( (w * byte_per_pixel + w_pad) * h > ctx->rescaled_tmp_length ){
         int len = (w * byte_per_pixel + w_pad) * h;
-        if ( rescaled_tmp_buffer ) delete[] rescaled_tmp_buffer;
-        rescaled_tmp_buffer = new unsigned char[ len ];
-        rescaled_tmp_length = len;
+        if ( ctx->rescaled_tmp_buffer ) delete[] ctx->rescaled_tmp_buffer;
+        ctx->rescaled_tmp_buffer = new unsigned char[ len ];
+        ctx->rescaled_tmp_length = len;
     }
 
     size_t len = (width * byte_per_pixel + width_pad) * (height+1) + byte_per_pixel;
     if ( len<16 ) len = 16;
-    if ( len > rescaled_tmp2_length ){
-        if ( rescaled_tmp2_buffer ) delete[] rescaled_tmp2_buffer;
-        rescaled_tmp2_buffer = new unsigned char[ len ];
-        rescaled_tmp2_length = len;
+    if ( len > ctx->rescaled_tmp2_length ){
+        if ( ctx->rescaled_tmp2_buffer ) delete[] ctx->rescaled_tmp2_buffer;
+        ctx->rescaled_tmp2_buffer = new unsigned char[ len ];
+        ctx->rescaled_tmp2_length = len;
     }
 
-    resizeImage( rescaled_tmp_buffer, w, h, w*byte_per_pixel+w_pad,
+    resizeImage( ctx->rescaled_tmp_buffer, w, h, w*byte_per_pixel+w_pad,
                  original_buffer, width, height, width*byte_per_pixel+width_pad,
-                 byte_per_pixel, rescaled_tmp2_buffer, width*byte_per_pixel+width_pad, palette_flag );
+                 byte_per_pixel, ctx->rescaled_tmp2_buffer, width*byte_per_pixel+width_pad, palette_flag );
 }
 
 
@@ -144,7 +172,8 @@ void term_destination (j_compress_ptr cinfo)
 {
 }
 
-size_t rescaleJPEGWrite( unsigned int width, unsigned int height, int byte_per_pixel, unsigned char **rescaled_buffer,
+// Encodes the width x height pixels of ctx->rescaled_tmp_buffer.
+size_t rescaleJPEGWrite( ConvContext *ctx, unsigned int width, unsigned int height, int byte_per_pixel,
                          int quality, bool bmp2jpeg_flag )
 {
     jpeg_error_mgr jerr;
@@ -159,17 +188,15 @@ size_t rescaleJPEGWrite( unsigned int width, unsigned int height, int byte_per_p
                                     sizeof(my_destination_mgr));
     my_destination_mgr * dest = (my_destination_mgr *) cinfo2.dest;
 
-    dest->buf = *rescaled_buffer;
-    dest->left = restored_length;
+    dest->buf = ctx->rescaled_buffer;
+    dest->left = ctx->restored_length;
 
     dest->pub.init_destination = init_destination;
     dest->pub.empty_output_buffer = empty_output_buffer;
     dest->pub.term_destination = term_destination;
 
-    cinfo2.image_width = (int)(width * scale_ratio_upper / scale_ratio_lower);
-    if ( cinfo2.image_width == 0 ) cinfo2.image_width = 1;
-    cinfo2.image_height = (int)(height * scale_ratio_upper / scale_ratio_lower);
-    if ( cinfo2.image_height == 0 ) cinfo2.image_height = 1;
+    cinfo2.image_width = width;
+    cinfo2.image_height = height;
     cinfo2.input_components = byte_per_pixel;
     if ( cinfo2.input_components == 1 )
         cinfo2.in_color_space = JCS_GRAYSCALE;
@@ -186,7 +213,7 @@ size_t rescaleJPEGWrite( unsigned int width, unsigned int height, int byte_per_p
 
     while (cinfo2.next_scanline < cinfo2.image_height) {
         if (bmp2jpeg_flag){
-            unsigned char *src = row_pointer[0] = &rescaled_tmp_buffer[(cinfo2.image_height - 1 - cinfo2.next_scanline) * row_stride];
+            unsigned char *src = row_pointer[0] = &ctx->rescaled_tmp_buffer[(cinfo2.image_height - 1 - cinfo2.next_scanline) * row_stride];
             for(unsigned int i=0 ; i<cinfo2.image_width ; i++, src+=3){
                 unsigned char tmp = src[2];
                 src[2] = src[0];
@@ -194,7 +221,7 @@ size_t rescaleJPEGWrite( unsigned int width, unsigned int height, int byte_per_p
             }
         }
         else{
-            row_pointer[0] = &rescaled_tmp_buffer[cinfo2.next_scanline * row_stride];
+            row_pointer[0] = &ctx->rescaled_tmp_buffer[cinfo2.next_scanline * row_stride];
         }
         jpeg_write_scanlines(&cinfo2, row_pointer, 1);
     }
@@ -207,7 +234,7 @@ size_t rescaleJPEGWrite( unsigned int width, unsigned int height, int byte_per_p
     return datacount;
 }
 
-size_t rescaleJPEG( unsigned char *original_buffer, size_t length, unsigned char **rescaled_buffer, int quality )
+size_t rescaleJPEG( ConvContext *ctx, unsigned char *original_buffer, size_t length, int quality )
 {
     struct jpeg_decompress_struct cinfo;
     jpeg_error_mgr jerr;
@@ -233,40 +260,51 @@ size_t rescaleJPEG( unsigned char *original_buffer, size_t length, unsigned char
     src->pub.next_input_byte = NULL;
 
     jpeg_read_header(&cinfo, TRUE);
+
+    // let libjpeg reduce by 1/2, 1/4 or 1/8 in the IDCT as long as the
+    // image stays at least as large as the target, then resize the rest
+    size_t w = scaleLength( cinfo.image_width );
+    size_t h = scaleLength( cinfo.image_height );
+    cinfo.scale_num = 1;
+    for ( cinfo.scale_denom = 8 ; cinfo.scale_denom > 1 ; cinfo.scale_denom /= 2 ){
+        jpeg_calc_output_dimensions(&cinfo);
+        if ( cinfo.output_width >= w && cinfo.output_height >= h ) break;
+    }
     jpeg_start_decompress(&cinfo);
 
-    if ( cinfo.output_width * cinfo.output_height * cinfo.output_components + 0x400 > restored_length ){
-        restored_length = cinfo.output_width * cinfo.output_height * cinfo.output_components + 0x400;
-        if ( restored_buffer ) delete[] restored_buffer;
-        restored_buffer = new unsigned char[ restored_length ];
-        if ( *rescaled_buffer ) delete[] *rescaled_buffer;
-        *rescaled_buffer = new unsigned char[ restored_length ];
+    if ( cinfo.output_width * cinfo.output_height * cinfo.output_components + 0x400 > ctx->restored_length ){
+        ctx->restored_length = cinfo.output_width * cinfo.output_height * cinfo.output_components + 0x400;
+        if ( ctx->restored_buffer ) delete[] ctx->restored_buffer;
+        ctx->restored_buffer = new unsigned char[ ctx->restored_length ];
+        if ( ctx->rescaled_buffer ) delete[] ctx->rescaled_buffer;
+        ctx->rescaled_buffer = new unsigned char[ ctx->restored_length ];
     }
     int row_stride = cinfo.output_width * cinfo.output_components;
 
     JSAMPARRAY buf = (*cinfo.mem->alloc_sarray)
         ((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
 
-    unsigned char *buf_p = restored_buffer;
+    unsigned char *buf_p = ctx->restored_buffer;
     while (cinfo.output_scanline < cinfo.output_height) {
         jpeg_read_scanlines(&cinfo, buf, 1);
         memcpy( buf_p, buf[0], row_stride );
         buf_p += cinfo.output_width * cinfo.output_components;
     }
 
-    rescaleImage( restored_buffer, cinfo.output_width, cinfo.output_height, cinfo.output_components, false, false, false );
+    rescaleImage( ctx, ctx->restored_buffer, cinfo.output_width, cinfo.output_height, w, h, cinfo.output_components, false, false, false );
 
-    size_t datacount = rescaleJPEGWrite(cinfo.output_width, cinfo.output_height, cinfo.output_components, rescaled_buffer, quality, false);
+    size_t datacount = rescaleJPEGWrite( ctx, w, h, cinfo.output_components, quality, false );
     jpeg_destroy_decompress(&cinfo);
 
     return datacount;
 }
 
-void rescaleBMPWrite( unsigned char *original_buffer, size_t total_size, int width, int height, unsigned char **rescaled_buffer )
+void rescaleBMPWrite( ConvContext *ctx, unsigned char *original_buffer, size_t total_size, int width, int height )
 {
+    unsigned char **rescaled_buffer = &ctx->rescaled_buffer;
     int buffer_offset = original_buffer[10] + (original_buffer[11] << 8);
     memcpy( *rescaled_buffer, original_buffer, buffer_offset );
-    memcpy( *rescaled_buffer + buffer_offset, rescaled_tmp_buffer, total_size - buffer_offset );
+    memcpy( *rescaled_buffer + buffer_offset, ctx->rescaled_tmp_buffer, total_size - buffer_offset );
 
     *(*rescaled_buffer + 2) = total_size & 0xff;
     *(*rescaled_buffer + 3) = (total_size >>  8) & 0xff;
@@ -293,8 +331,7 @@ void rescaleBMPWrite( unsigned char *original_buffer, size_t total_size, int wid
 #endif
 }
 
-size_t rescaleBMP( unsigned char *original_buffer, unsigned char **rescaled_buffer,
-                   bool output_jpeg_flag, int quality )
+size_t rescaleBMP( ConvContext *ctx, unsigned char *original_buffer, bool output_jpeg_flag, int quality )
 {
     if (original_buffer[14] != 40){
         if (original_buffer[14] == 12)
@@ -321,30 +358,91 @@ size_t rescaleBMP( unsigned char *original_buffer, unsigned char **rescaled_buff
     if (bit_per_pixel == 8) palette_flag = true;
     if (palette_flag) output_jpeg_flag = false;
 
-    size_t width2  = (int)(width * scale_ratio_upper / scale_ratio_lower);
-    if ( width2 == 0 ) width2 = 1;
+    size_t width2  = scaleLength( width );
     size_t width2_pad = (4 - width2 * byte_per_pixel % 4) % 4;
     
-    size_t height2 = (int)(height * scale_ratio_upper / scale_ratio_lower);
-    if ( height2 == 0 ) height2 = 1;
+    size_t height2 = scaleLength( height );
 
     size_t total_size = (width2 * byte_per_pixel + width2_pad) * height2 + buffer_offset;
-    if ( total_size+0x400 > restored_length ){
-        restored_length = total_size+0x400;
-        if ( restored_buffer ) delete[] restored_buffer;
-        restored_buffer = new unsigned char[ restored_length ];
-        if ( *rescaled_buffer ) delete[] *rescaled_buffer;
-        *rescaled_buffer = new unsigned char[ restored_length ];
+    if ( total_size+0x400 > ctx->restored_length ){
+        ctx->restored_length = total_size+0x400;
+        if ( ctx->restored_buffer ) delete[] ctx->restored_buffer;
+        ctx->restored_buffer = new unsigned char[ ctx->restored_length ];
+        if ( ctx->rescaled_buffer ) delete[] ctx->rescaled_buffer;
+        ctx->rescaled_buffer = new unsigned char[ ctx->restored_length ];
     }
 
     if (output_jpeg_flag){
-        rescaleImage( original_buffer+buffer_offset, width, height, byte_per_pixel, true, false, palette_flag );
-        total_size = rescaleJPEGWrite(width, height, byte_per_pixel, rescaled_buffer, quality, true);
+        rescaleImage( ctx, original_buffer+buffer_offset, width, height, width2, height2, byte_per_pixel, true, false, palette_flag );
+        total_size = rescaleJPEGWrite( ctx, width2, height2, byte_per_pixel, quality, true );
     }
     else {
-        rescaleImage( original_buffer+buffer_offset, width, height, byte_per_pixel, true, true, palette_flag );
-        rescaleBMPWrite(original_buffer, total_size, width2, height2, rescaled_buffer);
+        rescaleImage( ctx, original_buffer+buffer_offset, width, height, width2, height2, byte_per_pixel, true, true, palette_flag );
+        rescaleBMPWrite( ctx, original_buffer, total_size, width2, height2 );
     }
 
     return total_size;
 }
+
+int getDefaultThreadCount()
+{
+    int n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+void convertEntries( unsigned int count, int num_threads,
+                     std::function<void(ConvContext*, unsigned int, ConvEntry*)> prepare,
+                     std::function<void(unsigned int, ConvEntry*)> write )
+{
+    if ( num_threads < 1 ) num_threads = 1;
+    const unsigned int window = num_threads * 4;
+
+    // slot i%window holds entry i until it is written
+    std::vector<ConvEntry> slots( window );
+    std::vector<bool> ready( window, false );
+    unsigned int next_entry = 0, next_write = 0;
+    std::mutex mutex;
+    std::condition_variable cond_ready, cond_free;
+
+    std::vector<std::thread> workers;
+    for ( int t=0 ; t<num_threads ; t++ ){
+        workers.push_back( std::thread( [&](){
+            ConvContext ctx;
+            ConvEntry entry;
+            while(1){
+                unsigned int no;
+                {
+                    std::unique_lock<std::mutex> lock( mutex );
+                    cond_free.wait( lock, [&](){ return next_entry >= count || next_entry < next_write + window; } );
+                    if ( next_entry >= count ) return;
+                    no = next_entry++;
+                }
+
+                prepare( &ctx, no, &entry );
+
+                std::lock_guard<std::mutex> lock( mutex );
+                std::swap( slots[no % window], entry );
+                ready[no % window] = true;
+                cond_ready.notify_all();
+            }
+        } ) );
+    }
+
+    while ( next_write < count ){
+        ConvEntry *entry;
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            cond_ready.wait( lock, [&](){ return (bool)ready[next_write % window]; } );
+            entry = &slots[next_write % window];
+        }
+        // the slot is not reused until next_write moves past it
+        write( next_write, entry );
+
+        std::lock_guard<std::mutex> lock( mutex );
+        ready[next_write % window] = false;
+        next_write++;
+        cond_free.notify_all();
+    }
+
+    for ( size_t t=0 ; t<workers.size() ; t++ ) workers[t].join();
+}
@@ -0,0 +1,71 @@
+/* -*- C++ -*-
+ *
+ *  conv_shared.h - Shared code of sarconv and nsaconv
+ *
+ *  Copyright (c) 2001-2006 Ogapee. All rights reserved.
+ *
+ *  ogapee@aqua.dti2.ne.jp
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __CONV_SHARED_H__
+#define __CONV_SHARED_H__
+
+#include <stddef.h>
+#include <functional>
+#include "SarReader.h"
+
+// Set once from the command line before any conversion starts.
+extern int scale_ratio_upper;
+extern int scale_ratio_lower;
+
+// Scratch buffers of one conversion worker.
+struct ConvContext{
+    unsigned char *rescaled_tmp_buffer;
+    size_t rescaled_tmp_length;
+    unsigned char *rescaled_tmp2_buffer;
+    size_t rescaled_tmp2_length;
+    unsigned char *restored_buffer;
+    size_t restored_length;
+    unsigned char *rescaled_buffer; // output of rescaleJPEG()/rescaleBMP()
+    unsigned char *buffer;          // the entry as read from the archive
+    size_t buffer_length;
+
+    ConvContext();
+    ~ConvContext();
+    unsigned char *getBuffer( size_t length );
+};
+
+size_t rescaleJPEG( ConvContext *ctx, unsigned char *original_buffer, size_t length, int quality );
+size_t rescaleBMP( ConvContext *ctx, unsigned char *original_buffer, bool output_jpeg_flag, int quality );
+
+// One entry on its way through the converter.
+struct ConvEntry{
+    bool retrieved;             // false if the entry is to be left as it is
+    size_t advance;             // distance to the offset of the next entry
+    SarReader::EncodedFile ef;
+};
+
+// Runs prepare() for entries 0..count-1 on num_threads workers, each with
+// its own ConvContext, and write() on the calling thread in entry order.
+// At most a few entries per worker are held between the two.
+void convertEntries( unsigned int count, int num_threads,
+                     std::function<void(ConvContext*, unsigned int, ConvEntry*)> prepare,
+                     std::function<void(unsigned int, ConvEntry*)> write );
+
+int getDefaultThreadCount();
+
+#endif // __CONV_SHARED_H__
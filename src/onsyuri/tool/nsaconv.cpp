@@ -28,25 +28,19 @@
 #include <sys/stat.h>
 #include "NsaReader.h"
 #include "gbk2utf16.h"
+#include "conv_shared.h"
 
 Coding2UTF16 *coding2utf16 = new GBK2UTF16();
 
-extern int scale_ratio_upper;
-extern int scale_ratio_lower;
-
-extern size_t rescaleJPEG( unsigned char *original_buffer, size_t length, unsigned char **rescaled_buffer,
-                           int quality );
-extern size_t rescaleBMP( unsigned char *original_buffer, unsigned char **rescaled_buffer,
-                          bool output_jpeg_flag, int quality );
-
 #ifdef main
 #undef main
 #endif
 
 void help()
 {
-    fprintf(stderr, "Usage: nsaconv [-e] [-j] [-ns2] [-ns3] [-q quality] src_width dst_width src_archive_file dst_archive_file\n");
+    fprintf(stderr, "Usage: nsaconv [-e] [-j] [-ns2] [-ns3] [-q quality] [-t threads] src_width dst_width src_archive_file dst_archive_file\n");
     fprintf(stderr, "           quality   ... 0 to 100\n");
+    fprintf(stderr, "           threads   ... number of worker threads (default: number of cores)\n");
     fprintf(stderr, "           src_width ... 640 or 800\n");
     fprintf(stderr, "           dst_width ... 176, 220, 320, 360, 384, 640, etc.\n");
     exit(-1);
@@ -56,13 +50,13 @@ int main( int argc, char **argv )
 {
     NsaReader cSR;
     unsigned int nsa_offset = 0;
-    unsigned long length, offset = 0, buffer_length = 0;
-    unsigned char *buffer = NULL, *rescaled_buffer = NULL;
-    unsigned int i, count;
+    unsigned long offset = 0;
+    unsigned int count;
     int archive_type = BaseReader::ARCHIVE_TYPE_NSA;
     bool enhanced_flag = false;
     bool bmp2jpeg_flag = false;
     int quality = 75;
+    int num_threads = getDefaultThreadCount();
     FILE *fp;
 
     argc--; // skip command name
@@ -77,6 +71,11 @@ int main( int argc, char **argv )
             argv++;
             quality = atoi(argv[0]);
         }
+        else if ( !strcmp( argv[0], "-t" ) ){
+            argc--;
+            argv++;
+            num_threads = atoi(argv[0]);
+        }
         argc--;
         argv++;
     }
@@ -93,58 +92,65 @@ int main( int argc, char **argv )
         exit(-1);
     }
     cSR.openForConvert( argv[2], archive_type, nsa_offset );
+    cSR.setDecodeCacheSize( 0 ); // every entry is read once
     count = cSR.getNumFiles();
+    if ( count > 0 ) offset = cSR.getFileByIndex( 0 ).offset;
 
-    SarReader::FileInfo sFI;
+    // read, decode, rescale and encode on the workers
+    auto prepare = [&]( ConvContext *ctx, unsigned int i, ConvEntry *entry ){
+        SarReader::FileInfo sFI = cSR.getFileByIndex( i );
+        size_t length = cSR.getFileLength( sFI.name );
+        unsigned char *buffer = ctx->getBuffer( length );
 
-    for ( i=0 ; i<count ; i++ ){
-        sFI = cSR.getFileByIndex( i );
-        printf( "%d/%d\n", i, count );
-        if ( i==0 ) offset = sFI.offset;
-        length = cSR.getFileLength( sFI.name );
-        if ( length > buffer_length ){
-            if ( buffer ) delete[] buffer;
-            buffer = new unsigned char[length];
-            buffer_length = length;
-        }
-
-        sFI.offset = offset;
+        entry->retrieved = true;
         if ( (strlen( sFI.name ) > 3 && !strcmp( sFI.name + strlen( sFI.name ) - 3, "JPG")) ||
              (strlen( sFI.name ) > 4 && !strcmp( sFI.name + strlen( sFI.name ) - 4, "JPEG")) ){
             if ( cSR.getFile( sFI.name, buffer ) != length ){
                 fprintf( stderr, "file %s can't be retrieved %ld\n", sFI.name, length );
-                continue;
+                entry->retrieved = false;
+                return;
             }
-            sFI.length = rescaleJPEG( buffer, length, &rescaled_buffer, quality );
-            cSR.putFile( fp, i, sFI.offset, sFI.length, sFI.length, sFI.compression_type, true, rescaled_buffer );
+            sFI.length = rescaleJPEG( ctx, buffer, length, quality );
+            cSR.encodeFile( i, sFI.length, sFI.length, sFI.compression_type, true, ctx->rescaled_buffer, &entry->ef );
+            entry->advance = sFI.length;
         }
         else if ( strlen( sFI.name ) > 3 && !strcmp( sFI.name + strlen( sFI.name ) - 3, "BMP") ){
             if ( cSR.getFile( sFI.name, buffer ) != length ){
                 fprintf( stderr, "file %s can't be retrieved %ld\n", sFI.name, length );
-                continue;
+                entry->retrieved = false;
+                return;
             }
-            sFI.length = rescaleBMP( buffer, &rescaled_buffer, bmp2jpeg_flag, quality );
-            cSR.putFile( fp, i, sFI.offset, sFI.length, sFI.length, enhanced_flag?BaseReader::NBZ_COMPRESSION:sFI.compression_type, true, rescaled_buffer );
+            sFI.length = rescaleBMP( ctx, buffer, bmp2jpeg_flag, quality );
+            cSR.encodeFile( i, sFI.length, sFI.length, enhanced_flag?BaseReader::NBZ_COMPRESSION:sFI.compression_type, true, ctx->rescaled_buffer, &entry->ef );
+            entry->advance = sFI.length;
         }
         else if ( enhanced_flag && strlen( sFI.name ) > 3 && !strcmp( sFI.name + strlen( sFI.name ) - 3, "WAV") ){
             if ( cSR.getFile( sFI.name, buffer ) != length ){
                 fprintf( stderr, "file %s can't be retrieved %ld\n", sFI.name, length );
-                continue;
+                entry->retrieved = false;
+                return;
             }
-            sFI.length = cSR.putFile( fp, i, sFI.offset, sFI.length, length, BaseReader::NBZ_COMPRESSION, true, buffer );
+            cSR.encodeFile( i, sFI.length, length, BaseReader::NBZ_COMPRESSION, true, buffer, &entry->ef );
+            entry->advance = entry->ef.length;
         }
         else{
-            cSR.putFile( fp, i, sFI.offset, sFI.length, sFI.original_length, sFI.compression_type, false, buffer );
+            cSR.encodeFile( i, sFI.length, sFI.original_length, sFI.compression_type, false, buffer, &entry->ef );
+            entry->advance = sFI.length;
         }
-        
-        offset += sFI.length;
-    }
+    };
+
+    // and write them back in their original order
+    auto write = [&]( unsigned int i, ConvEntry *entry ){
+        printf( "%d/%d\n", i, count );
+        if ( !entry->retrieved ) return;
+        cSR.putEncodedFile( fp, i, offset, entry->ef );
+        offset += entry->advance;
+    };
+
+    convertEntries( count, num_threads, prepare, write );
     cSR.writeHeader( fp, archive_type, nsa_offset );
 
     fclose(fp);
 
-    if ( rescaled_buffer ) delete[] rescaled_buffer;
-    if ( buffer ) delete[] buffer;
-    
     return 0;
 }
@@ -0,0 +1,167 @@
+/* -*- C++ -*-
+ *
+ *  nsxconv.cpp - Converter from NSA archive to NSX archive
+ *
+ *  Copyright (c) 2026 ONScripter-jh-Switch contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Build with -DUSE_SDL_IMAGE and SDL2/SDL2_image to enable -s.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <vector>
+#include "NsxReader.h"
+#include "gbk2utf16.h"
+#include "conv_shared.h"
+#if defined(USE_SDL_IMAGE)
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#endif
+
+Coding2UTF16 *coding2utf16 = new GBK2UTF16();
+
+#ifdef main
+#undef main
+#endif
+
+void help()
+{
+    fprintf(stderr, "Usage: nsxconv [-s] [-abgr] [-n] [-ns2] [-ns3] [-t threads] src_archive_file dst_archive_file\n");
+    fprintf(stderr, "           -s        ... store PNG/JPG/BMP images as decoded pixels\n");
+    fprintf(stderr, "           -abgr     ... with -s, in ABGR8888 instead of ARGB8888 (match the renderer)\n");
+    fprintf(stderr, "           -n        ... no LZ4 compression\n");
+    fprintf(stderr, "           threads   ... number of worker threads (default: number of cores)\n");
+    fprintf(stderr, "           dst_archive_file is usually arc.nsx next to the source archive\n");
+    exit(-1);
+}
+
+#if defined(USE_SDL_IMAGE)
+static bool isImage( const char *name )
+{
+    const char *ext = strrchr( name, '.' );
+    if ( ext == NULL ) return false;
+    return !strcasecmp( ext, ".PNG" ) || !strcasecmp( ext, ".JPG" ) ||
+           !strcasecmp( ext, ".JPEG" ) || !strcasecmp( ext, ".BMP" );
+}
+
+// Decodes the image as ONScripter::createSurfaceFromFile() would.
+static bool encodeImage( unsigned char *buffer, size_t length, Uint32 format, bool compress, NsxWriter::EncodedEntry *ee )
+{
+    SDL_RWops *src = SDL_RWFromConstMem( buffer, length );
+    int is_png = IMG_isPNG( src );
+    SDL_Surface *tmp = IMG_Load_RW( src, 1 );
+    if ( tmp == NULL ) return false;
+
+    bool has_alpha = tmp->format->Amask || is_png;
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat( tmp, format, 0 );
+    SDL_FreeSurface( tmp );
+    if ( surface == NULL ) return false;
+
+    SDL_LockSurface( surface );
+    NsxWriter::encodeSurface( (unsigned char*)surface->pixels, surface->w, surface->h, surface->pitch,
+                              format, has_alpha, compress, ee );
+    SDL_UnlockSurface( surface );
+    SDL_FreeSurface( surface );
+
+    return true;
+}
+#endif
+
+int main( int argc, char **argv )
+{
+    NsaReader cSR;
+    NsxWriter writer;
+    unsigned int nsa_offset = 0;
+    unsigned int count;
+    int archive_type = BaseReader::ARCHIVE_TYPE_NSA;
+    bool surface_flag = false;
+    bool abgr_flag = false;
+    bool compress_flag = true;
+    int num_threads = getDefaultThreadCount();
+
+    argc--; // skip command name
+    argv++;
+    while (argc > 2){
+        if      ( !strcmp( argv[0], "-s" ) )    surface_flag = true;
+        else if ( !strcmp( argv[0], "-abgr" ) ) abgr_flag = true;
+        else if ( !strcmp( argv[0], "-n" ) )    compress_flag = false;
+        else if ( !strcmp( argv[0], "-ns2" ) )  nsa_offset = 1;
+        else if ( !strcmp( argv[0], "-ns3" ) )  nsa_offset = 2;
+        else if ( !strcmp( argv[0], "-t" ) ){
+            argc--;
+            argv++;
+            num_threads = atoi(argv[0]);
+        }
+        argc--;
+        argv++;
+    }
+    if (argc != 2) help();
+
+#if defined(USE_SDL_IMAGE)
+    Uint32 format = abgr_flag ? SDL_PIXELFORMAT_ABGR8888 : SDL_PIXELFORMAT_ARGB8888;
+    if ( surface_flag ) IMG_Init( IMG_INIT_PNG | IMG_INIT_JPG );
+#else
+    if ( surface_flag || abgr_flag ){
+        fprintf( stderr, "-s is not available, nsxconv was built without USE_SDL_IMAGE.\n" );
+        exit(-1);
+    }
+#endif
+
+    if ( cSR.openForConvert( argv[0], archive_type, nsa_offset ) ) exit(-1);
+    cSR.setDecodeCacheSize( 0 ); // every entry is read once
+    if ( writer.open( argv[1] ) ) exit(-1);
+    count = cSR.getNumFiles();
+
+    // the entries decoded from SPB/LZSS/NBZ, then compressed on the workers
+    std::vector<NsxWriter::EncodedEntry> encoded( count );
+    auto prepare = [&]( ConvContext *ctx, unsigned int i, ConvEntry *entry ){
+        SarReader::FileInfo sFI = cSR.getFileByIndex( i );
+        size_t length = cSR.getFileLength( sFI.name );
+        unsigned char *buffer = ctx->getBuffer( length );
+
+        entry->retrieved = true;
+        if ( cSR.getFile( sFI.name, buffer ) != length ){
+            fprintf( stderr, "file %s can't be retrieved %ld\n", sFI.name, length );
+            entry->retrieved = false;
+            return;
+        }
+#if defined(USE_SDL_IMAGE)
+        if ( surface_flag && isImage( sFI.name ) &&
+             encodeImage( buffer, length, format, compress_flag, &encoded[i] ) ) return;
+#endif
+        NsxWriter::encodeEntry( buffer, length, compress_flag, &encoded[i] );
+    };
+
+    // and write them in their original order, which keeps the payloads of
+    // neighbouring entries next to each other
+    auto write = [&]( unsigned int i, ConvEntry *entry ){
+        printf( "%d/%d\n", i, count );
+        if ( entry->retrieved ) writer.putEntry( cSR.getFileByIndex( i ).name, encoded[i] );
+        std::vector<unsigned char>().swap( encoded[i].data );
+    };
+
+    convertEntries( count, num_threads, prepare, write );
+
+    if ( writer.close() ){
+        fprintf( stderr, "can't write %s\n", argv[1] );
+        exit(-1);
+    }
+
+    return 0;
+}
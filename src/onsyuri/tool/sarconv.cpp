@@ -27,14 +27,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "SarReader.h"
+#include "gbk2utf16.h"
+#include "conv_shared.h"
 
-extern int scale_ratio_upper;
-extern int scale_ratio_lower;
-
-extern size_t rescaleJPEG( unsigned char *original_buffer, size_t length, unsigned char **rescaled_buffer,
-                           int quality );
-extern size_t rescaleBMP( unsigned char *original_buffer, unsigned char **rescaled_buffer,
-                          bool output_jpeg_flag, int quality );
+Coding2UTF16 *coding2utf16 = new GBK2UTF16();
 
 #ifdef main
 #undef main
@@ -42,8 +38,9 @@ extern size_t rescaleBMP( unsigned char *original_buffer, unsigned char **rescal
 
 void help()
 {
-    fprintf(stderr, "Usage: sarconv [-j] [-q quality] src_width dst_width src_archive_file dst_archive_file\n");
+    fprintf(stderr, "Usage: sarconv [-j] [-q quality] [-t threads] src_width dst_width src_archive_file dst_archive_file\n");
     fprintf(stderr, "           quality   ... 0 to 100\n");
+    fprintf(stderr, "           threads   ... number of worker threads (default: number of cores)\n");
     fprintf(stderr, "           src_width ... 640 or 800\n");
     fprintf(stderr, "           dst_width ... 176, 220, 320, 360, 384, 640, etc.\n");
     exit(-1);
@@ -52,11 +49,11 @@ void help()
 int main( int argc, char **argv )
 {
     SarReader cSR;
-    unsigned long length, offset = 0, buffer_length = 0;
-    unsigned char *buffer = NULL, *rescaled_buffer = NULL;
-    unsigned int i, count;
+    unsigned long offset = 0;
+    unsigned int count;
     bool bmp2jpeg_flag = false;
     int quality = 75;
+    int num_threads = getDefaultThreadCount();
     FILE *fp;
 
     argc--; // skip command name
@@ -68,6 +65,11 @@ int main( int argc, char **argv )
             argv++;
             quality = atoi(argv[0]);
         }
+        else if ( !strcmp( argv[0], "-t" ) ){
+            argc--;
+            argv++;
+            num_threads = atoi(argv[0]);
+        }
         argc--;
         argv++;
     }
@@ -86,51 +88,54 @@ int main( int argc, char **argv )
         fprintf( stderr, "can't open file %s\n", argv[2] );
         exit(-1);
     }
+    cSR.setDecodeCacheSize( 0 ); // every entry is read once
     count = cSR.getNumFiles();
+    if ( count > 0 ) offset = cSR.getFileByIndex( 0 ).offset;
 
-    SarReader::FileInfo sFI;
-    
-    for ( i=0 ; i<count ; i++ ){
-        printf( "%d/%d\n", i, count );
-        sFI = cSR.getFileByIndex( i );
-        if ( i==0 ) offset = sFI.offset;
-        length = cSR.getFileLength( sFI.name );
-        if ( length > buffer_length ){
-            if ( buffer ) delete[] buffer;
-            buffer = new unsigned char[length];
-            buffer_length = length;
-        }
+    // read, decode, rescale and encode on the workers
+    auto prepare = [&]( ConvContext *ctx, unsigned int i, ConvEntry *entry ){
+        SarReader::FileInfo sFI = cSR.getFileByIndex( i );
+        size_t length = cSR.getFileLength( sFI.name );
+        unsigned char *buffer = ctx->getBuffer( length );
 
-        sFI.offset = offset;
+        entry->retrieved = true;
         if ( (strlen( sFI.name ) > 3 && !strcmp( sFI.name + strlen( sFI.name ) - 3, "JPG")) ||
              (strlen( sFI.name ) > 4 && !strcmp( sFI.name + strlen( sFI.name ) - 4, "JPEG")) ){
             if ( cSR.getFile( sFI.name, buffer ) != length ){
                 fprintf( stderr, "file %s can't be retrieved %ld\n", sFI.name, length );
-                continue;
+                entry->retrieved = false;
+                return;
             }
-            sFI.length = rescaleJPEG( buffer, length, &rescaled_buffer, quality );
-            cSR.putFile( fp, i, sFI.offset, sFI.length, sFI.length, true, rescaled_buffer );
+            sFI.length = rescaleJPEG( ctx, buffer, length, quality );
+            cSR.encodeFile( i, sFI.length, sFI.length, sFI.compression_type, true, ctx->rescaled_buffer, &entry->ef );
         }
         else if ( strlen( sFI.name ) > 3 && !strcmp( sFI.name + strlen( sFI.name ) - 3, "BMP") ){
             if ( cSR.getFile( sFI.name, buffer ) != length ){
                 fprintf( stderr, "file %s can't be retrieved %ld\n", sFI.name, length );
-                continue;
+                entry->retrieved = false;
+                return;
             }
-            sFI.length = rescaleBMP( buffer, &rescaled_buffer, bmp2jpeg_flag, quality );
-            cSR.putFile( fp, i, sFI.offset, sFI.length, sFI.length, true, rescaled_buffer );
+            sFI.length = rescaleBMP( ctx, buffer, bmp2jpeg_flag, quality );
+            cSR.encodeFile( i, sFI.length, sFI.length, sFI.compression_type, true, ctx->rescaled_buffer, &entry->ef );
         }
         else{
-            cSR.putFile( fp, i, sFI.offset, sFI.length, sFI.original_length, false, buffer );
+            cSR.encodeFile( i, sFI.length, sFI.original_length, sFI.compression_type, false, buffer, &entry->ef );
         }
-        
-        offset += sFI.length;
-    }
+        entry->advance = sFI.length;
+    };
+
+    // and write them back in their original order
+    auto write = [&]( unsigned int i, ConvEntry *entry ){
+        printf( "%d/%d\n", i, count );
+        if ( !entry->retrieved ) return;
+        cSR.putEncodedFile( fp, i, offset, entry->ef );
+        offset += entry->advance;
+    };
+
+    convertEntries( count, num_threads, prepare, write );
     cSR.writeHeader( fp );
 
     fclose(fp);
 
-    if ( rescaled_buffer ) delete[] rescaled_buffer;
-    if ( buffer ) delete[] buffer;
-    
     return 0;
 }
@@ -0,0 +1,153 @@
+/**
+ * Helpers for writing synthetic NSA archives that the real
+ * DirectReader/SarReader/NsaReader classes can open.
+ */
+
+#ifndef ARCHIVE_BUILDER_H
+#define ARCHIVE_BUILDER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <bzlib.h>
+
+#include "coding2utf16.h"
+
+// DirectReader.cpp refers to the engine-wide converter
+Coding2UTF16 *coding2utf16 = NULL;
+
+namespace ArchiveBuilder {
+
+struct Entry {
+    std::string name;
+    int compression_type;
+    std::vector<unsigned char> data;
+    size_t original_length;
+};
+
+inline void putShort(FILE *fp, unsigned int v) {
+    fputc((v >> 8) & 0xff, fp);
+    fputc(v & 0xff, fp);
+}
+
+inline void putLong(FILE *fp, unsigned long v) {
+    fputc((v >> 24) & 0xff, fp);
+    fputc((v >> 16) & 0xff, fp);
+    fputc((v >> 8) & 0xff, fp);
+    fputc(v & 0xff, fp);
+}
+
+inline Entry makeEntry(const std::string &name, const std::vector<unsigned char> &data,
+                       int compression_type = 0, size_t original_length = 0) {
+    Entry e;
+    e.name = name;
+    e.compression_type = compression_type;
+    e.data = data;
+    e.original_length = original_length ? original_length : data.size();
+    return e;
+}
+
+inline std::vector<unsigned char> makeData(size_t length, unsigned int seed) {
+    std::vector<unsigned char> data(length);
+    for (size_t i = 0; i < length; i++) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (unsigned char)(seed >> 16);
+    }
+    return data;
+}
+
+// NBZ body: big-endian decompressed length followed by a bzip2 stream.
+inline Entry makeNBZEntry(const std::string &name, const std::vector<unsigned char> &data) {
+    unsigned int dest_len = data.size() + data.size() / 100 + 600;
+    std::vector<unsigned char> body(4 + dest_len);
+    body[0] = (data.size() >> 24) & 0xff;
+    body[1] = (data.size() >> 16) & 0xff;
+    body[2] = (data.size() >> 8) & 0xff;
+    body[3] = data.size() & 0xff;
+    BZ2_bzBuffToBuffCompress((char*)&body[4], &dest_len, (char*)&data[0], data.size(), 9, 0, 30);
+    body.resize(4 + dest_len);
+    return makeEntry(name, body, 4 /* NBZ_COMPRESSION */, data.size());
+}
+
+// Any bit sequence is a valid LZSS stream, so random bytes exercise every
+// literal/match path of the decoder.
+inline Entry makeLZSSEntry(const std::string &name, size_t original_length, unsigned int seed) {
+    return makeEntry(name, makeData(original_length * 9 / 8 + 16, seed),
+                     2 /* LZSS_COMPRESSION */, original_length);
+}
+
+// SPB body: 16-bit width and height followed by the bit stream; sized so
+// that the decoder never runs off the end of the entry.
+inline Entry makeSPBEntry(const std::string &name, int width, int height, unsigned int seed) {
+    std::vector<unsigned char> body = makeData(4 + width * height * 3 * 5 + 16, seed);
+    body[0] = (width >> 8) & 0xff;
+    body[1] = width & 0xff;
+    body[2] = (height >> 8) & 0xff;
+    body[3] = height & 0xff;
+    return makeEntry(name, body, 1 /* SPB_COMPRESSION */, 0);
+}
+
+// Writes the classic NSA layout: header, then the entry bodies in order.
+// With a key_table every byte is stored as its preimage, so a reader
+// constructed with the same (involutive) table sees the plain archive.
+inline bool writeNSA(const std::string &path, const std::vector<Entry> &entries,
+                     const unsigned char *key_table = NULL) {
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) return false;
+
+    unsigned long base_offset = 6;
+    for (size_t i = 0; i < entries.size(); i++)
+        base_offset += entries[i].name.size() + 1 + 1 + 4 + 4 + 4;
+
+    putShort(fp, (unsigned int)entries.size());
+    putLong(fp, base_offset);
+
+    unsigned long offset = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry &e = entries[i];
+        fwrite(e.name.c_str(), 1, e.name.size() + 1, fp);
+        fputc(e.compression_type, fp);
+        putLong(fp, offset);
+        putLong(fp, e.data.size());
+        putLong(fp, e.original_length);
+        offset += e.data.size();
+    }
+    for (size_t i = 0; i < entries.size(); i++)
+        if (!entries[i].data.empty())
+            fwrite(&entries[i].data[0], 1, entries[i].data.size(), fp);
+
+    fclose(fp);
+
+    if (key_table) {
+        fp = fopen(path.c_str(), "r+b");
+        if (!fp) return false;
+        std::vector<unsigned char> bytes(base_offset + offset);
+        if (fread(&bytes[0], 1, bytes.size(), fp) != bytes.size()) { fclose(fp); return false; }
+        for (size_t i = 0; i < bytes.size(); i++) bytes[i] = key_table[bytes[i]];
+        fseek(fp, 0, SEEK_SET);
+        fwrite(&bytes[0], 1, bytes.size(), fp);
+        fclose(fp);
+    }
+    return true;
+}
+
+// Creates an empty scratch directory and returns it with a trailing '/'.
+inline std::string makeTempDir(const char *tag) {
+    char path[256];
+    snprintf(path, sizeof(path), "/tmp/onsyuri_%s_XXXXXX", tag);
+    if (!mkdtemp(path)) return "";
+    return std::string(path) + "/";
+}
+
+inline void removeTempDir(const std::string &dir) {
+    std::string cmd = "rm -rf '" + dir + "'";
+    if (system(cmd.c_str()) != 0) fprintf(stderr, "failed to remove %s\n", dir.c_str());
+}
+
+}
+
+#endif
@@ -0,0 +1,221 @@
+/**
+ * Archive reader micro-benchmarks.
+ * Run with `make bench`; results are printed as "name value unit".
+ */
+
+#include <chrono>
+#include "archive_builder.h"
+#include "legacy_decoders.h"
+#include "NsxReader.h"
+
+using namespace ArchiveBuilder;
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Exposes the name index for timing without the loose-file probe.
+struct IndexedReader : public NsaReader {
+    IndexedReader(char *path) : NsaReader(0, path) {}
+    using SarReader::findFileIndex;
+};
+
+// The per-archive strcmp scan that the index replaced.
+static int linearLookup(const std::vector<BaseReader::FileInfo> &list, const char *file_name) {
+    char capital_name[MAX_FILE_NAME_LENGTH + 1];
+    size_t len = strlen(file_name), i;
+    if (len > MAX_FILE_NAME_LENGTH) len = MAX_FILE_NAME_LENGTH;
+    for (i = 0; i < len; i++) {
+        char ch = file_name[i];
+        if ('a' <= ch && ch <= 'z') ch += 'A' - 'a';
+        else if (ch == '/') ch = '\\';
+        capital_name[i] = ch;
+    }
+    capital_name[len] = '\0';
+    for (i = 0; i < list.size(); i++)
+        if (!strcmp(capital_name, list[i].name)) break;
+    return (int)i;
+}
+
+static void benchLookup(const std::string &dir, int num_files) {
+    IndexedReader reader((char*)dir.c_str());
+    if (reader.open() != 0) {
+        fprintf(stderr, "cannot open bench archive\n");
+        return;
+    }
+
+    std::vector<BaseReader::FileInfo> list(num_files);
+    for (int i = 0; i < num_files; i++) list[i] = reader.getFileByIndex(i);
+
+    std::vector<std::string> names;
+    for (int i = 0; i < 4096; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "cg/scene%06d.png", (i * 7919) % num_files);
+        names.push_back(name);
+    }
+
+    const int linear_rounds = 1;
+    Clock::time_point start = Clock::now();
+    long sink = 0;
+    for (int r = 0; r < linear_rounds; r++)
+        for (size_t i = 0; i < names.size(); i++)
+            sink += linearLookup(list, names[i].c_str());
+    double linear = names.size() * linear_rounds / secondsSince(start);
+
+    const int hash_rounds = 200;
+    start = Clock::now();
+    for (int r = 0; r < hash_rounds; r++)
+        for (size_t i = 0; i < names.size(); i++) {
+            BaseReader::ArchiveInfo *ai;
+            unsigned int no;
+            if (reader.findFileIndex(names[i].c_str(), &ai, &no)) sink += no;
+        }
+    double hashed = names.size() * hash_rounds / secondsSince(start);
+
+    printf("lookup_linear_%dk %.0f lookups/s\n", num_files / 1000, linear);
+    printf("lookup_hashed_%dk %.0f lookups/s\n", num_files / 1000, hashed);
+    printf("lookup_speedup_%dk %.1f x\n", num_files / 1000, hashed / linear);
+    if (sink == 42) printf("\n");
+}
+
+static void benchDecoders(const std::string &dir, const std::vector<Entry> &corpus, const char *tag) {
+    NsaReader reader(0, (char*)dir.c_str());
+    if (reader.open() != 0) {
+        fprintf(stderr, "cannot open bench archive\n");
+        return;
+    }
+    reader.setDecodeCacheSize(0); // time the decoders, not the cache
+
+    const int rounds = 3;
+    double bytes = 0;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < corpus.size(); i++) {
+            std::vector<unsigned char> out = corpus[i].compression_type == BaseReader::LZSS_COMPRESSION ?
+                LegacyDecoders::decodeLZSS(corpus[i].data, corpus[i].original_length) :
+                LegacyDecoders::decodeSPB(corpus[i].data);
+            bytes += out.size();
+        }
+    double legacy = bytes / secondsSince(start) / 1e6;
+
+    bytes = 0;
+    start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < corpus.size(); i++) {
+            std::vector<unsigned char> out(reader.getFileLength(corpus[i].name.c_str()));
+            bytes += reader.getFile(corpus[i].name.c_str(), &out[0]);
+        }
+    double current = bytes / secondsSince(start) / 1e6;
+
+    printf("decode_%s_bitwise %.1f MB/s\n", tag, legacy);
+    printf("decode_%s_reservoir %.1f MB/s\n", tag, current);
+    printf("decode_%s_speedup %.1f x\n", tag, current / legacy);
+}
+
+// Re-reading one sound-effect-sized NBZ entry, as looping SEs do.
+static void benchDecodeCache(const std::string &dir) {
+    NsaReader reader(0, (char*)dir.c_str());
+    if (reader.open() != 0) {
+        fprintf(stderr, "cannot open bench archive\n");
+        return;
+    }
+
+    const int rounds = 50;
+    double rate[2];
+    for (int cached = 0; cached < 2; cached++) {
+        reader.setDecodeCacheSize(cached ? DEFAULT_DECODE_CACHE_SIZE : 0);
+        std::vector<unsigned char> out(reader.getFileLength("SE.NBZ"));
+        Clock::time_point start = Clock::now();
+        for (int r = 0; r < rounds; r++) reader.getFile("SE.NBZ", &out[0]);
+        rate[cached] = rounds / secondsSince(start);
+    }
+
+    printf("nbz_reread_uncached %.0f reads/s\n", rate[0]);
+    printf("nbz_reread_cached %.0f reads/s\n", rate[1]);
+    printf("nbz_reread_speedup %.1f x\n", rate[1] / rate[0]);
+}
+
+// Opening a title: NSA headers are parsed entry by entry, the NSX index
+// is read in one go.
+static void benchOpen(const std::string &dir, int num_files) {
+    std::string nsx_dir = dir + "nsx/";
+    mkdir(nsx_dir.c_str(), 0755);
+    {
+        NsaReader src(0, (char*)dir.c_str());
+        NsxWriter writer;
+        if (src.open() != 0 || writer.open((nsx_dir + "arc.nsx").c_str()) != 0) {
+            fprintf(stderr, "cannot write bench archive\n");
+            return;
+        }
+        for (int i = 0; i < src.getNumFiles(); i++) {
+            BaseReader::FileInfo fi = src.getFileByIndex(i);
+            std::vector<unsigned char> data(fi.length);
+            src.getFile(fi.name, &data[0]);
+            NsxWriter::EncodedEntry ee;
+            NsxWriter::encodeEntry(&data[0], data.size(), false, &ee);
+            writer.putEntry(fi.name, ee);
+        }
+        writer.close();
+    }
+
+    const int rounds = 20;
+    double rate[2];
+    for (int nsx = 0; nsx < 2; nsx++) {
+        Clock::time_point start = Clock::now();
+        for (int r = 0; r < rounds; r++) {
+            NsxReader reader(0, (char*)(nsx ? nsx_dir : dir).c_str());
+            reader.open();
+        }
+        rate[nsx] = rounds / secondsSince(start);
+    }
+
+    printf("open_nsa_%dk %.1f opens/s\n", num_files / 1000, rate[0]);
+    printf("open_nsx_%dk %.1f opens/s\n", num_files / 1000, rate[1]);
+    printf("open_speedup_%dk %.1f x\n", num_files / 1000, rate[1] / rate[0]);
+}
+
+int main() {
+    const int num_files = 50000;
+    std::string dir = makeTempDir("bench");
+    if (dir.empty()) return 1;
+
+    std::vector<Entry> entries;
+    for (int i = 0; i < num_files; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "CG\\SCENE%06d.PNG", i);
+        entries.push_back(makeEntry(name, makeData(4, i)));
+    }
+    writeNSA(dir + "arc.nsa", entries);
+
+    benchLookup(dir, num_files);
+    benchOpen(dir, num_files);
+
+    // LZSS streams from random bits are ~1/3 matches, which is typical of
+    // real BMP entries; SPB entries are full-screen 640x480 images
+    std::vector<Entry> lzss, spb;
+    for (int i = 0; i < 8; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "LZSS%d.BMP", i);
+        lzss.push_back(makeLZSSEntry(name, 1 << 20, i));
+        snprintf(name, sizeof(name), "SPB%d.BMP", i);
+        spb.push_back(makeSPBEntry(name, 640, 480, i));
+    }
+    std::string lzss_dir = dir + "lzss/", spb_dir = dir + "spb/";
+    mkdir(lzss_dir.c_str(), 0755);
+    mkdir(spb_dir.c_str(), 0755);
+    writeNSA(lzss_dir + "arc.nsa", lzss);
+    writeNSA(spb_dir + "arc.nsa", spb);
+    benchDecoders(lzss_dir, lzss, "lzss");
+    benchDecoders(spb_dir, spb, "spb");
+
+    std::string nbz_dir = dir + "nbz/";
+    mkdir(nbz_dir.c_str(), 0755);
+    std::vector<Entry> nbz(1, makeNBZEntry("SE.NBZ", makeData(512 * 1024, 1)));
+    writeNSA(nbz_dir + "arc.nsa", nbz);
+    benchDecodeCache(nbz_dir);
+
+    removeTempDir(dir);
+    return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * Screen composition benchmark on the profile of a 4-core handheld: a
+ * 1280x720 frame of a background, a full screen sprite, three standing
+ * pictures, small sprites and a text window, composed by refreshSurface()
+ * of ONScripter_image.cpp (see onscripter_harness.h)
+ * - serial: on one thread, as with --compositor-threads 1 and no OpenMP;
+ * - per_sprite: on one thread with every layer split across the cores and
+ *   joined before the next one, as the parallel::For of blendOnSurface()
+ *   does with OpenMP;
+ * - bands: the whole stack on a band per thread, joined once per frame.
+ *
+ * The handheld is approximated by the number of cores only.  Pin the run to
+ * as many cores as threads, e.g. `taskset -c 0-3 ./bench_band_compositor`,
+ * so that OpenMP also gets 4 (omp_get_num_procs() follows the affinity);
+ * the "cores" of the first line tell how many it got.  The clock is not
+ * lowered to that of the handheld (about 1 GHz for the Cortex-A57 of a
+ * Switch), so compare the lines with each other rather than with frame
+ * times measured on the device.
+ * Run with `make bench` or `./bench_band_compositor [WIDTHxHEIGHT [THREADS]]`
+ * (default 1280x720 on 4 threads); results are printed as "name value unit".
+ */
+
+#include <chrono>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Parallel.h"
+#include "onscripter_harness.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Runs frame until half a second has passed, and returns the frames per
+// second.
+template <class Frame>
+static double measure(Frame frame) {
+    int frames = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed;
+    do {
+        frame();
+        frames++;
+    } while ((elapsed = secondsSince(start)) < 0.5);
+    return frames / elapsed;
+}
+
+int main(int argc, char **argv) {
+    int width = 1280, height = 720, threads = 4;
+    if ((argc > 1 && (sscanf(argv[1], "%dx%d", &width, &height) != 2 || width < 128 || height < 128)) ||
+        (argc > 2 && (threads = atoi(argv[2])) <= 0)) {
+        fprintf(stderr, "usage: %s [WIDTHxHEIGHT [THREADS]]\n", argv[0]);
+        return 1;
+    }
+
+    ONScripterHarness h(width, height, threads);
+    h.setImage(&h.sprites[900], 0, 0, width, height, ONScripterHarness::TRANSLUCENT);
+    h.sprites[900].trans = 96;
+    for (int i = 0; i < 3; i++)
+        h.setImage(&h.tachi[i], width * (1 + 4 * i) / 16, height / 16, width / 4, height * 15 / 16,
+                   ONScripterHarness::MARGINS);
+    for (int i = 0; i < 24; i++)
+        h.setImage(&h.sprites[10 + i], h.nextRandom() % (width - 64), h.nextRandom() % (height - 64), 64, 64,
+                   ONScripterHarness::OPAQUE);
+    SDL_Rect text = {width / 16, height * 2 / 3, width - width / 8, height / 4};
+    h.setText(text);
+
+    const int mode = ONScripterHarness::REFRESH_NORMAL | ONScripterHarness::REFRESH_TEXT;
+    SDL_Rect clip = {0, 0, width, height};
+    std::vector<uint32_t> serial, per_sprite, banded;
+
+    printf("# %dx%d, %d threads, %d cores, %d sprites\n", width, height, h.getThreads(), omp_get_num_procs(), 1 + 3 + 24);
+
+    h.setThreads(1);
+    parallel::serial = true;
+    printf("compose.serial %.1f fps\n", measure([&]() { h.refresh(h.screen(), &clip, mode); }));
+    serial = ONScripterHarness::pixels(h.screen());
+
+    parallel::serial = false;
+    printf("compose.per_sprite %.1f fps\n", measure([&]() { h.refresh(h.screen(), &clip, mode); }));
+    per_sprite = ONScripterHarness::pixels(h.screen());
+
+    h.setThreads(threads);
+    printf("compose.bands %.1f fps\n", measure([&]() { h.refresh(h.screen(), &clip, mode); }));
+    banded = ONScripterHarness::pixels(h.screen());
+    printf("compose.bands_identical %d bool\n", serial == banded && serial == per_sprite);
+
+    return 0;
+}
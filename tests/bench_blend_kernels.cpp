@@ -0,0 +1,204 @@
+/**
+ * Pixel kernel benchmarks on synthetic frames, one line per kernel and
+ * SIMD level the CPU runs, for tracking across releases.
+ * - blend_*, add_blend, alpha_blend_const, alpha_blend_mask,
+ *   alpha_blend_text, nega and monochrome: the kernels that
+ *   blendOnSurface(), blendOnSurface2(), alphaBlend(), alphaBlendText(),
+ *   makeNegaSurface() and makeMonochromeSurface() run row by row, on rows
+ *   of the frame;
+ * - surface2_affine and surface2_affine_premultiplied: blendOnSurface2()
+ *   of a sprite half the frame in size, scaled by 1.5 and rotated by 30
+ *   degrees, straight and premultiplied, per pixel of its bounding box;
+ * - alpha_blend_fade_mask and alpha_blend_crossfade_mask: alphaBlend() of
+ *   the two frames through a mask, as the mask fades do;
+ * - blend_text: AnimationInfo::blendText() of a frame of glyph coverage
+ *   into the text window, at the SIMD level of the build;
+ * - resize_image: resizeImage() at the SIMD level of the build.
+ * surface2_*, alpha_blend_*_mask and blend_text run the engine code itself
+ * on the surfaces of mock_sdl2 (see onscripter_harness.h).
+ * Run with `make bench` or `./bench_blend_kernels [WIDTHxHEIGHT]` (default
+ * 1280x720); results are printed as "name.level value unit".
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+#include "blend_kernels.h"
+#include "onscripter_harness.h"
+#include "resize_image.h"
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<uint32_t> Pixels;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static int width = 1280, height = 720;
+
+static uint32_t rng = 1;
+static uint32_t nextRandom() {
+    rng = rng * 1103515245 + 12345;
+    return (rng >> 8) ^ (rng << 24);
+}
+
+// An opaque ellipse with an antialiased edge in a transparent box, the
+// size of the frame.
+static Pixels makeSprite() {
+    Pixels p((size_t)width * height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) {
+            double dx = (x - width / 2.0) / (width / 2.0), dy = (y - height / 2.0) / (height / 2.0);
+            double d = (1.0 - (dx * dx + dy * dy)) * 40.0;
+            uint32_t a = d <= 0 ? 0 : d >= 1 ? 255 : (uint32_t)(d * 255);
+            p[(size_t)y * width + x] = (a << 24) | (nextRandom() & 0xffffff);
+        }
+    return p;
+}
+
+static Pixels makeScreen() {
+    Pixels p((size_t)width * height);
+    for (size_t i = 0; i < p.size(); i++) p[i] = nextRandom() | 0xff000000;
+    return p;
+}
+
+// Lines of glyph-like coverage: runs of 0 and 255 with antialiased edges.
+static std::vector<uint8_t> makeText() {
+    std::vector<uint8_t> t((size_t)width * height);
+    for (size_t i = 0; i < t.size(); i++) {
+        uint32_t r = nextRandom();
+        t[i] = (i / width) % 32 >= 24 ? 0 : (r & 3) == 0 ? r >> 24 : ((r >> 2) & 1) * 255;
+    }
+    return t;
+}
+
+// Runs body on every row of a frame until a quarter of a second has
+// passed, and returns the millions of pixels per second.
+template <class Body>
+static double measure(Body body) {
+    int frames = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed;
+    do {
+        for (int y = 0; y < height; y++) body(y);
+        frames++;
+    } while ((elapsed = secondsSince(start)) < 0.25);
+    return (double)width * height * frames / elapsed / 1e6;
+}
+
+// Runs frame until a quarter of a second has passed, and returns the
+// millions of pixels per second for pixels per frame.
+template <class Frame>
+static double measureFrames(size_t pixels, Frame frame) {
+    int frames = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed;
+    do {
+        frame();
+        frames++;
+    } while ((elapsed = secondsSince(start)) < 0.25);
+    return (double)pixels * frames / elapsed / 1e6;
+}
+
+// The pixels of a surface of the screen within the bounding box of anim.
+static size_t boundingPixels(const AnimationInfo &anim, int width, int height) {
+    int x1 = anim.bounding_rect.x > 0 ? anim.bounding_rect.x : 0;
+    int y1 = anim.bounding_rect.y > 0 ? anim.bounding_rect.y : 0;
+    int x2 = anim.bounding_rect.x + anim.bounding_rect.w < width ? anim.bounding_rect.x + anim.bounding_rect.w : width;
+    int y2 = anim.bounding_rect.y + anim.bounding_rect.h < height ? anim.bounding_rect.y + anim.bounding_rect.h : height;
+    return x2 > x1 && y2 > y1 ? (size_t)(x2 - x1) * (y2 - y1) : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && (sscanf(argv[1], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+        fprintf(stderr, "usage: %s [WIDTHxHEIGHT]\n", argv[0]);
+        return 1;
+    }
+
+    Pixels sprite = makeSprite(), screen = makeScreen(), screen2 = makeScreen(), dst = makeScreen();
+    std::vector<uint8_t> text = makeText();
+    Pixels mask((size_t)width);
+    for (int x = 0; x < width; x++) mask[x] = (nextRandom() >> 24) * 0x01010101;
+    uint32_t lut[256];
+    for (uint32_t c = 0; c < 256; c++) lut[c] = c << 16 | (c * 3 / 4) << 8 | c / 2;
+
+    // the engine paths, on a screen of the same size
+    ONScripterHarness h(width, height);
+    SDL_Rect screen_rect = {0, 0, width, height};
+    h.setImage(&h.sprites2[0], width / 4, height / 4, width / 2, height / 2, ONScripterHarness::TRANSLUCENT);
+    h.setAffine(&h.sprites2[0], 150, 150, 30);
+    h.setImage(&h.sprites2[1], width / 4, height / 4, width / 2, height / 2, ONScripterHarness::TRANSLUCENT, true);
+    h.setAffine(&h.sprites2[1], 150, 150, 30);
+    const size_t affine_pixels = boundingPixels(h.sprites2[0], width, height);
+    SDL_Surface *mask_surface = AnimationInfo::allocSurface(width, height, SDL_PIXELFORMAT_ARGB8888);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            ((uint32_t *)mask_surface->pixels)[(size_t)y * width + x] = ((x + y) & 0xff) * 0x010101 | 0xff000000;
+    memcpy(h.effectSrc()->pixels, &screen[0], screen.size() * 4);
+    memcpy(h.effectDst()->pixels, &screen2[0], screen2.size() * 4);
+
+    printf("# %dx%d\n", width, height);
+    for (int level = 0; level < NUM_BLEND_KERNELS; level++) {
+        if (!isBlendKernelsSupported(level)) continue;
+        const BlendKernels *k = blend_kernels_table[level];
+        const size_t w = width;
+
+        // blendOnSurface() and the BLEND_NORMAL rows of blendOnSurface2()
+        printf("blend_alpha255.%s %.1f Mpx/s\n", k->name, measure([&](int y) {
+            k->blend(&dst[y * w], &sprite[y * w], width, 255); }));
+        printf("blend_alpha128.%s %.1f Mpx/s\n", k->name, measure([&](int y) {
+            k->blend(&dst[y * w], &sprite[y * w], width, 128); }));
+        printf("add_blend.%s %.1f Mpx/s\n", k->name, measure([&](int y) {
+            k->addBlend(&dst[y * w], &sprite[y * w], width); }));
+        // ALPHA_BLEND_CONST and ALPHA_BLEND_MULTIPLE
+        printf("alpha_blend_const.%s %.1f Mpx/s\n", k->name, measure([&](int y) {
+            k->crossfadeConst(&dst[y * w], &screen[y * w], &screen2[y * w], 100, width); }));
+        // ALPHA_BLEND_FADE_MASK and ALPHA_BLEND_CROSSFADE_MASK
+        printf("alpha_blend_mask.%s %.1f Mpx/s\n", k->name, measure([&](int y) {
+            k->crossfade(&dst[y * w], &screen[y * w], &screen2[y * w], &mask[0], width); }));
+        // the kernel of alphaBlendText(); AnimationInfo::blendText() is blend_text
+        printf("alpha_blend_text.%s %.1f Mpx/s\n", k->name, measure([&](int y) {
+            k->blendText(&dst[y * w], &text[y * w], width, 0xffe0c0a0); }));
+        printf("nega.%s %.1f Mpx/s\n", k->name, measure([&](int y) {
+            k->nega(&dst[y * w], width, 0x00ffffff); }));
+        printf("monochrome.%s %.1f Mpx/s\n", k->name, measure([&](int y) {
+            k->monochrome(&dst[y * w], width, 16, lut); }));
+
+        setBlendKernels(k->name);
+        printf("surface2_affine.%s %.1f Mpx/s\n", k->name, measureFrames(affine_pixels, [&]() {
+            h.sprites2[0].blendOnSurface2(h.screen(), h.sprites2[0].pos.x, h.sprites2[0].pos.y, screen_rect, 255); }));
+        printf("surface2_affine_premultiplied.%s %.1f Mpx/s\n", k->name, measureFrames(affine_pixels, [&]() {
+            h.sprites2[1].blendOnSurface2(h.screen(), h.sprites2[1].pos.x, h.sprites2[1].pos.y, screen_rect, 255); }));
+        printf("alpha_blend_fade_mask.%s %.1f Mpx/s\n", k->name, measureFrames(w * height, [&]() {
+            h.alphaBlend(mask_surface, ONScripterHarness::ALPHA_BLEND_FADE_MASK, 128); }));
+        printf("alpha_blend_crossfade_mask.%s %.1f Mpx/s\n", k->name, measureFrames(w * height, [&]() {
+            h.alphaBlend(mask_surface, ONScripterHarness::ALPHA_BLEND_CROSSFADE_MASK, 128); }));
+    }
+    setBlendKernels("auto");
+
+    // the glyphs of a full text window, as drawChar() blends them
+    SDL_Surface *glyphs = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 8, 0, 0, 0, 0);
+    for (int y = 0; y < height; y++)
+        memcpy((unsigned char *)glyphs->pixels + (size_t)y * glyphs->pitch, &text[(size_t)y * width], width);
+    SDL_Color color = {0xff, 0xe0, 0xc0, 0xff};
+    printf("blend_text.build %.1f Mpx/s\n", measureFrames((size_t)width * height, [&]() {
+        h.text.blendText(glyphs, 0, 0, color, &screen_rect, false); }));
+    SDL_FreeSurface(glyphs);
+    SDL_FreeSurface(mask_surface);
+
+    // the images of a 1.5 times larger screen scaled down, as on loading
+    int src_w = width * 3 / 2, src_h = height * 3 / 2;
+    std::vector<unsigned char> src((size_t)src_w * 4 * (src_h + 1) + 4), tmp(src.size());
+    for (size_t i = 0; i < src.size(); i++) src[i] = nextRandom() >> 24;
+    int frames = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed;
+    do {
+        resizeImage((unsigned char *)&dst[0], width, height, width * 4, &src[0], src_w, src_h, src_w * 4,
+                    4, &tmp[0], src_w * 4, false);
+        frames++;
+    } while ((elapsed = secondsSince(start)) < 0.25);
+    printf("resize_image.build %.1f Mpx/s\n", (double)width * height * frames / elapsed / 1e6);
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * setupImageAlpha() kernel benchmarks at 720p and 1080p.
+ * Run with `make bench`; results are printed as "name value unit".
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+#include "legacy_alpha.h"
+#include "image_alpha.h"
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<uint32_t> Pixels;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static Pixels makePixels(size_t n) {
+    Pixels p(n);
+    uint32_t r = 1;
+    for (size_t i = 0; i < n; i++) {
+        r = r * 1103515245 + 12345;
+        p[i] = (r & 0x100) ? 0xff00ff : r;
+    }
+    return p;
+}
+
+static void report(const char *mode, int w, int h, double legacy, double current) {
+    printf("alpha_%s_%dx%d_scalar %.0f Mpx/s\n", mode, w, h, legacy / 1e6);
+    printf("alpha_%s_%dx%d_kernel %.0f Mpx/s\n", mode, w, h, current / 1e6);
+    printf("alpha_%s_%dx%d_speedup %.1f x\n", mode, w, h, current / legacy);
+}
+
+static void benchSize(int w, int h) {
+    const int rounds = 20;
+    const double pixels = (double)w * h * rounds;
+    Pixels src = makePixels((size_t)w * h), buf = src, mask = makePixels((size_t)w * (h + 1) + 1);
+    Pixels dst((size_t)w / 2 * h);
+    double rate[2];
+
+    for (int k = 0; k < 2; k++) {
+        Clock::time_point start = Clock::now();
+        for (int r = 0; r < rounds; r++) {
+            if (k) setupAlphaFromHalves(&dst[0], &src[0], w, h, 1);
+            else   LegacyAlpha::halves(&dst[0], &src[0], w, h, 1);
+        }
+        rate[k] = pixels / secondsSince(start);
+    }
+    report("halves", w, h, rate[0], rate[1]);
+
+    for (int k = 0; k < 2; k++) {
+        Clock::time_point start = Clock::now();
+        for (int r = 0; r < rounds; r++) {
+            if (k) setupAlphaFromMask(&buf[0], w, h, 1, &mask[0], w, h);
+            else   LegacyAlpha::mask(&buf[0], w, h, 1, &mask[0], w, h);
+        }
+        rate[k] = pixels / secondsSince(start);
+    }
+    report("mask", w, h, rate[0], rate[1]);
+
+    for (int k = 0; k < 2; k++) {
+        Clock::time_point start = Clock::now();
+        for (int r = 0; r < rounds; r++) {
+            if (k) setupAlphaFromColorKey(&buf[0], w * h, 0xff00ff);
+            else   LegacyAlpha::colorKey(&buf[0], w * h, 0xff00ff);
+        }
+        rate[k] = pixels / secondsSince(start);
+    }
+    report("colorkey", w, h, rate[0], rate[1]);
+
+    for (int k = 0; k < 2; k++) {
+        Clock::time_point start = Clock::now();
+        for (int r = 0; r < rounds; r++) {
+            if (k) setupAlphaOpaque(&buf[0], w * h);
+            else   LegacyAlpha::opaque(&buf[0], w * h);
+        }
+        rate[k] = pixels / secondsSince(start);
+    }
+    report("opaque", w, h, rate[0], rate[1]);
+
+    if (buf[0] == 42 && dst[0] == 42) printf("\n");
+}
+
+int main() {
+    benchSize(1280, 720);
+    benchSize(1920, 1080);
+    return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * Sprite compositing benchmark: a dense scene of 50 character-like
+ * sprites over a 1280x720 background, blended with straight alpha as
+ * blendOnSurface() does and with premultiplied alpha.
+ * Run with `make bench`; results are printed as "name value unit".
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+#include "legacy_blend.h"
+#include "image_alpha.h"
+#include "image_blend.h"
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<uint32_t> Pixels;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static const int screen_w = 1280, screen_h = 720;
+static const int sprite_w = 320, sprite_h = 480, num_sprites = 50;
+
+// An opaque ellipse with an antialiased edge in a transparent box.
+static Pixels makeSprite(uint32_t seed) {
+    Pixels p((size_t)sprite_w * sprite_h);
+    for (int y = 0; y < sprite_h; y++)
+        for (int x = 0; x < sprite_w; x++) {
+            double dx = (x - sprite_w / 2.0) / (sprite_w / 2.0), dy = (y - sprite_h / 2.0) / (sprite_h / 2.0);
+            double d = (1.0 - (dx * dx + dy * dy)) * 40.0;
+            uint32_t a = d <= 0 ? 0 : d >= 1 ? 255 : (uint32_t)(d * 255);
+            seed = seed * 1103515245 + 12345;
+            p[(size_t)y * sprite_w + x] = (a << 24) | ((seed >> 8) & 0xffffff);
+        }
+    return p;
+}
+
+static double composite(const std::vector<Pixels> &sprites, bool premultiplied, int alpha) {
+    const int rounds = 5;
+    Pixels screen((size_t)screen_w * screen_h, 0xff203040);
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < num_sprites; i++) {
+            int x0 = (i * 197) % (screen_w - sprite_w), y0 = (i * 89) % (screen_h - sprite_h);
+            const Pixels &s = sprites[i % sprites.size()];
+            for (int y = 0; y < sprite_h; y++) {
+                uint32_t *dst = &screen[(size_t)(y0 + y) * screen_w + x0];
+                const uint32_t *src = &s[(size_t)y * sprite_w];
+                if (premultiplied) blendPremultiplied(dst, src, sprite_w, alpha);
+                else               LegacyBlend::blend(dst, src, sprite_w, alpha);
+            }
+        }
+    return secondsSince(start) / rounds;
+}
+
+int main() {
+    std::vector<Pixels> straight, premultiplied;
+    for (uint32_t i = 0; i < 4; i++) {
+        straight.push_back(makeSprite(i + 1));
+        premultiplied.push_back(straight.back());
+        premultiplyAlpha(&premultiplied.back()[0], sprite_w * sprite_h);
+    }
+
+    const int alphas[] = {255, 128};
+    for (int k = 0; k < 2; k++) {
+        double t0 = composite(straight, false, alphas[k]);
+        double t1 = composite(premultiplied, true, alphas[k]);
+        printf("blend_50sprites_alpha%d_straight %.2f ms\n", alphas[k], t0 * 1e3);
+        printf("blend_50sprites_alpha%d_premultiplied %.2f ms\n", alphas[k], t1 * 1e3);
+        printf("blend_50sprites_alpha%d_speedup %.1f x\n", alphas[k], t0 / t1);
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * Decoding JPEG images for a smaller screen, at full size then shrunk by
+ * resizeImage() against reduced by libjpeg first.
+ * Run with `make bench`; results are printed as "name value unit".
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <jpeglib.h>
+#include <vector>
+#include "image_jpeg.h"
+#include "resize_image.h"
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<unsigned char> Bytes;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Noise over a gradient, not to be all flat blocks.
+static Bytes encode(int w, int h) {
+    Bytes rgb(w * h * 3);
+    unsigned r = 1;
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            for (int k = 0; k < 3; k++) {
+                r = r * 1103515245 + 12345;
+                rgb[(y * w + x) * 3 + k] = ((x + y * k) * 255 / (w + h) + (r >> 28)) & 0xff;
+            }
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    unsigned char *out = NULL;
+    unsigned long out_size = 0;
+    jpeg_mem_dest(&cinfo, &out, &out_size);
+    cinfo.image_width = w;
+    cinfo.image_height = h;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = &rgb[cinfo.next_scanline * w * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    Bytes data(out, out + out_size);
+    free(out);
+    return data;
+}
+
+static void benchLoad(int sw, int sh, int dw, int dh, int max_denom) {
+    const int rounds = 10;
+    Bytes data = encode(sw, sh);
+    std::vector<uint32_t> src(sw * (sh + 1) + 1), tmp(src.size()), dst(dw * dh);
+
+    double ms[2];
+    size_t peak[2];
+    for (int k = 0; k < 2; k++) {
+        int denom = 1, w = sw, h = sh;
+        if (k) denom = getJPEGScaleDenom(&data[0], data.size(), max_denom, 1, &w, &h);
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < rounds; i++) {
+            decodeJPEGScaled(&data[0], data.size(), denom, &src[0], w * 4, 16, 8, 0);
+            if (w != dw || h != dh)
+                resizeImage((unsigned char*)&dst[0], dw, dh, dw * 4, (unsigned char*)&src[0], w, h, w * 4,
+                            4, (unsigned char*)&tmp[0], w * 4, false);
+        }
+        ms[k] = secondsSince(start) * 1000 / rounds;
+        peak[k] = (size_t)w * (h + 1) * 4 * 2 + dw * dh * 4;
+    }
+
+    printf("jpeg_%dx%d_to_%dx%d_full %.2f ms\n", sw, sh, dw, dh, ms[0]);
+    printf("jpeg_%dx%d_to_%dx%d_reduced %.2f ms\n", sw, sh, dw, dh, ms[1]);
+    printf("jpeg_%dx%d_to_%dx%d_speedup %.1f x\n", sw, sh, dw, dh, ms[0] / ms[1]);
+    printf("jpeg_%dx%d_to_%dx%d_memory %.1f x\n", sw, sh, dw, dh, (double)peak[0] / peak[1]);
+}
+
+int main() {
+    benchLoad(1920, 1080, 960, 540, 2);
+    benchLoad(1920, 1080, 640, 360, 2);
+    benchLoad(2560, 1440, 640, 360, 4);
+    return 0;
+}
@@ -0,0 +1,48 @@
+/**
+ * resizeImage() benchmarks on the rescales done when loading images.
+ * Run with `make bench`; results are printed as "name value unit".
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+#include "legacy_resize.h"
+#include "resize_image.h"
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<unsigned char> Bytes;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void benchResize(int sw, int sh, int dw, int dh) {
+    const int rounds = 10;
+    Bytes src(sw * 4 * (sh + 1) + 4), tmp(src.size()), dst(dw * 4 * dh);
+    unsigned r = 1;
+    for (size_t i = 0; i < src.size(); i++) {
+        r = r * 1103515245 + 12345;
+        src[i] = r >> 24;
+    }
+
+    double rate[2];
+    for (int k = 0; k < 2; k++) {
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < rounds; i++) {
+            if (k) resizeImage(&dst[0], dw, dh, dw * 4, &src[0], sw, sh, sw * 4, 4, &tmp[0], sw * 4, false);
+            else   LegacyResize::resizeImage(&dst[0], dw, dh, dw * 4, &src[0], sw, sh, sw * 4, 4, &tmp[0], sw * 4, false);
+        }
+        rate[k] = (double)dw * dh * rounds / secondsSince(start);
+    }
+
+    printf("resize_%dx%d_to_%dx%d_legacy %.1f Mpx/s\n", sw, sh, dw, dh, rate[0] / 1e6);
+    printf("resize_%dx%d_to_%dx%d_blocks %.1f Mpx/s\n", sw, sh, dw, dh, rate[1] / 1e6);
+    printf("resize_%dx%d_to_%dx%d_speedup %.1f x\n", sw, sh, dw, dh, rate[1] / rate[0]);
+}
+
+int main() {
+    benchResize(800, 600, 1280, 960);
+    benchResize(640, 480, 1920, 1440);
+    benchResize(1920, 1080, 640, 360);
+    return 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * Reference copies of the original per-pixel alpha loops of
+ * AnimationInfo::setupImageAlpha() and sp_rgb_gradation, on raw 32bpp
+ * buffers.  Used to check
+ * that the SIMD kernels stay bit-identical and to measure them.
+ */
+
+#ifndef LEGACY_ALPHA_H
+#define LEGACY_ALPHA_H
+
+#include <stdint.h>
+
+namespace LegacyAlpha {
+
+inline unsigned char *alphaOf(uint32_t *buffer) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return (unsigned char *)buffer + 3;
+#else
+    return (unsigned char *)buffer;
+#endif
+}
+
+inline void halves(uint32_t *buffer2, const uint32_t *src, int w, int h, int num_of_cells) {
+    const uint32_t *buffer = src;
+    int w2 = w / num_of_cells;
+    const int w22 = w2/2;
+    const int w3 = w22 * num_of_cells;
+    unsigned char *alphap = alphaOf(buffer2);
+    for (int i=h ; i!=0 ; i--){
+        for (int c=num_of_cells ; c!=0 ; c--){
+            for (int j=w22 ; j!=0 ; j--, buffer++, alphap+=4){
+                *buffer2++ = *buffer;
+                *alphap = (*(buffer + w22) & 0xff) ^ 0xff;
+            }
+            buffer += (w2 - w22);
+        }
+        buffer  +=  w  - w2 *num_of_cells;
+        buffer2 +=  w3 - w22*num_of_cells;
+        alphap  += (w3 - w22*num_of_cells)*4;
+    }
+}
+
+inline void mask(uint32_t *buffer, int w, int h, int num_of_cells, const uint32_t *pixels_m, int mw, int mh) {
+    int w2 = w / num_of_cells;
+    const int mwh = mw * mh;
+    unsigned char *alphap = alphaOf(buffer);
+    int i2 = 0;
+    for (int i=h ; i!=0 ; i--){
+        const uint32_t *buffer_m = pixels_m + i2;
+        for (int c=num_of_cells ; c!=0 ; c--){
+            int j2 = 0;
+            for (int j=w2 ; j!=0 ; j--, buffer++, alphap+=4){
+                *alphap = (*(buffer_m + j2) & 0xff) ^ 0xff;
+                if (j2 >= mw) j2 = 0;
+                else          j2++;
+            }
+        }
+        if (i2 >= mwh) i2 = 0;
+        else           i2 += mw;
+    }
+}
+
+inline void colorKey(uint32_t *buffer, int num, uint32_t ref_color) {
+    ref_color &= 0xffffff;
+    unsigned char *alphap = alphaOf(buffer);
+    for (int j=num ; j!=0 ; j--, buffer++, alphap+=4){
+        if ( (*buffer & 0xffffff) == ref_color )
+            *alphap = 0x00;
+        else
+            *alphap = 0xff;
+    }
+}
+
+inline void opaque(uint32_t *buffer, int num) {
+    unsigned char *alphap = alphaOf(buffer);
+    for (int j=num ; j!=0 ; j--, buffer++, alphap+=4)
+        *alphap = 0xff;
+}
+
+// The 32bpp loop of ONScripter::sp_rgb_gradationCommand() on an ARGB
+// buffer, w pixels to a row, with key, upper and lower as 0xRRGGBB.
+inline void gradation(uint32_t *pixels, int w, int h, uint32_t key,
+                      uint32_t upper, uint32_t lower, uint32_t alpha) {
+    const uint32_t key_mask = key & 0xffffff, rgb_mask = 0xffffff;
+    int upper_r = upper >> 16 & 0xff, upper_g = upper >> 8 & 0xff, upper_b = upper & 0xff;
+    int lower_r = lower >> 16 & 0xff, lower_g = lower >> 8 & 0xff, lower_b = lower & 0xff;
+    int i, j;
+    int upper_bound=0, lower_bound=0;
+    bool is_key_found = false;
+    for (i=0 ; i<h ; i++){
+        uint32_t *buf = pixels + w * i;
+        for (j=0 ; j<w ; j++, buf++){
+            if ((*buf & rgb_mask) == key_mask){
+                if (is_key_found == false){
+                    is_key_found = true;
+                    upper_bound = lower_bound = i;
+                }
+                else{
+                    lower_bound = i;
+                }
+                break;
+            }
+        }
+    }
+
+    for (i=upper_bound ; i<=lower_bound ; i++){
+        uint32_t *buf = pixels + w * i;
+        unsigned char *alphap = alphaOf(buf);
+        uint32_t color = alpha << 24;
+        if (upper_bound != lower_bound){
+            color |= ((lower_r - upper_r) * (i-upper_bound) / (lower_bound - upper_bound) + upper_r) << 16;
+            color |= ((lower_g - upper_g) * (i-upper_bound) / (lower_bound - upper_bound) + upper_g) << 8;
+            color |= ((lower_b - upper_b) * (i-upper_bound) / (lower_bound - upper_bound) + upper_b);
+        }
+        else{
+            color |= upper_r << 16 | upper_g << 8 | upper_b;
+        }
+
+        for (j=0 ; j<w ; j++, buf++){
+            if ((*buf & rgb_mask) == key_mask){
+                *buf = color;
+                *alphap = alpha;
+            }
+            alphap += 4;
+        }
+    }
+}
+
+} // namespace LegacyAlpha
+
+#endif
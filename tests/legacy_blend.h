@@ -0,0 +1,190 @@
+/**
+ * Reference copies of the straight-alpha blend loops of
+ * AnimationInfo::blendOnSurface() and blendOnSurface2(), on one row of
+ * raw 32bpp pixels.  Used to check that the premultiplied kernels give
+ * the same picture and to measure them.
+ */
+
+#ifndef LEGACY_BLEND_H
+#define LEGACY_BLEND_H
+
+#include <stdint.h>
+#ifdef USE_SIMD
+#include "simd/simd.h"
+#endif
+
+namespace LegacyBlend {
+
+#define RMASK 0x00ff0000
+#define GMASK 0x0000ff00
+#define BMASK 0x000000ff
+#define AMASK 0xff000000
+#define RBMASK (RMASK|BMASK)
+
+#define BLEND_PIXEL() do{\
+    uint32_t mask2 = (*alphap * alpha) >> 8;\
+    uint32_t temp = *dst_buffer & 0xff00ff;\
+    uint32_t mask_rb = (((((*src_buffer & 0xff00ff) - temp ) * mask2 ) >> 8 ) + temp ) & 0xff00ff;\
+    temp = *dst_buffer & 0x00ff00;\
+    uint32_t mask_g  = (((((*src_buffer & 0x00ff00) - temp ) * mask2 ) >> 8 ) + temp ) & 0x00ff00;\
+    *dst_buffer = mask_rb | mask_g | 0xff000000;\
+    alphap += 4;\
+}while(0)
+
+#define ADDBLEND_PIXEL() do{\
+    uint32_t mask2 = (*alphap * alpha) >> 8;\
+    uint32_t mask_rb = (*dst_buffer & RBMASK) + ((((*src_buffer & RBMASK) * mask2) >> 8) & RBMASK);\
+    mask_rb |= ((mask_rb & AMASK) ? RMASK : 0) | ((mask_rb & GMASK) ? BMASK : 0);\
+    uint32_t mask_g = (*dst_buffer & GMASK) + ((((*src_buffer & GMASK) * mask2) >> 8) & GMASK);\
+    mask_g |= ((mask_g & RMASK) ? GMASK : 0);\
+    *dst_buffer = (mask_rb & RBMASK) | (mask_g & GMASK) | 0xff000000;\
+    alphap += 4;\
+}while(0)
+
+#define SUBBLEND_PIXEL() do{\
+    uint32_t mask2 = (*alphap * alpha) >> 8;\
+    uint32_t mask_r = (*dst_buffer & RMASK) -\
+                    ((((*src_buffer & RMASK) * mask2) >> 8) & RMASK);\
+    mask_r &= ((mask_r & AMASK) ? 0 : RMASK);\
+    uint32_t mask_g = (*dst_buffer & GMASK) -\
+                    ((((*src_buffer & GMASK) * mask2) >> 8) & GMASK);\
+    mask_g &= ((mask_g & ~(GMASK | BMASK)) ? 0 : GMASK);\
+    uint32_t mask_b = (*dst_buffer & BMASK) -\
+                    ((((*src_buffer & BMASK) * mask2) >> 8) & BMASK);\
+    mask_b &= ((mask_b & ~BMASK) ? 0 : BMASK);\
+    *dst_buffer = (mask_r & RMASK) | (mask_g & GMASK) | (mask_b & BMASK) | 0xff000000;\
+    alphap += 4;\
+}while(0)
+
+#ifdef USE_SIMD
+inline void blend4Pixel32(const uint32_t *src_buffer, uint32_t *__restrict dst_buffer, simd::uint16x8 alpha, simd::uint8x16 alpha_mask, simd::ivec128 zero, simd::uint8x16 amask) {
+    using namespace simd;
+    uint8x16 src = load_u(src_buffer), dst = load_u(dst_buffer);
+    uint16x8 dstu = widen_lo(dst, zero);
+    uint16x8 r1 = widen_lo(src, zero);
+    r1 -= dstu;
+    dstu = widen_hi(dst, zero);
+    uint16x8 r2 = widen_hi(src, zero);
+    r2 -= dstu;
+#ifdef USE_SIMD_X86_SSSE3
+    uint8x16 an = shuffle(src, alpha_mask);
+    uint16x8 a = widen_lo(an, zero);
+#else
+    const uint8_t *alphap = (const uint8_t*)src_buffer + 3;
+    uint16x8 a = uint16x8::set2(*alphap, *(alphap + 4));
+    alphap += 8;
+#endif
+    a = (a * alpha) >> immint<8>();
+    r1 = (r1 * a) >> immint<8>();
+#ifdef USE_SIMD_X86_SSSE3
+    a = widen_hi(an, zero);
+#else
+    a = uint16x8::set2(*alphap, *(alphap + 4));
+#endif
+    a = (a * alpha) >> immint<8>();
+    r2 = (r2 * a) >> immint<8>();
+    uint8x16 r = pack_hz(r1, r2);
+    r += dst;
+    r |= amask;
+    store_u(dst_buffer, r);
+}
+
+#ifdef USE_SIMD_X86_AVX2
+inline void blend8Pixel32(const uint32_t *src_buffer, uint32_t *__restrict dst_buffer, simd::uint16x16 alpha, simd::uint8x32 alpha_mask, simd::ivec256 zero, simd::uint8x32 amask) {
+    using namespace simd;
+    uint8x32 src = load256_u(src_buffer), dst = load256_u(dst_buffer);
+    uint16x16 dstu = widen_lo(dst, zero);
+    uint16x16 r1 = widen_lo(src, zero);
+    r1 -= dstu;
+    dstu = widen_hi(dst, zero);
+    uint16x16 r2 = widen_hi(src, zero);
+    r2 -= dstu;
+    uint8x32 an = shuffle(src, alpha_mask);
+    uint16x16 a = widen_lo(an, zero);
+    a = (a * alpha) >> immint<8>();
+    r1 = (r1 * a) >> immint<8>();
+    a = widen_hi(an, zero);
+    a = (a * alpha) >> immint<8>();
+    r2 = (r2 * a) >> immint<8>();
+    uint8x32 r = pack_hz(r1, r2);
+    r += dst;
+    r |= amask;
+    store256_u(dst_buffer, r);
+}
+#endif
+#endif
+
+// One row of the BLEND_NORMAL loop of blendOnSurface().
+inline void blend(uint32_t *dst_buffer, const uint32_t *src_buffer, int num, int alpha) {
+    alpha &= 0xff;
+    const unsigned char *alphap = (const unsigned char *)src_buffer + 3;
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    ivec256 zero = ivec256::zero();
+    uint8x32 mask = uint8x32::set8(3, 7, 11, 15, 19, 23, 27, 31);
+    uint8x32 amask = uint8x32::set(0, 0, 0, 0xFF);
+    ivec128 zerol = zero.lo();
+    uint8x16 maskl = mask.lo();
+    uint8x16 amaskl = amask.lo();
+#else
+    ivec128 zerol = ivec128::zero();
+    uint8x16 maskl = uint8x16::set4(3, 7, 11, 15);
+    uint8x16 amaskl = uint8x16::set(0, 0, 0, 0xFF);
+#endif
+    int remain = num;
+    while (remain > 0) {
+        if (*alphap == 0) {
+            --remain; ++src_buffer; ++dst_buffer; alphap += 4;
+        }
+        else if ((*alphap == 255) && (alpha == 255)) {
+            *dst_buffer = *src_buffer;
+            --remain; ++src_buffer; ++dst_buffer; alphap += 4;
+        }
+#ifdef USE_SIMD_X86_AVX2
+        else if (remain >= 8) {
+            blend8Pixel32(src_buffer, dst_buffer, uint16x16(alpha), mask, zero, amask);
+            remain -= 8; src_buffer += 8; dst_buffer += 8; alphap += 32;
+        }
+#endif
+        else if (remain >= 4) {
+            blend4Pixel32(src_buffer, dst_buffer, uint16x8(alpha), maskl, zerol, amaskl);
+            remain -= 4; src_buffer += 4; dst_buffer += 4; alphap += 16;
+        }
+        else {
+            BLEND_PIXEL();
+            --remain; ++src_buffer; ++dst_buffer;
+        }
+    }
+#else
+    for (int j = num; j != 0; j--, src_buffer++, dst_buffer++) {
+        BLEND_PIXEL();
+    }
+#endif
+}
+
+// One row of the BLEND_ADD and BLEND_SUB loops of blendOnSurface2().
+inline void addBlend(uint32_t *dst_buffer, const uint32_t *src_buffer, int num, int alpha) {
+    alpha &= 0xff;
+    const unsigned char *alphap = (const unsigned char *)src_buffer + 3;
+    for (; num > 0; num--, src_buffer++, dst_buffer++) ADDBLEND_PIXEL();
+}
+
+inline void subBlend(uint32_t *dst_buffer, const uint32_t *src_buffer, int num, int alpha) {
+    alpha &= 0xff;
+    const unsigned char *alphap = (const unsigned char *)src_buffer + 3;
+    for (; num > 0; num--, src_buffer++, dst_buffer++) SUBBLEND_PIXEL();
+}
+
+#undef BLEND_PIXEL
+#undef ADDBLEND_PIXEL
+#undef SUBBLEND_PIXEL
+#undef RMASK
+#undef GMASK
+#undef BMASK
+#undef AMASK
+#undef RBMASK
+
+}
+
+#endif
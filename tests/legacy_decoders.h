@@ -0,0 +1,145 @@
+/**
+ * Reference copies of the original bit-at-a-time SPB/LZSS decoders,
+ * operating on an in-memory entry body.  Used to check that the archive
+ * reader stays byte-exact and to measure it against the old code path.
+ */
+
+#ifndef LEGACY_DECODERS_H
+#define LEGACY_DECODERS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace LegacyDecoders {
+
+struct BitReader {
+    const unsigned char *data;
+    size_t len, pos;
+    int mask;
+    int buf;
+};
+
+inline int getbit(BitReader &br, int n) {
+    int i, x = 0;
+    for (i = 0; i < n; i++) {
+        if (br.mask == 0) {
+            if (br.pos == br.len) return EOF;
+            br.buf = br.data[br.pos++];
+            br.mask = 128;
+        }
+        x <<= 1;
+        if (br.buf & br.mask) x++;
+        br.mask >>= 1;
+    }
+    return x;
+}
+
+inline std::vector<unsigned char> decodeLZSS(const std::vector<unsigned char> &body, size_t original_length) {
+    const int EI = 8, EJ = 4, N = 1 << EI;
+    std::vector<unsigned char> out(original_length);
+    unsigned char ring[N];
+    memset(ring, 0, N);
+    BitReader br = { body.empty() ? NULL : &body[0], body.size(), 0, 0, 0 };
+    size_t count = 0;
+    int i, j, k, r = N - ((1 << EJ) + 1), c;
+
+    while (count < original_length) {
+        if (getbit(br, 1)) {
+            if ((c = getbit(br, 8)) == EOF) break;
+            out[count++] = c;
+            ring[r++] = c;  r &= (N - 1);
+        } else {
+            if ((i = getbit(br, EI)) == EOF) break;
+            if ((j = getbit(br, EJ)) == EOF) break;
+            for (k = 0; k <= j + 1 && count < original_length; k++) {
+                c = ring[(i + k) & (N - 1)];
+                out[count++] = c;
+                ring[r++] = c;  r &= (N - 1);
+            }
+        }
+    }
+    out.resize(count);
+    return out;
+}
+
+inline std::vector<unsigned char> decodeSPB(const std::vector<unsigned char> &body) {
+    size_t width = body[0] << 8 | body[1];
+    size_t height = body[2] << 8 | body[3];
+    size_t width_pad = (4 - width * 3 % 4) % 4;
+    size_t total_size = (width * 3 + width_pad) * height + 54;
+
+    std::vector<unsigned char> out(total_size, 0);
+    unsigned char *buf = &out[0];
+    buf[0] = 'B'; buf[1] = 'M';
+    buf[2] = total_size & 0xff;
+    buf[3] = (total_size >> 8) & 0xff;
+    buf[4] = (total_size >> 16) & 0xff;
+    buf[5] = (total_size >> 24) & 0xff;
+    buf[10] = 54;
+    buf[14] = 40;
+    buf[18] = width & 0xff;
+    buf[19] = (width >> 8) & 0xff;
+    buf[22] = height & 0xff;
+    buf[23] = (height >> 8) & 0xff;
+    buf[26] = 1;
+    buf[28] = 24;
+    buf[34] = total_size - 54;
+    buf += 54;
+
+    std::vector<unsigned char> plane(width * height + 4);
+    BitReader br = { &body[0], body.size(), 4, 0, 0 };
+    size_t i, j, k;
+    int c, n, m;
+
+    for (i = 0; i < 3; i++) {
+        unsigned int count = 0;
+        plane[count++] = c = getbit(br, 8);
+        while (count < (unsigned)(width * height)) {
+            n = getbit(br, 3);
+            if (n == 0) {
+                plane[count++] = c;
+                plane[count++] = c;
+                plane[count++] = c;
+                plane[count++] = c;
+                continue;
+            }
+            else if (n == 7) {
+                m = getbit(br, 1) + 1;
+            }
+            else {
+                m = n + 2;
+            }
+
+            for (j = 0; j < 4; j++) {
+                if (m == 8) {
+                    c = getbit(br, 8);
+                }
+                else {
+                    k = getbit(br, m);
+                    if (k & 1) c += (k >> 1) + 1;
+                    else        c -= (k >> 1);
+                }
+                plane[count++] = c;
+            }
+        }
+
+        unsigned char *pbuf = buf + (width * 3 + width_pad) * (height - 1) + i;
+        unsigned char *psbuf = &plane[0];
+        for (j = 0; j < height; j++) {
+            if (j & 1) {
+                for (k = 0; k < width; k++, pbuf -= 3) *pbuf = *psbuf++;
+                pbuf -= width * 3 + width_pad - 3;
+            }
+            else {
+                for (k = 0; k < width; k++, pbuf += 3) *pbuf = *psbuf++;
+                pbuf -= width * 3 + width_pad + 3;
+            }
+        }
+    }
+    return out;
+}
+
+}
+
+#endif
@@ -0,0 +1,346 @@
+/**
+ * Reference copies of the compositor loops that moved to blend_kernels,
+ * as AnimationInfo.cpp and ONScripter_image.cpp had them, on raw 32bpp
+ * rows.  Built with the SIMD flags of the binary, they give what a build
+ * with those flags used to give.
+ */
+
+#ifndef LEGACY_KERNELS_H
+#define LEGACY_KERNELS_H
+
+#include <stdint.h>
+#ifdef USE_SIMD
+#include "simd/simd.h"
+#endif
+
+namespace LegacyKernels {
+
+#define AMASK 0xff000000
+
+#ifdef USE_SIMD
+inline void blendPixel32(const uint32_t *src_buffer, uint32_t *__restrict dst_buffer, uint8_t alpha, const uint8_t *alphap) {
+    using namespace simd;
+    uint8x4 src = load(src_buffer), dst = load(dst_buffer);
+    ivec128 zero = ivec128::zero();
+    uint16x4 r1 = widen(src, zero);
+    uint16x4 dstu = widen(dst, zero);
+    r1 -= dstu;
+    uint16x4 a((alpha * *alphap) >> 8);
+    r1 = (r1 * a) >> immint<8>();
+    uint8x4 r = narrow_hz(r1);
+    r += dst;
+    *dst_buffer = uint8x4::cvt2i32(r) | AMASK;
+}
+
+inline void blend4Pixel32(const uint32_t *src_buffer, uint32_t *__restrict dst_buffer, simd::uint16x8 alpha, simd::uint8x16 alpha_mask, simd::ivec128 zero, simd::uint8x16 amask) {
+    using namespace simd;
+    uint8x16 src = load_u(src_buffer), dst = load_u(dst_buffer);
+    uint16x8 dstu = widen_lo(dst, zero);
+    uint16x8 r1 = widen_lo(src, zero);
+    r1 -= dstu;
+    dstu = widen_hi(dst, zero);
+    uint16x8 r2 = widen_hi(src, zero);
+    r2 -= dstu;
+#ifdef USE_SIMD_X86_SSSE3
+    uint8x16 an = shuffle(src, alpha_mask);
+    uint16x8 a = widen_lo(an, zero);
+#else
+    const uint8_t *alphap = (const uint8_t*)src_buffer + 3;
+    uint16x8 a = uint16x8::set2(*alphap, *(alphap + 4));
+    alphap += 8;
+#endif
+    a = (a * alpha) >> immint<8>();
+    r1 = (r1 * a) >> immint<8>();
+#ifdef USE_SIMD_X86_SSSE3
+    a = widen_hi(an, zero);
+#else
+    a = uint16x8::set2(*alphap, *(alphap + 4));
+#endif
+    a = (a * alpha) >> immint<8>();
+    r2 = (r2 * a) >> immint<8>();
+    uint8x16 r = pack_hz(r1, r2);
+    r += dst;
+    r |= amask;
+    store_u(dst_buffer, r);
+}
+
+#ifdef USE_SIMD_X86_AVX2
+inline void blend8Pixel32(const uint32_t *src_buffer, uint32_t *__restrict dst_buffer, simd::uint16x16 alpha, simd::uint8x32 alpha_mask, simd::ivec256 zero, simd::uint8x32 amask) {
+    using namespace simd;
+    uint8x32 src = load256_u(src_buffer), dst = load256_u(dst_buffer);
+    uint16x16 dstu = widen_lo(dst, zero);
+    uint16x16 r1 = widen_lo(src, zero);
+    r1 -= dstu;
+    dstu = widen_hi(dst, zero);
+    uint16x16 r2 = widen_hi(src, zero);
+    r2 -= dstu;
+    uint8x32 an = shuffle(src, alpha_mask);
+    uint16x16 a = widen_lo(an, zero);
+    a = (a * alpha) >> immint<8>();
+    r1 = (r1 * a) >> immint<8>();
+    a = widen_hi(an, zero);
+    a = (a * alpha) >> immint<8>();
+    r2 = (r2 * a) >> immint<8>();
+    uint8x32 r = pack_hz(r1, r2);
+    r += dst;
+    r |= amask;
+    store256_u(dst_buffer, r);
+}
+
+inline void alphaBlend8Core32(const uint32_t *src1_buffer, const uint32_t *src2_buffer, uint32_t *dst_buffer,
+    simd::uint16x16 m_lo, simd::uint16x16 m_hi, simd::uint8x32 zero, simd::uint8x32 amask) {
+    using namespace simd;
+    uint8x32 src1 = load256_u(src1_buffer), src2 = load256_u(src2_buffer);
+    uint16x16 src1u = widen_lo(src1, zero);
+    uint16x16 r1 = widen_lo(src2, zero);
+    r1 -= src1u;
+    src1u = widen_hi(src1, zero);
+    uint16x16 r2 = widen_hi(src2, zero);
+    r2 -= src1u;
+    r1 = (r1 * m_lo) >> immint<8>();
+    r2 = (r2 * m_hi) >> immint<8>();
+    uint8x32 r = pack_hz(r1, r2);
+    r = (r + src1) | amask;
+    store256_u(dst_buffer, r);
+}
+#endif
+
+inline void alphaBlendCore32(const uint32_t *src1_buffer, const uint32_t *src2_buffer, uint32_t *dst_buffer,
+    simd::uint16x8 m_lo, simd::uint16x8 m_hi, simd::uint8x16 zero, simd::uint8x16 amask) {
+    using namespace simd;
+    uint8x16 src1 = load_u(src1_buffer), src2 = load_u(src2_buffer);
+    uint16x8 src1u = widen_lo(src1, zero);
+    uint16x8 r1 = widen_lo(src2, zero);
+    r1 -= src1u;
+    src1u = widen_hi(src1, zero);
+    uint16x8 r2 = widen_hi(src2, zero);
+    r2 -= src1u;
+    r1 = (r1 * m_lo) >> immint<8>();
+    r2 = (r2 * m_hi) >> immint<8>();
+    uint8x16 r = pack_hz(r1, r2);
+    r = (r + src1) | amask;
+    store_u(dst_buffer, r);
+}
+
+inline void alphaBlendPixelCore32(const uint32_t *src1_buffer, const uint32_t *src2_buffer, uint32_t *dst_buffer, uint8_t mask, simd::ivec128 zero) {
+    using namespace simd;
+    uint8x4 src1 = load(src1_buffer), src2 = load(src2_buffer);
+    uint16x4 r1 = widen(src2, zero);
+    uint16x4 dstu = widen(src1, zero);
+    r1 -= dstu;
+    uint16x4 m(mask);
+    r1 *= m;
+    r1 >>= immint<8>();
+    uint8x4 r = narrow_hz(r1);
+    r += src1;
+    *dst_buffer = uint8x4::cvt2i32(r) | 0xff000000;
+}
+#endif
+
+// One row of the BLEND_NORMAL loop of blendOnSurface().
+inline void blend(uint32_t *dst_buffer, const uint32_t *src_buffer, int num, int alpha) {
+    const uint8_t *alphap = (const uint8_t *)src_buffer + 3;
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    ivec256 zero = ivec256::zero();
+    uint8x32 mask = uint8x32::set8(3, 7, 11, 15, 19, 23, 27, 31);
+    uint8x32 amask = uint8x32::set(0, 0, 0, 0xFF);
+    ivec128 zerol = zero.lo();
+    uint8x16 maskl = mask.lo();
+    uint8x16 amaskl = amask.lo();
+#else
+    ivec128 zerol = ivec128::zero();
+    uint8x16 maskl = uint8x16::set4(3, 7, 11, 15);
+    uint8x16 amaskl = uint8x16::set(0, 0, 0, 0xFF);
+#endif
+    int remain = num;
+    while (remain > 0) {
+        if (*alphap == 0) {
+            --remain; ++src_buffer; ++dst_buffer; alphap += 4;
+        }
+        else if ((*alphap == 255) && (alpha == 255)) {
+            *dst_buffer = *src_buffer;
+            --remain; ++src_buffer; ++dst_buffer; alphap += 4;
+        }
+#ifdef USE_SIMD_X86_AVX2
+        else if (remain >= 8) {
+            blend8Pixel32(src_buffer, dst_buffer, uint16x16(alpha), mask, zero, amask);
+            remain -= 8; src_buffer += 8; dst_buffer += 8; alphap += 32;
+        }
+#endif
+        else if (remain >= 4) {
+            blend4Pixel32(src_buffer, dst_buffer, uint16x8(alpha), maskl, zerol, amaskl);
+            remain -= 4; src_buffer += 4; dst_buffer += 4; alphap += 16;
+        }
+        else {
+            blendPixel32(src_buffer, dst_buffer, alpha, alphap);
+            alphap += 4;
+            --remain; ++src_buffer; ++dst_buffer;
+        }
+    }
+#else
+    for (int j = num; j != 0; j--, src_buffer++, dst_buffer++) {
+        uint32_t mask2 = (*alphap * alpha) >> 8;
+        uint32_t temp = *dst_buffer & 0xff00ff;
+        uint32_t mask_rb = (((((*src_buffer & 0xff00ff) - temp ) * mask2 ) >> 8 ) + temp ) & 0xff00ff;
+        temp = *dst_buffer & 0x00ff00;
+        uint32_t mask_g  = (((((*src_buffer & 0x00ff00) - temp ) * mask2 ) >> 8 ) + temp ) & 0x00ff00;
+        *dst_buffer = mask_rb | mask_g | 0xff000000;
+        alphap += 4;
+    }
+#endif
+}
+
+// BLEND_ADD of the builtin layer effects in blendOnSurface().
+inline void addBlend(uint32_t *dst_buffer, const uint32_t *src_buffer, int num) {
+#ifdef USE_SIMD
+    using namespace simd;
+    int remain = num;
+    while (remain >= 4) {
+        uint8x16 srcvec = load_u(src_buffer), dstvec = load_u(dst_buffer);
+        store_u(dst_buffer, adds(srcvec, dstvec));
+        remain -= 4; src_buffer += 4; dst_buffer += 4;
+    }
+    while (remain > 0) {
+        uint8x4 src = uint8x4::cvt2vec(*src_buffer);
+        uint8x4 dst = uint8x4::cvt2vec(*dst_buffer);
+        *dst_buffer = uint8x4::cvt2i32(adds(dst, src));
+        --remain; ++src_buffer; ++dst_buffer;
+    }
+#else
+    for (int j = num; j != 0; j--, src_buffer++, dst_buffer++) {
+        if (*src_buffer == AMASK) continue;
+        const uint8_t *src = (const uint8_t*)src_buffer;
+        uint8_t *dst = (uint8_t*)dst_buffer;
+        for (int i = 0; i < 3; ++i, ++src, ++dst) {
+            int result = (*dst) + (*src);
+            (*dst) = (result < 255) ? result : 255;
+        }
+    }
+#endif
+}
+
+// alphaBlend32() of ONScripter::alphaBlend(), with the masks computed.
+inline void crossfade(uint32_t *dst_buffer, const uint32_t *src1_buffer, const uint32_t *src2_buffer, const uint32_t *mask2p, int rect_w) {
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    ivec256 zero = ivec256::zero();
+    uint8x32 amask = uint8x32::set(0, 0, 0, 0xFF);
+    ivec128 zerol = zero.lo();
+    uint8x16 amaskl = amask.lo();
+    while (rect_w >= 8) {
+        uint8x32 maskv = load256_u(mask2p);
+        alphaBlend8Core32(src1_buffer, src2_buffer, dst_buffer, widen_lo(maskv, zero), widen_hi(maskv, zero), zero, amask);
+        rect_w -= 8; src1_buffer += 8; src2_buffer += 8; dst_buffer += 8; mask2p += 8;
+    }
+#else
+    ivec128 zerol = ivec128::zero();
+    uint8x16 amaskl = uint8x16::set(0, 0, 0, 0xFF);
+#endif
+    while (rect_w >= 4) {
+        uint8x16 maskv = load_u(mask2p);
+        alphaBlendCore32(src1_buffer, src2_buffer, dst_buffer, widen_lo(maskv, zerol), widen_hi(maskv, zerol), zerol, amaskl);
+        rect_w -= 4; src1_buffer += 4; src2_buffer += 4; dst_buffer += 4; mask2p += 4;
+    }
+    while (rect_w > 0) {
+        alphaBlendPixelCore32(src1_buffer, src2_buffer, dst_buffer, *((const uint8_t*)mask2p), zerol);
+        --rect_w; ++src1_buffer; ++src2_buffer; ++dst_buffer; ++mask2p;
+    }
+#else
+    for (int j = 0; j < rect_w; j++) {
+        uint32_t mask2 = mask2p[j] & 0xff;
+        uint32_t temp = *src1_buffer & 0xff00ff;
+        uint32_t mask_rb = (((((*src2_buffer & 0xff00ff) - temp ) * mask2 ) >> 8 ) + temp ) & 0xff00ff;
+        temp = *src1_buffer & 0x00ff00;
+        uint32_t mask_g  = (((((*src2_buffer & 0x00ff00) - temp ) * mask2 ) >> 8 ) + temp ) & 0x00ff00;
+        *dst_buffer = mask_rb | mask_g;
+        src1_buffer++; src2_buffer++; dst_buffer++;
+    }
+#endif
+}
+
+// alphaBlendConst32() of ONScripter::alphaBlend().
+inline void crossfadeConst(uint32_t *dst_buffer, const uint32_t *src1_buffer, const uint32_t *src2_buffer, uint32_t mask2, int remain) {
+#ifdef USE_SIMD
+    using namespace simd;
+#ifdef USE_SIMD_X86_AVX2
+    ivec256 zero = ivec256::zero();
+    uint16x16 m(mask2);
+    uint8x32 amask = uint8x32::set(0, 0, 0, 0xFF);
+    ivec128 zerol = zero.lo();
+    uint16x8 ml = m.lo();
+    uint8x16 amaskl = amask.lo();
+    while (remain >= 8) {
+        alphaBlend8Core32(src1_buffer, src2_buffer, dst_buffer, m, m, zero, amask);
+        remain -= 8; src1_buffer += 8; src2_buffer += 8; dst_buffer += 8;
+    }
+#else
+    ivec128 zerol = ivec128::zero();
+    uint16x8 ml(mask2);
+    uint8x16 amaskl = uint8x16::set(0, 0, 0, 0xFF);
+#endif
+    while (remain >= 4) {
+        alphaBlendCore32(src1_buffer, src2_buffer, dst_buffer, ml, ml, zerol, amaskl);
+        remain -= 4; src1_buffer += 4; src2_buffer += 4; dst_buffer += 4;
+    }
+    while (remain > 0) {
+        alphaBlendPixelCore32(src1_buffer, src2_buffer, dst_buffer, mask2, zerol);
+        --remain; ++src1_buffer; ++src2_buffer; ++dst_buffer;
+    }
+#else
+    for (int i = 0; i < remain; ++i, ++src1_buffer, ++src2_buffer, ++dst_buffer) {
+        uint32_t temp = *src1_buffer & 0xff00ff;
+        uint32_t mask_rb = (((((*src2_buffer & 0xff00ff) - temp) * mask2) >> 8) + temp) & 0xff00ff;
+        temp = *src1_buffer & 0x00ff00;
+        uint32_t mask_g = (((((*src2_buffer & 0x00ff00) - temp) * mask2) >> 8) + temp) & 0x00ff00;
+        *dst_buffer = mask_rb | mask_g;
+    }
+#endif
+}
+
+// One row of the unrotated 32bpp loop of alphaBlendText(), which had no
+// SIMD version.
+inline void blendText(uint32_t *dst_buffer, const uint8_t *src_buffer, int num, uint32_t src_color3) {
+    uint32_t src_color1 = src_color3 & 0xff00ff, src_color2 = src_color3 & 0x00ff00;
+    for (int j = num; j != 0; j--, src_buffer++, dst_buffer++) {
+        uint32_t mask2 = *src_buffer;
+        if (mask2 == 255){
+            *dst_buffer = src_color3;
+        }
+        else if (mask2 != 0){
+            uint32_t mask1   = mask2 ^ 0xff;
+            uint32_t mask_rb = (((*dst_buffer & 0xff00ff) * mask1 + src_color1 * mask2) >> 8) & 0xff00ff;
+            uint32_t mask_g  = (((*dst_buffer & 0x00ff00) * mask1 + src_color2 * mask2) >> 8) & 0x00ff00;
+            *dst_buffer    = 0xff000000 | mask_rb | mask_g;
+        }
+    }
+}
+
+// One row of makeNegaSurface().
+inline void nega(uint32_t *buf, int num, uint32_t mask) {
+    for (int j = 0; j < num; j++)
+        *buf++ ^= mask;
+}
+
+// One row of makeMonochromeSurface() on a 32bpp surface with red at
+// rshift, green at 8 and blue at 16 - rshift.
+inline void monochrome(uint32_t *buf, int num, int rshift, const uint8_t (*monocro_color_lut)[3]) {
+    int bshift = 16 - rshift;
+    uint32_t rmask = 0xff << rshift, gmask = 0xff00, bmask = 0xff << bshift;
+    for (int j = 0; j < num; j++) {
+        uint32_t c = (((*buf & rmask) >> rshift) * 77 +
+                      ((*buf & gmask) >> 8) * 151 +
+                      ((*buf & bmask) >> bshift) * 28 ) >> 8;
+        *buf++ = ((uint32_t)monocro_color_lut[c][0] << rshift |
+                  (uint32_t)monocro_color_lut[c][1] << 8 |
+                  (uint32_t)monocro_color_lut[c][2] << bshift);
+    }
+}
+
+#undef AMASK
+
+}
+
+#endif
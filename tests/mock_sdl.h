@@ -48,4 +48,9 @@ typedef struct {
 
 typedef SDL_Keycode ONS_Key;
 
+typedef struct SDL_Rect {
+    int x, y;
+    int w, h;
+} SDL_Rect;
+
 #endif
@@ -0,0 +1,334 @@
+/**
+ * Stands in for <SDL2/SDL.h> in the engine sources that only need the
+ * SDL types of mock_sdl.h, the threads, mutexes and conditions of SDL on
+ * top of the standard library, and software surfaces of 8, 16 and 32
+ * bits per pixel with the blits and fills the compositor uses.
+ */
+
+#include "../../mock_sdl.h"
+
+#ifndef MOCK_SDL2_THREADS
+#define MOCK_SDL2_THREADS
+
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+
+typedef std::recursive_mutex SDL_mutex; // SDL mutexes are recursive
+typedef std::condition_variable_any SDL_cond;
+typedef std::thread SDL_Thread;
+typedef int (*SDL_ThreadFunction)(void *data);
+
+inline SDL_mutex *SDL_CreateMutex() { return new SDL_mutex; }
+inline void SDL_DestroyMutex(SDL_mutex *mutex) { delete mutex; }
+inline int SDL_mutexP(SDL_mutex *mutex) { mutex->lock(); return 0; }
+inline int SDL_mutexV(SDL_mutex *mutex) { mutex->unlock(); return 0; }
+
+inline SDL_cond *SDL_CreateCond() { return new SDL_cond; }
+inline void SDL_DestroyCond(SDL_cond *cond) { delete cond; }
+inline int SDL_CondWait(SDL_cond *cond, SDL_mutex *mutex) { cond->wait(*mutex); return 0; }
+inline int SDL_CondSignal(SDL_cond *cond) { cond->notify_one(); return 0; }
+inline int SDL_CondBroadcast(SDL_cond *cond) { cond->notify_all(); return 0; }
+
+inline SDL_Thread *SDL_CreateThread(SDL_ThreadFunction fn, const char *, void *data) {
+    return new std::thread(fn, data);
+}
+inline void SDL_WaitThread(SDL_Thread *thread, int *status) {
+    thread->join();
+    delete thread;
+    if (status) *status = 0;
+}
+inline int SDL_GetCPUCount() {
+    int n = (int)std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+#endif
+
+#ifndef MOCK_SDL2_SURFACES
+#define MOCK_SDL2_SURFACES
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SDL_LIL_ENDIAN 1234
+#define SDL_BIG_ENDIAN 4321
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SDL_BYTEORDER SDL_LIL_ENDIAN
+#else
+#define SDL_BYTEORDER SDL_BIG_ENDIAN
+#endif
+
+#define SDL_SWSURFACE 0
+
+typedef uint16_t Uint16;
+
+enum {
+    SDL_PIXELFORMAT_UNKNOWN  = 0,
+    SDL_PIXELFORMAT_INDEX8   = 0x13000801,
+    SDL_PIXELFORMAT_RGB565   = 0x15151002,
+    SDL_PIXELFORMAT_ARGB8888 = 0x16362004,
+    SDL_PIXELFORMAT_ABGR8888 = 0x16762004
+};
+
+typedef enum {
+    SDL_BLENDMODE_NONE  = 0,
+    SDL_BLENDMODE_BLEND = 1,
+    SDL_BLENDMODE_ADD   = 2,
+    SDL_BLENDMODE_MOD   = 4
+} SDL_BlendMode;
+
+typedef struct SDL_Color {
+    Uint8 r, g, b, a;
+} SDL_Color;
+
+typedef struct SDL_PixelFormat {
+    Uint32 format;
+    Uint8 BitsPerPixel, BytesPerPixel;
+    Uint32 Rmask, Gmask, Bmask, Amask;
+    Uint8 Rloss, Gloss, Bloss, Aloss;
+    Uint8 Rshift, Gshift, Bshift, Ashift;
+} SDL_PixelFormat;
+
+typedef struct SDL_Surface {
+    Uint32 flags;
+    SDL_PixelFormat *format;
+    int w, h, pitch;
+    void *pixels;
+    int refcount;
+    // mock only
+    SDL_BlendMode blend_mode;
+    bool owns_pixels;
+} SDL_Surface;
+
+inline const char *SDL_GetError() { return "mock"; }
+
+inline void mockSetChannel(Uint32 mask, Uint8 *shift, Uint8 *loss) {
+    *shift = 0;
+    *loss = 8;
+    if (mask == 0) return;
+    while (!(mask & 1)) { mask >>= 1; (*shift)++; }
+    while (mask & 1) { mask >>= 1; (*loss)--; }
+}
+
+inline SDL_Surface *mockCreateSurface(void *pixels, int w, int h, int depth, int pitch,
+                                      Uint32 Rmask, Uint32 Gmask, Uint32 Bmask, Uint32 Amask) {
+    if (w < 0 || h < 0 || (depth != 8 && depth != 16 && depth != 32)) return NULL;
+    SDL_Surface *s = new SDL_Surface;
+    SDL_PixelFormat *f = s->format = new SDL_PixelFormat;
+    f->BitsPerPixel = depth;
+    f->BytesPerPixel = depth / 8;
+    f->Rmask = Rmask; f->Gmask = Gmask; f->Bmask = Bmask; f->Amask = Amask;
+    mockSetChannel(Rmask, &f->Rshift, &f->Rloss);
+    mockSetChannel(Gmask, &f->Gshift, &f->Gloss);
+    mockSetChannel(Bmask, &f->Bshift, &f->Bloss);
+    mockSetChannel(Amask, &f->Ashift, &f->Aloss);
+    if (depth == 8) f->format = SDL_PIXELFORMAT_INDEX8;
+    else if (depth == 16) f->format = SDL_PIXELFORMAT_RGB565;
+    else f->format = Rmask == 0x00ff0000 ? SDL_PIXELFORMAT_ARGB8888 : SDL_PIXELFORMAT_ABGR8888;
+    s->flags = 0;
+    s->w = w;
+    s->h = h;
+    s->refcount = 1;
+    s->blend_mode = Amask ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE;
+    s->owns_pixels = pixels == NULL;
+    if (pixels) {
+        s->pitch = pitch;
+        s->pixels = pixels;
+    }
+    else {
+        s->pitch = (w * f->BytesPerPixel + 3) & ~3;
+        s->pixels = calloc((size_t)s->pitch * (h > 0 ? h : 1), 1);
+    }
+    return s;
+}
+
+inline void mockFormatMasks(Uint32 format, Uint32 *r, Uint32 *g, Uint32 *b, Uint32 *a) {
+    if (format == SDL_PIXELFORMAT_INDEX8) { *r = *g = *b = *a = 0; }
+    else if (format == SDL_PIXELFORMAT_RGB565) { *r = 0xf800; *g = 0x07e0; *b = 0x001f; *a = 0; }
+    else if (format == SDL_PIXELFORMAT_ABGR8888) { *r = 0xff; *g = 0xff00; *b = 0xff0000; *a = 0xff000000; }
+    else { *r = 0xff0000; *g = 0xff00; *b = 0xff; *a = 0xff000000; }
+}
+
+inline SDL_Surface *SDL_CreateRGBSurface(Uint32, int w, int h, int depth,
+                                         Uint32 Rmask, Uint32 Gmask, Uint32 Bmask, Uint32 Amask) {
+    return mockCreateSurface(NULL, w, h, depth, 0, Rmask, Gmask, Bmask, Amask);
+}
+
+inline SDL_Surface *SDL_CreateRGBSurfaceFrom(void *pixels, int w, int h, int depth, int pitch,
+                                             Uint32 Rmask, Uint32 Gmask, Uint32 Bmask, Uint32 Amask) {
+    return mockCreateSurface(pixels, w, h, depth, pitch, Rmask, Gmask, Bmask, Amask);
+}
+
+inline SDL_Surface *SDL_CreateRGBSurfaceWithFormat(Uint32, int w, int h, int depth, Uint32 format) {
+    Uint32 r, g, b, a;
+    mockFormatMasks(format, &r, &g, &b, &a);
+    return mockCreateSurface(NULL, w, h, depth, 0, r, g, b, a);
+}
+
+inline SDL_Surface *SDL_CreateRGBSurfaceWithFormatFrom(void *pixels, int w, int h, int depth, int pitch,
+                                                       Uint32 format) {
+    Uint32 r, g, b, a;
+    mockFormatMasks(format, &r, &g, &b, &a);
+    return mockCreateSurface(pixels, w, h, depth, pitch, r, g, b, a);
+}
+
+inline void SDL_FreeSurface(SDL_Surface *s) {
+    if (s == NULL || --s->refcount > 0) return;
+    if (s->owns_pixels) free(s->pixels);
+    delete s->format;
+    delete s;
+}
+
+inline int SDL_LockSurface(SDL_Surface *) { return 0; }
+inline void SDL_UnlockSurface(SDL_Surface *) {}
+
+inline int SDL_SetSurfaceBlendMode(SDL_Surface *s, SDL_BlendMode mode) { s->blend_mode = mode; return 0; }
+inline int SDL_GetSurfaceBlendMode(SDL_Surface *s, SDL_BlendMode *mode) { *mode = s->blend_mode; return 0; }
+
+inline Uint32 SDL_MapRGBA(const SDL_PixelFormat *f, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    return (r >> f->Rloss) << f->Rshift | (g >> f->Gloss) << f->Gshift | (b >> f->Bloss) << f->Bshift |
+           ((a >> f->Aloss) << f->Ashift & f->Amask);
+}
+
+inline Uint32 SDL_MapRGB(const SDL_PixelFormat *f, Uint8 r, Uint8 g, Uint8 b) {
+    return SDL_MapRGBA(f, r, g, b, 255);
+}
+
+// Clips rect to the surface, or to all of it if rect is NULL.
+inline bool mockClip(const SDL_Surface *s, const SDL_Rect *rect, SDL_Rect *clipped) {
+    SDL_Rect r = {0, 0, s->w, s->h};
+    if (rect) {
+        int x2 = rect->x + rect->w < s->w ? rect->x + rect->w : s->w;
+        int y2 = rect->y + rect->h < s->h ? rect->y + rect->h : s->h;
+        r.x = rect->x > 0 ? rect->x : 0;
+        r.y = rect->y > 0 ? rect->y : 0;
+        r.w = x2 - r.x;
+        r.h = y2 - r.y;
+    }
+    *clipped = r;
+    return r.w > 0 && r.h > 0;
+}
+
+inline int SDL_FillRect(SDL_Surface *dst, const SDL_Rect *rect, Uint32 color) {
+    SDL_Rect r;
+    if (!mockClip(dst, rect, &r)) return 0;
+    for (int y = r.y; y < r.y + r.h; y++) {
+        unsigned char *row = (unsigned char *)dst->pixels + (size_t)y * dst->pitch;
+        for (int x = r.x; x < r.x + r.w; x++) {
+            if (dst->format->BytesPerPixel == 1) row[x] = (Uint8)color;
+            else if (dst->format->BytesPerPixel == 2) ((Uint16 *)row)[x] = (Uint16)color;
+            else ((Uint32 *)row)[x] = color;
+        }
+    }
+    return 0;
+}
+
+// Copies, or blends straight alpha over the destination with
+// SDL_BLENDMODE_BLEND, between surfaces of the same format.
+inline int SDL_BlitSurface(SDL_Surface *src, const SDL_Rect *srcrect, SDL_Surface *dst, SDL_Rect *dstrect) {
+    SDL_Rect sr, dr;
+    if (!mockClip(src, srcrect, &sr)) return 0;
+    SDL_Rect want = {dstrect ? dstrect->x : 0, dstrect ? dstrect->y : 0, sr.w, sr.h};
+    if (!mockClip(dst, &want, &dr)) return 0;
+    sr.x += dr.x - want.x;
+    sr.y += dr.y - want.y;
+    int bpp = dst->format->BytesPerPixel;
+    bool blend = src->blend_mode == SDL_BLENDMODE_BLEND && src->format->Amask;
+    for (int y = 0; y < dr.h; y++) {
+        unsigned char *d = (unsigned char *)dst->pixels + (size_t)(dr.y + y) * dst->pitch + dr.x * bpp;
+        const unsigned char *s = (const unsigned char *)src->pixels + (size_t)(sr.y + y) * src->pitch + sr.x * bpp;
+        if (!blend) {
+            memcpy(d, s, (size_t)dr.w * bpp);
+            continue;
+        }
+        for (int x = 0; x < dr.w; x++) {
+            Uint32 sp = ((const Uint32 *)s)[x], dp = ((Uint32 *)d)[x];
+            Uint32 a = (sp & src->format->Amask) >> src->format->Ashift, out = 0;
+            for (int k = 0; k < 32; k += 8) {
+                Uint32 sc = sp >> k & 0xff, dc = dp >> k & 0xff;
+                Uint32 c = (Uint32)k == src->format->Ashift ? sc + dc * (255 - a) / 255
+                                                            : (sc * a + dc * (255 - a)) / 255;
+                out |= c << k;
+            }
+            ((Uint32 *)d)[x] = out;
+        }
+    }
+    if (dstrect) *dstrect = dr;
+    return 0;
+}
+
+#endif
+
+#ifndef MOCK_SDL2_ENGINE
+#define MOCK_SDL2_ENGINE
+
+#include <chrono>
+#include <stdio.h>
+
+// Enough of the rest of SDL for ONScripter.h to compile; the tests build
+// the engine sources with -ffunction-sections and link with --gc-sections,
+// so only what the code under test reaches has to work.
+
+typedef enum { SDL_FALSE = 0, SDL_TRUE = 1 } SDL_bool;
+
+typedef struct SDL_Window SDL_Window;
+typedef struct SDL_Renderer SDL_Renderer;
+typedef struct SDL_Texture SDL_Texture;
+typedef struct SDL_GameController SDL_GameController;
+typedef struct SDL_RWops {
+    long (*seek)(struct SDL_RWops *context, long offset, int whence);
+    const unsigned char *mem; // of SDL_RWFromMem() and SDL_RWFromConstMem()
+    size_t size;
+} SDL_RWops;
+
+typedef struct SDL_MouseMotionEvent { Uint32 type; Sint32 x, y; } SDL_MouseMotionEvent;
+typedef struct SDL_MouseButtonEvent { Uint32 type; Uint8 button; Sint32 x, y; } SDL_MouseButtonEvent;
+typedef struct SDL_MouseWheelEvent { Uint32 type; Sint32 x, y; } SDL_MouseWheelEvent;
+typedef union SDL_Event {
+    Uint32 type;
+    SDL_KeyboardEvent key;
+    SDL_MouseMotionEvent motion;
+    SDL_MouseButtonEvent button;
+    SDL_MouseWheelEvent wheel;
+} SDL_Event;
+
+typedef struct SDL_AudioSpec {
+    int freq;
+    Uint16 format;
+    Uint8 channels;
+    Uint16 samples;
+} SDL_AudioSpec;
+
+inline Uint32 SDL_GetTicks() {
+    return (Uint32)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline SDL_RWops *SDL_RWFromConstMem(const void *mem, int size) {
+    SDL_RWops *rw = new SDL_RWops();
+    rw->mem = (const unsigned char *)mem;
+    rw->size = size;
+    return rw;
+}
+inline SDL_RWops *SDL_RWFromMem(void *mem, int size) { return SDL_RWFromConstMem(mem, size); }
+inline SDL_RWops *SDL_RWFromFP(FILE *, SDL_bool) { return NULL; }
+inline SDL_RWops *SDL_RWFromFile(const char *, const char *) { return NULL; }
+inline int SDL_RWclose(SDL_RWops *rw) {
+    delete rw;
+    return 0;
+}
+
+inline SDL_Surface *SDL_ConvertSurface(SDL_Surface *src, const SDL_PixelFormat *fmt, Uint32) {
+    SDL_Surface *s = SDL_CreateRGBSurface(0, src->w, src->h, fmt->BitsPerPixel,
+                                          fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask);
+    if (s && src->format->BitsPerPixel == fmt->BitsPerPixel) {
+        SDL_Surface copy = *src;
+        copy.blend_mode = SDL_BLENDMODE_NONE;
+        SDL_BlitSurface(&copy, NULL, s, NULL);
+    }
+    return s;
+}
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * Stands in for <SDL2/SDL_image.h>.  In place of PNG and JPEG, IMG_Load_RW()
+ * decodes the raw images that mockSaveImage() writes: "MOCKIMG\0", the width
+ * and the height as 32-bit integers, then the pixels in ARGB8888.
+ */
+
+#ifndef MOCK_SDL2_IMAGE_H
+#define MOCK_SDL2_IMAGE_H
+
+#include <SDL2/SDL.h>
+
+inline SDL_Surface *IMG_Load_RW(SDL_RWops *src, int freesrc) {
+    SDL_Surface *s = NULL;
+    Sint32 wh[2];
+    if (src && src->size >= 8 + sizeof(wh) && memcmp(src->mem, "MOCKIMG", 8) == 0) {
+        memcpy(wh, src->mem + 8, sizeof(wh));
+        if (wh[0] > 0 && wh[1] > 0 && src->size - 8 - sizeof(wh) >= (size_t)wh[0] * wh[1] * 4) {
+            s = SDL_CreateRGBSurfaceWithFormat(0, wh[0], wh[1], 32, SDL_PIXELFORMAT_ARGB8888);
+            for (int j = 0; j < wh[1]; j++)
+                memcpy((Uint8 *)s->pixels + (size_t)j * s->pitch, src->mem + 8 + sizeof(wh) + (size_t)j * wh[0] * 4,
+                       (size_t)wh[0] * 4);
+        }
+    }
+    if (freesrc) SDL_RWclose(src);
+    return s;
+}
+inline SDL_Surface *IMG_LoadJPG_RW(SDL_RWops *) { return NULL; }
+inline int IMG_isPNG(SDL_RWops *) { return 0; }
+inline const char *IMG_GetError() { return SDL_GetError(); }
+
+// Writes an ARGB8888 surface to path for IMG_Load_RW().
+inline bool mockSaveImage(SDL_Surface *s, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) return false;
+    Sint32 wh[2] = {s->w, s->h};
+    bool ok = fwrite("MOCKIMG", 8, 1, fp) == 1 && fwrite(wh, sizeof(wh), 1, fp) == 1;
+    for (int j = 0; ok && j < s->h; j++)
+        ok = fwrite((Uint8 *)s->pixels + (size_t)j * s->pitch, (size_t)s->w * 4, 1, fp) == 1;
+    return fclose(fp) == 0 && ok;
+}
+
+#endif
@@ -0,0 +1,13 @@
+/**
+ * Stands in for <SDL2/SDL_mixer.h>; the tests never play sound.
+ */
+
+#ifndef MOCK_SDL2_MIXER_H
+#define MOCK_SDL2_MIXER_H
+
+#include <SDL2/SDL.h>
+
+typedef struct _Mix_Music Mix_Music;
+typedef struct Mix_Chunk { int allocated; Uint8 *abuf; Uint32 alen; Uint8 volume; } Mix_Chunk;
+
+#endif
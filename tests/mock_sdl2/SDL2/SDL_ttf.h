@@ -0,0 +1,16 @@
+/**
+ * Stands in for <SDL2/SDL_ttf.h>; the tests never render glyphs through it.
+ */
+
+#ifndef MOCK_SDL2_TTF_H
+#define MOCK_SDL2_TTF_H
+
+#include <SDL2/SDL.h>
+
+typedef struct _TTF_Font TTF_Font;
+
+inline TTF_Font *TTF_OpenFontRW(SDL_RWops *, int, int) { return NULL; }
+inline void TTF_SetFontOutline(TTF_Font *, int) {}
+inline const char *TTF_GetError() { return SDL_GetError(); }
+
+#endif
@@ -0,0 +1,304 @@
+/**
+ * An ONScripter on the software surfaces of mock_sdl2, for the tests and
+ * benchmarks of the compositor: refreshSurface(), composeLayers() and
+ * alphaBlend() run as ONScripter_image.cpp has them, with the sprites,
+ * standing pictures and text window set up here instead of by a script.
+ *
+ * The engine sources are built with -ffunction-sections and linked with
+ * --gc-sections, so that only what the compositor reaches has to link.
+ * ONScripter.cpp, which opens the window and the audio, is left out: the
+ * constructor and destructor below set up and free what init(), reset()
+ * and resetSub() do for the compositor, and the shadow of the text window
+ * is not drawn, nor are strings.  Images are read by a DirectReader from
+ * the directory given to setArchivePath().  Include this file from one
+ * source of a binary only.
+ */
+
+#ifndef ONSCRIPTER_HARNESS_H
+#define ONSCRIPTER_HARNESS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "ONScripter.h"
+#include "DirectReader.h"
+
+ONScripter::ONScripter()
+{
+    ScriptParser::reset();
+
+    premultiplied_alpha_flag = false;
+    sprite_info  = new AnimationInfo[MAX_SPRITE_NUM];
+    sprite2_info = new AnimationInfo[MAX_SPRITE2_NUM];
+    texture_info = new AnimationInfo[MAX_TEXTURE_NUM];
+    for (int i = 0; i < MAX_SPRITE2_NUM; i++) sprite2_info[i].affine_flag = true;
+    for (int i = 0; i < MAX_PARAM_NUM; i++) bar_info[i] = prnum_info[i] = NULL;
+    for (int i = 0; i < 3; i++) human_order[i] = 2 - i; // "rcl"
+
+    all_sprite_hide_flag = all_sprite2_hide_flag = false;
+    show_dialog_flag = false;
+    clickstr_state = CLICK_NONE;
+    monocro_flag = false;
+    monocro_color[0] = monocro_color[1] = monocro_color[2] = 0;
+    nega_mode = 0;
+
+    composite_stats.frames = composite_stats.pixels = 0;
+    composite_stats.sprites_visited = composite_stats.sprites_drawn = 0;
+    composite_stats.layer_cache_hits = composite_stats.layer_cache_misses = 0;
+    composite_stats.pixels_skipped = 0;
+    accumulation_surface = effect_src_surface = effect_dst_surface = NULL;
+    layer_cache_surface = NULL;
+    layer_cache_rect.x = layer_cache_rect.y = layer_cache_rect.w = layer_cache_rect.h = 0;
+    live_sprites_generation = 0;
+
+    image_surface = AnimationInfo::alloc32bitSurface(1, 1, SDL_PIXELFORMAT_ARGB8888);
+    tmp_image_buf = NULL;
+    tmp_image_buf_length = 0;
+    mean_size_of_loaded_images = 0;
+    num_loaded_images = 10;
+    disable_rescale_flag = false;
+    asset_prefetcher.setDecoder(decodePrefetched, this);
+    lookahead_label = NULL;
+}
+
+ONScripter::~ONScripter()
+{
+    asset_prefetcher.stop(); // the workers read through script_h.cBR
+    delete script_h.cBR;
+    SDL_FreeSurface(image_surface);
+    delete[] tmp_image_buf;
+    SDL_FreeSurface(accumulation_surface);
+    SDL_FreeSurface(effect_src_surface);
+    SDL_FreeSurface(effect_dst_surface);
+    SDL_FreeSurface(layer_cache_surface);
+    delete[] sprite_info;
+    delete[] sprite2_info;
+    delete[] texture_info;
+}
+
+void ONScripter::shadowTextDisplay(SDL_Surface *, SDL_Rect &)
+{
+}
+
+// as in ONScripter.cpp, for parseTaggedString()
+int ONScripter::getNumberFromBuffer(const char **buf)
+{
+    int ret = 0;
+    while (**buf >= '0' && **buf <= '9')
+        ret = ret * 10 + *(*buf)++ - '0';
+
+    return ret;
+}
+
+// string sprites are left blank
+void ONScripter::drawString(const char *, uchar3, FontInfo *, bool, SDL_Surface *, SDL_Rect *, AnimationInfo *, bool)
+{
+}
+
+class ONScripterHarness {
+public:
+    enum { REFRESH_NORMAL = ONScripter::REFRESH_NORMAL_MODE,
+           REFRESH_SAYA   = ONScripter::REFRESH_SAYA_MODE,
+           REFRESH_TEXT   = ONScripter::REFRESH_TEXT_MODE,
+           REFRESH_CURSOR = ONScripter::REFRESH_CURSOR_MODE
+    };
+    enum { ALPHA_BLEND_CONST          = ONScripter::ALPHA_BLEND_CONST,
+           ALPHA_BLEND_FADE_MASK      = ONScripter::ALPHA_BLEND_FADE_MASK,
+           ALPHA_BLEND_CROSSFADE_MASK = ONScripter::ALPHA_BLEND_CROSSFADE_MASK
+    };
+    // what setImage() fills an image with
+    enum Fill { OPAQUE,      // random colors at an alpha of 255
+                TRANSLUCENT, // random colors and alpha, half of it 255
+                MARGINS      // OPAQUE within a transparent border of a quarter
+    };
+
+    ONScripter ons;
+    const int width, height;
+    AnimationInfo &bg, &text;
+    AnimationInfo *const tachi, *const sprites, *const sprites2;
+    int &z_order, *const human_order, &nega_mode;
+    bool &windowback, &all_sprite_hide, &all_sprite2_hide;
+    ONScripter::CompositeStats &stats;
+
+    // A screen of width x height in ARGB8888 with a background of random
+    // colors and an empty text window, composed on threads.
+    ONScripterHarness(int width, int height, int threads = 1)
+        : width(width), height(height), bg(ons.bg_info), text(ons.text_info), tachi(ons.tachi_info),
+          sprites(ons.sprite_info), sprites2(ons.sprite2_info), z_order(ons.z_order),
+          human_order(ons.human_order), nega_mode(ons.nega_mode), windowback(ons.windowback_flag),
+          all_sprite_hide(ons.all_sprite_hide_flag), all_sprite2_hide(ons.all_sprite2_hide_flag),
+          stats(ons.composite_stats), rng(1)
+    {
+        ons.screen_width = width;
+        ons.screen_height = height;
+        ons.screen_rect.x = ons.screen_rect.y = 0;
+        ons.screen_rect.w = width;
+        ons.screen_rect.h = height;
+        ons.texture_format = SDL_PIXELFORMAT_ARGB8888;
+        ons.accumulation_surface = AnimationInfo::allocSurface(width, height, ons.texture_format);
+        ons.effect_src_surface = AnimationInfo::allocSurface(width, height, ons.texture_format);
+        ons.effect_dst_surface = AnimationInfo::allocSurface(width, height, ons.texture_format);
+        ons.band_compositor.setThreads(threads);
+
+        setImage(&bg, 0, 0, width, height, OPAQUE);
+        text.num_of_cells = 1;
+        text.allocImage(width, height, ons.texture_format);
+        text.fill(0, 0, 0, 0);
+        text.visible = true;
+    }
+
+    uint32_t nextRandom() {
+        rng = rng * 1103515245 + 12345;
+        return (rng >> 8) ^ (rng << 24);
+    }
+
+    // Gives anim an image of w x h at x, y of cells side by side, set up
+    // with its alpha as by setupAnimationInfo(), and shows it.
+    void setImage(AnimationInfo *anim, int x, int y, int w, int h, Fill fill,
+                  bool premultiplied = false, int cells = 1) {
+        SDL_Surface *surface = AnimationInfo::alloc32bitSurface(w * cells, h, ons.texture_format);
+        for (int j = 0; j < h; j++) {
+            uint32_t *row = (uint32_t *)((unsigned char *)surface->pixels + (size_t)j * surface->pitch);
+            for (int i = 0; i < w * cells; i++) {
+                uint32_t r = nextRandom(), a = 255;
+                if (fill == TRANSLUCENT)
+                    a = (r & 1) ? 255 : r >> 24;
+                else if (fill == MARGINS && (i % w < w / 4 || i % w >= w - w / 4 || j < h / 4 || j >= h - h / 4))
+                    a = 0;
+                row[i] = (a << 24) | (nextRandom() & 0xffffff);
+            }
+        }
+
+        anim->deleteSurface();
+        anim->num_of_cells = cells;
+        anim->current_cell = 0;
+        anim->trans_mode = AnimationInfo::TRANS_ALPHA;
+        anim->premultiplied = premultiplied;
+        AlphaBounds bounds;
+        surface = anim->setupImageAlpha(surface, NULL, true, &bounds);
+        anim->setImage(surface, ons.texture_format, &bounds);
+        anim->orig_pos.x = x;
+        anim->orig_pos.y = y;
+        anim->scalePosXY(1, 1);
+        anim->trans = 255;
+        anim->visible = true;
+        if (anim->affine_flag) anim->calcAffineMatrix();
+    }
+
+    // Draws rows of glyph-like coverage, as drawChar() would, into the
+    // text window within rect.
+    void setText(const SDL_Rect &rect) {
+        SDL_Surface *glyphs = SDL_CreateRGBSurface(SDL_SWSURFACE, rect.w, rect.h, 8, 0, 0, 0, 0);
+        for (int j = 0; j < rect.h; j++)
+            for (int i = 0; i < rect.w; i++) {
+                uint32_t r = nextRandom();
+                ((unsigned char *)glyphs->pixels)[(size_t)j * glyphs->pitch + i] =
+                    j % 32 >= 24 ? 0 : (r & 3) == 0 ? r >> 24 : ((r >> 2) & 1) * 255;
+            }
+        SDL_Color color = {0xff, 0xe0, 0xc0, 0xff};
+        text.blendText(glyphs, rect.x, rect.y, color, NULL, false);
+        SDL_FreeSurface(glyphs);
+    }
+
+    // Scales and rotates anim about the center of its cell as lsp2 does;
+    // sprites2 are always affine, sprites and tachi become so.
+    void setAffine(AnimationInfo *anim, int scale_x, int scale_y, int rot) {
+        anim->affine_flag = true;
+        anim->scale_x = scale_x;
+        anim->scale_y = scale_y;
+        anim->rot = rot;
+        anim->calcAffineMatrix();
+    }
+
+    void setMonochrome(Uint8 r, Uint8 g, Uint8 b) {
+        ons.monocro_flag = true;
+        ons.monocro_color[0] = r;
+        ons.monocro_color[1] = g;
+        ons.monocro_color[2] = b;
+        for (int i = 0; i < 256; i++) {
+            ons.monocro_color_lut[i][0] = (r * i) >> 8;
+            ons.monocro_color_lut[i][1] = (g * i) >> 8;
+            ons.monocro_color_lut[i][2] = (b * i) >> 8;
+        }
+    }
+    void clearMonochrome() { ons.monocro_flag = false; }
+
+    // Makes anim look to the compositor as if its alpha had not been
+    // scanned, as after a write through detachSurface(): no margins are
+    // left out and it hides nothing under it.  The pixels drawn stay the
+    // same.
+    void forgetAlphaBounds(AnimationInfo *anim) { anim->alpha_version = anim->image_version - 1; }
+
+    // Reads the images that loadImage() names from dir, which ends with
+    // a '/', as with no archive.  The reader before is replaced as nsa
+    // does.
+    void setArchivePath(const char *dir) {
+        ons.releaseReader();
+        delete ons.script_h.cBR;
+        ons.script_h.cBR = new DirectReader(dir);
+    }
+    // Sets anim up from a tagged string such as ":a;image.bmp", as lsp does,
+    // and shows it.
+    void loadImage(AnimationInfo *anim, const char *tagged) {
+        anim->deleteSurface();
+        anim->setImageName(tagged);
+        ons.parseTaggedString(anim);
+        ons.setupAnimationInfo(anim);
+        anim->visible = true;
+    }
+    // What savescreenshot does after writing filename.
+    void wroteFile(const char *filename) {
+        ons.script_h.cBR->invalidateDirectoryIndex();
+        ons.forgetWrittenFile(filename);
+    }
+    SurfaceCache::Stats imageCacheStats() { return ons.getImageCacheStats(); }
+
+    // Stages names as the lookahead of prefetchAhead() does.
+    void prefetch(const std::vector<std::string> &names) { ons.asset_prefetcher.request(names); }
+    AssetPrefetcher::Stats prefetchStats() { return ons.asset_prefetcher.getStats(); }
+
+    void setThreads(int threads) { ons.band_compositor.setThreads(threads); }
+    int getThreads() { return ons.band_compositor.getThreads(); }
+
+    // Keeps the layers below the text window composed, as init() does.
+    void enableLayerCache() {
+        if (ons.layer_cache_surface == NULL)
+            ons.layer_cache_surface = AnimationInfo::allocSurface(width, height, ons.texture_format);
+    }
+    const SDL_Rect &layerCacheRect() { return ons.layer_cache_rect; }
+
+    void refresh(SDL_Surface *surface, SDL_Rect *clip, int refresh_mode) {
+        ons.refreshSurface(surface, clip, refresh_mode);
+    }
+    // refreshSurface() as if there were no layer cache, leaving what it
+    // keeps alone.
+    void refreshUncached(SDL_Surface *surface, SDL_Rect *clip, int refresh_mode) {
+        SDL_Surface *cache = ons.layer_cache_surface;
+        ons.layer_cache_surface = NULL;
+        ons.refreshSurface(surface, clip, refresh_mode);
+        ons.layer_cache_surface = cache;
+    }
+
+    SDL_Surface *screen() { return ons.accumulation_surface; }
+    SDL_Surface *effectSrc() { return ons.effect_src_surface; }
+    SDL_Surface *effectDst() { return ons.effect_dst_surface; }
+
+    void alphaBlend(SDL_Surface *mask, int trans_mode, Uint32 mask_value, SDL_Rect *clip = NULL) {
+        ons.alphaBlend(mask, trans_mode, mask_value, clip);
+    }
+
+    SDL_Surface *allocScreen() { return AnimationInfo::allocSurface(width, height, ons.texture_format); }
+
+    static std::vector<uint32_t> pixels(SDL_Surface *surface) {
+        std::vector<uint32_t> p((size_t)surface->w * surface->h);
+        for (int j = 0; j < surface->h; j++)
+            memcpy(&p[(size_t)j * surface->w], (unsigned char *)surface->pixels + (size_t)j * surface->pitch,
+                   surface->w * 4);
+        return p;
+    }
+
+private:
+    uint32_t rng;
+};
+
+#endif
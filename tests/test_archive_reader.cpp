@@ -0,0 +1,928 @@
+#include "test_framework.h"
+#include "archive_builder.h"
+#include "legacy_decoders.h"
+#include "NsxReader.h"
+#include "lz4_codec.h"
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+using namespace ArchiveBuilder;
+
+static std::string g_dir;
+
+static std::vector<unsigned char> readAll(BaseReader &reader, const char *name) {
+    std::vector<unsigned char> buf(reader.getFileLength(name));
+    if (!buf.empty()) buf.resize(reader.getFile(name, &buf[0]));
+    return buf;
+}
+
+void test_lookup_is_case_insensitive() {
+    TEST("archive lookup ignores case and slash direction");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    ASSERT_EQ(100, (int)reader.getFileLength("image\\bg01.png"));
+    ASSERT_EQ(100, (int)reader.getFileLength("IMAGE/BG01.PNG"));
+    ASSERT_EQ(100, (int)reader.getFileLength("Image/Bg01.Png"));
+    TEST_PASS();
+}
+
+void test_lookup_missing_file() {
+    TEST("archive lookup of a missing file returns 0");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    ASSERT_EQ(0, (int)reader.getFileLength("image\\nothere.png"));
+    unsigned char buf[16];
+    ASSERT_EQ(0, (int)reader.getFile("image\\nothere.png", buf));
+    TEST_PASS();
+}
+
+void test_lookup_priority() {
+    TEST("arc.nsa takes priority over arc1.nsa");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    std::vector<unsigned char> data = readAll(reader, "shared.txt");
+    ASSERT_EQ(8, (int)data.size());
+    ASSERT_TRUE(data == makeData(8, 1));
+    ASSERT_EQ(33, (int)reader.getFileLength("only_in_arc1.txt"));
+    TEST_PASS();
+}
+
+void test_lookup_skips_empty_entries() {
+    TEST("a name empty in arc.nsa is read from arc1.nsa, as the linear search did");
+    std::string dir = makeTempDir("empty");
+    std::vector<Entry> arc, arc1;
+    arc.push_back(makeEntry("EMPTY.TXT", std::vector<unsigned char>()));
+    arc.push_back(makeEntry("EMPTY_EVERYWHERE.TXT", std::vector<unsigned char>()));
+    arc1.push_back(makeEntry("EMPTY.TXT", makeData(21, 4)));
+    arc1.push_back(makeEntry("EMPTY_EVERYWHERE.TXT", std::vector<unsigned char>()));
+    ASSERT_TRUE(writeNSA(dir + "arc.nsa", arc) && writeNSA(dir + "arc1.nsa", arc1));
+
+    NsaReader reader(0, (char*)dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    ASSERT_EQ(21, (int)reader.getFileLength("empty.txt"));
+    ASSERT_TRUE(readAll(reader, "empty.txt") == makeData(21, 4));
+    BaseReader::ResolvedFile rf;
+    ASSERT_TRUE(reader.resolveFile("empty.txt", &rf));
+    ASSERT_EQ(21, (int)rf.length);
+    ASSERT_EQ(0, (int)reader.getFileLength("empty_everywhere.txt"));
+    ASSERT_TRUE(!reader.resolveFile("empty_everywhere.txt", &rf));
+    reader.close();
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+void test_lookup_all_entries() {
+    TEST("every entry of a large archive is found with its own data");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    for (int i = 0; i < 5000; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "many\\file%05d.dat", i);
+        std::vector<unsigned char> data = readAll(reader, name);
+        ASSERT_TRUE(data == makeData(16 + i % 7, i));
+    }
+    TEST_PASS();
+}
+
+void test_file_view_matches_getfile() {
+    TEST("getFileView returns the same bytes as getFile");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    size_t length = 0;
+    int location = -1;
+    const unsigned char *view = reader.getFileView("image/bg01.png", &length, &location);
+#if defined(USE_MMAP_ARCHIVE)
+    ASSERT_NOT_NULL(view);
+    ASSERT_EQ(100, (int)length);
+    ASSERT_EQ(BaseReader::ARCHIVE_TYPE_NSA, location);
+    ASSERT_TRUE(memcmp(view, &makeData(100, 7)[0], 100) == 0);
+#else
+    ASSERT_NULL(view);
+#endif
+    TEST_PASS();
+}
+
+void test_file_view_skips_compressed() {
+    TEST("getFileView refuses compressed entries");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    size_t length = 0;
+    ASSERT_NULL(reader.getFileView("packed.bmp", &length));
+    ASSERT_NULL(reader.getFileView("nothere.png", &length));
+    TEST_PASS();
+}
+
+static std::vector<std::string> packedNames() {
+    std::vector<std::string> names;
+    for (int i = 0; i < 24; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "packed\\%s%02d.bmp",
+                 i % 4 == 0 ? "raw" : i % 4 == 1 ? "lzss" : i % 4 == 2 ? "spb" : "nbz", i);
+        names.push_back(name);
+    }
+    return names;
+}
+
+void test_concurrent_reads_are_byte_exact() {
+    TEST("8 threads reading one NsaReader get byte-exact data");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+
+    std::vector<std::string> names = packedNames();
+    std::vector<std::vector<unsigned char> > expected;
+    for (size_t i = 0; i < names.size(); i++) {
+        expected.push_back(readAll(reader, names[i].c_str()));
+        ASSERT_GT((int)expected.back().size(), 0);
+    }
+
+    std::atomic<int> mismatches(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (int round = 0; round < 20; round++) {
+                for (size_t k = 0; k < names.size(); k++) {
+                    size_t i = (k * 7 + t * 5 + round) % names.size();
+                    if (readAll(reader, names[i].c_str()) != expected[i]) mismatches++;
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+    ASSERT_EQ(0, mismatches.load());
+    TEST_PASS();
+}
+
+void test_concurrent_first_lookups() {
+    TEST("8 threads racing the first NBZ/SPB length lookups agree");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+
+    std::vector<std::string> names = packedNames();
+    std::vector<size_t> expected;
+    {
+        NsaReader warm(0, (char*)g_dir.c_str());
+        ASSERT_EQ(0, warm.open());
+        for (size_t i = 0; i < names.size(); i++)
+            expected.push_back(warm.getFileLength(names[i].c_str()));
+    }
+
+    std::atomic<int> mismatches(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (size_t k = 0; k < names.size(); k++) {
+                size_t i = (k + t) % names.size();
+                if (reader.getFileLength(names[i].c_str()) != expected[i]) mismatches++;
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+    ASSERT_EQ(0, mismatches.load());
+    TEST_PASS();
+}
+
+void test_nbz_roundtrip() {
+    TEST("NBZ entries decode to their original bytes");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    std::vector<unsigned char> data = readAll(reader, "packed\\nbz03.bmp");
+    ASSERT_TRUE(data == makeData(30000 + 3 * 1000, 3));
+    TEST_PASS();
+}
+
+static std::vector<unsigned char> readResolved(BaseReader &reader, const char *name) {
+    BaseReader::ResolvedFile rf;
+    if (!reader.resolveFile(name, &rf)) return std::vector<unsigned char>();
+    std::vector<unsigned char> buf(rf.length);
+    buf.resize(reader.readFile(rf, &buf[0]));
+    return buf;
+}
+
+void test_resolved_read_matches_getfile() {
+    TEST("reading through a resolved file matches getFile");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    std::vector<std::string> names = packedNames();
+    names.push_back("image/bg01.png");
+    names.push_back("only_in_arc1.txt");
+    for (size_t i = 0; i < names.size(); i++) {
+        std::vector<unsigned char> data = readResolved(reader, names[i].c_str());
+        ASSERT_GT((int)data.size(), 0);
+        ASSERT_TRUE(data == readAll(reader, names[i].c_str()));
+    }
+    TEST_PASS();
+}
+
+void test_resolved_file_fields() {
+    TEST("a resolved file records location, compression and length");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    BaseReader::ResolvedFile rf;
+    ASSERT_TRUE(reader.resolveFile("packed/nbz03.bmp", &rf));
+    ASSERT_EQ(BaseReader::ARCHIVE_TYPE_NSA, rf.location);
+    ASSERT_EQ(BaseReader::NBZ_COMPRESSION, rf.compression_type);
+    ASSERT_EQ(30000 + 3 * 1000, (int)rf.length);
+    ASSERT_NOT_NULL(rf.ai);
+
+    size_t length = 0;
+    const unsigned char *view = reader.viewFile(rf, &length);
+    ASSERT_NULL(view);
+    ASSERT_TRUE(reader.resolveFile("image/bg01.png", &rf));
+    view = reader.viewFile(rf, &length);
+    ASSERT_TRUE(view == reader.getFileView("image/bg01.png", &length));
+
+    ASSERT_FALSE(reader.resolveFile("nothere.png", &rf));
+    TEST_PASS();
+}
+
+void test_resolved_loose_file() {
+    TEST("a loose file shadowing an archived one resolves to the loose file");
+    std::string dir = makeTempDir("resolve");
+    std::vector<Entry> arc(1, makeEntry("SHARED.TXT", makeData(8, 1)));
+    ASSERT_TRUE(writeNSA(dir + "arc.nsa", arc));
+    FILE *fp = fopen((dir + "Shared.Txt").c_str(), "wb");
+    fwrite("loose", 1, 5, fp);
+    fclose(fp);
+
+    NsaReader reader(0, (char*)dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    BaseReader::ResolvedFile rf;
+    ASSERT_TRUE(reader.resolveFile("shared.txt", &rf));
+    ASSERT_EQ(BaseReader::ARCHIVE_TYPE_NONE, rf.location);
+    ASSERT_NULL(rf.ai);
+    ASSERT_EQ(5, (int)rf.length);
+    unsigned char buf[8];
+    ASSERT_EQ(5, (int)reader.readFile(rf, buf));
+    ASSERT_TRUE(memcmp(buf, "loose", 5) == 0);
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+void test_encoded_files_roundtrip() {
+    TEST("entries written through encodeFile/putEncodedFile read back intact");
+    std::string dir = makeTempDir("encode");
+    std::vector<Entry> arc;
+    arc.push_back(makeEntry("A.WAV", makeData(5000, 1)));
+    arc.push_back(makeEntry("B.DAT", makeData(300, 2)));
+    arc.push_back(makeEntry("C.BMP", makeData(64, 3), BaseReader::LZSS_COMPRESSION, 200));
+    ASSERT_TRUE(writeNSA(dir + "src.nsa", arc));
+
+    NsaReader src;
+    ASSERT_EQ(0, src.openForConvert((char*)(dir + "src.nsa").c_str()));
+    std::vector<unsigned char> c = readAll(src, "C.BMP");
+    FILE *fp = fopen((dir + "arc.nsa").c_str(), "wb");
+    size_t offset = src.getFileByIndex(0).offset;
+    for (unsigned int i = 0; i < arc.size(); i++) {
+        BaseReader::FileInfo fi = src.getFileByIndex(i);
+        std::vector<unsigned char> data = readAll(src, fi.name);
+        SarReader::EncodedFile ef;
+        if (i == 0)
+            src.encodeFile(i, fi.length, data.size(), BaseReader::NBZ_COMPRESSION, true, &data[0], &ef);
+        else
+            src.encodeFile(i, fi.length, fi.original_length, fi.compression_type, false, &data[0], &ef);
+        offset += src.putEncodedFile(fp, i, offset, ef);
+    }
+    src.writeHeader(fp);
+    fclose(fp);
+
+    NsaReader reader(0, (char*)dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    ASSERT_TRUE(readAll(reader, "a.wav") == makeData(5000, 1));
+    ASSERT_TRUE(readAll(reader, "b.dat") == makeData(300, 2));
+    ASSERT_TRUE(readAll(reader, "c.bmp") == c);
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+static unsigned char g_key_table[256];
+
+// Random streams of many shapes, including ones that run out of bits early.
+static std::vector<Entry> decoderCorpus() {
+    std::vector<Entry> corpus;
+    for (int i = 0; i < 40; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "LZSS%02d.BMP", i);
+        Entry e = makeLZSSEntry(name, 1 + i * 997, 100 + i);
+        if (i % 5 == 4) e.data.resize(e.data.size() / 3); // truncated stream
+        corpus.push_back(e);
+        snprintf(name, sizeof(name), "SPB%02d.BMP", i);
+        corpus.push_back(makeSPBEntry(name, 1 + i * 7 % 61, 1 + i * 5 % 43, 200 + i));
+    }
+    return corpus;
+}
+
+static std::vector<unsigned char> legacyDecode(const Entry &e) {
+    if (e.compression_type == BaseReader::LZSS_COMPRESSION)
+        return LegacyDecoders::decodeLZSS(e.data, e.original_length);
+    return LegacyDecoders::decodeSPB(e.data);
+}
+
+static bool matchesLegacy(BaseReader &reader, const std::vector<Entry> &corpus) {
+    for (size_t i = 0; i < corpus.size(); i++) {
+        std::vector<unsigned char> expected = legacyDecode(corpus[i]);
+        size_t length = reader.getFileLength(corpus[i].name.c_str());
+        std::vector<unsigned char> buf(length + 16);
+        size_t got = reader.getFile(corpus[i].name.c_str(), &buf[0]);
+        buf.resize(got);
+        if (buf != expected) {
+            printf("\n    mismatch in %s ", corpus[i].name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_decoders_match_legacy() {
+    TEST("LZSS/SPB decoders match the bit-at-a-time reference");
+    std::string dir = makeTempDir("decoder");
+    ASSERT_TRUE(writeNSA(dir + "arc.nsa", decoderCorpus()));
+    NsaReader reader(0, (char*)dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    ASSERT_TRUE(matchesLegacy(reader, decoderCorpus()));
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+void test_decoders_match_legacy_with_key_table() {
+    TEST("LZSS/SPB decoders match the reference through a key table");
+    std::string dir = makeTempDir("decoder_key");
+    ASSERT_TRUE(writeNSA(dir + "arc.___", decoderCorpus(), g_key_table));
+    NsaReader reader(0, (char*)dir.c_str(), BaseReader::ARCHIVE_TYPE_NSA, g_key_table);
+    ASSERT_EQ(0, reader.open());
+    ASSERT_TRUE(matchesLegacy(reader, decoderCorpus()));
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+void test_decode_cache_hits() {
+    TEST("repeated reads of a compressed entry hit the decode cache");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    std::vector<unsigned char> first = readAll(reader, "packed\\nbz03.bmp");
+    for (int i = 0; i < 5; i++)
+        ASSERT_TRUE(readAll(reader, "packed\\nbz03.bmp") == first);
+    ASSERT_TRUE(first == makeData(30000 + 3 * 1000, 3));
+
+    BaseReader::DecodeCacheStats stats = reader.getDecodeCacheStats();
+    ASSERT_EQ(1, (int)stats.misses);
+    ASSERT_EQ(5, (int)stats.hits);
+    ASSERT_EQ((int)first.size(), (int)stats.bytes);
+
+    readAll(reader, "image\\bg01.png"); // stored entries bypass the cache
+    ASSERT_EQ(1, (int)reader.getDecodeCacheStats().misses);
+    TEST_PASS();
+}
+
+void test_decode_cache_eviction() {
+    TEST("decode cache evicts the least recently used entry within its budget");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    size_t lzss = reader.getFileLength("packed\\lzss01.bmp");
+    size_t spb = reader.getFileLength("packed\\spb06.bmp"); // larger than spb02
+    reader.setDecodeCacheSize(lzss + spb);
+
+    std::vector<unsigned char> a = readAll(reader, "packed\\lzss01.bmp");
+    std::vector<unsigned char> b = readAll(reader, "packed\\spb02.bmp");
+    readAll(reader, "packed\\lzss01.bmp");            // hit, now most recent
+    std::vector<unsigned char> c = readAll(reader, "packed\\spb06.bmp"); // evicts spb02
+
+    BaseReader::DecodeCacheStats stats = reader.getDecodeCacheStats();
+    ASSERT_EQ(1, (int)stats.hits);
+    ASSERT_EQ(3, (int)stats.misses);
+    ASSERT_EQ(1, (int)stats.evictions);
+    ASSERT_TRUE(stats.bytes <= stats.budget);
+
+    ASSERT_TRUE(readAll(reader, "packed\\lzss01.bmp") == a);
+    ASSERT_TRUE(readAll(reader, "packed\\spb06.bmp") == c);
+    ASSERT_TRUE(readAll(reader, "packed\\spb02.bmp") == b);
+    ASSERT_EQ(3, (int)reader.getDecodeCacheStats().hits);
+    ASSERT_EQ(4, (int)reader.getDecodeCacheStats().misses);
+    TEST_PASS();
+}
+
+void test_decode_cache_disabled() {
+    TEST("a zero budget disables the decode cache");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    reader.setDecodeCacheSize(0);
+    std::vector<unsigned char> a = readAll(reader, "packed\\spb06.bmp");
+    ASSERT_TRUE(readAll(reader, "packed\\spb06.bmp") == a);
+    BaseReader::DecodeCacheStats stats = reader.getDecodeCacheStats();
+    ASSERT_EQ(0, (int)(stats.hits + stats.misses));
+    ASSERT_EQ(0, (int)stats.bytes);
+    TEST_PASS();
+}
+
+static void touch(const std::string &path, size_t length) {
+    FILE *fp = fopen(path.c_str(), "wb");
+    std::vector<unsigned char> data = makeData(length, 9);
+    fwrite(&data[0], 1, length, fp);
+    fclose(fp);
+}
+
+void test_loose_file_lookup_ignores_case() {
+    TEST("loose files are found regardless of case in every path component");
+    std::string dir = makeTempDir("loose");
+    mkdir((dir + "Image").c_str(), 0755);
+    mkdir((dir + "Image/Sub").c_str(), 0755);
+    touch(dir + "Image/Sub/Bg01.Png", 11);
+    touch(dir + "Top.txt", 5);
+
+    DirectReader reader(dir.c_str());
+    ASSERT_EQ(11, (int)reader.getFileLength("image/sub/bg01.png"));
+    ASSERT_EQ(11, (int)reader.getFileLength("IMAGE\\SUB\\BG01.PNG"));
+    ASSERT_EQ(11, (int)reader.getFileLength("Image//Sub/Bg01.Png"));
+    ASSERT_EQ(5, (int)reader.getFileLength("top.TXT"));
+    ASSERT_EQ(0, (int)reader.getFileLength("image/nothere/bg01.png"));
+    ASSERT_EQ(0, (int)reader.getFileLength("top.txt/x"));
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+void test_loose_file_lookup_prefers_exact_case() {
+    TEST("an exact-case loose file wins over a case-folded match");
+    std::string dir = makeTempDir("loose_exact");
+    touch(dir + "a.txt", 3);
+    touch(dir + "A.TXT", 4);
+    DirectReader reader(dir.c_str());
+    ASSERT_EQ(3, (int)reader.getFileLength("a.txt"));
+    ASSERT_EQ(4, (int)reader.getFileLength("A.TXT"));
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+void test_loose_file_index_invalidation() {
+    TEST("files added after a lookup are seen once the index is invalidated");
+    std::string dir = makeTempDir("loose_new");
+    DirectReader reader(dir.c_str());
+    ASSERT_EQ(0, (int)reader.getFileLength("save1.dat"));
+    touch(dir + "SAVE1.DAT", 7);
+    ASSERT_EQ(0, (int)reader.getFileLength("save1.dat"));
+    reader.invalidateDirectoryIndex();
+    ASSERT_EQ(7, (int)reader.getFileLength("save1.dat"));
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+// Exposes the protected fopen() that NsaReader and friends open files with.
+struct WritingReader : public DirectReader {
+    WritingReader(const char *path) : DirectReader(path) {}
+    using DirectReader::fopen;
+};
+
+void test_loose_file_write_modes() {
+    TEST("files created through fopen() are seen without an explicit invalidation");
+    std::string dir = makeTempDir("loose_write");
+    touch(dir + "Config.Dat", 3);
+    WritingReader reader(dir.c_str());
+    const char *modes[] = {"w", "wb", "a", "ab+", "w+"};
+    for (int i = 0; i < 5; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "save%d.dat", i);
+        ASSERT_EQ(0, (int)reader.getFileLength(name)); // cached as missing
+        FILE *fp = reader.fopen(name, modes[i]);
+        ASSERT_TRUE(fp != NULL);
+        fwrite("saved", 1, 5, fp);
+        fclose(fp);
+        ASSERT_EQ(5, (int)reader.getFileLength(name));
+    }
+
+    // "r+" is a write mode too, and still finds an existing file of another case
+    FILE *fp = reader.fopen("config.dat", "r+");
+    ASSERT_TRUE(fp != NULL);
+    fwrite("abcdef", 1, 6, fp);
+    fclose(fp);
+    ASSERT_EQ(6, (int)reader.getFileLength("CONFIG.DAT"));
+    ASSERT_TRUE(reader.fopen("missing.dat", "r+") == NULL);
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+static std::vector<unsigned char> lz4Roundtrip(const std::vector<unsigned char> &data) {
+    std::vector<unsigned char> packed(lz4CompressBound(data.size()));
+    size_t n = lz4Compress(data.empty() ? NULL : &data[0], data.size(), &packed[0], packed.size());
+    std::vector<unsigned char> out(data.size() + 1);
+    size_t m = lz4Decompress(&packed[0], n, &out[0], out.size());
+    out.resize(m == (size_t)-1 ? 0 : m);
+    return out;
+}
+
+void test_lz4_roundtrip() {
+    TEST("LZ4 blocks of many shapes decompress to their input");
+    std::vector<unsigned char> text;
+    for (int i = 0; i < 20000; i++) text.push_back("the quick brown fox "[i % 20] + (i % 977 == 0));
+    ASSERT_TRUE(lz4Roundtrip(text) == text);
+    ASSERT_TRUE(lz4Roundtrip(makeData(70000, 3)) == makeData(70000, 3));
+    ASSERT_TRUE(lz4Roundtrip(std::vector<unsigned char>(100000, 7)) == std::vector<unsigned char>(100000, 7));
+    for (size_t len = 0; len < 40; len++)
+        ASSERT_TRUE(lz4Roundtrip(std::vector<unsigned char>(len, 'a')) == std::vector<unsigned char>(len, 'a'));
+    TEST_PASS();
+}
+
+void test_lz4_block_format() {
+    TEST("LZ4 decoder follows the block format and rejects bad offsets");
+    // "abc", then 9 bytes from 3 back (overlapping), then the literal "x"
+    const unsigned char block[] = {0x35, 'a', 'b', 'c', 0x03, 0x00, 0x10, 'x'};
+    unsigned char out[32];
+    ASSERT_EQ(13, (int)lz4Decompress(block, sizeof(block), out, sizeof(out)));
+    ASSERT_TRUE(memcmp(out, "abcabcabcabcx", 13) == 0);
+    ASSERT_TRUE(lz4Decompress(block, sizeof(block), out, 12) == (size_t)-1);
+
+    const unsigned char bad_offset[] = {0x35, 'a', 'b', 'c', 0x04, 0x00, 0x10, 'x'};
+    ASSERT_TRUE(lz4Decompress(bad_offset, sizeof(bad_offset), out, sizeof(out)) == (size_t)-1);
+    const unsigned char truncated[] = {0xf0, 0xff};
+    ASSERT_TRUE(lz4Decompress(truncated, sizeof(truncated), out, sizeof(out)) == (size_t)-1);
+    TEST_PASS();
+}
+
+// Copies every entry of the archives in src_dir into a NSX archive,
+// LZ4 compressing every other one.
+static bool writeNSX(const std::string &src_dir, const std::string &path) {
+    NsaReader src(0, (char*)src_dir.c_str());
+    NsxWriter writer;
+    if (src.open() != 0 || writer.open(path.c_str()) != 0) return false;
+    for (int i = 0; i < src.getNumFiles(); i++) {
+        BaseReader::FileInfo fi = src.getFileByIndex(i);
+        std::vector<unsigned char> data = readAll(src, fi.name);
+        NsxWriter::EncodedEntry ee;
+        NsxWriter::encodeEntry(data.empty() ? NULL : &data[0], data.size(), i % 2 == 0, &ee);
+        writer.putEntry(fi.name, ee);
+    }
+    return writer.close() == 0;
+}
+
+void test_nsx_matches_nsa() {
+    TEST("every entry converted to NSX reads back byte-exact and page aligned");
+    std::string dir = makeTempDir("nsx");
+    ASSERT_TRUE(writeNSX(g_dir, dir + "arc.nsx"));
+
+    NsaReader nsa(0, (char*)g_dir.c_str());
+    NsxReader nsx(0, (char*)dir.c_str());
+    ASSERT_EQ(0, nsa.open());
+    ASSERT_EQ(0, nsx.open());
+    ASSERT_STREQ("nsx", nsx.getArchiveName());
+
+    bool compressed = false;
+    for (int i = 0; i < nsa.getNumFiles(); i++) {
+        BaseReader::FileInfo fi = nsa.getFileByIndex(i);
+        BaseReader::ResolvedFile rf;
+        ASSERT_TRUE(nsx.resolveFile(fi.name, &rf));
+        ASSERT_EQ((int)BaseReader::ARCHIVE_TYPE_NSX, rf.location);
+        ASSERT_EQ(0, (int)(rf.offset % NSX_ALIGNMENT));
+        if (rf.compression_type == BaseReader::LZ4_COMPRESSION) compressed = true;
+
+        std::vector<unsigned char> expected = readAll(nsa, fi.name);
+        std::vector<unsigned char> buf(rf.length);
+        ASSERT_EQ(expected.size(), nsx.readFile(rf, &buf[0]));
+        ASSERT_TRUE(buf == expected);
+
+        size_t length = 0;
+        const unsigned char *view = nsx.viewFile(rf, &length);
+        if (view) {
+            ASSERT_EQ((int)BaseReader::NO_COMPRESSION, rf.compression_type);
+            ASSERT_TRUE(length == expected.size() && memcmp(view, &expected[0], length) == 0);
+        }
+    }
+    ASSERT_TRUE(compressed);
+    ASSERT_EQ(0, (int)nsx.getFileLength("not\there.png"));
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+void test_nsx_priority() {
+    TEST("loose files beat NSX entries, which beat NSA entries");
+    std::string dir = makeTempDir("nsx_priority");
+    std::vector<Entry> nsa;
+    nsa.push_back(makeEntry("SHARED.TXT", makeData(10, 1)));
+    nsa.push_back(makeEntry("NSA_ONLY.TXT", makeData(11, 2)));
+    nsa.push_back(makeEntry("LOOSE.TXT", makeData(12, 3)));
+    ASSERT_TRUE(writeNSA(dir + "arc.nsa", nsa));
+
+    NsxWriter writer;
+    ASSERT_EQ(0, writer.open((dir + "arc.nsx").c_str()));
+    std::vector<unsigned char> shared = makeData(20, 4);
+    NsxWriter::EncodedEntry ee;
+    NsxWriter::encodeEntry(&shared[0], shared.size(), true, &ee);
+    ASSERT_TRUE(writer.putEntry("shared.txt", ee));
+    ASSERT_FALSE(writer.putEntry("SHARED.TXT", ee));
+    NsxWriter::encodeEntry(&shared[0], shared.size(), false, &ee);
+    ASSERT_TRUE(writer.putEntry("LOOSE.TXT", ee));
+    ASSERT_EQ(0, writer.close());
+    touch(dir + "loose.txt", 5);
+
+    NsxReader reader(0, (char*)dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    int location = -1;
+    std::vector<unsigned char> buf(64);
+    ASSERT_EQ(20, (int)reader.getFile("shared.txt", &buf[0], &location));
+    ASSERT_EQ((int)BaseReader::ARCHIVE_TYPE_NSX, location);
+    ASSERT_TRUE(memcmp(&buf[0], &shared[0], 20) == 0);
+    ASSERT_EQ(11, (int)reader.getFile("nsa_only.txt", &buf[0], &location));
+    ASSERT_EQ((int)BaseReader::ARCHIVE_TYPE_NSA, location);
+    ASSERT_EQ(5, (int)reader.getFile("loose.txt", &buf[0], &location));
+    ASSERT_EQ((int)BaseReader::ARCHIVE_TYPE_NONE, location);
+
+    std::vector<unsigned char> junk = makeData(100, 5);
+    FILE *fp = fopen((dir + "arc1.nsx").c_str(), "wb");
+    fwrite(&junk[0], 1, junk.size(), fp);
+    fclose(fp);
+    NsxReader broken(0, (char*)dir.c_str());
+    ASSERT_EQ(0, broken.open()); // arc1.nsx is ignored
+    ASSERT_EQ(20, (int)broken.getFileLength("shared.txt"));
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+void test_nsx_surface() {
+    TEST("pre-decoded surfaces read back as pixels and as a BMP");
+    const int width = 3, height = 2, pitch = 16;
+    std::vector<unsigned char> pixels = makeData(pitch * height, 6);
+
+    std::string dir = makeTempDir("nsx_surface");
+    NsxWriter writer;
+    ASSERT_EQ(0, writer.open((dir + "arc.nsx").c_str()));
+    NsxWriter::EncodedEntry ee;
+    NsxWriter::encodeSurface(&pixels[0], width, height, pitch, NSX_FORMAT_ARGB8888, true, true, &ee);
+    ASSERT_TRUE(writer.putEntry("cg\\face.png", ee));
+    ASSERT_EQ(0, writer.close());
+
+    NsxReader reader(0, (char*)dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    BaseReader::ResolvedFile rf;
+    ASSERT_TRUE(reader.resolveFile("CG/FACE.PNG", &rf));
+    ASSERT_EQ((int)BaseReader::SURFACE_COMPRESSION, rf.compression_type);
+
+    BaseReader::SurfaceInfo si;
+    ASSERT_TRUE(reader.getSurfaceInfo(rf, &si));
+    ASSERT_EQ(width, si.width);
+    ASSERT_EQ(height, si.height);
+    ASSERT_EQ((unsigned int)NSX_FORMAT_ARGB8888, si.format);
+    ASSERT_TRUE(si.has_alpha);
+
+    std::vector<unsigned char> out(20 * height, 0);
+    ASSERT_TRUE(reader.readSurface(rf, &out[0], 20));
+    for (int y = 0; y < height; y++)
+        ASSERT_TRUE(memcmp(&out[20 * y], &pixels[pitch * y], width * 4) == 0);
+
+    std::vector<unsigned char> bmp = readAll(reader, "cg\\face.png");
+    ASSERT_EQ(122 + width * height * 4, (int)bmp.size());
+    ASSERT_TRUE(bmp[0] == 'B' && bmp[1] == 'M');
+    ASSERT_EQ(122, bmp[10]);
+    ASSERT_TRUE(memcmp(&bmp[122 + width * 4], &pixels[pitch], width * 4) == 0);
+    removeTempDir(dir);
+    TEST_PASS();
+}
+
+// Stored length of an archived entry, what the I/O thread reads ahead.
+static size_t storedLength(NsaReader &reader, const char *name) {
+    std::string capital = name;
+    for (size_t i = 0; i < capital.size(); i++) capital[i] = toupper(capital[i]);
+    for (int i = 0; i < reader.getNumFiles(); i++) {
+        BaseReader::FileInfo fi = reader.getFileByIndex(i);
+        if (capital == fi.name) return fi.length;
+    }
+    return 0;
+}
+
+// Polls until the I/O thread has accounted for every requested byte.
+static bool waitForPrefetch(BaseReader &reader, size_t bytes, size_t advised) {
+    for (int i = 0; i < 5000; i++) {
+        BaseReader::PrefetchStats stats = reader.getPrefetchStats();
+        if (stats.queue_depth == 0 && stats.bytes + stats.wasted_bytes == bytes && stats.advised == advised)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+void test_prefetch_serves_reads() {
+    TEST("prefetched entries are read from the readahead buffer");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    reader.setDecodeCacheSize(0);
+
+    // compressed entries go through readAt(), stored ones are mapped
+    std::vector<std::string> names, all = packedNames();
+    size_t bytes = 0, advised = 0;
+    for (size_t i = 0; i < all.size(); i++) {
+        if (i % 4 == 0) {
+#if defined(USE_MMAP_ARCHIVE)
+            advised++;
+#else
+            bytes += storedLength(reader, all[i].c_str());
+#endif
+        }
+        else bytes += storedLength(reader, all[i].c_str());
+        names.push_back(all[i]);
+    }
+    std::vector<std::vector<unsigned char> > expected;
+    for (size_t i = 0; i < names.size(); i++) expected.push_back(readAll(reader, names[i].c_str()));
+
+    reader.prefetch(names);
+    ASSERT_TRUE(waitForPrefetch(reader, bytes, advised));
+    ASSERT_EQ((int)names.size(), (int)reader.getPrefetchStats().requested);
+
+    for (size_t i = 0; i < names.size(); i++)
+        ASSERT_TRUE(readAll(reader, names[i].c_str()) == expected[i]);
+    BaseReader::PrefetchStats stats = reader.getPrefetchStats();
+    ASSERT_EQ((int)(names.size() - advised), (int)stats.hits);
+    ASSERT_EQ(0, (int)stats.wasted_bytes);
+    TEST_PASS();
+}
+
+void test_prefetch_budget() {
+    TEST("readahead stays within its budget and counts unread bytes as wasted");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    size_t a = storedLength(reader, "packed\\nbz03.bmp");
+    size_t b = storedLength(reader, "packed\\nbz07.bmp");
+    reader.setPrefetchSize(b);
+
+    std::vector<std::string> names;
+    names.push_back("packed\\nbz03.bmp"); // evicted by the next one
+    names.push_back("packed\\nbz07.bmp");
+    names.push_back("packed\\nothere.bmp");
+    reader.prefetch(names);
+    ASSERT_TRUE(waitForPrefetch(reader, a + b, 0));
+
+    BaseReader::PrefetchStats stats = reader.getPrefetchStats();
+    ASSERT_EQ((int)a, (int)stats.wasted_bytes);
+    ASSERT_EQ((int)b, (int)stats.bytes);
+    ASSERT_TRUE(readAll(reader, "packed\\nbz03.bmp") == makeData(30000 + 3 * 1000, 3));
+    ASSERT_EQ(0, (int)reader.getPrefetchStats().hits);
+
+    reader.setPrefetchSize(0); // drops what is left
+    stats = reader.getPrefetchStats();
+    ASSERT_EQ((int)(a + b), (int)stats.wasted_bytes);
+    ASSERT_EQ(0, (int)stats.bytes);
+    reader.prefetch(names);
+    ASSERT_EQ(3, (int)reader.getPrefetchStats().requested);
+    TEST_PASS();
+}
+
+void test_prefetch_concurrent_reads() {
+    TEST("reads racing the I/O thread stay byte-exact");
+    NsaReader reader(0, (char*)g_dir.c_str());
+    ASSERT_EQ(0, reader.open());
+    reader.setDecodeCacheSize(0);
+    std::vector<std::string> names = packedNames();
+    std::vector<std::vector<unsigned char> > expected;
+    for (size_t i = 0; i < names.size(); i++) expected.push_back(readAll(reader, names[i].c_str()));
+
+    for (int round = 0; round < 10; round++) {
+        reader.prefetch(names);
+        for (size_t i = 0; i < names.size(); i++) {
+            size_t k = (i * 5 + round) % names.size();
+            ASSERT_TRUE(readAll(reader, names[k].c_str()) == expected[k]);
+        }
+    }
+    TEST_PASS();
+}
+
+static bool setup() {
+    for (int i = 0; i < 256; i++) g_key_table[i] = i ^ 0x5a;
+
+    g_dir = makeTempDir("archive");
+    if (g_dir.empty()) return false;
+
+    std::vector<Entry> arc;
+    arc.push_back(makeEntry("IMAGE\\BG01.PNG", makeData(100, 7)));
+    arc.push_back(makeEntry("SHARED.TXT", makeData(8, 1)));
+    arc.push_back(makeEntry("PACKED.BMP", makeData(64, 5), BaseReader::LZSS_COMPRESSION, 200));
+    for (int i = 0; i < 5000; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "MANY\\FILE%05d.DAT", i);
+        arc.push_back(makeEntry(name, makeData(16 + i % 7, i)));
+    }
+
+    std::vector<std::string> packed = packedNames();
+    for (int i = 0; i < (int)packed.size(); i++) {
+        std::string name = packed[i];
+        for (size_t j = 0; j < name.size(); j++) name[j] = toupper(name[j]);
+        if (i % 4 == 0)      arc.push_back(makeEntry(name, makeData(20000 + i * 1000, i)));
+        else if (i % 4 == 1) arc.push_back(makeLZSSEntry(name, 20000 + i * 1000, i));
+        else if (i % 4 == 2) arc.push_back(makeSPBEntry(name, 61 + i, 47 + i, i));
+        else                 arc.push_back(makeNBZEntry(name, makeData(30000 + i * 1000, i)));
+    }
+
+    std::vector<Entry> arc1;
+    arc1.push_back(makeEntry("SHARED.TXT", makeData(12, 2)));
+    arc1.push_back(makeEntry("ONLY_IN_ARC1.TXT", makeData(33, 3)));
+
+    return writeNSA(g_dir + "arc.nsa", arc) && writeNSA(g_dir + "arc1.nsa", arc1);
+}
+
+void run_lookup_tests() {
+    TEST_SUITE_BEGIN("Archive Lookup Tests");
+    test_lookup_is_case_insensitive();
+    test_lookup_missing_file();
+    test_lookup_priority();
+    test_lookup_skips_empty_entries();
+    test_lookup_all_entries();
+    TEST_SUITE_END();
+}
+
+void run_view_tests() {
+    TEST_SUITE_BEGIN("Archive View Tests");
+    test_file_view_matches_getfile();
+    test_file_view_skips_compressed();
+    TEST_SUITE_END();
+}
+
+void run_resolve_tests() {
+    TEST_SUITE_BEGIN("Archive Resolved Lookup Tests");
+    test_resolved_read_matches_getfile();
+    test_resolved_file_fields();
+    test_resolved_loose_file();
+    TEST_SUITE_END();
+}
+
+void run_concurrency_tests() {
+    TEST_SUITE_BEGIN("Archive Concurrent Read Tests");
+    test_nbz_roundtrip();
+    test_concurrent_reads_are_byte_exact();
+    test_concurrent_first_lookups();
+    TEST_SUITE_END();
+}
+
+void run_decoder_tests() {
+    TEST_SUITE_BEGIN("Archive Decoder Equivalence Tests");
+    test_decoders_match_legacy();
+    test_decoders_match_legacy_with_key_table();
+    TEST_SUITE_END();
+}
+
+void run_convert_tests() {
+    TEST_SUITE_BEGIN("Archive Convert Tests");
+    test_encoded_files_roundtrip();
+    TEST_SUITE_END();
+}
+
+void run_decode_cache_tests() {
+    TEST_SUITE_BEGIN("Archive Decode Cache Tests");
+    test_decode_cache_hits();
+    test_decode_cache_eviction();
+    test_decode_cache_disabled();
+    TEST_SUITE_END();
+}
+
+void run_loose_file_tests() {
+    TEST_SUITE_BEGIN("Loose File Lookup Tests");
+    test_loose_file_lookup_ignores_case();
+    test_loose_file_lookup_prefers_exact_case();
+    test_loose_file_index_invalidation();
+    test_loose_file_write_modes();
+    TEST_SUITE_END();
+}
+
+void run_prefetch_tests() {
+    TEST_SUITE_BEGIN("Archive Prefetch Tests");
+    test_prefetch_serves_reads();
+    test_prefetch_budget();
+    test_prefetch_concurrent_reads();
+    TEST_SUITE_END();
+}
+
+void run_nsx_tests() {
+    TEST_SUITE_BEGIN("NSX Archive Tests");
+    test_lz4_roundtrip();
+    test_lz4_block_format();
+    test_nsx_matches_nsa();
+    test_nsx_priority();
+    test_nsx_surface();
+    TEST_SUITE_END();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+    printf("  Archive Reader Unit Tests\n");
+    printf("========================================\n");
+
+    if (!setup()) {
+        printf("failed to create test archives\n");
+        return 1;
+    }
+
+    run_lookup_tests();
+    run_view_tests();
+    run_resolve_tests();
+    run_concurrency_tests();
+    run_decoder_tests();
+    run_decode_cache_tests();
+    run_convert_tests();
+    run_loose_file_tests();
+    run_nsx_tests();
+    run_prefetch_tests();
+
+    removeTempDir(g_dir);
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
@@ -0,0 +1,186 @@
+#include "test_framework.h"
+#include "BandCompositor.h"
+#include "blend_kernels.h"
+#include "onscripter_harness.h"
+#include <atomic>
+#include <thread>
+
+static SDL_Rect rect(int x, int y, int w, int h) {
+    SDL_Rect r = {x, y, w, h};
+    return r;
+}
+
+void test_split_covers_clip() {
+    TEST("bands cover the clip top to bottom, none lower than MIN_BAND_HEIGHT");
+    SDL_Rect bands[MAX_COMPOSITOR_THREADS];
+    SDL_Rect clip = rect(16, 7, 1000, 701);
+    int n = BandCompositor::split(clip, 4, bands);
+    ASSERT_EQ(4, n);
+    int y = clip.y;
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(clip.x, bands[i].x);
+        ASSERT_EQ(clip.w, bands[i].w);
+        ASSERT_EQ(y, bands[i].y);
+        ASSERT_TRUE(bands[i].h >= MIN_BAND_HEIGHT);
+        y += bands[i].h;
+    }
+    ASSERT_EQ(clip.y + clip.h, y);
+
+    ASSERT_EQ(2, BandCompositor::split(rect(0, 0, 640, MIN_BAND_HEIGHT * 2 + 1), 4, bands));
+    ASSERT_EQ(1, BandCompositor::split(rect(0, 0, 640, MIN_BAND_HEIGHT - 1), 4, bands));
+    ASSERT_EQ(MIN_BAND_HEIGHT - 1, bands[0].h);
+    ASSERT_EQ(MAX_COMPOSITOR_THREADS, BandCompositor::split(rect(0, 0, 640, 4096), 64, bands));
+    TEST_PASS();
+}
+
+struct Calls {
+    std::atomic<int> count[MAX_COMPOSITOR_THREADS];
+    std::thread::id caller[MAX_COMPOSITOR_THREADS];
+};
+
+static void countBand(void *data, int band) {
+    Calls *calls = (Calls*)data;
+    calls->count[band]++;
+    calls->caller[band] = std::this_thread::get_id();
+}
+
+void test_run_calls_every_band_once() {
+    TEST("every band runs once per run(), the first on the caller");
+    BandCompositor bc;
+    bc.setThreads(4);
+    ASSERT_EQ(4, bc.getThreads());
+    for (int num = 4; num >= 1; num--) {
+        Calls calls;
+        for (int i = 0; i < MAX_COMPOSITOR_THREADS; i++) calls.count[i] = 0;
+        bc.run(num, countBand, &calls);
+        for (int i = 0; i < MAX_COMPOSITOR_THREADS; i++)
+            ASSERT_EQ(i < num ? 1 : 0, calls.count[i].load());
+        ASSERT_TRUE(calls.caller[0] == std::this_thread::get_id());
+        if (num > 1) ASSERT_TRUE(calls.caller[1] != std::this_thread::get_id());
+    }
+
+    Calls calls;
+    for (int i = 0; i < MAX_COMPOSITOR_THREADS; i++) calls.count[i] = 0;
+    bc.setThreads(1);
+    bc.run(4, countBand, &calls);
+    ASSERT_EQ(1, calls.count[0].load());
+    ASSERT_EQ(0, calls.count[1].load());
+    TEST_PASS();
+}
+
+// A screen of every kind of layer the bands split: a full screen sprite,
+// standing pictures, sprites above and below z_order, rotated sprite2,
+// some premultiplied, and text.
+static void setScene(ONScripterHarness &h) {
+    const int w = h.width, ht = h.height;
+    h.setImage(&h.sprites[900], -20, -10, w + 40, ht + 20, ONScripterHarness::TRANSLUCENT);
+    h.sprites[900].trans = 160;
+    for (int i = 0; i < 3; i++)
+        h.setImage(&h.tachi[i], w * (1 + 4 * i) / 16, ht / 16, w / 4, ht * 15 / 16, ONScripterHarness::MARGINS, i == 1);
+    h.setImage(&h.sprites2[3], w / 3, ht / 4, 120, 90, ONScripterHarness::TRANSLUCENT);
+    h.setAffine(&h.sprites2[3], 150, 80, 30);
+    h.setImage(&h.sprites2[7], w / 2, ht / 2, 64, 64, ONScripterHarness::OPAQUE, true);
+    h.setAffine(&h.sprites2[7], 100, 100, 45);
+    for (int i = 0; i < 20; i++) {
+        AnimationInfo *anim = &h.sprites[(i % 2) ? 600 + i : 10 + i];
+        h.setImage(anim, h.nextRandom() % (w - 20), h.nextRandom() % (ht - 20), 37, 41,
+                   (ONScripterHarness::Fill)(i % 3), i % 4 == 0);
+        anim->trans = i % 5 ? 255 : h.nextRandom() % 256;
+    }
+    h.z_order = 499;
+    SDL_Rect text = rect(w / 16, ht * 2 / 3, w - w / 8, ht / 4);
+    h.setText(text);
+}
+
+void test_bands_match_serial() {
+    TEST("refreshSurface() in bands gives the pixels of composing the clip at once");
+    ONScripterHarness serial(643, 487, 1), banded(643, 487, 4);
+    setScene(serial);
+    setScene(banded);
+    ASSERT_EQ(4, banded.getThreads());
+
+    SDL_Rect clips[] = { rect(0, 0, 643, 487), rect(3, 77, 401, 300), rect(0, 450, 643, 37) };
+    int modes[] = { ONScripterHarness::REFRESH_NORMAL,
+                    ONScripterHarness::REFRESH_NORMAL | ONScripterHarness::REFRESH_TEXT };
+    for (int windowback = 0; windowback < 2; windowback++)
+        for (int effect = 0; effect < 3; effect++)
+            for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+                for (size_t c = 0; c < sizeof(clips) / sizeof(clips[0]); c++) {
+                    ONScripterHarness *hs[] = { &serial, &banded };
+                    for (int k = 0; k < 2; k++) {
+                        ONScripterHarness &h = *hs[k];
+                        h.windowback = windowback;
+                        h.nega_mode = effect == 1 ? 1 : 0;
+                        if (effect == 2) h.setMonochrome(0xff, 0xc0, 0x80);
+                        else h.clearMonochrome();
+                        SDL_FillRect(h.screen(), NULL, 0);
+                        h.refresh(h.screen(), &clips[c], modes[m]);
+                    }
+                    ASSERT_TRUE(ONScripterHarness::pixels(serial.screen()) ==
+                                ONScripterHarness::pixels(banded.screen()));
+                }
+    TEST_PASS();
+}
+
+static void fillRandom(ONScripterHarness &h, SDL_Surface *surface) {
+    for (int j = 0; j < surface->h; j++)
+        for (int i = 0; i < surface->w; i++)
+            ((uint32_t *)((unsigned char *)surface->pixels + (size_t)j * surface->pitch))[i] = h.nextRandom();
+}
+
+void test_mask_blend_matches_rows() {
+    TEST("alphaBlend() with a mask gives the bytes of crossfading each row at once");
+    const int w = 643, ht = 40;
+    ONScripterHarness h(w, ht);
+    SDL_Surface *mask = AnimationInfo::allocSurface(w, 16, SDL_PIXELFORMAT_ARGB8888); // repeated down the screen
+    fillRandom(h, h.effectSrc());
+    fillRandom(h, h.effectDst());
+    fillRandom(h, mask);
+
+    SDL_Rect clip = rect(13, 3, w - 13, ht - 5);
+    int modes[] = { ONScripterHarness::ALPHA_BLEND_FADE_MASK, ONScripterHarness::ALPHA_BLEND_CROSSFADE_MASK };
+    for (int m = 0; m < 2; m++)
+        for (uint32_t value = 0; value <= 256; value += 64) {
+            SDL_FillRect(h.screen(), NULL, 0);
+            h.alphaBlend(mask, modes[m], value, &clip);
+
+            std::vector<uint32_t> ref = ONScripterHarness::pixels(h.screen());
+            std::vector<uint32_t> row_mask(clip.w);
+            for (int j = clip.y; j < clip.y + clip.h; j++) {
+                const uint32_t *mask_row = (const uint32_t *)mask->pixels + (size_t)w * (j % mask->h);
+                for (int i = 0; i < clip.w; i++) {
+                    uint32_t m2 = 0, a = mask_row[clip.x + i] & 0xff;
+                    if (value > a) m2 = value - a;
+                    // a fade goes all the way where the mask is below value
+                    if (m2 > 0xff || (m2 && modes[m] == ONScripterHarness::ALPHA_BLEND_FADE_MASK)) m2 = 0xff;
+                    row_mask[i] = m2 * 0x01010101;
+                }
+                size_t o = (size_t)w * j + clip.x;
+                blend_kernels->crossfade(&ref[o], (uint32_t *)h.effectSrc()->pixels + o,
+                                         (uint32_t *)h.effectDst()->pixels + o, &row_mask[0], clip.w);
+            }
+            ASSERT_TRUE(ONScripterHarness::pixels(h.screen()) == ref);
+        }
+    SDL_FreeSurface(mask);
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+    printf("  Band Compositor Unit Tests\n");
+    printf("========================================\n");
+
+    TEST_SUITE_BEGIN("Band Compositor Tests");
+    test_split_covers_clip();
+    test_run_calls_every_band_once();
+    test_bands_match_serial();
+    test_mask_blend_matches_rows();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
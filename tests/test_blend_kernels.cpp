@@ -0,0 +1,245 @@
+#include "test_framework.h"
+#include "legacy_kernels.h"
+#include "blend_kernels.h"
+#include <stdlib.h>
+#include <vector>
+
+typedef std::vector<uint32_t> Pixels;
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom() {
+    rng = rng * 1103515245 + 12345;
+    return (rng >> 8) ^ (rng << 24);
+}
+
+// Random colours with runs of transparent, opaque and translucent pixels.
+static Pixels makeSprite(size_t n) {
+    Pixels p(n);
+    uint32_t alpha = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t r = nextRandom();
+        if ((r & 7) == 0) alpha = (r >> 8) & 3 ? ((r >> 8) & 1) * 0xff : r >> 24;
+        p[i] = (alpha << 24) | (r & 0xffffff);
+    }
+    return p;
+}
+
+static Pixels makeScreen(size_t n) {
+    Pixels p(n);
+    for (size_t i = 0; i < n; i++) p[i] = nextRandom() | 0xff000000;
+    return p;
+}
+
+// Glyph coverage, mostly 0 and 255 with antialiased edges.
+static std::vector<uint8_t> makeGlyph(size_t n) {
+    std::vector<uint8_t> g(n);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t r = nextRandom();
+        g[i] = (r & 3) == 0 ? r >> 24 : ((r >> 2) & 1) * 255;
+    }
+    return g;
+}
+
+static const int widths[] = {1, 3, 4, 5, 8, 9, 16, 17, 31, 64, 641};
+static const int num_widths = sizeof(widths) / sizeof(widths[0]);
+static const int alphas[] = {255, 254, 128, 37, 1, 0};
+static const int num_alphas = sizeof(alphas) / sizeof(alphas[0]);
+
+// The legacy code of this binary is what the levels of its SIMD flags
+// have to give.
+static std::vector<const BlendKernels *> levelsToCheck() {
+#if defined(USE_SIMD_X86_AVX2)
+    static const int levels[] = {BLEND_KERNELS_AVX2};
+#elif defined(USE_SIMD_X86_SSE2) || defined(USE_SIMD_X86_SSSE3)
+    static const int levels[] = {BLEND_KERNELS_SSE2, BLEND_KERNELS_SSSE3};
+#elif defined(USE_SIMD_ARM_NEON)
+    static const int levels[] = {BLEND_KERNELS_NEON};
+#else
+    static const int levels[] = {BLEND_KERNELS_SCALAR};
+#endif
+    std::vector<const BlendKernels *> kernels;
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++)
+        if (isBlendKernelsSupported(levels[i])) kernels.push_back(blend_kernels_table[levels[i]]);
+    return kernels;
+}
+
+void test_blend_matches_legacy() {
+    TEST("blend gives the bytes of the old blendOnSurface loop");
+    std::vector<const BlendKernels *> levels = levelsToCheck();
+    ASSERT_TRUE(!levels.empty());
+    for (size_t l = 0; l < levels.size(); l++)
+        for (int w = 0; w < num_widths; w++)
+            for (int a = 0; a < num_alphas; a++) {
+                Pixels src = makeSprite(widths[w]), dst = makeScreen(widths[w]);
+                Pixels ref = dst;
+                LegacyKernels::blend(&ref[0], &src[0], widths[w], alphas[a]);
+#ifdef USE_SIMD
+                // but for the opaque pixels of its blocks, rounded at 255
+                if (alphas[a] == 255)
+                    for (int i = 0; i < widths[w]; i++)
+                        if (src[i] >= 0xff000000) ref[i] = src[i];
+#endif
+                levels[l]->blend(&dst[0], &src[0], widths[w], alphas[a]);
+                ASSERT_TRUE(dst == ref);
+            }
+    TEST_PASS();
+}
+
+void test_blend_from_any_start() {
+    TEST("blend gives a pixel the same from whichever pixel the row starts");
+    for (int level = 0; level < NUM_BLEND_KERNELS; level++) {
+        if (!isBlendKernelsSupported(level)) continue;
+        const BlendKernels *k = blend_kernels_table[level];
+        for (int a = 0; a < num_alphas; a++) {
+            Pixels src = makeSprite(64), screen = makeScreen(64);
+            Pixels whole = screen;
+            k->blend(&whole[0], &src[0], 64, alphas[a]);
+            for (int start = 1; start < 12; start++) {
+                Pixels part = screen;
+                k->blend(&part[start], &src[start], 64 - start, alphas[a]);
+                ASSERT_TRUE(Pixels(part.begin() + start, part.end()) == Pixels(whole.begin() + start, whole.end()));
+            }
+        }
+    }
+    TEST_PASS();
+}
+
+void test_copies_opaque() {
+    TEST("blend at 255 copies opaque pixels where copies_opaque says so");
+    for (int level = 0; level < NUM_BLEND_KERNELS; level++) {
+        if (!isBlendKernelsSupported(level)) continue;
+        const BlendKernels *k = blend_kernels_table[level];
+        for (int w = 0; w < num_widths; w++) {
+            Pixels src = makeScreen(widths[w]), dst = makeScreen(widths[w]);
+            k->blend(&dst[0], &src[0], widths[w], 255);
+            if (k->copies_opaque) ASSERT_TRUE(dst == src);
+        }
+        ASSERT_EQ(level != BLEND_KERNELS_SCALAR, k->copies_opaque);
+    }
+    TEST_PASS();
+}
+
+void test_add_blend_matches_legacy() {
+    TEST("addBlend gives the bytes of the old rainAddBlend32");
+    std::vector<const BlendKernels *> levels = levelsToCheck();
+    for (size_t l = 0; l < levels.size(); l++)
+        for (int w = 0; w < num_widths; w++) {
+            Pixels src = makeSprite(widths[w]), dst = makeScreen(widths[w]);
+            for (int i = 0; i < widths[w]; i += 3) src[i] = 0xff000000;
+            Pixels ref = dst;
+            LegacyKernels::addBlend(&ref[0], &src[0], widths[w]);
+            levels[l]->addBlend(&dst[0], &src[0], widths[w]);
+            ASSERT_TRUE(dst == ref);
+        }
+    TEST_PASS();
+}
+
+void test_crossfade_matches_legacy() {
+    TEST("crossfade and crossfadeConst give the bytes of the old alphaBlend");
+    std::vector<const BlendKernels *> levels = levelsToCheck();
+    for (size_t l = 0; l < levels.size(); l++)
+        for (int w = 0; w < num_widths; w++) {
+            Pixels src1 = makeScreen(widths[w]), src2 = makeScreen(widths[w]);
+            Pixels mask(widths[w]);
+            for (int i = 0; i < widths[w]; i++) mask[i] = (nextRandom() >> 24) * 0x01010101;
+            Pixels ref(widths[w]), dst(widths[w]);
+            LegacyKernels::crossfade(&ref[0], &src1[0], &src2[0], &mask[0], widths[w]);
+            levels[l]->crossfade(&dst[0], &src1[0], &src2[0], &mask[0], widths[w]);
+            ASSERT_TRUE(dst == ref);
+
+            for (int a = 0; a < num_alphas; a++) {
+                LegacyKernels::crossfadeConst(&ref[0], &src1[0], &src2[0], alphas[a], widths[w]);
+                levels[l]->crossfadeConst(&dst[0], &src1[0], &src2[0], alphas[a], widths[w]);
+                ASSERT_TRUE(dst == ref);
+            }
+        }
+    TEST_PASS();
+}
+
+void test_blend_text_matches_legacy() {
+    TEST("blendText of every level gives the bytes of the old text loop");
+    for (int i = 0; i < NUM_BLEND_KERNELS; i++) {
+        if (!isBlendKernelsSupported(i)) continue;
+        for (int w = 0; w < num_widths; w++) {
+            std::vector<uint8_t> glyph = makeGlyph(widths[w]);
+            Pixels dst = makeScreen(widths[w]);
+            uint32_t color = nextRandom() | 0xff000000;
+            Pixels ref = dst;
+            LegacyKernels::blendText(&ref[0], &glyph[0], widths[w], color);
+            blend_kernels_table[i]->blendText(&dst[0], &glyph[0], widths[w], color);
+            ASSERT_TRUE(dst == ref);
+        }
+    }
+    TEST_PASS();
+}
+
+void test_nega_monochrome_match_legacy() {
+    TEST("nega and monochrome of every level give the bytes of the old loops");
+    uint8_t color_lut[256][3];
+    const int color[3] = {0xff, 0xc0, 0x80};
+    for (int i = 0; i < 256; i++)
+        for (int k = 0; k < 3; k++) color_lut[i][k] = (color[k] * i) >> 8;
+    for (int i = 0; i < NUM_BLEND_KERNELS; i++) {
+        if (!isBlendKernelsSupported(i)) continue;
+        for (int w = 0; w < num_widths; w++) {
+            Pixels buf = makeScreen(widths[w]);
+            Pixels ref = buf;
+            LegacyKernels::nega(&ref[0], widths[w], 0x00ffffff);
+            blend_kernels_table[i]->nega(&buf[0], widths[w], 0x00ffffff);
+            ASSERT_TRUE(buf == ref);
+
+            for (int rshift = 0; rshift <= 16; rshift += 16) {
+                uint32_t lut[256];
+                for (int c = 0; c < 256; c++)
+                    lut[c] = color_lut[c][0] << rshift | color_lut[c][1] << 8 | color_lut[c][2] << (16 - rshift);
+                buf = makeScreen(widths[w]);
+                ref = buf;
+                LegacyKernels::monochrome(&ref[0], widths[w], rshift, color_lut);
+                blend_kernels_table[i]->monochrome(&buf[0], widths[w], rshift, lut);
+                ASSERT_TRUE(buf == ref);
+            }
+        }
+    }
+    TEST_PASS();
+}
+
+void test_set_blend_kernels() {
+    TEST("setBlendKernels takes the supported levels by name and auto");
+    const BlendKernels *best = blend_kernels;
+    ASSERT_TRUE(best != NULL);
+    ASSERT_TRUE(setBlendKernels("scalar"));
+    ASSERT_TRUE(blend_kernels == blend_kernels_table[BLEND_KERNELS_SCALAR]);
+    ASSERT_TRUE(!setBlendKernels("mmx"));
+    ASSERT_TRUE(blend_kernels == blend_kernels_table[BLEND_KERNELS_SCALAR]);
+    for (int i = 0; i < NUM_BLEND_KERNELS; i++) {
+        if (blend_kernels_table[i] == NULL) continue;
+        ASSERT_EQ(isBlendKernelsSupported(i), setBlendKernels(blend_kernels_table[i]->name));
+    }
+    ASSERT_TRUE(setBlendKernels("auto"));
+    ASSERT_TRUE(blend_kernels == best);
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+    printf("  Blend Kernels Unit Tests\n");
+    printf("========================================\n");
+
+    TEST_SUITE_BEGIN("Blend Kernels Tests");
+    test_blend_matches_legacy();
+    test_blend_from_any_start();
+    test_copies_opaque();
+    test_add_blend_matches_legacy();
+    test_crossfade_matches_legacy();
+    test_blend_text_matches_legacy();
+    test_nega_monochrome_match_legacy();
+    test_set_blend_kernels();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
@@ -0,0 +1,106 @@
+#include "test_framework.h"
+#include "DirtyRect.h"
+
+static SDL_Rect rect(int x, int y, int w, int h) {
+    SDL_Rect r = {x, y, w, h};
+    return r;
+}
+
+static int area(const DirtyRect &d) {
+    int a = 0;
+    for (int i = 0; i < d.num_rects; i++) a += d.rects[i].w * d.rects[i].h;
+    return a;
+}
+
+static bool sameRect(const SDL_Rect &a, const SDL_Rect &b) {
+    return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+void test_distant_rects_kept_apart() {
+    TEST("a cursor and a sprite in opposite corners stay two rects");
+    DirtyRect d;
+    d.setDimension(1280, 720);
+    d.add(rect(0, 0, 100, 100));
+    d.add(rect(1250, 690, 20, 20));
+    ASSERT_EQ(2, d.num_rects);
+    ASSERT_EQ(100 * 100 + 20 * 20, area(d));
+    ASSERT_TRUE(sameRect(rect(0, 0, 1270, 710), d.bounding_box));
+    TEST_PASS();
+}
+
+void test_overlapping_and_adjacent_merged() {
+    TEST("overlapping and adjacent rects are merged, in chains");
+    DirtyRect d;
+    d.setDimension(1280, 720);
+    d.add(rect(0, 0, 10, 10));
+    d.add(rect(100, 0, 10, 10));
+    d.add(rect(5, 5, 10, 10));
+    ASSERT_EQ(2, d.num_rects);
+    d.add(rect(110, 0, 10, 10)); // touches the second one
+    ASSERT_EQ(2, d.num_rects);
+    d.add(rect(15, 0, 85, 1));   // bridges both
+    ASSERT_EQ(1, d.num_rects);
+    ASSERT_TRUE(sameRect(rect(0, 0, 120, 15), d.rects[0]));
+    TEST_PASS();
+}
+
+void test_falls_back_to_bounding_box() {
+    TEST("too many rects, or rects covering most of their box, become the box");
+    DirtyRect d;
+    d.setDimension(1280, 720);
+    for (int i = 0; i < MAX_DIRTY_RECTS; i++) d.add(rect(i * 100, i * 50, 10, 10));
+    ASSERT_EQ(MAX_DIRTY_RECTS, d.num_rects);
+    d.add(rect(1000, 600, 10, 10));
+    ASSERT_EQ(1, d.num_rects);
+    ASSERT_TRUE(sameRect(d.bounding_box, d.rects[0]));
+
+    d.clear();
+    ASSERT_EQ(0, d.num_rects);
+    d.add(rect(0, 0, 100, 100));
+    d.add(rect(0, 102, 100, 100));
+    ASSERT_EQ(1, d.num_rects);
+    ASSERT_TRUE(sameRect(rect(0, 0, 100, 202), d.rects[0]));
+    TEST_PASS();
+}
+
+void test_clipping_fill_and_copy() {
+    TEST("rects are clipped to the screen, fill covers it, copies keep the rects");
+    DirtyRect d;
+    d.setDimension(640, 480);
+    d.add(rect(-10, -10, 20, 20));
+    d.add(rect(630, 470, 50, 50));
+    d.add(rect(700, 0, 10, 10));
+    d.add(rect(0, 0, 0, 10));
+    ASSERT_EQ(2, d.num_rects);
+    ASSERT_TRUE(sameRect(rect(0, 0, 10, 10), d.rects[0]));
+    ASSERT_TRUE(sameRect(rect(630, 470, 10, 10), d.rects[1]));
+
+    DirtyRect copy = d;
+    d.fill(640, 480);
+    ASSERT_EQ(1, d.num_rects);
+    ASSERT_TRUE(sameRect(rect(0, 0, 640, 480), d.rects[0]));
+    ASSERT_EQ(2, copy.num_rects);
+    copy = d;
+    ASSERT_EQ(1, copy.num_rects);
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+    printf("  Dirty Rect Unit Tests\n");
+    printf("========================================\n");
+
+    TEST_SUITE_BEGIN("Dirty Rect Tests");
+    test_distant_rects_kept_apart();
+    test_overlapping_and_adjacent_merged();
+    test_falls_back_to_bounding_box();
+    test_clipping_fill_and_copy();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
@@ -0,0 +1,224 @@
+#include "test_framework.h"
+#include "legacy_alpha.h"
+#include "image_alpha.h"
+#include <vector>
+
+typedef std::vector<uint32_t> Pixels;
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom() {
+    rng = rng * 1103515245 + 12345;
+    return (rng >> 8) ^ (rng << 24);
+}
+
+// A few colours, so that colour keys match, with random alpha bytes.
+static Pixels makePixels(size_t n) {
+    static const uint32_t palette[4] = {0x000000, 0xffffff, 0x123456, 0xff00ff};
+    Pixels p(n);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t r = nextRandom();
+        p[i] = (r & 0xff000000) | ((r & 0x30) ? (r & 0xffffff) : palette[r & 3]);
+    }
+    return p;
+}
+
+static const int widths[] = {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 641};
+static const int num_widths = sizeof(widths) / sizeof(widths[0]);
+
+void test_halves() {
+    TEST("TRANS_ALPHA halves match the per-pixel loop");
+    for (int wi = 0; wi < num_widths; wi++)
+        for (int cells = 1; cells <= 4; cells++) {
+            int w = widths[wi] * cells + (wi & 1), h = 3;
+            int w3 = w / cells / 2 * cells;
+            Pixels src = makePixels(w * h);
+            Pixels ref(w3 * h + 1, 0xdeadbeef), out(w3 * h + 1, 0xdeadbeef);
+            LegacyAlpha::halves(&ref[0], &src[0], w, h, cells);
+            setupAlphaFromHalves(&out[0], &src[0], w, h, cells);
+            ASSERT_TRUE(ref == out);
+        }
+    TEST_PASS();
+}
+
+void test_mask() {
+    TEST("TRANS_MASK matches the per-pixel loop, wrapping masks included");
+    const int mask_sizes[][2] = {{1, 1}, {3, 2}, {16, 5}, {40, 7}, {700, 3}};
+    for (int wi = 0; wi < num_widths; wi++)
+        for (int cells = 1; cells <= 3; cells++)
+            for (int m = 0; m < 5; m++) {
+                int w = widths[wi] * cells + (wi & 1), h = 6;
+                int mw = mask_sizes[m][0], mh = mask_sizes[m][1];
+                // the loop reads up to a row and a pixel past the mask
+                Pixels mask = makePixels(mw * (mh + 1) + 1);
+                Pixels ref = makePixels(w * h), out = ref;
+                LegacyAlpha::mask(&ref[0], w, h, cells, &mask[0], mw, mh);
+                setupAlphaFromMask(&out[0], w, h, cells, &mask[0], mw, mh);
+                ASSERT_TRUE(ref == out);
+            }
+    TEST_PASS();
+}
+
+void test_color_key() {
+    TEST("TRANS_TOPLEFT/TOPRIGHT/DIRECT colour keys match the per-pixel loop");
+    for (int wi = 0; wi < num_widths; wi++) {
+        int n = widths[wi] * 5;
+        Pixels ref = makePixels(n);
+        uint32_t keys[3] = {ref[0], ref[widths[wi] - 1], 0xff00ff};
+        for (int k = 0; k < 3; k++) {
+            Pixels src = ref, out = ref;
+            LegacyAlpha::colorKey(&src[0], n, keys[k]);
+            setupAlphaFromColorKey(&out[0], n, keys[k]);
+            ASSERT_TRUE(src == out);
+        }
+    }
+    TEST_PASS();
+}
+
+void test_opaque() {
+    TEST("TRANS_COPY matches the per-pixel loop");
+    for (int wi = 0; wi < num_widths; wi++) {
+        int n = widths[wi] * 3;
+        Pixels ref = makePixels(n), out = ref;
+        LegacyAlpha::opaque(&ref[0], n);
+        setupAlphaOpaque(&out[0], n);
+        ASSERT_TRUE(ref == out);
+    }
+    TEST_PASS();
+}
+
+void test_unaligned() {
+    TEST("kernels leave the pixels around an unaligned run untouched");
+    Pixels ref = makePixels(64), out = ref;
+    LegacyAlpha::colorKey(&ref[3], 37, ref[3]);
+    setupAlphaFromColorKey(&out[3], 37, out[3]);
+    ASSERT_TRUE(ref == out);
+    LegacyAlpha::opaque(&ref[1], 21);
+    setupAlphaOpaque(&out[1], 21);
+    ASSERT_TRUE(ref == out);
+    TEST_PASS();
+}
+
+// Cells of transparent pixels around a box of translucent pixels, then opaque
+// and transparent ones.
+void test_scan_alpha() {
+    TEST("scanAlpha finds the box with alpha over all cells, and opaque images");
+    for (int wi = 0; wi < num_widths; wi++)
+        for (int cells = 1; cells <= 3; cells++) {
+            int cw = widths[wi], w = cw * cells, h = 5, pitch = w + 3;
+            Pixels p(pitch * h, 0x00ffffff);
+            int x1 = cw, x2 = 0, y1 = h, y2 = 0;
+            for (int c = 0; c < cells; c++) {
+                int bx = nextRandom() % cw, by = nextRandom() % h;
+                int bw = 1 + nextRandom() % (cw - bx), bh = 1 + nextRandom() % (h - by);
+                for (int y = by; y < by + bh; y++)
+                    for (int x = bx; x < bx + bw; x++)
+                        p[y * pitch + cw * c + x] = (nextRandom() & 0x7fffffff) | 0x01000000;
+                if (x1 > bx) x1 = bx;
+                if (x2 < bx + bw) x2 = bx + bw;
+                if (y1 > by) y1 = by;
+                if (y2 < by + bh) y2 = by + bh;
+            }
+            AlphaBounds b;
+            scanAlpha(&p[0], w, h, pitch, cells, &b);
+            ASSERT_EQ(x1, b.x);
+            ASSERT_EQ(y1, b.y);
+            ASSERT_EQ(x2 - x1, b.w);
+            ASSERT_EQ(y2 - y1, b.h);
+            ASSERT_TRUE(!b.transparent);
+            ASSERT_TRUE(!b.opaque);
+
+            for (int y = 0; y < h; y++)
+                for (int x = 0; x < w; x++) p[y * pitch + x] |= 0xff000000;
+            scanAlpha(&p[0], w, h, pitch, cells, &b);
+            ASSERT_TRUE(b.opaque);
+            ASSERT_EQ(cw, b.w);
+            p[(h - 1) * pitch + w - 1] &= 0xfeffffff;
+            scanAlpha(&p[0], w, h, pitch, cells, &b);
+            ASSERT_TRUE(!b.opaque);
+
+            for (int y = 0; y < h; y++)
+                for (int x = 0; x < w; x++) p[y * pitch + x] &= 0x00ffffff;
+            scanAlpha(&p[0], w, h, pitch, cells, &b);
+            ASSERT_TRUE(b.transparent && !b.opaque);
+            ASSERT_EQ(0, b.w);
+        }
+    TEST_PASS();
+}
+
+// Key pixels, in rows 2..h-3 only, and three other colours far enough apart
+// that scaling by an alpha of 16 or more never makes them equal; half the
+// non-key pixels are transparent.
+static Pixels makeGradationPixels(int w, int h, uint32_t key) {
+    static const uint32_t palette[3] = {0x000000, 0xffffff, 0xff00ff};
+    Pixels p(w * h);
+    for (int i = 0; i < w * h; i++) {
+        uint32_t r = nextRandom();
+        uint32_t a = 16 + (r >> 24) % 240;
+        int row = i / w;
+        if (row >= 2 && row < h - 2 && (r & 3) == 0) p[i] = a << 24 | key;
+        else p[i] = ((r & 4) ? a << 24 : 0) | palette[(r >> 4) % 3];
+    }
+    return p;
+}
+
+void test_gradation() {
+    TEST("sp_rgb_gradation matches the per-pixel loop");
+    for (int wi = 0; wi < num_widths; wi++) {
+        int w = widths[wi], h = 9;
+        Pixels ref = makeGradationPixels(w, h, 0x123456);
+        Pixels src = ref, out = ref;
+        LegacyAlpha::gradation(&src[0], w, h, 0x123456, 0x204080, 0xf0e0d0, 200);
+        paintColorKeyGradation(&out[0], w, h, w, 0x123456, 0x204080, 0xf0e0d0, 200, false);
+        ASSERT_TRUE(src == out);
+    }
+    TEST_PASS();
+}
+
+void test_gradation_premultiplied() {
+    TEST("sp_rgb_gradation on a premultiplied image premultiplies the straight result");
+    const uint8_t alphas[] = {255, 200, 37, 0};
+    for (int wi = 0; wi < num_widths; wi++) {
+        int w = widths[wi], h = 9;
+        for (int k = 0; k < 4; k++) {
+            Pixels straight = makeGradationPixels(w, h, 0x123456);
+            Pixels pm = straight;
+            premultiplyAlpha(&pm[0], w * h);
+
+            paintColorKeyGradation(&straight[0], w, h, w, 0x123456, 0x102030, 0xfff0e0, alphas[k], false);
+            premultiplyAlpha(&straight[0], w * h);
+            paintColorKeyGradation(&pm[0], w, h, w, 0x123456, 0x102030, 0xfff0e0, alphas[k], true);
+            ASSERT_TRUE(straight == pm);
+        }
+    }
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+#if defined(USE_SIMD_X86_AVX2)
+    printf("  Image Alpha Unit Tests (AVX2)\n");
+#elif defined(USE_SIMD)
+    printf("  Image Alpha Unit Tests (SIMD)\n");
+#else
+    printf("  Image Alpha Unit Tests (scalar)\n");
+#endif
+    printf("========================================\n");
+
+    TEST_SUITE_BEGIN("Image Alpha Tests");
+    test_halves();
+    test_mask();
+    test_color_key();
+    test_opaque();
+    test_unaligned();
+    test_scan_alpha();
+    test_gradation();
+    test_gradation_premultiplied();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
@@ -0,0 +1,163 @@
+#include "test_framework.h"
+#include "legacy_blend.h"
+#include "image_alpha.h"
+#include "image_blend.h"
+#include <stdlib.h>
+#include <vector>
+
+typedef std::vector<uint32_t> Pixels;
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom() {
+    rng = rng * 1103515245 + 12345;
+    return (rng >> 8) ^ (rng << 24);
+}
+
+// Random colours with runs of transparent, opaque and translucent pixels.
+static Pixels makeSprite(size_t n) {
+    Pixels p(n);
+    uint32_t alpha = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t r = nextRandom();
+        if ((r & 7) == 0) alpha = (r >> 8) & 3 ? ((r >> 8) & 1) * 0xff : r >> 24;
+        p[i] = (alpha << 24) | (r & 0xffffff);
+    }
+    return p;
+}
+
+static Pixels makeScreen(size_t n) {
+    Pixels p(n);
+    for (size_t i = 0; i < n; i++) p[i] = nextRandom() | 0xff000000;
+    return p;
+}
+
+static int maxDifference(const Pixels &a, const Pixels &b) {
+    int diff = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        for (int shift = 0; shift < 32; shift += 8) {
+            int d = abs((int)((a[i] >> shift) & 0xff) - (int)((b[i] >> shift) & 0xff));
+            if (diff < d) diff = d;
+        }
+    return diff;
+}
+
+static const int widths[] = {1, 3, 4, 5, 8, 9, 16, 17, 31, 64, 641};
+static const int num_widths = sizeof(widths) / sizeof(widths[0]);
+static const int alphas[] = {255, 254, 128, 37, 1, 0};
+static const int num_alphas = sizeof(alphas) / sizeof(alphas[0]);
+
+void test_premultiply() {
+    TEST("premultiplyAlpha rounds color*alpha/255 and keeps the alpha");
+    Pixels p(256 * 256);
+    for (uint32_t a = 0; a < 256; a++)
+        for (uint32_t c = 0; c < 256; c++)
+            p[a * 256 + c] = (a << 24) | (c << 16) | ((255 - c) << 8) | (c ^ 0x5a);
+    Pixels ref = p;
+    premultiplyAlpha(&p[0], (int)p.size());
+    for (size_t i = 0; i < p.size(); i++) {
+        uint32_t a = ref[i] >> 24, expected = ref[i] & 0xff000000;
+        for (int shift = 0; shift < 24; shift += 8)
+            expected |= ((((ref[i] >> shift) & 0xff) * a * 2 + 255) / 510) << shift;
+        ASSERT_EQ(expected, p[i]);
+    }
+    TEST_PASS();
+}
+
+void test_blend_matches_straight() {
+    TEST("premultiplied blending gives the straight-alpha picture within 2");
+    for (int wi = 0; wi < num_widths; wi++)
+        for (int ai = 0; ai < num_alphas; ai++) {
+            int n = widths[wi];
+            Pixels src = makeSprite(n), pm = src;
+            premultiplyAlpha(&pm[0], n);
+            Pixels ref = makeScreen(n), out = ref;
+            LegacyBlend::blend(&ref[0], &src[0], n, alphas[ai]);
+            blendPremultiplied(&out[0], &pm[0], n, alphas[ai]);
+            ASSERT_TRUE(maxDifference(ref, out) <= 2);
+        }
+    TEST_PASS();
+}
+
+void test_blend_spans() {
+    TEST("skipped and copied spans give the same bytes as the pixel loop");
+    for (int wi = 0; wi < num_widths; wi++)
+        for (int ai = 0; ai < num_alphas; ai++) {
+            int n = widths[wi];
+            Pixels pm = makeSprite(n);
+            premultiplyAlpha(&pm[0], n);
+            Pixels ref = makeScreen(n), out = ref;
+            // a single pixel goes through the scalar tail
+            for (int i = 0; i < n; i++)
+                blendPremultiplied(&ref[i], &pm[i], 1, alphas[ai]);
+            blendPremultiplied(&out[0], &pm[0], n, alphas[ai]);
+            ASSERT_TRUE(ref == out);
+        }
+
+    Pixels clear(16, 0), screen = makeScreen(16), out = screen;
+    blendPremultiplied(&out[0], &clear[0], 16, 255);
+    ASSERT_TRUE(screen == out);
+    Pixels opaque = makeScreen(16);
+    blendPremultiplied(&out[0], &opaque[0], 16, 255);
+    ASSERT_TRUE(opaque == out);
+    TEST_PASS();
+}
+
+void test_blend_copies_opaque() {
+    TEST("blending at 255 copies opaque pixels and leaves transparent ones");
+    for (int wi = 0; wi < num_widths; wi++) {
+        int n = widths[wi];
+        Pixels pm = makeSprite(n);
+        premultiplyAlpha(&pm[0], n);
+        Pixels screen = makeScreen(n), out = screen;
+        blendPremultiplied(&out[0], &pm[0], n, 255);
+        for (int i = 0; i < n; i++) {
+            if (pm[i] >= 0xff000000) ASSERT_EQ(pm[i], out[i]);
+            if (pm[i] < 0x01000000) ASSERT_EQ(screen[i], out[i]);
+        }
+    }
+    TEST_PASS();
+}
+
+void test_add_sub_match_straight() {
+    TEST("premultiplied add and sub give the straight-alpha picture within 3");
+    for (int wi = 0; wi < num_widths; wi++)
+        for (int ai = 0; ai < num_alphas; ai++) {
+            int n = widths[wi];
+            Pixels src = makeSprite(n), pm = src;
+            premultiplyAlpha(&pm[0], n);
+            Pixels screen = makeScreen(n);
+
+            // the old loops scale opaque pixels by 254/256
+            Pixels ref = screen, out = screen;
+            LegacyBlend::addBlend(&ref[0], &src[0], n, alphas[ai]);
+            addBlendPremultiplied(&out[0], &pm[0], n, alphas[ai]);
+            ASSERT_TRUE(maxDifference(ref, out) <= 3);
+
+            ref = out = screen;
+            LegacyBlend::subBlend(&ref[0], &src[0], n, alphas[ai]);
+            subBlendPremultiplied(&out[0], &pm[0], n, alphas[ai]);
+            ASSERT_TRUE(maxDifference(ref, out) <= 3);
+        }
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+    printf("  Premultiplied Blend Unit Tests\n");
+    printf("========================================\n");
+
+    TEST_SUITE_BEGIN("Premultiplied Blend Tests");
+    test_premultiply();
+    test_blend_matches_straight();
+    test_blend_spans();
+    test_blend_copies_opaque();
+    test_add_sub_match_straight();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
@@ -0,0 +1,240 @@
+#include "test_framework.h"
+#include "image_jpeg.h"
+#include "tool/conv_shared.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <jpeglib.h>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+// A smooth RGB gradient, encoded at high quality.
+static Bytes encode(int w, int h) {
+    Bytes rgb(w * h * 3);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            unsigned char *p = &rgb[(y * w + x) * 3];
+            p[0] = x * 255 / w;
+            p[1] = y * 255 / h;
+            p[2] = (x + y) * 255 / (w + h);
+        }
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    unsigned char *out = NULL;
+    unsigned long out_size = 0;
+    jpeg_mem_dest(&cinfo, &out, &out_size);
+    cinfo.image_width = w;
+    cinfo.image_height = h;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 95, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = &rgb[cinfo.next_scanline * w * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    Bytes data(out, out + out_size);
+    free(out);
+    return data;
+}
+
+static std::vector<uint32_t> decode(const Bytes &data, int denom, int w, int h) {
+    std::vector<uint32_t> pixels(w * h, 0);
+    if (!decodeJPEGScaled(&data[0], data.size(), denom, &pixels[0], w * 4, 16, 8, 0))
+        pixels.clear();
+    return pixels;
+}
+
+static int channel(uint32_t p, int c) {
+    return (p >> (16 - c * 8)) & 0xff;
+}
+
+void test_detect() {
+    TEST("JPEG data is recognized, anything else is left alone");
+    Bytes data = encode(64, 32);
+    ASSERT_TRUE(isJPEG(&data[0], data.size()));
+    const unsigned char png[] = {0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a};
+    ASSERT_TRUE(!isJPEG(png, sizeof(png)));
+    ASSERT_TRUE(!isJPEG(&data[0], 2));
+
+    int w, h;
+    ASSERT_EQ(0, getJPEGScaleDenom(png, sizeof(png), 8, 1, &w, &h));
+    Bytes truncated(data.begin(), data.begin() + 20);
+    ASSERT_EQ(0, getJPEGScaleDenom(&truncated[0], truncated.size(), 8, 1, &w, &h));
+    TEST_PASS();
+}
+
+void test_scale_denom() {
+    TEST("the largest exact scale up to max_denom is chosen");
+    Bytes data = encode(1280, 720);
+    int w, h;
+    ASSERT_EQ(8, getJPEGScaleDenom(&data[0], data.size(), 8, 1, &w, &h));
+    ASSERT_EQ(160, w);
+    ASSERT_EQ(90, h);
+    ASSERT_EQ(4, getJPEGScaleDenom(&data[0], data.size(), 4, 1, &w, &h));
+    ASSERT_EQ(320, w);
+    ASSERT_EQ(1, getJPEGScaleDenom(&data[0], data.size(), 1, 1, &w, &h));
+    ASSERT_EQ(1280, w);
+    ASSERT_EQ(720, h);
+
+    // 3 cells of 1280/3 pixels can't be kept exact
+    ASSERT_EQ(1, getJPEGScaleDenom(&data[0], data.size(), 8, 3, &w, &h));
+    // 2 cells, halved by TRANS_ALPHA
+    ASSERT_EQ(8, getJPEGScaleDenom(&data[0], data.size(), 8, 4, &w, &h));
+
+    data = encode(200, 100);
+    ASSERT_EQ(4, getJPEGScaleDenom(&data[0], data.size(), 8, 1, &w, &h));
+    ASSERT_EQ(50, w);
+    ASSERT_EQ(25, h);
+    ASSERT_EQ(2, getJPEGScaleDenom(&data[0], data.size(), 8, 4, &w, &h));
+    TEST_PASS();
+}
+
+void test_full_size() {
+    TEST("pixels are opaque with the colors at the given shifts");
+    Bytes data = encode(64, 32);
+    std::vector<uint32_t> p = decode(data, 1, 64, 32);
+    ASSERT_EQ(64 * 32, (int)p.size());
+    int max_diff = 0;
+    for (int y = 0; y < 32; y++)
+        for (int x = 0; x < 64; x++) {
+            uint32_t c = p[y * 64 + x];
+            ASSERT_EQ(0xffu, c >> 24);
+            int expect[3] = {x * 255 / 64, y * 255 / 32, (x + y) * 255 / 96};
+            for (int k = 0; k < 3; k++)
+                max_diff = std::max(max_diff, abs(channel(c, k) - expect[k]));
+        }
+    ASSERT_TRUE(max_diff <= 8);
+
+    std::vector<uint32_t> q(64 * 32);
+    ASSERT_TRUE(decodeJPEGScaled(&data[0], data.size(), 1, &q[0], 64 * 4, 0, 8, 16));
+    for (int i = 0; i < 64 * 32; i++)
+        ASSERT_EQ(p[i], (q[i] & 0xff00ff00) | (q[i] & 0xff) << 16 | (q[i] >> 16 & 0xff));
+    TEST_PASS();
+}
+
+void test_reduced() {
+    TEST("reduced decodes are close to the average of the full size");
+    Bytes data = encode(256, 128);
+    std::vector<uint32_t> full = decode(data, 1, 256, 128);
+    for (int denom = 2; denom <= 8; denom *= 2) {
+        int w = 256 / denom, h = 128 / denom;
+        std::vector<uint32_t> p = decode(data, denom, w, h);
+        ASSERT_EQ(w * h, (int)p.size());
+        int max_diff = 0;
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                for (int k = 0; k < 3; k++) {
+                    int sum = 0;
+                    for (int j = 0; j < denom; j++)
+                        for (int i = 0; i < denom; i++)
+                            sum += channel(full[(y * denom + j) * 256 + x * denom + i], k);
+                    int avg = sum / (denom * denom);
+                    max_diff = std::max(max_diff, abs(channel(p[y * w + x], k) - avg));
+                }
+        ASSERT_TRUE(max_diff <= 6);
+    }
+    TEST_PASS();
+}
+
+void test_corrupt() {
+    TEST("corrupt data fails without touching past the pixels");
+    Bytes data = encode(64, 32);
+    Bytes truncated(data.begin(), data.begin() + 40);
+    std::vector<uint32_t> p(32 * 16);
+    ASSERT_TRUE(!decodeJPEGScaled(&truncated[0], truncated.size(), 2, &p[0], 32 * 4, 16, 8, 0));
+    TEST_PASS();
+}
+
+// Decodes to packed RGB at full size.
+static Bytes decodeRGB(const unsigned char *data, size_t length, int *w, int *h) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char *)data, length);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+    *w = cinfo.output_width;
+    *h = cinfo.output_height;
+    Bytes rgb(*w * *h * 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = &rgb[cinfo.output_scanline * *w * 3];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return rgb;
+}
+
+void test_converter_rescale() {
+    TEST("the converter's rescaleJPEG() keeps the target size and colors");
+    const int sizes[][2] = {{256, 128}, {250, 125}, {97, 61}};
+    const int ratios[][2] = {{1, 2}, {1, 4}, {1, 8}, {3, 8}, {1, 3}, {3, 4}, {1, 1}};
+    ConvContext ctx;
+    for (int si = 0; si < 3; si++) {
+        int sw = sizes[si][0], sh = sizes[si][1];
+        Bytes data = encode(sw, sh);
+        for (int ri = 0; ri < 7; ri++) {
+            scale_ratio_upper = ratios[ri][0];
+            scale_ratio_lower = ratios[ri][1];
+            size_t length = rescaleJPEG(&ctx, &data[0], data.size(), 95);
+            ASSERT_GT((int)length, 0);
+
+            int w, h;
+            Bytes rgb = decodeRGB(ctx.rescaled_buffer, length, &w, &h);
+            int tw = std::max(1, sw * scale_ratio_upper / scale_ratio_lower);
+            int th = std::max(1, sh * scale_ratio_upper / scale_ratio_lower);
+            ASSERT_EQ(tw, w);
+            ASSERT_EQ(th, h);
+
+            // away from the edges, each pixel is close to the gradient at
+            // the centre of the area it came from
+            int max_diff = 0;
+            for (int y = 1; y < h - 1; y++)
+                for (int x = 1; x < w - 1; x++) {
+                    double fx = (x + 0.5) * sw / w - 0.5, fy = (y + 0.5) * sh / h - 0.5;
+                    double expect[3] = {fx * 255 / sw, fy * 255 / sh, (fx + fy) * 255 / (sw + sh)};
+                    for (int k = 0; k < 3; k++)
+                        max_diff = std::max(max_diff, abs(rgb[(y * w + x) * 3 + k] - (int)(expect[k] + 0.5)));
+                }
+            // partial 8x8 blocks at the edges weigh more in tiny results
+            ASSERT_TRUE(max_diff <= (w < 16 ? 20 : 12));
+        }
+    }
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+    printf("  JPEG Decoding Unit Tests\n");
+    printf("========================================\n");
+
+    TEST_SUITE_BEGIN("JPEG Decoding Tests");
+    test_detect();
+    test_scale_denom();
+    test_full_size();
+    test_reduced();
+    test_corrupt();
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("JPEG Converter Tests");
+    test_converter_rescale();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
@@ -0,0 +1,193 @@
+#include "test_framework.h"
+#include "onscripter_harness.h"
+
+static SDL_Rect rect(int x, int y, int w, int h) {
+    SDL_Rect r = {x, y, w, h};
+    return r;
+}
+
+static const int TEXT_MODE = ONScripterHarness::REFRESH_NORMAL | ONScripterHarness::REFRESH_TEXT;
+
+// A screen with a text window over sprites above and below z_order,
+// standing pictures and a rotated sprite2.
+static void setScene(ONScripterHarness &h) {
+    h.setImage(&h.sprites[900], 40, 30, 300, 200, ONScripterHarness::TRANSLUCENT);
+    h.setImage(&h.sprites[20], 200, 150, 64, 48, ONScripterHarness::TRANSLUCENT, false, 2);
+    h.setImage(&h.sprites[10], 350, 60, 80, 80, ONScripterHarness::OPAQUE, true);
+    for (int i = 0; i < 3; i++)
+        h.setImage(&h.tachi[i], 20 + 150 * i, 40, 140, 300, ONScripterHarness::MARGINS, i == 2);
+    h.setImage(&h.sprites2[5], 250, 100, 90, 70, ONScripterHarness::TRANSLUCENT);
+    h.setAffine(&h.sprites2[5], 120, 90, 20);
+    h.z_order = 499;
+    h.setText(rect(30, 250, 420, 80));
+}
+
+// The screen refreshSurface() gives within clip with the layer cache, and
+// without it, from the same state.
+static bool cachedMatches(ONScripterHarness &h, SDL_Rect clip) {
+    SDL_Surface *cached = h.allocScreen(), *full = h.allocScreen();
+    h.refresh(cached, &clip, TEXT_MODE);
+    h.refreshUncached(full, &clip, TEXT_MODE);
+    bool same = ONScripterHarness::pixels(cached) == ONScripterHarness::pixels(full);
+    SDL_FreeSurface(cached);
+    SDL_FreeSurface(full);
+    return same;
+}
+
+void test_cache_hits_while_unchanged() {
+    TEST("the layers below the text window are composed once while unchanged");
+    ONScripterHarness h(480, 360);
+    h.enableLayerCache();
+    setScene(h);
+    SDL_Rect screen = rect(0, 0, 480, 360);
+    ASSERT_TRUE(cachedMatches(h, screen));
+    ASSERT_EQ(1, (int)h.stats.layer_cache_misses);
+    ASSERT_TRUE(cachedMatches(h, screen));
+    ASSERT_TRUE(cachedMatches(h, rect(100, 260, 200, 40)));
+    ASSERT_EQ(1, (int)h.stats.layer_cache_misses);
+    ASSERT_EQ(2, (int)h.stats.layer_cache_hits);
+
+    // the text is drawn over the kept layers, not into them
+    h.setText(rect(60, 270, 100, 30));
+    ASSERT_TRUE(cachedMatches(h, screen));
+    ASSERT_EQ(1, (int)h.stats.layer_cache_misses);
+    TEST_PASS();
+}
+
+void test_cache_follows_every_change() {
+    TEST("after every kind of change the cached compose is the full one");
+    ONScripterHarness h(480, 360);
+    h.enableLayerCache();
+    setScene(h);
+    SDL_Rect screen = rect(0, 0, 480, 360);
+    ASSERT_TRUE(cachedMatches(h, screen));
+    size_t misses = h.stats.layer_cache_misses;
+
+    // Applies a change and checks the next refresh recomposes the layers
+    // into what composing them all over gives, and the one after keeps them.
+#define CHECK_CHANGE(change) \
+    do { \
+        change; \
+        ASSERT_TRUE(cachedMatches(h, screen)); \
+        ASSERT_EQ((int)misses + 1, (int)h.stats.layer_cache_misses); \
+        ASSERT_TRUE(cachedMatches(h, screen)); \
+        ASSERT_EQ((int)misses + 1, (int)h.stats.layer_cache_misses); \
+        misses = h.stats.layer_cache_misses; \
+    } while (0)
+
+    // bg with a color, as createBackground() does
+    CHECK_CHANGE(h.bg.fill(0x40, 0x80, 0xc0, 0xff));
+    // a blit of btndef into bg, as blt does
+    SDL_Surface *btndef = h.allocScreen();
+    SDL_FillRect(btndef, NULL, 0xff123456);
+    SDL_Rect src = rect(0, 0, 100, 60), dst = rect(150, 90, 100, 60);
+    CHECK_CHANGE(h.bg.detachSurface(); SDL_BlitSurface(btndef, &src, h.bg.image_surface, &dst));
+    SDL_FreeSurface(btndef);
+
+    AnimationInfo *sp = &h.sprites[20];
+    CHECK_CHANGE(sp->orig_pos.x += 37; sp->scalePosXY(1, 1));
+    CHECK_CHANGE(sp->setCell(1));
+    CHECK_CHANGE(sp->trans = 100);
+    CHECK_CHANGE(sp->visible = false);
+    CHECK_CHANGE(sp->visible = true);
+    CHECK_CHANGE(h.sprites[10].orig_pos.y += 5; h.sprites[10].scalePosXY(1, 1));
+    CHECK_CHANGE(h.sprites2[5].rot = 45; h.sprites2[5].calcAffineMatrix());
+
+    CHECK_CHANGE(h.human_order[0] = 0; h.human_order[2] = 2);
+    CHECK_CHANGE(h.human_order[1] = -1);
+
+    CHECK_CHANGE(h.nega_mode = 1);
+    CHECK_CHANGE(h.nega_mode = 2);
+    CHECK_CHANGE(h.setMonochrome(0xff, 0xc0, 0x80));
+    CHECK_CHANGE(h.nega_mode = 0);
+    CHECK_CHANGE(h.clearMonochrome());
+
+    CHECK_CHANGE(h.windowback = true);
+    CHECK_CHANGE(h.z_order = 15);
+    CHECK_CHANGE(h.windowback = false);
+
+    // pixels written in place, as the drawing commands do after
+    // detachSurface()
+    CHECK_CHANGE(h.sprites[900].detachSurface();
+                 ((uint32_t *)h.sprites[900].image_surface->pixels)[10 * 300 + 10] = 0xff00ff00);
+    CHECK_CHANGE(h.tachi[0].detachSurface();
+                 memset(h.tachi[0].image_surface->pixels, 0xff, h.tachi[0].image_surface->pitch * 20));
+#undef CHECK_CHANGE
+    TEST_PASS();
+}
+
+void test_cached_rect_grows_over_disjoint_clips() {
+    TEST("the cached rect grows to the bounding box of disjoint clips");
+    ONScripterHarness h(480, 360);
+    h.enableLayerCache();
+    setScene(h);
+
+    SDL_Rect a = rect(10, 20, 100, 50), b = rect(300, 200, 80, 60);
+    ASSERT_TRUE(cachedMatches(h, a));
+    ASSERT_EQ(10, h.layerCacheRect().x);
+    ASSERT_EQ(20, h.layerCacheRect().y);
+    ASSERT_EQ(100, h.layerCacheRect().w);
+    ASSERT_EQ(50, h.layerCacheRect().h);
+
+    ASSERT_TRUE(cachedMatches(h, b));
+    ASSERT_EQ(10, h.layerCacheRect().x);
+    ASSERT_EQ(20, h.layerCacheRect().y);
+    ASSERT_EQ(380 - 10, h.layerCacheRect().w);
+    ASSERT_EQ(260 - 20, h.layerCacheRect().h);
+    ASSERT_EQ(2, (int)h.stats.layer_cache_misses);
+
+    // between the two, within what is kept though never asked for
+    ASSERT_TRUE(cachedMatches(h, rect(150, 100, 120, 90)));
+    ASSERT_TRUE(cachedMatches(h, rect(10, 20, 370, 240)));
+    ASSERT_EQ(2, (int)h.stats.layer_cache_misses);
+    ASSERT_EQ(2, (int)h.stats.layer_cache_hits);
+
+    // partly out of it
+    ASSERT_TRUE(cachedMatches(h, rect(0, 250, 60, 100)));
+    ASSERT_EQ(0, h.layerCacheRect().x);
+    ASSERT_EQ(20, h.layerCacheRect().y);
+    ASSERT_EQ(380, h.layerCacheRect().w);
+    ASSERT_EQ(350 - 20, h.layerCacheRect().h);
+    ASSERT_TRUE(cachedMatches(h, rect(0, 0, 480, 360)));
+    ASSERT_EQ(4, (int)h.stats.layer_cache_misses);
+
+    // a change starts over from the clip
+    h.sprites[900].trans = 200;
+    ASSERT_TRUE(cachedMatches(h, b));
+    ASSERT_EQ(300, h.layerCacheRect().x);
+    ASSERT_EQ(80, h.layerCacheRect().w);
+    TEST_PASS();
+}
+
+void test_cache_in_bands() {
+    TEST("the layer cache composed in bands gives the full compose");
+    ONScripterHarness h(480, 360, 4);
+    h.enableLayerCache();
+    setScene(h);
+    ASSERT_TRUE(cachedMatches(h, rect(0, 0, 480, 360)));
+    h.sprites[20].orig_pos.x -= 90;
+    h.sprites[20].scalePosXY(1, 1);
+    ASSERT_TRUE(cachedMatches(h, rect(5, 7, 400, 300)));
+    ASSERT_TRUE(cachedMatches(h, rect(0, 0, 480, 360)));
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+    printf("  Layer Cache Unit Tests\n");
+    printf("========================================\n");
+
+    TEST_SUITE_BEGIN("Layer Cache Tests");
+    test_cache_hits_while_unchanged();
+    test_cache_follows_every_change();
+    test_cached_rect_grows_over_disjoint_clips();
+    test_cache_in_bands();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
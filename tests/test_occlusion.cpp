@@ -0,0 +1,171 @@
+#include "test_framework.h"
+#include "blend_kernels.h"
+#include "onscripter_harness.h"
+
+static SDL_Rect rect(int x, int y, int w, int h) {
+    SDL_Rect r = {x, y, w, h};
+    return r;
+}
+
+static const int TEXT_MODE = ONScripterHarness::REFRESH_NORMAL | ONScripterHarness::REFRESH_TEXT;
+
+// where the opaque cover of a scene goes
+enum Position { UPPER_SPRITE, TACHI, SPRITE2, LOWER_SPRITE, NUM_POSITIONS };
+
+// The cover and the clips within it, where it hides everything drawn
+// before it.
+static const SDL_Rect cover_rect = {60, 40, 320, 300};
+static const SDL_Rect hidden_clips[] = {{100, 80, 200, 150}, {80, 250, 280, 80}};
+
+// Layers of every kind around an opaque cover at position: sprites above
+// and below z_order, straight add and sub blending with margins, standing
+// pictures, rotated sprite2, and text, which the cover of a lower sprite
+// hides only with windowback.
+static AnimationInfo *setScene(ONScripterHarness &h, Position position, bool premultiplied) {
+    h.setImage(&h.sprites[900], 40, 30, 300, 200, ONScripterHarness::TRANSLUCENT);
+    h.setImage(&h.sprites[700], 100, 60, 200, 200, ONScripterHarness::MARGINS);
+    h.sprites[700].blending_mode = AnimationInfo::BLEND_ADD;
+    for (int i = 0; i < 3; i++)
+        h.setImage(&h.tachi[i], 20 + 150 * i, 40, 140, 300, ONScripterHarness::MARGINS, i == 2);
+    h.setImage(&h.sprites2[5], 150, 100, 90, 70, ONScripterHarness::TRANSLUCENT);
+    h.setAffine(&h.sprites2[5], 120, 90, 20);
+    h.setImage(&h.sprites2[6], 200, 120, 120, 120, ONScripterHarness::MARGINS);
+    h.sprites2[6].blending_mode = AnimationInfo::BLEND_SUB;
+    h.setAffine(&h.sprites2[6], 100, 100, 30);
+    h.setImage(&h.sprites[30], 90, 90, 160, 160, ONScripterHarness::MARGINS, true);
+    h.setImage(&h.sprites[20], 200, 150, 64, 48, ONScripterHarness::TRANSLUCENT);
+    h.z_order = 499;
+    h.setText(rect(30, 250, 420, 80));
+
+    // drawn over sprites[900], tachi[0], sprites2[6] and sprites[30] and
+    // under the rest of their kind
+    AnimationInfo *cover = position == UPPER_SPRITE ? &h.sprites[800]
+                         : position == TACHI        ? &h.tachi[1]
+                         : position == SPRITE2      ? &h.sprites2[4]
+                                                    : &h.sprites[25];
+    h.setImage(cover, cover_rect.x, cover_rect.y, cover_rect.w, cover_rect.h, ONScripterHarness::OPAQUE,
+               premultiplied);
+    // sprite2 are always affine, so never a cover
+    if (position == SPRITE2) h.setAffine(cover, 100, 100, 0);
+    return cover;
+}
+
+static void forgetAllAlphaBounds(ONScripterHarness &h) {
+    h.forgetAlphaBounds(&h.bg);
+    h.forgetAlphaBounds(&h.text);
+    for (int i = 0; i < 3; i++) h.forgetAlphaBounds(&h.tachi[i]);
+    for (int i = 0; i < MAX_SPRITE_NUM; i++) h.forgetAlphaBounds(&h.sprites[i]);
+    for (int i = 0; i < MAX_SPRITE2_NUM; i++) h.forgetAlphaBounds(&h.sprites2[i]);
+}
+
+enum Culling { CULLING_ON, CULLING_NO_COVER, CULLING_OFF };
+
+// The screen composed within clip, and the pixels left out for it.
+static std::vector<uint32_t> compose(Position position, bool premultiplied, bool windowback, bool effects,
+                                     Culling culling, SDL_Rect clip, size_t *skipped) {
+    ONScripterHarness h(480, 360);
+    AnimationInfo *cover = setScene(h, position, premultiplied);
+    h.windowback = windowback;
+    if (effects) {
+        h.nega_mode = 1;
+        h.setMonochrome(0xff, 0xc0, 0x80);
+    }
+    if (culling == CULLING_NO_COVER) h.forgetAlphaBounds(cover);
+    if (culling == CULLING_OFF) forgetAllAlphaBounds(h);
+
+    SDL_Surface *screen = h.allocScreen();
+    h.refresh(screen, &clip, TEXT_MODE);
+    std::vector<uint32_t> pixels = ONScripterHarness::pixels(screen);
+    SDL_FreeSurface(screen);
+    *skipped = h.stats.pixels_skipped;
+    return pixels;
+}
+
+void test_culling_keeps_every_pixel() {
+    TEST("a cover in each position gives the bytes of composing every layer");
+    const SDL_Rect clips[] = {hidden_clips[0], hidden_clips[1], {40, 20, 360, 200}, {0, 0, 480, 360}};
+    const char *levels[] = {"auto", "scalar"};
+    for (int l = 0; l < 2; l++) {
+        ASSERT_TRUE(setBlendKernels(levels[l]));
+        for (int p = 0; p < NUM_POSITIONS; p++)
+            for (int pm = 0; pm < 2; pm++)
+                for (int wb = 0; wb < 2; wb++)
+                    for (int fx = 0; fx < 2; fx++)
+                        for (size_t c = 0; c < sizeof(clips) / sizeof(clips[0]); c++) {
+                            Position position = (Position)p;
+                            size_t on, no_cover, off;
+                            std::vector<uint32_t> culled =
+                                compose(position, pm, wb, fx, CULLING_ON, clips[c], &on);
+                            std::vector<uint32_t> uncovered =
+                                compose(position, pm, wb, fx, CULLING_NO_COVER, clips[c], &no_cover);
+                            std::vector<uint32_t> full = compose(position, pm, wb, fx, CULLING_OFF, clips[c], &off);
+                            ASSERT_TRUE(culled == full);
+                            ASSERT_TRUE(uncovered == full);
+                            ASSERT_EQ(0, (int)off);
+
+                            // what the cover itself leaves out
+                            bool hides = c < 2 && position != SPRITE2 && (pm || blend_kernels->copies_opaque);
+                            ASSERT_EQ(hides, on > no_cover);
+                        }
+    }
+    ASSERT_TRUE(setBlendKernels("auto"));
+    TEST_PASS();
+}
+
+// Blends anim with its alpha bounds or without into a surface of color,
+// as a screen when opaque and as a sprite drawn into when clear.
+static std::vector<uint32_t> blendInto(ONScripterHarness &h, AnimationInfo *anim, bool bounds, Uint32 color) {
+    unsigned int alpha_version = anim->alpha_version;
+    if (!bounds) h.forgetAlphaBounds(anim);
+    SDL_Surface *surface = h.allocScreen();
+    SDL_FillRect(surface, NULL, color);
+    SDL_Rect clip = rect(0, 0, h.width, h.height);
+    if (anim->affine_flag)
+        anim->blendOnSurface2(surface, anim->pos.x, anim->pos.y, clip, 255);
+    else
+        anim->blendOnSurface(surface, anim->pos.x, anim->pos.y, clip, 255);
+    std::vector<uint32_t> pixels = ONScripterHarness::pixels(surface);
+    SDL_FreeSurface(surface);
+    anim->alpha_version = alpha_version;
+    return pixels;
+}
+
+void test_margins_of_every_blending_mode() {
+    TEST("the margins are left out only where blending leaves dst as it is");
+    ONScripterHarness h(320, 240);
+    AnimationInfo *anims[] = {&h.sprites[10], &h.sprites2[10]};
+    h.setImage(anims[0], 30, 20, 160, 120, ONScripterHarness::MARGINS);
+    h.setImage(anims[1], 60, 40, 160, 120, ONScripterHarness::MARGINS);
+    h.setAffine(anims[1], 110, 90, 15);
+    for (int a = 0; a < 2; a++)
+        for (int pm = 0; pm < 2; pm++)
+            for (int mode = AnimationInfo::BLEND_NORMAL; mode <= AnimationInfo::BLEND_SUB; mode++) {
+                h.setImage(anims[a], anims[a]->orig_pos.x, anims[a]->orig_pos.y, 160, 120,
+                           ONScripterHarness::MARGINS, pm);
+                anims[a]->blending_mode = mode;
+                ASSERT_TRUE(blendInto(h, anims[a], true, 0xff336699) == blendInto(h, anims[a], false, 0xff336699));
+                // the straight add and sub make every pixel they pass over
+                // opaque
+                if (!pm && mode != AnimationInfo::BLEND_NORMAL)
+                    ASSERT_TRUE(blendInto(h, anims[a], true, 0) == blendInto(h, anims[a], false, 0));
+            }
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+    printf("  Occlusion Culling Unit Tests\n");
+    printf("========================================\n");
+
+    TEST_SUITE_BEGIN("Occlusion Culling Tests");
+    test_culling_keeps_every_pixel();
+    test_margins_of_every_blending_mode();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
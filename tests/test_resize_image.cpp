@@ -0,0 +1,89 @@
+#include "test_framework.h"
+#include "legacy_resize.h"
+#include "resize_image.h"
+#include <stdlib.h>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+// Resizes a random image both ways, returns the largest difference.
+static int compareResize(int sw, int sh, int dw, int dh, int bpp, bool palette, unsigned seed) {
+    int stw = sw * bpp + (sw & 1), dtw = dw * bpp + (dw & 2);
+    // the original reads a row past the source when it does not smooth
+    Bytes src(stw * (sh + 1) + bpp);
+    srand(seed);
+    for (size_t i = 0; i < src.size(); i++) src[i] = rand() & 0xff;
+
+    Bytes ref(dtw * dh, 0xcd), out(dtw * dh, 0xcd);
+    Bytes tmp1(stw * (sh + 1) + bpp), tmp2(stw * (sh + 1) + bpp);
+    LegacyResize::resizeImage(&ref[0], dw, dh, dtw, &src[0], sw, sh, stw, bpp, &tmp1[0], stw, palette);
+    resizeImage(&out[0], dw, dh, dtw, &src[0], sw, sh, stw, bpp, &tmp2[0], stw, palette);
+
+    int max_diff = 0;
+    for (size_t i = 0; i < ref.size(); i++) {
+        int d = abs(ref[i] - out[i]);
+        if (d > max_diff) max_diff = d;
+    }
+    return max_diff;
+}
+
+void test_upscale() {
+    TEST("upscales match the original resampler");
+    ASSERT_EQ(0, compareResize(80, 60, 128, 96, 4, false, 1));
+    ASSERT_EQ(0, compareResize(64, 48, 192, 144, 4, false, 2));
+    ASSERT_EQ(0, compareResize(33, 17, 50, 31, 4, false, 3));
+    ASSERT_EQ(0, compareResize(33, 17, 50, 31, 3, false, 4));
+    ASSERT_EQ(0, compareResize(1, 1, 7, 5, 4, false, 5));
+    ASSERT_EQ(0, compareResize(5, 1, 9, 3, 4, false, 6));
+    TEST_PASS();
+}
+
+void test_downscale() {
+    TEST("smoothed downscales stay within 1 of the original");
+    ASSERT_TRUE(compareResize(128, 96, 64, 48, 4, false, 7) <= 1);
+    ASSERT_TRUE(compareResize(191, 143, 64, 47, 4, false, 8) <= 1);
+    ASSERT_TRUE(compareResize(100, 70, 13, 9, 3, false, 9) <= 1);
+    ASSERT_TRUE(compareResize(300, 40, 37, 40, 4, false, 10) <= 1);
+    ASSERT_TRUE(compareResize(40, 300, 40, 37, 4, false, 11) <= 1);
+    ASSERT_TRUE(compareResize(64, 64, 1, 1, 4, false, 12) <= 1);
+    TEST_PASS();
+}
+
+void test_palette_and_gray() {
+    TEST("palette and 1 byte images are resampled like before");
+    ASSERT_EQ(0, compareResize(40, 30, 64, 48, 1, true, 13));
+    ASSERT_EQ(0, compareResize(64, 48, 40, 30, 1, true, 14));
+    ASSERT_EQ(0, compareResize(41, 29, 77, 51, 1, false, 15));
+    TEST_PASS();
+}
+
+void test_many_blocks() {
+    TEST("images taller than a block of rows match the original");
+    ASSERT_EQ(0, compareResize(80, 200, 96, 333, 4, false, 16));
+    ASSERT_TRUE(compareResize(160, 333, 50, 100, 4, false, 17) <= 1);
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+#if defined(USE_SIMD)
+    printf("  Resize Image Unit Tests (SIMD)\n");
+#else
+    printf("  Resize Image Unit Tests (scalar)\n");
+#endif
+    printf("========================================\n");
+
+    TEST_SUITE_BEGIN("Resize Image Tests");
+    test_upscale();
+    test_downscale();
+    test_palette_and_gray();
+    test_many_blocks();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
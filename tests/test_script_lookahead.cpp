@@ -0,0 +1,149 @@
+#include "test_framework.h"
+#include "archive_builder.h"
+#include "ScriptHandler.h"
+#include "gbk2utf16.h"
+#include <string>
+#include <vector>
+
+struct Scan {
+    std::vector<std::string> images, sounds;
+};
+
+// Scans script from the line after *start.
+static Scan scan(const char *script, int max_lines) {
+    Scan s;
+    std::string dir = ArchiveBuilder::makeTempDir("script");
+    FILE *fp = fopen((dir + "0.txt").c_str(), "wb");
+    fputs(script, fp);
+    fclose(fp);
+
+    ScriptHandler sh;
+    sh.reset();
+    if (sh.openScript((char*)dir.c_str()) == 0)
+        sh.scanAssets(sh.lookupLabel("start").start_address, max_lines, s.images, s.sounds);
+
+    ArchiveBuilder::removeTempDir(dir);
+    return s;
+}
+
+void test_scan_commands() {
+    TEST("image and sound literals of known commands are collected");
+    Scan s = scan("*define\ngame\n*start\n"
+                  "lsp 1,\"a.png\",0,0:bg \"b.jpg\",1\n"
+                  "ld c,\"c.bmp\",1:btndef \"d.png\"\n"
+                  "dwave 0,\"se.wav\":bgm \"music.ogg\"\n"
+                  "mov $0,\"notanimage.png\"\n"
+                  "end\n", 100);
+    ASSERT_EQ(4, (int)s.images.size());
+    ASSERT_STREQ("a.png", s.images[0].c_str());
+    ASSERT_STREQ("b.jpg", s.images[1].c_str());
+    ASSERT_STREQ("c.bmp", s.images[2].c_str());
+    ASSERT_STREQ("d.png", s.images[3].c_str());
+    ASSERT_EQ(2, (int)s.sounds.size());
+    ASSERT_STREQ("se.wav", s.sounds[0].c_str());
+    ASSERT_STREQ("music.ogg", s.sounds[1].c_str());
+    TEST_PASS();
+}
+
+void test_scan_tags_and_comments() {
+    TEST("tags are stripped, strings, rectangles and comments are skipped");
+    Scan s = scan("*define\ngame\n*start\n"
+                  "lsp 1,\":a/3,100,0;anim.png\",0,0\n"
+                  "lsp 2,\":s/20,20,0;#ffffff text\",0,0\n"
+                  "lsp 3,\">640,480,#000000\",0,0\n"
+                  "; lsp 4,\"commented.png\",0,0\n"
+                  "_lsp 5,\"builtin.png\",0,0 ; lsp 6,\"after.png\"\n"
+                  "lsp 7,\"x;y:z.png\",0,0\n"
+                  "end\n", 100);
+    ASSERT_EQ(3, (int)s.images.size());
+    ASSERT_STREQ("anim.png", s.images[0].c_str());
+    ASSERT_STREQ("builtin.png", s.images[1].c_str());
+    ASSERT_STREQ("x;y:z.png", s.images[2].c_str());
+    TEST_PASS();
+}
+
+void test_scan_follows_jumps() {
+    TEST("goto and gosub to static labels are followed, return comes back");
+    Scan s = scan("*define\ngame\n*start\n"
+                  "gosub *sub\n"
+                  "lsp 1,\"after_sub.png\",0,0\n"
+                  "goto *next\n"
+                  "lsp 2,\"skipped.png\",0,0\n"
+                  "*sub\n"
+                  "lsp 3,\"in_sub.png\",0,0\n"
+                  "return\n"
+                  "*next\n"
+                  "bg \"next.jpg\",1\n"
+                  "goto $0\n"
+                  "bg \"unreached.jpg\",1\n", 100);
+    ASSERT_EQ(3, (int)s.images.size());
+    ASSERT_STREQ("in_sub.png", s.images[0].c_str());
+    ASSERT_STREQ("after_sub.png", s.images[1].c_str());
+    ASSERT_STREQ("next.jpg", s.images[2].c_str());
+    TEST_PASS();
+}
+
+void test_scan_conditionals() {
+    TEST("commands after if are collected, conditional jumps are not taken");
+    Scan s = scan("*define\ngame\n*start\n"
+                  "if %0 == 1 && $1 == \"lsp\" lsp 1,\"cond.png\",0,0:goto *away\n"
+                  "notif %0 == 1 gosub *away\n"
+                  "bg \"fall_through.jpg\",1\n"
+                  "end\n"
+                  "*away\n"
+                  "bg \"away.jpg\",1\n", 100);
+    ASSERT_EQ(2, (int)s.images.size());
+    ASSERT_STREQ("cond.png", s.images[0].c_str());
+    ASSERT_STREQ("fall_through.jpg", s.images[1].c_str());
+    TEST_PASS();
+}
+
+void test_scan_window() {
+    TEST("scanning stops after max_lines lines and on jump loops");
+    Scan s = scan("*define\ngame\n*start\n"
+                  "bg \"1.jpg\",1\n"
+                  "bg \"2.jpg\",1\n"
+                  "bg \"3.jpg\",1\n", 2);
+    ASSERT_EQ(2, (int)s.images.size());
+    ASSERT_STREQ("2.jpg", s.images[1].c_str());
+
+    s = scan("*define\ngame\n*start\n"
+             "bg \"loop.jpg\",1\n"
+             "goto *start\n", 10);
+    ASSERT_EQ(5, (int)s.images.size());
+    TEST_PASS();
+}
+
+void test_scan_unterminated_literal() {
+    TEST("an unterminated literal at the end of the script ends the scan");
+    Scan s = scan("*define\ngame\n*start\n"
+                  "bg \"1.jpg\",1\n"
+                  "bg \"2.jpg", 10);
+    ASSERT_EQ(1, (int)s.images.size());
+    ASSERT_STREQ("1.jpg", s.images[0].c_str());
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+    printf("  Script Lookahead Unit Tests\n");
+    printf("========================================\n");
+
+    coding2utf16 = new GBK2UTF16();
+
+    TEST_SUITE_BEGIN("Script Lookahead Tests");
+    test_scan_commands();
+    test_scan_tags_and_comments();
+    test_scan_follows_jumps();
+    test_scan_conditionals();
+    test_scan_window();
+    test_scan_unterminated_literal();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}
@@ -0,0 +1,142 @@
+#include "test_framework.h"
+#include "onscripter_harness.h"
+#include <SDL2/SDL_image.h>
+#include <chrono>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// A directory of images, as the game folder without archives.
+class GameDir {
+public:
+    GameDir() {
+        char tmpl[] = "/tmp/ons_written_XXXXXX";
+        path = mkdtemp(tmpl) ? std::string(tmpl) + "/" : std::string();
+    }
+    ~GameDir() {
+        for (size_t i = 0; i < files.size(); i++) unlink((path + files[i]).c_str());
+        if (!path.empty()) rmdir(path.c_str());
+    }
+
+    // Writes an image of w x h in color to name.
+    bool write(const char *name, int w, int h, Uint32 color) {
+        SDL_Surface *s = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+        SDL_FillRect(s, NULL, color);
+        bool ok = mockSaveImage(s, (path + name).c_str());
+        SDL_FreeSurface(s);
+        files.push_back(name);
+        return ok;
+    }
+
+    std::string path;
+
+private:
+    std::vector<std::string> files;
+};
+
+static Uint32 firstPixel(AnimationInfo *anim) {
+    return anim->image_surface ? *(Uint32 *)anim->image_surface->pixels : 0;
+}
+
+void test_image_cache_after_write() {
+    TEST("an image written over is loaded again, not taken from the image cache");
+    GameDir dir;
+    ASSERT_TRUE(!dir.path.empty());
+    ASSERT_TRUE(dir.write("shot.bmp", 16, 8, 0xffff0000));
+
+    ONScripterHarness h(64, 48);
+    h.setArchivePath(dir.path.c_str());
+    h.loadImage(&h.sprites[1], ":c;shot.bmp");
+    ASSERT_EQ(0xffff0000u, firstPixel(&h.sprites[1]));
+    // the same image again comes out of the cache
+    h.loadImage(&h.sprites[2], ":c;shot.bmp");
+    ASSERT_EQ(0xffff0000u, firstPixel(&h.sprites[2]));
+    ASSERT_EQ(1, (int)h.imageCacheStats().hits);
+
+    ASSERT_TRUE(dir.write("shot.bmp", 24, 8, 0xff0000ff));
+    h.wroteFile("shot.bmp");
+    h.loadImage(&h.sprites[1], ":c;shot.bmp");
+    ASSERT_EQ(0xff0000ffu, firstPixel(&h.sprites[1]));
+    ASSERT_EQ(24, h.sprites[1].pos.w);
+    TEST_PASS();
+}
+
+// Waits for the workers to stage what was requested.
+static bool waitForStaging(ONScripterHarness &h) {
+    for (int i = 0; i < 5000; i++) {
+        AssetPrefetcher::Stats s = h.prefetchStats();
+        if (s.pending == 0 && s.bytes > 0) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+void test_prefetcher_after_write() {
+    TEST("an image written over is not taken from what the prefetcher staged");
+    GameDir dir;
+    ASSERT_TRUE(!dir.path.empty());
+    ASSERT_TRUE(dir.write("shot.bmp", 16, 8, 0xffff0000));
+
+    ONScripterHarness h(64, 48);
+    h.setArchivePath(dir.path.c_str());
+    h.prefetch(std::vector<std::string>(1, "shot.bmp"));
+    ASSERT_TRUE(waitForStaging(h));
+
+    ASSERT_TRUE(dir.write("shot.bmp", 24, 8, 0xff0000ff));
+    h.wroteFile("shot.bmp");
+    ASSERT_EQ(0, (int)h.prefetchStats().bytes);
+    h.loadImage(&h.sprites[1], ":c;shot.bmp");
+    ASSERT_EQ(0xff0000ffu, firstPixel(&h.sprites[1]));
+    ASSERT_EQ(0, (int)h.prefetchStats().used);
+
+    // nor is it read ahead again, in any spelling
+    size_t requested = h.prefetchStats().requested;
+    h.prefetch(std::vector<std::string>(1, "SHOT.BMP"));
+    ASSERT_EQ(requested, h.prefetchStats().requested);
+    TEST_PASS();
+}
+
+void test_images_after_archive_change() {
+    TEST("images are read again through the reader that replaces another");
+    GameDir dirs[2];
+    ASSERT_TRUE(!dirs[0].path.empty() && !dirs[1].path.empty());
+    ASSERT_TRUE(dirs[0].write("bg.bmp", 16, 8, 0xffff0000));
+    ASSERT_TRUE(dirs[0].write("next.bmp", 16, 8, 0xffff0000));
+    ASSERT_TRUE(dirs[1].write("bg.bmp", 24, 8, 0xff0000ff));
+    ASSERT_TRUE(dirs[1].write("next.bmp", 24, 8, 0xff0000ff));
+
+    ONScripterHarness h(64, 48);
+    h.setArchivePath(dirs[0].path.c_str());
+    h.loadImage(&h.sprites[1], ":c;bg.bmp");
+    ASSERT_EQ(0xffff0000u, firstPixel(&h.sprites[1]));
+    h.prefetch(std::vector<std::string>(1, "next.bmp"));
+    ASSERT_TRUE(waitForStaging(h));
+
+    h.setArchivePath(dirs[1].path.c_str());
+    ASSERT_EQ(0, (int)h.prefetchStats().bytes);
+    h.loadImage(&h.sprites[1], ":c;bg.bmp");
+    ASSERT_EQ(0xff0000ffu, firstPixel(&h.sprites[1]));
+    h.loadImage(&h.sprites[2], ":c;next.bmp");
+    ASSERT_EQ(0xff0000ffu, firstPixel(&h.sprites[2]));
+    TEST_PASS();
+}
+
+int main() {
+    printf("\n");
+    printf("========================================\n");
+    printf("  Written File Unit Tests\n");
+    printf("========================================\n");
+
+    TEST_SUITE_BEGIN("Written File Tests");
+    test_image_cache_after_write();
+    test_prefetcher_after_write();
+    test_images_after_archive_change();
+    TEST_SUITE_END();
+
+    printf("\n========================================\n");
+    printf("  Final Results: %d passed, %d failed\n", _test_passed, _test_failed);
+    printf("========================================\n\n");
+
+    return get_test_result();
+}